@@ -0,0 +1,463 @@
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include "libmegas2.h"
+
+#include "simulation/simulation.h"
+#include "simulation/sys_desc.h"
+#include "simulation/sim_points.h"
+#include "devices/mcu/mcu.h"
+#include "devices/sd_card.h"
+#include "glue/pin_device.h"
+#include "glue/pin_ref.h"
+#include "glue/rs232_capture.h"
+#include "networking/net_device.h"
+#include "utils/fail.h"
+#include "utils/time.h"
+
+using namespace std;
+
+struct megas2_sim {
+    unique_ptr<SystemDescription> sys_desc;
+    unique_ptr<Simulation> sim;
+    Mcu *mcu;
+    vector<SdCard *> cards;
+    RS232Capture console;
+    
+    uint64_t until_generation;
+    bool point_reached;
+    
+    megas2_counters counters;
+};
+
+struct megas2_snapshot {
+    const megas2_sim *owner;
+    SimulationSnapshot snapshot;
+};
+
+static thread_local string last_error;
+static atomic<bool> verbose(false);
+
+/**
+ * Runs the body of an API function, turning exceptions into an error return
+ * and keeping device chatter out of the host's output.
+ */
+template<typename F>
+static int guarded(F&& body)
+{
+    bool quiet = !verbose.load(memory_order_relaxed);
+    int result;
+    
+    mute_info(quiet);
+    mute_warnings(quiet);
+    
+    try {
+        result = body();
+    } catch (exception& e) {
+        last_error = e.what();
+        result = -1;
+    }
+    
+    mute_info(false);
+    mute_warnings(false);
+    
+    return result;
+}
+
+static Entity *lookup_device(megas2_sim *sim, const char *device)
+{
+    Entity *entity = sim->sys_desc->lookupEntity(device);
+    if (!entity)
+        fail("Device '%s' not found", device);
+    
+    return entity;
+}
+
+static Mcu *need_mcu(megas2_sim *sim)
+{
+    if (!sim->mcu)
+        fail("The system has no MCU");
+    
+    return sim->mcu;
+}
+
+static void run_timed(megas2_sim *sim, sim_time_t to_time)
+{
+    int64_t start_ns = monotonic_time_ns();
+    
+    sim->sim->resume(to_time);
+    
+    sim->counters.host_ns += monotonic_time_ns() - start_ns;
+    sim->counters.run_calls++;
+}
+
+static void send_byte(megas2_sim *sim, RS232Device *device, shared_ptr<string> data,
+                      size_t index, sim_time_t interval)
+{
+    device->onRS232Receive((uint8_t)(*data)[index]);
+    
+    if (index + 1 < data->size())
+        sim->sim->scheduleCallbackIn(NULL, interval, [sim, device, data, index, interval]() {
+            send_byte(sim, device, data, index + 1, interval);
+        });
+}
+
+int megas2_api_version(void)
+{
+    return MEGAS2_API_VERSION;
+}
+
+const char *megas2_last_error(void)
+{
+    return last_error.c_str();
+}
+
+void megas2_set_verbose(int verbose_)
+{
+    verbose = (verbose_ != 0);
+}
+
+megas2_sim *megas2_create(const char *json_text)
+{
+    unique_ptr<megas2_sim> sim(new megas2_sim());
+    
+    int result = guarded([&]() {
+        Json::Value json_data;
+        Json::Reader reader;
+        if (!reader.parse(json_text, json_data))
+            fail("Error parsing system description: %s",
+                reader.getFormattedErrorMessages().c_str());
+        
+        sim->sys_desc.reset(new SystemDescription(json_data));
+        sim->sim.reset(new Simulation(*sim->sys_desc));
+        sim->sim->sync_with_real_time = false;
+        sim->mcu = find_mcu(*sim->sys_desc);
+        
+        for (auto ent : sim->sys_desc->entities) {
+            auto as_card = dynamic_cast<SdCard *>(ent);
+            if (as_card) {
+                as_card->holdWrites();
+                sim->cards.push_back(as_card);
+            }
+        }
+        
+        auto as_rs232 = dynamic_cast<RS232Device *>(sim->mcu);
+        if (as_rs232)
+            sim->console.connectToRS232Peer(as_rs232);
+        
+        sim->until_generation = 0;
+        sim->point_reached = false;
+        
+        sim->sim->reset();
+        sim->counters = megas2_counters();
+        
+        return 0;
+    });
+    
+    if (result < 0) {
+        for (auto card : sim->cards)
+            card->discardWrites();
+        return NULL;
+    }
+    
+    return sim.release();
+}
+
+void megas2_destroy(megas2_sim *sim)
+{
+    if (!sim)
+        return;
+    
+    for (auto card : sim->cards)
+        card->discardWrites();
+    
+    delete sim;
+}
+
+int megas2_reset(megas2_sim *sim)
+{
+    return guarded([&]() {
+        for (auto card : sim->cards)
+            card->discardWrites();
+        
+        if (sim->mcu)
+            sim->mcu->clearBreakpoint();
+        sim->sim->reset();
+        sim->console.output.clear();
+        sim->counters = megas2_counters();
+        
+        return 0;
+    });
+}
+
+int64_t megas2_time(megas2_sim *sim)
+{
+    return sim_time_to_ns(sim->sim->time);
+}
+
+int megas2_run_for(megas2_sim *sim, int64_t duration)
+{
+    return guarded([&]() {
+        if (duration < 0)
+            fail("Duration must not be negative");
+        
+        run_timed(sim, sim->sim->time + ns_to_sim_time(duration));
+        
+        return 0;
+    });
+}
+
+/**
+ * Runs the simulation until the MCU has executed the given number of cycles.
+ */
+int megas2_step(megas2_sim *sim, uint64_t cycles)
+{
+    return guarded([&]() {
+        Mcu *mcu = need_mcu(sim);
+        Simulation *simulation = sim->sim.get();
+        
+        if (!cycles)
+            return 0;
+        
+        mcu->setCycleBreakpoint(mcu->getCycleCount() + cycles, [simulation]() {
+            simulation->end();
+        });
+        
+        try {
+            run_timed(sim, SIM_TIME_NEVER);
+        } catch (exception& e) {
+            mcu->clearBreakpoint();
+            throw;
+        }
+        
+        return 0;
+    });
+}
+
+/**
+ * Runs the simulation until the given point (an absolute time like "2s", or
+ * the name of a function the MCU is to reach), or for at most the given time
+ * (if not negative). Returns 1 if the point was reached, 0 if not.
+ */
+int megas2_run_until(megas2_sim *sim, const char *point, int64_t timeout)
+{
+    return guarded([&]() {
+        Simulation *simulation = sim->sim.get();
+        
+        // A callback left over from an earlier call that timed out must not
+        // end this run
+        uint64_t generation = ++sim->until_generation;
+        sim->point_reached = false;
+        
+        schedule_at_point(*simulation, *sim->sys_desc, point, [sim, simulation, generation]() {
+            if (generation != sim->until_generation)
+                return;
+            
+            sim->point_reached = true;
+            simulation->end();
+        });
+        
+        sim_time_t to_time = (timeout < 0) ? SIM_TIME_NEVER : simulation->time + ns_to_sim_time(timeout);
+        
+        try {
+            run_timed(sim, to_time);
+        } catch (exception& e) {
+            sim->until_generation++;
+            throw;
+        }
+        
+        if (!sim->point_reached) {
+            sim->until_generation++;
+            if (sim->mcu)
+                sim->mcu->clearBreakpoint();
+        }
+        
+        return sim->point_reached ? 1 : 0;
+    });
+}
+
+int megas2_find_symbol(megas2_sim *sim, const char *name, int *address, int *length)
+{
+    return guarded([&]() {
+        Json::Value ref(name);
+        int symbol_length;
+        
+        int symbol_address = resolve_data_ref(need_mcu(sim), ref, symbol_length);
+        
+        if (address)
+            *address = symbol_address;
+        if (length)
+            *length = symbol_length;
+        
+        return 0;
+    });
+}
+
+int megas2_read_ram(megas2_sim *sim, int address, void *data, int length)
+{
+    return guarded([&]() {
+        Mcu *mcu = need_mcu(sim);
+        
+        if ((address < 0) || (length < 0) || (address + length > mcu->dataSize()))
+            fail("RAM range %d+%d out of bounds", address, length);
+        
+        for (int i = 0; i < length; i++)
+            ((uint8_t *)data)[i] = mcu->peekData(address + i);
+        
+        return 0;
+    });
+}
+
+int megas2_write_ram(megas2_sim *sim, int address, const void *data, int length)
+{
+    return guarded([&]() {
+        Mcu *mcu = need_mcu(sim);
+        
+        if ((address < 0) || (length < 0) || (address + length > mcu->dataSize()))
+            fail("RAM range %d+%d out of bounds", address, length);
+        
+        for (int i = 0; i < length; i++)
+            mcu->pokeData(address + i, ((const uint8_t *)data)[i]);
+        
+        return 0;
+    });
+}
+
+/**
+ * Gets the effective value of a pin, i.e. as the device sees it. Floating
+ * pins read as the value they float to (e.g. VCC with a pull-up).
+ */
+int megas2_read_pin(megas2_sim *sim, const char *device, const char *pin, double *volts)
+{
+    return guarded([&]() {
+        auto as_pin_dev = dynamic_cast<PinDevice *>(lookup_device(sim, device));
+        if (!as_pin_dev)
+            fail("Device '%s' has no pins", device);
+        
+        PinReference ref(as_pin_dev, pin);
+        *volts = ref.device->readPin(ref.pin_id) / pin_val_t(1.0);
+        
+        return 0;
+    });
+}
+
+/**
+ * Drives a pin of a device from the outside, as a bus would.
+ */
+int megas2_drive_pin(megas2_sim *sim, const char *device, const char *pin, double volts)
+{
+    return guarded([&]() {
+        auto as_pin_dev = dynamic_cast<PinDevice *>(lookup_device(sim, device));
+        if (!as_pin_dev)
+            fail("Device '%s' has no pins", device);
+        
+        PinReference ref(as_pin_dev, pin);
+        ref.device->drivePin(ref.pin_id, isnan(volts) ? PIN_VAL_Z : pin_val_t(volts));
+        
+        return 0;
+    });
+}
+
+int megas2_inject_frame(megas2_sim *sim, const char *device, const void *data, size_t length)
+{
+    return guarded([&]() {
+        auto as_net_dev = dynamic_cast<NetworkDevice *>(lookup_device(sim, device));
+        if (!as_net_dev)
+            fail("Device '%s' is not a network device", device);
+        
+        EthernetFrame frame(data, (int)length, false);
+        frame.padTo(60);
+        frame.addFcs();
+        
+        as_net_dev->receiveFrame(frame);
+        sim->counters.frames_injected++;
+        
+        return 0;
+    });
+}
+
+/**
+ * Sends bytes to a device's serial port, the first one right away and the
+ * others at the given interval, as the simulation runs.
+ */
+int megas2_send_bytes(megas2_sim *sim, const char *device, const void *data, size_t length,
+                      int64_t interval)
+{
+    return guarded([&]() {
+        auto as_rs232 = dynamic_cast<RS232Device *>(lookup_device(sim, device));
+        if (!as_rs232)
+            fail("Device '%s' has no serial port", device);
+        if (interval <= 0)
+            fail("Byte interval must be positive");
+        
+        if (length) {
+            send_byte(sim, as_rs232, make_shared<string>((const char *)data, length), 0,
+                ns_to_sim_time(interval));
+            sim->counters.bytes_injected += length;
+        }
+        
+        return 0;
+    });
+}
+
+/**
+ * Takes up to size bytes of what the MCU sent over its serial port so far.
+ */
+int megas2_read_console(megas2_sim *sim, char *buffer, size_t size)
+{
+    size_t count = min(size, sim->console.output.size());
+    
+    sim->console.output.copy(buffer, count);
+    sim->console.output.erase(0, count);
+    sim->counters.console_bytes += count;
+    
+    return (int)count;
+}
+
+megas2_snapshot *megas2_snapshot_take(megas2_sim *sim)
+{
+    unique_ptr<megas2_snapshot> snapshot(new megas2_snapshot());
+    
+    int result = guarded([&]() {
+        snapshot->owner = sim;
+        snapshot->snapshot = sim->sim->snapshot();
+        
+        return 0;
+    });
+    
+    return (result < 0) ? NULL : snapshot.release();
+}
+
+int megas2_snapshot_restore(megas2_sim *sim, const megas2_snapshot *snapshot)
+{
+    return guarded([&]() {
+        if (snapshot->owner != sim)
+            fail("Snapshot was taken from another simulation");
+        
+        sim->sim->restore(snapshot->snapshot);
+        
+        return 0;
+    });
+}
+
+void megas2_snapshot_free(megas2_snapshot *snapshot)
+{
+    delete snapshot;
+}
+
+int megas2_get_counters(megas2_sim *sim, megas2_counters *counters)
+{
+    *counters = sim->counters;
+    
+    counters->sim_time_ns = sim_time_to_ns(sim->sim->time);
+    counters->mcu_cycles = sim->mcu ? sim->mcu->getCycleCount() : 0;
+    counters->console_bytes = sim->console.output.size() + sim->counters.console_bytes;
+    
+    return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef _H_LIBMEGAS2_H
+#define _H_LIBMEGAS2_H
+
+/**
+ * C API for embedding the simulator in other programs (see "make lib").
+ *
+ * A simulation is created from the same JSON as a .msd file (paths in it are
+ * relative to the current directory), and starts out reset. Simulations are
+ * independent of each other: any number of them may exist at once, and each
+ * may be driven from any thread, though only from one thread at a time.
+ *
+ * Functions returning int give 0 (or a count) on success and -1 on failure,
+ * those returning pointers give NULL on failure; megas2_last_error() then
+ * tells what went wrong (per thread). Device and pin names are those of the
+ * system description (e.g. "mcu", "B3").
+ *
+ * SD card writes are held in memory and dropped with the simulation, so that
+ * simulations may share image files.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MEGAS2_API_VERSION 1
+
+typedef struct megas2_sim megas2_sim;
+typedef struct megas2_snapshot megas2_snapshot;
+
+typedef struct megas2_counters {
+    uint64_t sim_time_ns;       /* Simulated time since reset */
+    uint64_t mcu_cycles;        /* Cycles executed by the MCU since reset */
+    uint64_t host_ns;           /* Host time spent running the simulation */
+    uint64_t run_calls;         /* Calls that ran the simulation */
+    uint64_t console_bytes;     /* Bytes sent by the MCU over its USART */
+    uint64_t bytes_injected;
+    uint64_t frames_injected;
+} megas2_counters;
+
+int megas2_api_version(void);
+const char *megas2_last_error(void);
+void megas2_set_verbose(int verbose);
+
+megas2_sim *megas2_create(const char *json_text);
+void megas2_destroy(megas2_sim *sim);
+int megas2_reset(megas2_sim *sim);
+
+/* Running (all times in ns of simulated time) */
+int64_t megas2_time(megas2_sim *sim);
+int megas2_run_for(megas2_sim *sim, int64_t duration);
+int megas2_step(megas2_sim *sim, uint64_t cycles);
+int megas2_run_until(megas2_sim *sim, const char *point, int64_t timeout);
+
+/* MCU memory, by data address or symbol */
+int megas2_find_symbol(megas2_sim *sim, const char *name, int *address, int *length);
+int megas2_read_ram(megas2_sim *sim, int address, void *data, int length);
+int megas2_write_ram(megas2_sim *sim, int address, const void *data, int length);
+
+/* Pins, in volts; driving NaN leaves the pin floating (Z), but reads always
+   give a voltage */
+int megas2_read_pin(megas2_sim *sim, const char *device, const char *pin, double *volts);
+int megas2_drive_pin(megas2_sim *sim, const char *device, const char *pin, double volts);
+
+/* External input */
+int megas2_inject_frame(megas2_sim *sim, const char *device, const void *data, size_t length);
+int megas2_send_bytes(megas2_sim *sim, const char *device, const void *data, size_t length,
+                      int64_t interval);
+int megas2_read_console(megas2_sim *sim, char *buffer, size_t size);
+
+/* Snapshots can only be restored into the simulation they were taken from */
+megas2_snapshot *megas2_snapshot_take(megas2_sim *sim);
+int megas2_snapshot_restore(megas2_sim *sim, const megas2_snapshot *snapshot);
+void megas2_snapshot_free(megas2_snapshot *snapshot);
+
+int megas2_get_counters(megas2_sim *sim, megas2_counters *counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,234 @@
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "batch_runner.h"
+#include "work_pool.h"
+
+#include "devices/sd_card.h"
+#include "glue/pin_device.h"
+#include "glue/pin_ref.h"
+#include "gui/dashboard.h"
+#include "simulation/simulation.h"
+#include "simulation/sim_points.h"
+#include "utils/fail.h"
+#include "utils/time.h"
+
+#define PIN_TOLERANCE   0.01
+
+BatchRunner::BatchRunner(const char *manifest_file)
+{
+    ifstream file(manifest_file);
+    if (file.fail())
+        fail("Cannot open batch manifest '%s'", manifest_file);
+    
+    Json::Value manifest;
+    Json::Reader reader;
+    if (!reader.parse(file, manifest))
+        fail("Error parsing batch manifest '%s': %s", manifest_file,
+            reader.getFormattedErrorMessages().c_str());
+    
+    if (!manifest["jobs"].isArray())
+        fail("Batch manifest must have a 'jobs' array");
+    
+    for (auto& job_data : manifest["jobs"]) {
+        BatchJob job;
+        
+        if (!job_data.isMember("system") || !job_data.isMember("run"))
+            fail("Each batch job needs 'system' and 'run' members");
+        
+        job.system = job_data["system"].asString();
+        job.name = job_data.get("name", job.system).asString();
+        job.run_time = parse_json_time(job_data["run"], "run");
+        job.expect = job_data.get("expect", Json::Value(Json::arrayValue));
+        
+        jobs.push_back(job);
+    }
+}
+
+/**
+ * Runs all jobs and collects their results, in manifest order, together with
+ * overall counts of passed and failed jobs.
+ */
+Json::Value BatchRunner::run(int threads)
+{
+    vector<Json::Value> results(jobs.size());
+    int64_t start_ns = monotonic_time_ns();
+    
+    WorkStealingPool pool(threads);
+    pool.run(jobs.size(), [this, &results](size_t index) {
+        results[index] = _runJob(jobs[index]);
+    });
+    
+    Json::Value summary;
+    int passed = 0;
+    
+    summary["jobs"] = Json::Value(Json::arrayValue);
+    for (auto& result : results) {
+        passed += result["passed"].asBool();
+        summary["jobs"].append(result);
+    }
+    
+    summary["passed"] = passed;
+    summary["failed"] = (int)results.size() - passed;
+    summary["wall_ms"] = (monotonic_time_ns() - start_ns) / 1e6;
+    
+    return summary;
+}
+
+Json::Value BatchRunner::_runJob(BatchJob &job)
+{
+    Json::Value result;
+    int64_t start_ns = monotonic_time_ns();
+    
+    result["name"] = job.name;
+    result["system"] = job.system;
+    
+    // Jobs run side by side, so keep device chatter out of the output
+    mute_info(true);
+    mute_warnings(true);
+    
+    try {
+        SystemDescription sys_desc(job.system.c_str());
+        vector<SdCard *> cards;
+        
+        for (auto ent : sys_desc.entities) {
+            if (dynamic_cast<Dashboard *>(ent))
+                fail("Batch jobs cannot have a dashboard");
+            
+            auto as_card = dynamic_cast<SdCard *>(ent);
+            if (as_card) {
+                as_card->holdWrites();
+                cards.push_back(as_card);
+            }
+        }
+        
+        try {
+            _runSystem(job, sys_desc, result);
+        } catch (exception& e) {
+            for (auto card : cards)
+                card->discardWrites();
+            throw;
+        }
+        
+        for (auto card : cards)
+            card->discardWrites();
+    } catch (exception& e) {
+        result["passed"] = false;
+        result["error"] = e.what();
+    }
+    
+    mute_info(false);
+    mute_warnings(false);
+    
+    result["wall_ms"] = (monotonic_time_ns() - start_ns) / 1e6;
+    
+    return result;
+}
+
+void BatchRunner::_runSystem(BatchJob &job, SystemDescription &sys_desc, Json::Value &result)
+{
+    Simulation sim(sys_desc);
+    sim.sync_with_real_time = false;
+    
+    // Take over the MCU's serial port (from any console widget)
+    Mcu *mcu = find_mcu(sys_desc);
+    RS232Capture console;
+    auto as_rs232 = dynamic_cast<RS232Device *>(mcu);
+    if (as_rs232)
+        console.connectToRS232Peer(as_rs232);
+    
+    sim.reset();
+    sim.resume(job.run_time);
+    
+    Json::Value failures(Json::arrayValue);
+    for (auto& expect : job.expect) {
+        string failure = _check(expect, sys_desc, mcu, console);
+        if (!failure.empty())
+            failures.append(failure);
+    }
+    
+    result["passed"] = failures.empty();
+    result["failures"] = failures;
+    result["time"] = (Json::Int64)sim_time_to_ns(sim.time);
+    if (mcu)
+        result["cycles"] = (Json::UInt64)mcu->getCycleCount();
+}
+
+/**
+ * Checks one expectation against the final state of a job.
+ * 
+ * @return A description of the mismatch, or an empty string if it holds
+ */
+string BatchRunner::_check(Json::Value &expect, SystemDescription &sys_desc, Mcu *mcu,
+                           RS232Capture &console)
+{
+    Json::Value &value = expect["value"];
+    ostringstream failure;
+    
+    if (expect.isMember("ram")) {
+        int length;
+        int address = resolve_data_ref(mcu, expect["ram"], length);
+        string name = expect["ram"].isString() ? expect["ram"].asString() : to_string(address);
+        
+        if (value.isArray()) {
+            for (int i = 0; i < (int)value.size(); i++) {
+                if (i >= length)
+                    return "RAM " + name + " is shorter than the expected value";
+                
+                uint8_t actual = mcu->peekData(address + i);
+                if (actual != value[i].asUInt()) {
+                    failure << "RAM " << name << "[" << i << "] = " << (int)actual <<
+                        ", expected " << value[i].asUInt();
+                    return failure.str();
+                }
+            }
+        } else if (value.isIntegral()) {
+            uint64_t actual = 0;
+            for (int i = min(length, 8) - 1; i >= 0; i--)
+                actual = (actual << 8) | mcu->peekData(address + i);
+            
+            if (actual != value.asUInt64()) {
+                failure << "RAM " << name << " = " << actual << ", expected " << value.asUInt64();
+                return failure.str();
+            }
+        } else {
+            fail("Expected RAM value must be a number or byte array");
+        }
+    } else if (expect.isMember("pin")) {
+        PinReference pin(expect["pin"], &sys_desc);
+        pin_val_t actual = pin.device->readPin(pin.pin_id);
+        bool matches = false;
+        
+        if (value.isNumeric()) {
+            matches = (fabs(actual / pin_val_t(1.0) - value.asDouble()) <= PIN_TOLERANCE);
+        } else if (value.asString() == "high") {
+            matches = pin.device->readPinDigital(pin.pin_id);
+        } else if (value.asString() == "low") {
+            matches = !pin.device->readPinDigital(pin.pin_id);
+        } else if (value.asString() == "Z") {
+            actual = pin.device->queryPin(pin.pin_id);
+            matches = (actual == PIN_VAL_Z);
+        } else {
+            fail("Expected pin value must be a number, 'high', 'low' or 'Z'");
+        }
+        
+        if (!matches) {
+            failure << "Pin " << expect["pin"]["device"].asString() << "." <<
+                expect["pin"]["pin"].asString() << " = " << actual << ", expected " <<
+                (value.isNumeric() ? to_string(value.asDouble()) : value.asString());
+            return failure.str();
+        }
+    } else if (expect.isMember("console")) {
+        string text = expect["console"].asString();
+        
+        if (console.output.find(text) == string::npos)
+            return "Console output does not contain '" + text + "'";
+    } else {
+        fail("Expectation must have a 'ram', 'pin' or 'console' member");
+    }
+    
+    return "";
+}
@@ -0,0 +1,68 @@
+#ifndef _H_BATCH_RUNNER_H
+#define _H_BATCH_RUNNER_H
+
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include "simulation/sim_time.h"
+#include "simulation/sys_desc.h"
+#include "devices/mcu/mcu.h"
+#include "glue/rs232_capture.h"
+
+using namespace std;
+
+class BatchJob {
+public:
+    string name;
+    string system;
+    sim_time_t run_time;
+    Json::Value expect;
+};
+
+/**
+ * Runs many simulations, each of a system description for a set time, in a
+ * pool of threads within one process, and checks the outcome of each against
+ * a list of expectations. The manifest looks like:
+ * 
+ *   {
+ *     "jobs": [
+ *       {
+ *         "name": "boot",
+ *         "system": "tests/boot.msd",
+ *         "run": "2s",
+ *         "expect": [
+ *           { "ram": "state", "value": 3 },
+ *           { "ram": "mac_addr", "value": [2, 0, 0, 0, 0, 1] },
+ *           { "pin": { "device": "mcu", "pin": "B0" }, "value": "high" },
+ *           { "console": "Ready" }
+ *         ]
+ *       }
+ *     ]
+ *   }
+ * 
+ * RAM is given by symbol name or address, and a single expected value is
+ * compared with the whole symbol, read as a little-endian integer. Pins are
+ * checked by their effective value: a number (volts), "high" or "low", or
+ * "Z" if the device must not be driving the pin. A console expectation passes if the text
+ * appears anywhere in what the MCU sent over its USART.
+ * 
+ * Jobs never change SD card images: their writes are held in memory and
+ * dropped at the end, so that jobs may share images.
+ */
+class BatchRunner {
+public:
+    BatchRunner(const char *manifest_file);
+    
+    Json::Value run(int threads);
+private:
+    vector<BatchJob> jobs;
+    
+    Json::Value _runJob(BatchJob &job);
+    void _runSystem(BatchJob &job, SystemDescription &sys_desc, Json::Value &result);
+    string _check(Json::Value &expect, SystemDescription &sys_desc, Mcu *mcu,
+                  RS232Capture &console);
+};
+
+#endif
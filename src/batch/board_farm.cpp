@@ -0,0 +1,197 @@
+#include <cstdio>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+#include "board_farm.h"
+
+#include "devices/sd_card.h"
+#include "gui/dashboard.h"
+#include "networking/net_device.h"
+#include "utils/fail.h"
+#include "utils/time.h"
+
+static int64_t resident_memory(void)
+{
+    long pages = 0, resident = 0;
+    
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    
+    return (int64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+BoardFarm::BoardFarm(const char *sys_desc_file, int board_count, sim_time_t quantum)
+    : net_switch(quantum)
+{
+    if (board_count < 1)
+        fail("A farm needs at least one board");
+    if (quantum <= 0)
+        fail("Farm quantum must be positive");
+    
+    this->quantum = quantum;
+    this->time = 0;
+    this->stop_requested = false;
+    this->run_time_ns = 0;
+    
+    // With so many boards, device chatter would drown everything else
+    mute_info(true);
+    
+    // The first board also loads everything the boards share
+    _addBoard(sys_desc_file);
+    
+    int64_t memory_before = resident_memory();
+    for (int i = 1; i < board_count; i++)
+        _addBoard(sys_desc_file);
+    
+    memory_per_board = (board_count > 1) ?
+        (resident_memory() - memory_before) / (board_count - 1) : memory_before;
+    
+    mute_info(false);
+}
+
+BoardFarm::~BoardFarm()
+{
+    for (auto& board : boards)
+        for (auto ent : board.sys_desc->entities) {
+            auto as_card = dynamic_cast<SdCard *>(ent);
+            if (as_card)
+                as_card->discardWrites();
+        }
+}
+
+void BoardFarm::_addBoard(const char *sys_desc_file)
+{
+    FarmBoard board;
+    
+    board.sys_desc.reset(new SystemDescription(sys_desc_file));
+    board.sim.reset(new Simulation(*board.sys_desc));
+    board.sim->sync_with_real_time = false;
+    
+    SwitchPort *port = net_switch.addPort(board.sim.get());
+    
+    for (auto ent : board.sys_desc->entities) {
+        if (dynamic_cast<Dashboard *>(ent))
+            fail("Farm boards cannot have a dashboard");
+        if (dynamic_cast<VirtualNetwork *>(ent))
+            fail("Farm boards cannot have a virtual network (they are connected to the farm's switch)");
+        
+        auto as_card = dynamic_cast<SdCard *>(ent);
+        if (as_card)
+            as_card->holdWrites();
+        
+        auto as_net_dev = dynamic_cast<NetworkDevice *>(ent);
+        if (as_net_dev)
+            as_net_dev->connectToNetwork(port);
+    }
+    
+    board.sim->reset();
+    
+    boards.push_back(move(board));
+}
+
+/**
+ * Runs all boards for the given time (or until stopped), using the given
+ * number of threads (including the calling one).
+ */
+void BoardFarm::run(sim_time_t duration, int threads)
+{
+    sim_time_t end_time = (duration == SIM_TIME_NEVER) ? SIM_TIME_NEVER : time + duration;
+    sim_time_t quantum_end = min(time + quantum, end_time);
+    
+    threads = max(1, min(threads, (int)boards.size()));
+    stop_requested = false;
+    
+    mutex lock;
+    condition_variable quantum_done;
+    int arrived = 0;
+    uint64_t generation = 0;
+    bool done = (time >= end_time);
+    string error;
+    atomic<size_t> next_board(0);
+    
+    auto work = [&]() {
+        mute_info(true);
+        
+        while (!done) {
+            size_t index;
+            while ((index = next_board.fetch_add(1)) < boards.size()) {
+                try {
+                    // Stop exactly at the end of the quantum; resume(time)
+                    // would finish the event in progress, and frames could
+                    // then be sent past it
+                    boards[index].sim->scheduleEvent(NULL, SIM_EVENT_END, quantum_end);
+                    boards[index].sim->resume();
+                } catch (exception& e) {
+                    lock_guard<mutex> guard(lock);
+                    if (error.empty())
+                        error = "Board " + to_string(index) + ": " + e.what();
+                }
+            }
+            
+            unique_lock<mutex> guard(lock);
+            if (++arrived == threads) {
+                // Last one in; all boards are at the end of the quantum
+                net_switch.forwardFrames();
+                
+                time = quantum_end;
+                quantum_end = min(time + quantum, end_time);
+                done = !error.empty() || (time >= end_time) || stop_requested;
+                
+                arrived = 0;
+                next_board = 0;
+                generation++;
+                quantum_done.notify_all();
+            } else {
+                uint64_t current = generation;
+                quantum_done.wait(guard, [&]() { return generation != current; });
+            }
+        }
+        
+        mute_info(false);
+    };
+    
+    int64_t start_ns = monotonic_time_ns();
+    
+    vector<thread> helpers;
+    for (int i = 1; i < threads; i++)
+        helpers.push_back(thread(work));
+    work();
+    for (auto& helper : helpers)
+        helper.join();
+    
+    run_time_ns += monotonic_time_ns() - start_ns;
+    
+    if (!error.empty())
+        throw runtime_error(error);
+}
+
+/**
+ * Makes run() return at the end of the current quantum. May be called from
+ * any thread, and also from a signal handler.
+ */
+void BoardFarm::requestStop(void)
+{
+    stop_requested = true;
+}
+
+void BoardFarm::reportStats(void)
+{
+    double sim_seconds = sim_time_to_ns(time) / 1e9;
+    double real_seconds = run_time_ns / 1e9;
+    
+    printf("Boards: %d (%lld KB of memory each)\n", (int)boards.size(),
+        (long long)(memory_per_board / 1024));
+    printf("Simulated: %.3f s in %.3f s (%d%% of real time per board)\n",
+        sim_seconds, real_seconds, real_seconds ? (int)(100.0 * sim_seconds / real_seconds) : 0);
+    printf("Frames: %llu forwarded, %llu flooded\n",
+        (unsigned long long)net_switch.frames_forwarded,
+        (unsigned long long)net_switch.frames_flooded);
+}
@@ -0,0 +1,62 @@
+#ifndef _H_BOARD_FARM_H
+#define _H_BOARD_FARM_H
+
+#include <inttypes.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "simulation/simulation.h"
+#include "simulation/sys_desc.h"
+#include "networking/eth_switch.h"
+
+using namespace std;
+
+#define FARM_DEFAULT_QUANTUM    us_to_sim_time(100)
+
+class FarmBoard {
+public:
+    unique_ptr<SystemDescription> sys_desc;
+    unique_ptr<Simulation> sim;
+};
+
+/**
+ * Simulates many identical boards (instances of the same system description)
+ * in one process, with the network devices of each connected to a port of a
+ * common EthernetSwitch.
+ *
+ * Boards running the same firmware share its image (see FirmwareImage), so
+ * each costs little more than its SRAM and peripheral state. SD card writes
+ * are held in memory per board, so all boards can use the same image file.
+ *
+ * The boards are run in lockstep, one quantum of simulated time at a time.
+ * In each quantum, the threads take boards one by one and run them to the
+ * end of the quantum; after all are done, the switch forwards the frames
+ * sent meanwhile, with a latency of one quantum. The outcome thus does not
+ * depend on the number of threads.
+ */
+class BoardFarm {
+public:
+    BoardFarm(const char *sys_desc_file, int board_count, sim_time_t quantum);
+    ~BoardFarm();
+
+    void run(sim_time_t duration, int threads);
+    void requestStop(void);
+
+    void reportStats(void);
+private:
+    EthernetSwitch net_switch;
+    vector<FarmBoard> boards;
+    sim_time_t quantum;
+
+    sim_time_t time;
+    atomic<bool> stop_requested;
+
+    int64_t memory_per_board;
+    int64_t run_time_ns;
+
+    void _addBoard(const char *sys_desc_file);
+};
+
+#endif
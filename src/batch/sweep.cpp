@@ -0,0 +1,549 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "sweep.h"
+
+#include "devices/atmega32/atmega32.h"
+#include "devices/voltage_src.h"
+#include "simulation/sim_points.h"
+#include "utils/fail.h"
+
+#define DEFAULT_BYTE_INTERVAL   ms_to_sim_time(1)
+#define MAX_VARIANTS            1000000
+
+/**
+ * Makes a CSV cell out of arbitrary text. Control characters are escaped
+ * C-style, so that every row stays on one line.
+ */
+static string csv_cell(const string& text)
+{
+    string cell;
+    bool quote = false;
+    
+    for (unsigned char c : text) {
+        if ((c < 0x20) || (c >= 0x7f) || (c == '\\')) {
+            char escape[8];
+            sprintf(escape, (c == '\\') ? "\\\\" : "\\x%02x", c);
+            cell += escape;
+        } else {
+            if ((c == ',') || (c == '"'))
+                quote = true;
+            cell += c;
+            if (c == '"')
+                cell += c;
+        }
+    }
+    
+    return quote ? "\"" + cell + "\"" : cell;
+}
+
+bool SweepAxis::needsReboot(void) const
+{
+    return (param == SWEEP_PARAM_FREQUENCY) || (param == SWEEP_PARAM_SD_IMAGE);
+}
+
+ParameterSweep::ParameterSweep(Simulation *sim, SystemDescription *sys_desc, const char *spec_file)
+{
+    this->sim = sim;
+    this->sys_desc = sys_desc;
+    this->mcu = find_mcu(*sys_desc);
+    
+    ifstream file(spec_file);
+    if (file.fail())
+        fail("Cannot open sweep spec '%s'", spec_file);
+    
+    Json::Value spec;
+    Json::Reader reader;
+    if (!reader.parse(file, spec))
+        fail("Error parsing sweep spec '%s': %s", spec_file,
+            reader.getFormattedErrorMessages().c_str());
+    
+    if (!spec.isMember("run"))
+        fail("Member 'run' required in sweep spec");
+    
+    boot_to = spec.get("boot_to", "").asString();
+    run_time = parse_json_time(spec["run"], "run");
+    byte_interval = spec.isMember("byte_interval") ?
+        parse_json_time(spec["byte_interval"], "byte_interval") : DEFAULT_BYTE_INTERVAL;
+    
+    variant_count = 1;
+    for (auto& axis_data : spec["axes"]) {
+        _parseAxis(axis_data);
+        
+        variant_count *= axes.back().values.size();
+        if (variant_count > MAX_VARIANTS)
+            fail("Too many variants in sweep (at most %d allowed)", MAX_VARIANTS);
+    }
+    
+    for (auto& metric_data : spec["metrics"])
+        _parseMetric(metric_data);
+    
+    for (auto ent : sys_desc->entities) {
+        auto as_card = dynamic_cast<SdCard *>(ent);
+        if (as_card)
+            cards.push_back(as_card);
+    }
+    
+    auto as_rs232 = dynamic_cast<RS232Device *>(mcu);
+    if (as_rs232)
+        console.connectToRS232Peer(as_rs232);
+}
+
+void ParameterSweep::_parseAxis(Json::Value &axis_data)
+{
+    SweepAxis axis;
+    
+    string param = axis_data["param"].asString();
+    if (param == "voltage")
+        axis.param = SWEEP_PARAM_VOLTAGE;
+    else if (param == "frequency")
+        axis.param = SWEEP_PARAM_FREQUENCY;
+    else if (param == "sd_image")
+        axis.param = SWEEP_PARAM_SD_IMAGE;
+    else if (param == "rs232_input")
+        axis.param = SWEEP_PARAM_RS232_INPUT;
+    else
+        fail("Unknown sweep parameter '%s'", param.c_str());
+    
+    string device_id = axis_data["device"].asString();
+    axis.device = sys_desc->lookupEntity(device_id.c_str());
+    if (!axis.device)
+        fail("Device '%s' not found for sweep parameter '%s'", device_id.c_str(), param.c_str());
+    
+    bool device_ok = false;
+    switch (axis.param) {
+        case SWEEP_PARAM_VOLTAGE:
+            device_ok = dynamic_cast<VoltageSource *>(axis.device);
+            break;
+        case SWEEP_PARAM_FREQUENCY:
+            device_ok = dynamic_cast<Atmega32 *>(axis.device);
+            break;
+        case SWEEP_PARAM_SD_IMAGE:
+            device_ok = dynamic_cast<SdCard *>(axis.device);
+            break;
+        case SWEEP_PARAM_RS232_INPUT:
+            device_ok = dynamic_cast<RS232Device *>(axis.device);
+            break;
+    }
+    if (!device_ok)
+        fail("Device '%s' does not support sweep parameter '%s'", device_id.c_str(), param.c_str());
+    
+    axis.name = axis_data.get("name", device_id + "." + param).asString();
+    
+    if (axis_data.isMember("range")) {
+        Json::Value &range = axis_data["range"];
+        double from = range["from"].asDouble();
+        double to = range["to"].asDouble();
+        double step = range["step"].asDouble();
+        
+        if ((step <= 0.0) || (to < from) || ((to - from) / step > MAX_VARIANTS))
+            fail("Invalid range for sweep axis '%s'", axis.name.c_str());
+        
+        // Step by index rather than by accumulating, to keep values exact
+        for (int i = 0; from + i * step <= to + step * 1e-9; i++)
+            axis.values.push_back(from + i * step);
+    } else {
+        for (auto& value : axis_data["values"])
+            axis.values.push_back(value);
+    }
+    
+    if (axis.values.empty())
+        fail("Sweep axis '%s' has no values", axis.name.c_str());
+    
+    for (auto& value : axis.values) {
+        bool is_text = (axis.param == SWEEP_PARAM_SD_IMAGE) ||
+            (axis.param == SWEEP_PARAM_RS232_INPUT);
+        if (is_text ? !value.isString() : !value.isNumeric())
+            fail("Invalid value for sweep axis '%s'", axis.name.c_str());
+    }
+    
+    axes.push_back(axis);
+}
+
+void ParameterSweep::_parseMetric(Json::Value &metric_data)
+{
+    SweepMetric metric;
+    
+    if (metric_data.isMember("ram")) {
+        metric.type = SWEEP_METRIC_RAM;
+        metric.address = resolve_data_ref(mcu, metric_data["ram"], metric.length);
+        metric.name = metric_data["ram"].isString() ? metric_data["ram"].asString() :
+            to_string(metric.address);
+    } else if (metric_data.isMember("cycles_to")) {
+        if (!mcu)
+            fail("The system has no MCU");
+        for (auto& other : metrics)
+            if (other.type == SWEEP_METRIC_CYCLES_TO)
+                fail("Only one 'cycles_to' metric is supported");
+        
+        metric.type = SWEEP_METRIC_CYCLES_TO;
+        metric.name = metric_data["cycles_to"].asString();
+        metric.pc = mcu->findProgramSymbolPC(metric.name.c_str());
+        if (metric.pc == -1)
+            fail("Symbol '%s' not found in the firmware", metric.name.c_str());
+    } else if (metric_data.isMember("console")) {
+        if (!dynamic_cast<RS232Device *>(mcu))
+            fail("The system has no MCU with a serial port");
+        
+        metric.type = SWEEP_METRIC_CONSOLE;
+        metric.name = "console";
+    } else if (metric_data.isMember("isr")) {
+        auto as_atmega = dynamic_cast<Atmega32 *>(mcu);
+        if (!as_atmega)
+            fail("The system has no Atmega32");
+        
+        metric.type = SWEEP_METRIC_ISR;
+        metric.vector = IsrStats::lookupVector(metric_data["isr"].asCString());
+        if (metric.vector == -1)
+            fail("Unknown interrupt vector '%s'", metric_data["isr"].asCString());
+        metric.stat = metric_data.get("stat", "count").asString();
+        
+        double value;
+        IsrStats probe;
+        if (!probe.lookupStat(metric.vector, metric.stat.c_str(), value))
+            fail("Unknown interrupt statistic '%s'", metric.stat.c_str());
+        
+        metric.name = string(IsrStats::vectorName(metric.vector)) + "_" + metric.stat;
+        
+        if (!isr_stats) {
+            isr_stats.reset(new IsrStats());
+            as_atmega->setIsrStats(isr_stats.get());
+        }
+    } else {
+        fail("Sweep metric must have a 'ram', 'cycles_to', 'console' or 'isr' member");
+    }
+    
+    metric.name = metric_data.get("name", metric.name).asString();
+    metrics.push_back(metric);
+}
+
+ParameterSweep::~ParameterSweep()
+{
+    if (isr_stats)
+        dynamic_cast<Atmega32 *>(mcu)->setIsrStats(NULL);
+}
+
+/**
+ * Runs all variants and prints the results as CSV, one row per variant.
+ */
+void ParameterSweep::run(int jobs)
+{
+    // The sweep output goes to stdout, so keep device chatter out of it
+    mute_info(true);
+    mute_warnings(true);
+    
+    for (auto card : cards)
+        card->holdWrites();
+    sim->sync_with_real_time = false;
+    
+    // Variants that need the same boot are run together
+    map<vector<int>, vector<size_t>> groups;
+    for (size_t index = 0; index < variant_count; index++) {
+        vector<int> variant = _variant(index);
+        vector<int> boot_key;
+        
+        for (size_t i = 0; i < axes.size(); i++)
+            if (axes[i].needsReboot())
+                boot_key.push_back(variant[i]);
+        
+        groups[boot_key].push_back(index);
+    }
+    
+    vector<string> rows(variant_count);
+    for (auto& group : groups) {
+        _boot(_variant(group.second.front()));
+        _runGroup(group.second, jobs, rows);
+    }
+    
+    for (auto card : cards)
+        card->discardWrites();
+    
+    mute_info(false);
+    mute_warnings(false);
+    
+    for (auto& axis : axes)
+        printf("%s,", csv_cell(axis.name).c_str());
+    for (auto& metric : metrics)
+        printf("%s,", csv_cell(metric.name).c_str());
+    printf("error\n");
+    
+    for (auto& row : rows)
+        printf("%s\n", row.c_str());
+}
+
+/**
+ * Gets the value index on each axis for a variant.
+ */
+vector<int> ParameterSweep::_variant(size_t index)
+{
+    vector<int> variant(axes.size());
+    
+    for (int i = (int)axes.size() - 1; i >= 0; i--) {
+        variant[i] = index % axes[i].values.size();
+        index /= axes[i].values.size();
+    }
+    
+    return variant;
+}
+
+/**
+ * Resets the system with the boot-time parameters of a variant and runs it
+ * up to the boot point.
+ */
+void ParameterSweep::_boot(const vector<int>& variant)
+{
+    for (size_t i = 0; i < axes.size(); i++) {
+        Json::Value &value = axes[i].values[variant[i]];
+        
+        switch (axes[i].param) {
+            case SWEEP_PARAM_FREQUENCY:
+                dynamic_cast<Atmega32 *>(axes[i].device)->setFrequency(value.asUInt64());
+                break;
+            case SWEEP_PARAM_SD_IMAGE:
+                dynamic_cast<SdCard *>(axes[i].device)->changeImage(value.asCString());
+                break;
+            default:
+                break;
+        }
+    }
+    
+    for (auto card : cards)
+        card->discardWrites();
+    
+    sim->reset();
+    
+    if (!boot_to.empty()) {
+        schedule_at_point(*sim, *sys_desc, boot_to.c_str(), [this]() {
+            sim->end();
+        });
+        sim->resume();
+    }
+}
+
+/**
+ * Runs the variants of one boot group from a snapshot, in forked workers
+ * that each take the next variant not yet claimed (through a counter in
+ * shared memory) and send back its CSV row.
+ */
+void ParameterSweep::_runGroup(const vector<size_t>& variants, int jobs, vector<string>& rows)
+{
+    SimulationSnapshot warm_state = sim->snapshot();
+    
+    size_t *next_variant = (size_t *)mmap(NULL, sizeof(size_t), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (next_variant == MAP_FAILED)
+        fail("Cannot allocate shared memory for sweep");
+    *next_variant = 0;
+    
+    int worker_count = min((size_t)max(jobs, 1), variants.size());
+    vector<struct pollfd> pipes;
+    vector<string> buffers(worker_count);
+    size_t received = 0;
+    
+    fflush(stdout);
+    for (int i = 0; i < worker_count; i++) {
+        int fds[2];
+        if (pipe(fds) < 0)
+            fail("Cannot create pipe for sweep worker");
+        
+        pid_t pid = fork();
+        if (pid == 0) {
+            for (auto& other : pipes)
+                close(other.fd);
+            close(fds[0]);
+            
+            _work(variants, next_variant, warm_state, fds[1]);
+            
+            // Skip all destructors, which would e.g. flush the SD card
+            _exit(EXIT_SUCCESS);
+        }
+        
+        if (pid < 0)
+            fail("Cannot fork sweep worker");
+        
+        close(fds[1]);
+        pipes.push_back({ fds[0], POLLIN, 0 });
+    }
+    
+    size_t open_pipes = pipes.size();
+    while (open_pipes) {
+        if (poll(pipes.data(), pipes.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            fail("poll() failed");
+        }
+        
+        for (size_t i = 0; i < pipes.size(); i++) {
+            if (!pipes[i].revents)
+                continue;
+            
+            char buffer[4096];
+            ssize_t count = read(pipes[i].fd, buffer, sizeof(buffer));
+            if (count <= 0) {
+                close(pipes[i].fd);
+                pipes[i].fd = -1;
+                open_pipes--;
+                continue;
+            }
+            
+            buffers[i].append(buffer, count);
+            
+            size_t end;
+            while ((end = buffers[i].find('\n')) != string::npos) {
+                size_t tab = buffers[i].find('\t');
+                rows[stoul(buffers[i].substr(0, tab))] = buffers[i].substr(tab + 1, end - tab - 1);
+                received++;
+                buffers[i].erase(0, end + 1);
+            }
+        }
+    }
+    
+    while (wait(NULL) > 0 || errno == EINTR)
+        ;
+    
+    munmap(next_variant, sizeof(size_t));
+    
+    if (received != variants.size())
+        fail("Sweep worker died before finishing its variants");
+}
+
+void ParameterSweep::_work(const vector<size_t>& variants, size_t *next_variant,
+                           const SimulationSnapshot& warm_state, int fd)
+{
+    while (true) {
+        size_t i = __atomic_fetch_add(next_variant, 1, __ATOMIC_RELAXED);
+        if (i >= variants.size())
+            break;
+        
+        string line = to_string(variants[i]) + "\t" + _runVariant(variants[i], warm_state) + "\n";
+        
+        for (size_t ptr = 0; ptr < line.size(); ) {
+            ssize_t count = write(fd, line.data() + ptr, line.size() - ptr);
+            if (count <= 0)
+                return;
+            ptr += count;
+        }
+    }
+    
+    close(fd);
+}
+
+/**
+ * Runs one variant from the warm state and gets its CSV row.
+ */
+string ParameterSweep::_runVariant(size_t index, const SimulationSnapshot& warm_state)
+{
+    vector<int> variant = _variant(index);
+    string row;
+    
+    sim->restore(warm_state);
+    if (mcu)
+        mcu->clearBreakpoint();
+    console.output.clear();
+    if (isr_stats)
+        isr_stats->clear();
+    
+    for (size_t i = 0; i < axes.size(); i++) {
+        Json::Value &value = axes[i].values[variant[i]];
+        
+        switch (axes[i].param) {
+            case SWEEP_PARAM_VOLTAGE:
+                dynamic_cast<VoltageSource *>(axes[i].device)->setValue(value.asDouble());
+                break;
+            case SWEEP_PARAM_RS232_INPUT:
+                if (!value.asString().empty())
+                    _sendByte(dynamic_cast<RS232Device *>(axes[i].device),
+                        make_shared<string>(value.asString()), 0);
+                break;
+            default:
+                break;
+        }
+        
+        row += _formatValue(value) + ",";
+    }
+    
+    reached_cycles = -1;
+    if (mcu) {
+        start_cycles = mcu->getCycleCount();
+        
+        for (auto& metric : metrics)
+            if (metric.type == SWEEP_METRIC_CYCLES_TO)
+                mcu->setBreakpoint(metric.pc, [this]() {
+                    reached_cycles = mcu->getCycleCount() - start_cycles;
+                });
+    }
+    
+    string error;
+    try {
+        sim->resume(sim->time + run_time);
+    } catch (exception& e) {
+        error = e.what();
+    }
+    
+    for (auto& metric : metrics) {
+        switch (metric.type) {
+            case SWEEP_METRIC_RAM:
+                if (metric.length <= 8) {
+                    uint64_t value = 0;
+                    for (int i = metric.length - 1; i >= 0; i--)
+                        value = (value << 8) | mcu->peekData(metric.address + i);
+                    row += to_string(value);
+                } else {
+                    char hex[3];
+                    for (int i = 0; i < metric.length; i++) {
+                        sprintf(hex, "%02x", mcu->peekData(metric.address + i));
+                        row += hex;
+                    }
+                }
+                break;
+            case SWEEP_METRIC_CYCLES_TO:
+                if (reached_cycles >= 0)
+                    row += to_string(reached_cycles);
+                break;
+            case SWEEP_METRIC_CONSOLE:
+                row += csv_cell(console.output);
+                break;
+            case SWEEP_METRIC_ISR: {
+                double value;
+                char buf[32];
+                isr_stats->lookupStat(metric.vector, metric.stat.c_str(), value);
+                snprintf(buf, sizeof(buf), "%.10g", value);
+                row += buf;
+                break;
+            }
+        }
+        
+        row += ",";
+    }
+    
+    return row + csv_cell(error);
+}
+
+void ParameterSweep::_sendByte(RS232Device *device, shared_ptr<string> data, size_t index)
+{
+    device->onRS232Receive((uint8_t)(*data)[index]);
+    
+    if (index + 1 < data->size())
+        sim->scheduleCallbackIn(NULL, byte_interval, [this, device, data, index]() {
+            _sendByte(device, data, index + 1);
+        });
+}
+
+string ParameterSweep::_formatValue(const Json::Value& value)
+{
+    if (value.isString())
+        return csv_cell(value.asString());
+    
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.10g", value.asDouble());
+    
+    return buf;
+}
@@ -0,0 +1,128 @@
+#ifndef _H_SWEEP_H
+#define _H_SWEEP_H
+
+#include <inttypes.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include "simulation/simulation.h"
+#include "simulation/sys_desc.h"
+#include "devices/mcu/mcu.h"
+#include "devices/sd_card.h"
+#include "glue/rs232_capture.h"
+#include "profiling/isr_stats.h"
+
+using namespace std;
+
+enum SweepParam {
+    SWEEP_PARAM_VOLTAGE,
+    SWEEP_PARAM_FREQUENCY,
+    SWEEP_PARAM_SD_IMAGE,
+    SWEEP_PARAM_RS232_INPUT
+};
+
+enum SweepMetricType {
+    SWEEP_METRIC_RAM,
+    SWEEP_METRIC_CYCLES_TO,
+    SWEEP_METRIC_CONSOLE,
+    SWEEP_METRIC_ISR
+};
+
+class SweepAxis {
+public:
+    string name;
+    SweepParam param;
+    Entity *device;
+    vector<Json::Value> values;
+
+    bool needsReboot(void) const;
+};
+
+class SweepMetric {
+public:
+    string name;
+    SweepMetricType type;
+    int address;
+    int length;
+    int pc;
+    int vector;
+    string stat;
+};
+
+/**
+ * Runs the same system many times with some of its parameters varied, and
+ * tabulates a few metrics of each run as CSV. The spec looks like:
+ *
+ *   {
+ *     "boot_to": "main_loop",
+ *     "run": "500ms",
+ *     "axes": [
+ *       { "param": "voltage", "device": "vsrc", "range": { "from": 0, "to": 5, "step": 0.5 } },
+ *       { "param": "rs232_input", "device": "mcu", "values": ["help\r", "stat\r"] }
+ *     ],
+ *     "metrics": [
+ *       { "name": "reading", "ram": "adc_value" },
+ *       { "name": "latency", "cycles_to": "on_command" },
+ *       { "name": "output", "console": true },
+ *       { "name": "adc_lat", "isr": "ADC", "stat": "worst_latency" }
+ *     ]
+ *   }
+ *
+ * Every combination of axis values is a variant. The system is booted (up to
+ * the time or function in "boot_to") once and snapshotted, and the variants
+ * are then run from that snapshot, for the "run" time each, in forked worker
+ * processes that pick up variants until all are done.
+ *
+ * Parameters are "voltage" (of a VoltageSource), "rs232_input" (bytes sent to
+ * an RS232 device, one per "byte_interval") and, since they only make sense
+ * from reset, "frequency" (of the MCU) and "sd_image" (of an SD card), which
+ * make the system boot once for every combination of their values instead.
+ *
+ * Metrics are a RAM value (as a little-endian integer, or hex bytes if longer
+ * than 8 bytes), the cycles taken to first reach a function (at most one such
+ * metric), the console output of the MCU, or a statistic of an interrupt
+ * handler of an Atmega32 over the run (see IsrStats::lookupStat).
+ */
+class ParameterSweep {
+public:
+    ParameterSweep(Simulation *sim, SystemDescription *sys_desc, const char *spec_file);
+    ~ParameterSweep();
+
+    void run(int jobs);
+private:
+    Simulation *sim;
+    SystemDescription *sys_desc;
+    Mcu *mcu;
+
+    string boot_to;
+    sim_time_t run_time;
+    sim_time_t byte_interval;
+    vector<SweepAxis> axes;
+    vector<SweepMetric> metrics;
+    size_t variant_count;
+
+    RS232Capture console;
+    unique_ptr<IsrStats> isr_stats;
+    vector<SdCard *> cards;
+
+    uint64_t start_cycles;
+    int64_t reached_cycles;
+
+    void _parseAxis(Json::Value &axis_data);
+    void _parseMetric(Json::Value &metric_data);
+
+    vector<int> _variant(size_t index);
+    void _boot(const vector<int>& variant);
+    void _runGroup(const vector<size_t>& variants, int jobs, vector<string>& rows);
+    void _work(const vector<size_t>& variants, size_t *next_variant,
+               const SimulationSnapshot& warm_state, int fd);
+    string _runVariant(size_t index, const SimulationSnapshot& warm_state);
+    void _sendByte(RS232Device *device, shared_ptr<string> data, size_t index);
+
+    string _formatValue(const Json::Value& value);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include <thread>
+
+#include "work_pool.h"
+
+WorkStealingPool::WorkStealingPool(int threads)
+{
+    this->threads = (threads > 0) ? threads : 1;
+}
+
+/**
+ * Runs tasks 0..count-1 and waits for all of them to finish. Tasks must not
+ * throw.
+ */
+void WorkStealingPool::run(size_t count, function<void(size_t)> task)
+{
+    int thread_count = min((size_t)threads, count);
+    
+    queues.clear();
+    for (int i = 0; i < thread_count; i++)
+        queues.emplace_back(new WorkQueue());
+    
+    for (size_t i = 0; i < count; i++)
+        queues[i % thread_count]->tasks.push_back(i);
+    
+    vector<thread> workers;
+    for (int i = 1; i < thread_count; i++)
+        workers.emplace_back(&WorkStealingPool::_work, this, i, ref(task));
+    
+    if (thread_count)
+        _work(0, task);
+    
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void WorkStealingPool::_work(int self, function<void(size_t)>& task)
+{
+    size_t index;
+    
+    while (_take(self, index))
+        task(index);
+}
+
+bool WorkStealingPool::_take(int self, size_t &index)
+{
+    {
+        WorkQueue& own = *queues[self];
+        lock_guard<mutex> guard(own.lock);
+        
+        if (!own.tasks.empty()) {
+            index = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    
+    for (size_t i = 1; i < queues.size(); i++) {
+        WorkQueue& victim = *queues[(self + i) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        
+        if (!victim.tasks.empty()) {
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    
+    return false;
+}
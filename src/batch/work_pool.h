@@ -0,0 +1,40 @@
+#ifndef _H_WORK_POOL_H
+#define _H_WORK_POOL_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A pool of threads that runs a number of independent tasks, identified by
+ * their index.
+ *
+ * The tasks are dealt out to per-thread queues up front. Each thread works
+ * through its own queue from the front and, once it is empty, steals from
+ * the back of the other threads' queues, so that a few long tasks do not hold
+ * up the rest of the work.
+ */
+class WorkStealingPool {
+public:
+    WorkStealingPool(int threads);
+    
+    void run(size_t count, function<void(size_t)> task);
+private:
+    struct WorkQueue {
+        mutex lock;
+        deque<size_t> tasks;
+    };
+    
+    int threads;
+    vector<unique_ptr<WorkQueue>> queues;
+    
+    void _work(int self, function<void(size_t)>& task);
+    bool _take(int self, size_t &index);
+};
+
+#endif
@@ -0,0 +1,386 @@
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <set>
+
+#include "board_gen.h"
+
+#include "utils/fail.h"
+
+using namespace std;
+
+#define CAN_SPI     1
+#define CAN_I2C     2
+#define HAS_PINS    4
+
+#define CONSTRUCT_FROM_JSON             0
+#define CONSTRUCT_FROM_JSON_AND_LOOKUP  1
+#define CONSTRUCT_SPI_BUS               2
+#define CONSTRUCT_I2C_BUS               3
+#define CONSTRUCT_ANALOG_BUS            4
+
+struct BoardEntityType {
+    const char *type;
+    const char *class_name;
+    const char *header;
+    const char *member_prefix;
+    int construct;
+    int capabilities;
+};
+
+// Must cover the same types as SystemDescription::parseEntity()
+static const BoardEntityType ENTITY_TYPES[] = {
+    { "Atmega32", "Atmega32", "devices/atmega32/atmega32.h", "atmega32",
+        CONSTRUCT_FROM_JSON_AND_LOOKUP, CAN_SPI | CAN_I2C | HAS_PINS },
+    { "Ds1307", "Ds1307", "devices/ds1307.h", "ds1307",
+        CONSTRUCT_FROM_JSON, CAN_I2C },
+    { "SdCard", "SdCard", "devices/sd_card.h", "sd_card",
+        CONSTRUCT_FROM_JSON, CAN_SPI | HAS_PINS },
+    { "Enc28J60", "Enc28J60", "devices/enc28j60/enc28j60.h", "enc28j60",
+        CONSTRUCT_FROM_JSON, CAN_SPI | HAS_PINS },
+    { "I2cBus", "I2cBus", "glue/i2c_bus.h", "i2c_bus",
+        CONSTRUCT_I2C_BUS, 0 },
+    { "SpiBus", "SpiBus", "glue/spi_bus.h", "spi_bus",
+        CONSTRUCT_SPI_BUS, 0 },
+    { "AnalogBus", "AnalogBus", "glue/analog_bus.h", "analog_bus",
+        CONSTRUCT_ANALOG_BUS, 0 },
+    { "VoltageSource", "VoltageSource", "devices/voltage_src.h", "voltage_src",
+        CONSTRUCT_FROM_JSON, HAS_PINS },
+    { "SpiStub", "SpiStub", "devices/spi_stub.h", "spi_stub",
+        CONSTRUCT_FROM_JSON, CAN_SPI | HAS_PINS },
+    { "VirtualNetwork", "VirtualNetwork", "networking/virtual_net.h", "virtual_net",
+        CONSTRUCT_FROM_JSON_AND_LOOKUP, 0 },
+    { "TrafficSource", "TrafficSource", "networking/traffic_source.h", "traffic_source",
+        CONSTRUCT_FROM_JSON_AND_LOOKUP, 0 },
+    { "SimpleLed", "SimpleLed", "gui/led.h", "led",
+        CONSTRUCT_FROM_JSON, HAS_PINS },
+    { "SimplePushButton", "SimplePushButton", "gui/push_button.h", "push_button",
+        CONSTRUCT_FROM_JSON, HAS_PINS },
+    { "PCIndicator", "PCIndicator", "gui/pc_indicator.h", "pc_indicator",
+        CONSTRUCT_FROM_JSON_AND_LOOKUP, 0 },
+    { "RS232Console", "RS232Console", "gui/rs232_console.h", "rs232_console",
+        CONSTRUCT_FROM_JSON_AND_LOOKUP, 0 },
+    { "Dashboard", "Dashboard", "gui/dashboard.h", "dashboard",
+        CONSTRUCT_FROM_JSON_AND_LOOKUP, 0 },
+};
+
+#define ENTITY_TYPE_COUNT (sizeof(ENTITY_TYPES) / sizeof(ENTITY_TYPES[0]))
+
+// The type of the buses added for pins with a "connect" shorthand
+#define WIRE_TYPE_NAME "AnalogBus"
+
+// Names that members of the generated board must not take
+static const char *RESERVED_NAMES[] = {
+    "config", "entities", "owns_entities", "main",
+    "alignas", "alignof", "and", "asm", "auto", "bool", "break", "case", "catch",
+    "char", "class", "const", "constexpr", "continue", "decltype", "default",
+    "delete", "do", "double", "else", "enum", "explicit", "export", "extern",
+    "false", "float", "for", "friend", "goto", "if", "inline", "int", "long",
+    "mutable", "namespace", "new", "noexcept", "not", "nullptr", "operator", "or",
+    "private", "protected", "public", "register", "return", "short", "signed",
+    "sizeof", "static", "struct", "switch", "template", "this", "throw", "true",
+    "try", "typedef", "typeid", "typename", "union", "unsigned", "using",
+    "virtual", "void", "volatile", "while", "xor",
+};
+
+static const BoardEntityType *find_entity_type(const string& type)
+{
+    for (size_t i = 0; i < ENTITY_TYPE_COUNT; i++)
+        if (type == ENTITY_TYPES[i].type)
+            return &ENTITY_TYPES[i];
+    
+    return NULL;
+}
+
+static string c_identifier(const string& text)
+{
+    string ident;
+    
+    for (char c : text)
+        ident += isalnum((unsigned char)c) ? (char)tolower(c) : '_';
+    
+    return ident;
+}
+
+static string c_string(const string& text)
+{
+    string result = "\"";
+    
+    for (unsigned char c : text) {
+        if ((c == '"') || (c == '\\')) {
+            result += '\\';
+            result += c;
+        } else if ((c < 32) || (c >= 127)) {
+            char buf[8];
+            sprintf(buf, "\\%03o", c);
+            result += buf;
+        } else {
+            result += c;
+        }
+    }
+    
+    return result + "\"";
+}
+
+BoardGenerator::BoardGenerator(const char *sys_desc_file)
+{
+    ifstream infile(sys_desc_file);
+    if (!infile.is_open())
+        fail("Cannot open system description file '%s'", sys_desc_file);
+    
+    Json::Reader reader;
+    if (!reader.parse(infile, json_data))
+        fail("Error parsing '%s': %s", sys_desc_file, reader.getFormattedErrorMessages().c_str());
+    
+    const char *slash = strrchr(sys_desc_file, '/');
+    source_name = slash ? slash + 1 : sys_desc_file;
+    
+    _parse();
+}
+
+void BoardGenerator::_parse(void)
+{
+    if (!json_data.isMember("entities"))
+        return;
+    
+    Json::Value& entities = json_data["entities"];
+    if (!entities.isArray())
+        fail("'entities' should be an array");
+    
+    for (int i = 0; i < (int)entities.size(); i++) {
+        const Json::Value& entity = entities[i];
+        
+        if (!entity.isMember("type"))
+            fail("Entity object lacks member 'type'");
+        
+        string type_name = entity["type"].asString();
+        const BoardEntityType *type = find_entity_type(type_name);
+        if (!type)
+            fail("Unsupported entity type '%s'", type_name.c_str());
+        
+        string id = entity.isMember("id") ? entity["id"].asString() : "";
+        string name = id.empty() ? string(type->member_prefix) + "_" + to_string(i) : c_identifier(id);
+        int index = _addMember(name, type, i);
+        
+        members[index].config = entity;
+        if (!id.empty())
+            members_by_id[id] = index;
+        
+        // Check the wiring of buses now, as the board makes no lookups
+        if (type->construct == CONSTRUCT_SPI_BUS) {
+            for (auto& dev_id : entity["devices"])
+                _lookupDevice(dev_id, "SPI");
+        } else if (type->construct == CONSTRUCT_I2C_BUS) {
+            for (auto& dev_id : entity["devices"])
+                _lookupDevice(dev_id, "I2C");
+        } else if (type->construct == CONSTRUCT_ANALOG_BUS) {
+            for (auto& pin_ref : entity["pins"])
+                _lookupDevice(pin_ref["device"], "pin");
+        }
+        
+        if (!entity.isMember("connect") || !entity["connect"].isObject())
+            continue;
+        
+        if (!(type->capabilities & HAS_PINS))
+            fail("Device '%s' is not a pin device", id.c_str());
+        
+        const Json::Value& pin_dict = entity["connect"];
+        for (Json::ValueConstIterator it = pin_dict.begin(); it != pin_dict.end(); it++) {
+            string pin = it.key().asString();
+            
+            _lookupDevice((*it)["device"], "pin");
+            
+            int wire = _addMember(members[index].name + "_" + c_identifier(pin) + "_wire",
+                find_entity_type(WIRE_TYPE_NAME), -1);
+            members[wire].owner = index;
+            members[wire].owner_pin = pin;
+            members[wire].other_pin = *it;
+        }
+    }
+}
+
+int BoardGenerator::_addMember(const string& name, const BoardEntityType *type, int config_index)
+{
+    set<string> taken;
+    for (auto& member : members)
+        taken.insert(member.name);
+    for (auto reserved : RESERVED_NAMES)
+        taken.insert(reserved);
+    
+    Member member;
+    
+    member.name = name;
+    if (member.name.empty() || isdigit((unsigned char)member.name[0]) || taken.count(member.name))
+        member.name = string(type->member_prefix) + "_" + to_string(members.size());
+    member.type = type;
+    member.config_index = config_index;
+    member.owner = -1;
+    
+    members.push_back(member);
+    
+    return (int)members.size() - 1;
+}
+
+int BoardGenerator::_lookupDevice(const Json::Value& id, const char *capability)
+{
+    if (!id.isString())
+        fail("Device references should be IDs");
+    
+    auto it = members_by_id.find(id.asString());
+    if (it == members_by_id.end())
+        fail("Device '%s' not defined at this point", id.asCString());
+    
+    int required = !strcmp(capability, "SPI") ? CAN_SPI : !strcmp(capability, "I2C") ? CAN_I2C : HAS_PINS;
+    if (!(members[it->second].type->capabilities & required))
+        fail("Device '%s' is not a %s device", id.asCString(), capability);
+    
+    return it->second;
+}
+
+void BoardGenerator::generate(ostream& out)
+{
+    string config_text = Json::StyledWriter().write(json_data);
+    if (config_text.find(")msd\"") != string::npos)
+        fail("The system description cannot be embedded as it is");
+    
+    out << "// Generated by megas2-gen from " << source_name << "; do not edit." << endl;
+    out << endl;
+    
+    set<string> headers;
+    for (auto& member : members)
+        headers.insert(member.type->header);
+    
+    out << "#include \"codegen/static_board.h\"" << endl;
+    for (auto& header : headers)
+        out << "#include \"" << header << "\"" << endl;
+    out << endl;
+    
+    out << "static const char *BOARD_CONFIG = R\"msd(" << config_text << ")msd\";" << endl;
+    out << endl;
+    
+    _emitClass(out);
+    _emitDispatchers(out);
+    _emitConstructor(out);
+    
+    out << "int main(int argc, char **argv)" << endl;
+    out << "{" << endl;
+    out << "    return static_board_main(argc, argv, []() -> StaticBoard * { return new GeneratedBoard(); });" << endl;
+    out << "}" << endl;
+}
+
+void BoardGenerator::_emitClass(ostream& out)
+{
+    out << "class GeneratedBoard : public StaticBoard {" << endl;
+    out << "public:" << endl;
+    out << "    GeneratedBoard();" << endl;
+    out << endl;
+    
+    for (auto& member : members)
+        out << "    BoardEntity<" << member.type->class_name << "> " << member.name << ";" << endl;
+    
+    out << "};" << endl;
+    out << endl;
+}
+
+/**
+ * Emits the functions through which the SPI buses deliver bytes: the same
+ * loop as SpiBus::sendData(), unrolled over the devices on the bus, with
+ * non-virtual calls to their handlers.
+ */
+void BoardGenerator::_emitDispatchers(ostream& out)
+{
+    for (auto& member : members) {
+        if (member.type->construct != CONSTRUCT_SPI_BUS)
+            continue;
+        
+        out << "static bool " << member.name << "_dispatch(void *context, SpiDevice *sender, uint8_t &data)" << endl;
+        out << "{" << endl;
+        out << "    GeneratedBoard *board = (GeneratedBoard *)context;" << endl;
+        out << "    bool ack = false;" << endl;
+        out << "    " << endl;
+        
+        const Json::Value& config = member.config;
+        set<int> seen;
+        for (auto& dev_id : config["devices"]) {
+            int device = members_by_id[dev_id.asString()];
+            if (!seen.insert(device).second)
+                continue;
+            
+            const string& name = members[device].name;
+            out << "    if (sender != &board->" << name << ")" << endl;
+            out << "        ack = merge_spi_ack(ack, board->" << name << "." <<
+                members[device].type->class_name << "::spiReceiveData(data));" << endl;
+        }
+        
+        out << "    " << endl;
+        out << "    if (!ack)" << endl;
+        out << "        data = 0xff;" << endl;
+        out << "    " << endl;
+        out << "    return ack;" << endl;
+        out << "}" << endl;
+        out << endl;
+    }
+}
+
+void BoardGenerator::_emitConstructor(ostream& out)
+{
+    out << "GeneratedBoard::GeneratedBoard() : StaticBoard(BOARD_CONFIG)";
+    for (auto& member : members) {
+        out << "," << endl << "    " << member.name << "(this";
+        if (member.type->construct == CONSTRUCT_FROM_JSON)
+            out << ", entityConfig(" << member.config_index << ")";
+        else if (member.type->construct == CONSTRUCT_FROM_JSON_AND_LOOKUP)
+            out << ", entityConfig(" << member.config_index << "), this";
+        out << ")";
+    }
+    out << endl;
+    out << "{" << endl;
+    
+    bool first = true;
+    for (auto& member : members) {
+        int construct = member.type->construct;
+        if ((construct == CONSTRUCT_FROM_JSON) || (construct == CONSTRUCT_FROM_JSON_AND_LOOKUP))
+            continue;
+        
+        if (!first)
+            out << "    " << endl;
+        first = false;
+        
+        if (member.owner >= 0) {
+            const string& owner = members[member.owner].name;
+            out << "    " << member.name << ".addDevicePin(&" << owner << ", PinReference(&" << owner <<
+                ", " << c_string(member.owner_pin) << ").pin_id);" << endl;
+            _emitPinRef(out << "    " << member.name << ".addDevicePin(", member.other_pin);
+            out << ");" << endl;
+            continue;
+        }
+        
+        out << "    nameEntity(&" << member.name << ", " << member.config_index << ");" << endl;
+        
+        const Json::Value& config = member.config;
+        
+        if (construct == CONSTRUCT_ANALOG_BUS) {
+            for (auto& pin_ref : config["pins"]) {
+                _emitPinRef(out << "    " << member.name << ".addDevicePin(", pin_ref);
+                out << ");" << endl;
+            }
+        } else {
+            for (auto& dev_id : config["devices"])
+                out << "    " << member.name << ".addDevice(&" << members[members_by_id[dev_id.asString()]].name <<
+                    ");" << endl;
+        }
+        
+        if (construct == CONSTRUCT_SPI_BUS)
+            out << "    " << member.name << ".setDispatcher(" << member.name << "_dispatch, this);" << endl;
+    }
+    
+    out << "}" << endl;
+    out << endl;
+}
+
+void BoardGenerator::_emitPinRef(ostream& out, const Json::Value& pin_ref)
+{
+    const string& device = members[members_by_id[pin_ref["device"].asString()]].name;
+    
+    out << "&" << device << ", PinReference(&" << device << ", " << c_string(pin_ref["pin"].asString()) << ").pin_id";
+}
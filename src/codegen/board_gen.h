@@ -0,0 +1,59 @@
+#ifndef _H_BOARD_GEN_H
+#define _H_BOARD_GEN_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+using namespace std;
+
+struct BoardEntityType;
+
+/**
+ * Turns a system description into the C++ source of a StaticBoard with the
+ * same devices and wiring, plus a main() that runs it. Compiled together
+ * with the simulator's sources, this gives a simulator for that one system.
+ *
+ * The wiring is checked while generating (devices must be defined before
+ * being referred to, and be of a kind the bus accepts); device settings are
+ * only checked when the board is constructed, as usual.
+ */
+class BoardGenerator {
+public:
+    BoardGenerator(const char *sys_desc_file);
+
+    void generate(ostream& out);
+private:
+    struct Member {
+        string name;
+        const BoardEntityType *type;
+        int config_index;
+        Json::Value config;
+
+        // For wires made by a 'connect' entry: the pin of the device this
+        // belongs to, and the pin it connects to
+        int owner;
+        string owner_pin;
+        Json::Value other_pin;
+    };
+
+    string source_name;
+    Json::Value json_data;
+
+    vector<Member> members;
+    map<string, int> members_by_id;
+
+    void _parse(void);
+    int _addMember(const string& name, const BoardEntityType *type, int config_index);
+    int _lookupDevice(const Json::Value& id, const char *capability);
+
+    void _emitClass(ostream& out);
+    void _emitDispatchers(ostream& out);
+    void _emitConstructor(ostream& out);
+    void _emitPinRef(ostream& out, const Json::Value& pin_ref);
+};
+
+#endif
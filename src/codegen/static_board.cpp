@@ -0,0 +1,132 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <signal.h>
+
+#include "static_board.h"
+
+#include "simulation/simulation.h"
+#include "utils/cmd_line.h"
+#include "utils/time.h"
+
+#define BENCHMARK_SECONDS           5
+
+using namespace std;
+
+StaticBoard::StaticBoard(const char *config_text)
+{
+    Json::Reader reader;
+    
+    if (!reader.parse(config_text, config))
+        fail("Error parsing embedded system description: %s",
+            reader.getFormattedErrorMessages().c_str());
+    
+    owns_entities = false;
+}
+
+Json::Value& StaticBoard::entityConfig(int index)
+{
+    return config["entities"][index];
+}
+
+/**
+ * Gives an entity that was not constructed from its configuration (i.e. a
+ * bus) the ID and name the configuration specifies, if any.
+ */
+void StaticBoard::nameEntity(Entity *entity, int index)
+{
+    entity->parseOptionalJsonParam(entity->id, entityConfig(index), "id");
+    entity->parseOptionalJsonParam(entity->name, entityConfig(index), "name");
+}
+
+static Simulation *running_sim = NULL;
+
+static void handle_stop_signal(int signum)
+{
+    if (running_sim)
+        running_sim->requestStop();
+}
+
+static void show_help(const char *program)
+{
+    printf("Invocation: %s [options]\n", program);
+    printf("\n");
+    printf("Options:\n");
+    printf("  --benchmark          Run unsynced for a few seconds and report speed\n");
+    printf("  --speed=N            Run at N times real time (default: 1)\n");
+    printf("  --time=T             Run unsynced for simulated time T, then exit\n");
+    
+    exit(EXIT_SUCCESS);
+}
+
+/**
+ * Runs a generated board, taking a subset of the options of megas2.
+ */
+int static_board_main(int argc, char **argv, StaticBoard *(*make_board)(void))
+{
+    bool do_benchmark = false;
+    double speed = 1.0;
+    sim_time_t run_time = SIM_TIME_NEVER;
+    
+    try {
+        const char *value;
+        
+        for (int i = 1; i < argc; i++) {
+            if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+                show_help(argv[0]);
+            } else if (!strcmp(argv[i], "--benchmark")) {
+                do_benchmark = true;
+            } else if ((value = flag_value(argc, argv, i, "--speed"))) {
+                speed = parse_double_flag(value, "--speed");
+                if (speed <= 0)
+                    fail("--speed must be positive");
+            } else if ((value = flag_value(argc, argv, i, "--time"))) {
+                if (!parse_sim_time(value, run_time))
+                    fail("Invalid value '%s' for --time", value);
+            } else {
+                fail("Unknown argument '%s'", argv[i]);
+            }
+        }
+        
+        unique_ptr<StaticBoard> board(make_board());
+        Simulation sim(*board);
+        
+        sim.pacer.speed = speed;
+        sim.reset();
+        
+        if (do_benchmark) {
+            sim.sync_with_real_time = false;
+            
+            int64_t start_ns = monotonic_time_ns();
+            sim.resume(sim.time + sec_to_sim_time(BENCHMARK_SECONDS));
+            int64_t real_elapsed = monotonic_time_ns() - start_ns;
+            
+            printf("Unsynced speed: %d%%\n",
+                (int)(100LL * sec_to_sim_time(BENCHMARK_SECONDS) / real_elapsed));
+        } else {
+            if (run_time != SIM_TIME_NEVER)
+                sim.sync_with_real_time = false;
+            
+            running_sim = &sim;
+            signal(SIGINT, handle_stop_signal);
+            signal(SIGTERM, handle_stop_signal);
+            
+            sim.resume(run_time);
+            
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            running_sim = NULL;
+            
+            if (run_time == SIM_TIME_NEVER)
+                sim.pacer.reportStats();
+        }
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
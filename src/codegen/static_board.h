@@ -0,0 +1,58 @@
+#ifndef _H_STATIC_BOARD_H
+#define _H_STATIC_BOARD_H
+
+#include <utility>
+
+#include <json/json.h>
+
+#include "simulation/sys_desc.h"
+#include "utils/fail.h"
+
+using namespace std;
+
+/**
+ * Base for the boards generated by megas2-gen from a system description.
+ *
+ * A generated board holds its devices and buses as members of their exact
+ * types, wired up directly rather than through lookups and casts, so that
+ * the buses can call into the devices without virtual dispatch. The
+ * configuration of each device is still read from the (embedded) JSON of
+ * the original file, with the same meaning.
+ */
+class StaticBoard : public SystemDescription {
+public:
+    StaticBoard(const char *config_text);
+    virtual ~StaticBoard() { }
+protected:
+    Json::Value config;
+    
+    Json::Value& entityConfig(int index);
+    void nameEntity(Entity *entity, int index);
+};
+
+/**
+ * A device or bus that is a member of a StaticBoard. It is listed among the
+ * board's entities as soon as it is constructed, so that the devices after
+ * it can look it up by ID, as they would in a SystemDescription.
+ */
+template<typename T>
+class BoardEntity : public T {
+public:
+    template<typename... Args>
+    BoardEntity(StaticBoard *board, Args&&... args) : T(forward<Args>(args)...)
+    {
+        board->entities.push_back(this);
+    }
+};
+
+static inline bool merge_spi_ack(bool ack, bool dev_ack)
+{
+    if (ack && dev_ack)
+        fail("Multiple devices ACK'ed SPI data");
+    
+    return ack || dev_ack;
+}
+
+int static_board_main(int argc, char **argv, StaticBoard *(*make_board)(void));
+
+#endif
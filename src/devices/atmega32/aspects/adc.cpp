@@ -45,6 +45,22 @@ void Atmega32::_adcInit()
     this->adc_result_locked = false;
 }
 
+void Atmega32::_adcSaveState(StateWriter& out)
+{
+    out.put(this->adc_enabled);
+    out.put(this->adc_result);
+    out.put(this->adc_result_locked);
+    out.put(this->adc_last_admux);
+}
+
+void Atmega32::_adcLoadState(StateReader& in)
+{
+    in.get(this->adc_enabled);
+    in.get(this->adc_result);
+    in.get(this->adc_result_locked);
+    in.get(this->adc_last_admux);
+}
+
 void Atmega32::_adcHandleRead(uint8_t port, int8_t bit, uint8_t &value)
 {
     int result_shift = bit_is_set(this->ports[PORT_ADMUX], B_ADLAR) ? 6 : 0;
@@ -126,6 +142,8 @@ void Atmega32::_completeAdcConversion()
 {
     if (!this->adc_result_locked) {
         this->adc_result = this->_getAdcMeasurement();
+        if (!bit_is_set(this->ports[PORT_ADCSRA], B_ADIF))
+            _noteIrqRaised(IRQ_ADC);
         set_bit(this->ports[PORT_ADCSRA], B_ADIF);
     }
     
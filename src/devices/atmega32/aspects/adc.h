@@ -10,6 +10,8 @@ protected:
     uint8_t adc_last_admux;
     
     void _adcInit();
+    void _adcSaveState(StateWriter& out);
+    void _adcLoadState(StateReader& in);
     void _adcHandleRead(uint8_t port, int8_t bit, uint8_t &value);
     void _adcHandleWrite(uint8_t port, int8_t bit, uint8_t value, uint8_t prev_val, uint8_t cleared);
 
@@ -139,6 +139,16 @@ void Atmega32::_pinsInit()
     }
 }
 
+void Atmega32::_pinsSaveState(StateWriter& out)
+{
+    out.putBools(this->_pin_overrides);
+}
+
+void Atmega32::_pinsLoadState(StateReader& in)
+{
+    in.getBools(this->_pin_overrides);
+}
+
 void Atmega32::_onPinChanged(int pin_id, pin_val_t value, pin_val_t old_value)
 {
     if (is_dataport_pin(pin_id)) {
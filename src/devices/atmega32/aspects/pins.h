@@ -6,6 +6,8 @@ protected:
     vector<bool> _pin_overrides;
 
     void _pinsInit();
+    void _pinsSaveState(StateWriter& out);
+    void _pinsLoadState(StateReader& in);
     virtual void _onPinChanged(int pin_id, pin_val_t value, pin_val_t old_value);
     
     void _handleDataPortRead(uint8_t port, int8_t bit, uint8_t &value);
@@ -30,6 +30,18 @@ void Atmega32::_spiInit()
     this->spi_stat_read = false;
 }
 
+void Atmega32::_spiSaveState(StateWriter& out)
+{
+    out.put(this->spi_stat_read);
+    out.put(this->spi_selected);
+}
+
+void Atmega32::_spiLoadState(StateReader& in)
+{
+    in.get(this->spi_stat_read);
+    in.get(this->spi_selected);
+}
+
 void Atmega32::_spiHandleRead(uint8_t port, int8_t bit, uint8_t &value)
 {
     switch (port) {
@@ -7,6 +7,8 @@ protected:
     bool spi_stat_read;
         
     void _spiInit();
+    void _spiSaveState(StateWriter& out);
+    void _spiLoadState(StateReader& in);
     void _spiHandleRead(uint8_t port, int8_t bit, uint8_t &value);
     void _spiHandleWrite(uint8_t port, int8_t bit, uint8_t value, uint8_t prev_val, uint8_t cleared);
     bool _spiIsEnabled();
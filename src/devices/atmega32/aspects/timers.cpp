@@ -64,6 +64,20 @@ void Atmega32::_timersInit()
     this->_timer2Init();
 }
 
+void Atmega32::_timersSaveState(StateWriter& out)
+{
+    out.put(this->prescaler01);
+    out.put(this->prescaler2);
+    out.put(this->timer1_temp_high_byte);
+}
+
+void Atmega32::_timersLoadState(StateReader& in)
+{
+    in.get(this->prescaler01);
+    in.get(this->prescaler2);
+    in.get(this->timer1_temp_high_byte);
+}
+
 void Atmega32::_runTimers()
 {
     int old_value;
@@ -94,7 +108,13 @@ void Atmega32::_timersCommonHandleWrite(uint8_t port, int8_t bit, uint8_t value,
 
 void Atmega32::_triggerTimerIrq(uint8_t flags)
 {
+    uint8_t raised = flags & ~this->ports[PORT_TIFR];
+    
     this->ports[PORT_TIFR] |= flags;
+    
+    for (int bit = 7; raised && (bit >= 0); bit--)
+        if (bit_is_set(raised, bit))
+            _noteIrqRaised(IRQ_TIMER0_OVF - bit);
 }
 
 uint8_t Atmega32::_handleTimerIrqs()
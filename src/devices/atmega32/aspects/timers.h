@@ -10,6 +10,8 @@ protected:
     uint8_t timer1_temp_high_byte;
 
     void _timersInit();
+    void _timersSaveState(StateWriter& out);
+    void _timersLoadState(StateReader& in);
     void _runTimers();
     
     void _timersCommonHandleRead(uint8_t port, int8_t bit, uint8_t &value);
@@ -42,6 +42,20 @@ void Atmega32::_twiInit()
     this->twi_start_just_sent = false;
 }
 
+void Atmega32::_twiSaveState(StateWriter& out)
+{
+    out.put(this->twi_has_floor);
+    out.put(this->twi_start_just_sent);
+    out.put(this->twi_xmit_mode);
+}
+
+void Atmega32::_twiLoadState(StateReader& in)
+{
+    in.get(this->twi_has_floor);
+    in.get(this->twi_start_just_sent);
+    in.get(this->twi_xmit_mode);
+}
+
 void Atmega32::_twiHandleRead(uint8_t port, int8_t bit, uint8_t &value)
 {
 }
@@ -13,6 +13,8 @@ protected:
     bool twi_xmit_mode;
 
     void _twiInit();
+    void _twiSaveState(StateWriter& out);
+    void _twiLoadState(StateReader& in);
     void _twiHandleRead(uint8_t port, int8_t bit, uint8_t &value);
     void _twiHandleWrite(uint8_t port, int8_t bit, uint8_t value, uint8_t prev_val, uint8_t cleared);
     
@@ -20,6 +20,7 @@ void Atmega32::_usartInit()
     this->ports[PORT_UCSRA] = 0x20;
     this->ports[PORT_UCSRB] = 0x00;
     this->_reg_UCSRC = 0x86;
+    this->_reg_UDR_rx = 0x00;
     this->ports[PORT_UBRRH] = 0x00;
     this->ports[PORT_UBRRL] = 0x00;
     
@@ -35,6 +36,20 @@ void Atmega32::_usartInit()
     this->port_metas[PORT_UBRRH].write_handler = &Atmega32::_usartHandleWrite;
 }
 
+void Atmega32::_usartSaveState(StateWriter& out)
+{
+    out.put(this->_reg_UCSRC);
+    out.put(this->_reg_UDR_rx);
+    out.put(this->_last_UBRRH_access);
+}
+
+void Atmega32::_usartLoadState(StateReader& in)
+{
+    in.get(this->_reg_UCSRC);
+    in.get(this->_reg_UDR_rx);
+    in.get(this->_last_UBRRH_access);
+}
+
 void Atmega32::_usartHandleRead(uint8_t port, int8_t bit, uint8_t &value)
 {
     switch (port) {
@@ -45,6 +60,11 @@ void Atmega32::_usartHandleRead(uint8_t port, int8_t bit, uint8_t &value)
             }
             this->_last_UBRRH_access = this->cycle_count;
             break;
+        case PORT_UDR:
+            value = this->_reg_UDR_rx;
+            clear_bit(ports[PORT_UCSRA], B_RXC);
+            clear_bit(ports[PORT_UCSRA], B_DOR);
+            break;
     }
 }
 
@@ -73,6 +93,26 @@ void Atmega32::_usartHandleWrite(uint8_t port, int8_t bit, uint8_t value, uint8_
     }
 }
 
+uint8_t Atmega32::_handleUsartIrqs()
+{
+    // RXC stays set until UDR is read, so the ISR must read it
+    if (bit_is_set(this->ports[PORT_UCSRA], B_RXC) &&
+        bit_is_set(this->ports[PORT_UCSRB], B_RXCIE))
+        return IRQ_USART_RXC;
+    
+    return 0;
+}
+
 void Atmega32::onRS232Receive(uint8_t data)
 {
+    if (!bit_is_set(ports[PORT_UCSRB], B_RXEN))
+        return;
+    
+    if (bit_is_set(ports[PORT_UCSRA], B_RXC))
+        set_bit(ports[PORT_UCSRA], B_DOR);
+    else
+        _noteIrqRaised(IRQ_USART_RXC);
+    
+    this->_reg_UDR_rx = data;
+    set_bit(ports[PORT_UCSRA], B_RXC);
 }
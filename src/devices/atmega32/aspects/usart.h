@@ -4,10 +4,14 @@ public:
 
 protected:
     uint8_t _reg_UCSRC;
+    uint8_t _reg_UDR_rx;
     uint64_t _last_UBRRH_access;
 
     void _usartInit();
+    void _usartSaveState(StateWriter& out);
+    void _usartLoadState(StateReader& in);
     void _usartHandleRead(uint8_t port, int8_t bit, uint8_t &value);
     void _usartHandleWrite(uint8_t port, int8_t bit, uint8_t value, uint8_t prev_val, uint8_t cleared);
+    uint8_t _handleUsartIrqs();
     
     void onRS232Receive(uint8_t data);
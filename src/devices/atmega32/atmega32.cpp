@@ -7,6 +7,8 @@
 
 #include "utils/bit_macros.h"
 #include "utils/fail.h"
+#include "profiling/call_stack_profile.h"
+#include "profiling/isr_stats.h"
 #include "atmega32.h"
 #include "defs.h"
 
@@ -46,6 +48,9 @@ void Atmega32::_init(void)
     atmega32_core_init(&this->core, this);
     this->setFrequency(16000000ULL);
     
+    this->breakpoint_pc = -1;
+    this->breakpoint_cycle = UINT64_MAX;
+    
     this->ports = this->core.ram + IO_BASE;
     for (unsigned int i = 0; i < MEGA32_PORT_COUNT; i++) {
         this->port_metas[i].write_mask = 0xff;
@@ -66,7 +71,17 @@ void Atmega32::setFrequency(uint64_t frequency)
 
 void Atmega32::loadProgramFromElf(const char *filename)
 {
-    this->core.prog_mem.loadElf(filename);
+    loadProgram(FirmwareImage::load(filename, MEGA32_FLASH_SIZE));
+}
+
+/**
+ * Loads a firmware image that was built some other way (e.g. assembled in
+ * memory). The MCU should be reset afterwards.
+ */
+void Atmega32::loadProgram(shared_ptr<const FirmwareImage> firmware)
+{
+    this->core.firmware = firmware;
+    this->core.flash = this->core.firmware->flash;
 }
 
 void Atmega32::reset(void)
@@ -76,6 +91,11 @@ void Atmega32::reset(void)
     
     cycle_count = 0;
     
+    if (core.call_stack)
+        core.call_stack->reset();
+    if (core.isr_stats)
+        core.isr_stats->reset();
+    
     _twiInit();
     _spiInit();
     _usartInit();
@@ -97,6 +117,9 @@ void Atmega32::act(int event)
             
             atmega32_core_step(&core);
             cycle_count++;
+            
+            if ((core.pc == breakpoint_pc) || (cycle_count == breakpoint_cycle))
+                _hitBreakpoint();
 
             scheduleEventIn(SIM_EVENT_TICK, clock_period);
             break;
@@ -106,14 +129,217 @@ void Atmega32::act(int event)
     }
 }
 
+void Atmega32::saveState(StateWriter& out)
+{
+    out.put(core.pc);
+    out.put(core.last_inst_pc);
+    out.write(core.ram, RAM_SIZE);
+    
+    out.put(cycle_count);
+    
+    _twiSaveState(out);
+    _spiSaveState(out);
+    _usartSaveState(out);
+    _timersSaveState(out);
+    _pinsSaveState(out);
+    _adcSaveState(out);
+}
+
+void Atmega32::loadState(StateReader& in)
+{
+    in.get(core.pc);
+    in.get(core.last_inst_pc);
+    in.read(core.ram, RAM_SIZE);
+    
+    in.get(cycle_count);
+    
+    _twiLoadState(in);
+    _spiLoadState(in);
+    _usartLoadState(in);
+    _timersLoadState(in);
+    _pinsLoadState(in);
+    _adcLoadState(in);
+}
+
+/**
+ * Saves the state for a checkpoint, along with a hash of the program memory,
+ * so that the checkpoint is only ever loaded with the same firmware.
+ */
+void Atmega32::saveCheckpoint(StateWriter& out)
+{
+    out.put(core.firmware->flash_hash);
+    
+    saveState(out);
+}
+
+void Atmega32::loadCheckpoint(StateReader& in)
+{
+    uint64_t flash_hash;
+    in.get(flash_hash);
+    
+    if (flash_hash != core.firmware->flash_hash)
+        fail("Checkpoint was made with a different firmware for '%s'", id.c_str());
+    
+    loadState(in);
+}
+
 int Atmega32::getPC(void)
 {
     return this->core.pc;
 }
 
-Symbol* Atmega32::getProgramSymbol(int pc)
+const Symbol* Atmega32::getProgramSymbol(int pc)
+{
+    return this->core.firmware->flashSymbolAt(2 * pc);
+}
+
+int Atmega32::findProgramSymbolPC(const char *name)
+{
+    const Symbol *symbol = this->core.firmware->flashSymbolByName(name);
+    
+    return symbol ? symbol->address / 2 : -1;
+}
+
+uint64_t Atmega32::getCycleCount(void)
+{
+    return this->cycle_count;
+}
+
+const Symbol* Atmega32::findDataSymbol(const char *name)
+{
+    return this->core.firmware->ramSymbolByName(name);
+}
+
+int Atmega32::dataSize(void)
+{
+    return RAM_SIZE;
+}
+
+uint8_t Atmega32::peekData(int address)
+{
+    return this->core.ram[address];
+}
+
+void Atmega32::pokeData(int address, uint8_t value)
+{
+    this->core.ram[address] = value;
+}
+
+void Atmega32::setBreakpoint(int pc, SimCallback callback)
+{
+    this->breakpoint_pc = pc;
+    this->breakpoint_cycle = UINT64_MAX;
+    this->breakpoint_callback = move(callback);
+}
+
+void Atmega32::setCycleBreakpoint(uint64_t cycle, SimCallback callback)
+{
+    this->breakpoint_pc = -1;
+    this->breakpoint_cycle = cycle;
+    this->breakpoint_callback = move(callback);
+}
+
+void Atmega32::clearBreakpoint(void)
+{
+    this->breakpoint_pc = -1;
+    this->breakpoint_cycle = UINT64_MAX;
+    this->breakpoint_callback = SimCallback();
+}
+
+/**
+ * Makes the core record the edges it executes into the given map (of size
+ * ATMEGA32_COVERAGE_MAP_SIZE), or stop recording if it is NULL.
+ */
+void Atmega32::setCoverageMap(uint8_t *coverage_map)
+{
+    this->core.coverage_map = coverage_map;
+    _updateInstrumented();
+}
+
+/**
+ * Makes the simulation fail when the stack pointer goes below the given
+ * address (0 to disable).
+ */
+void Atmega32::setStackLimit(int address)
+{
+    this->core.stack_limit = address;
+    _updateInstrumented();
+}
+
+/**
+ * Makes the core count the cycles spent at each PC into the given array (of
+ * MEGA32_FLASH_SIZE counters), or stop counting if it is NULL.
+ */
+void Atmega32::setProfileCounts(uint64_t *counts)
+{
+    this->core.profile_counts = counts;
+    _updateInstrumented();
+}
+
+/**
+ * Makes the core report calls, returns, interrupts and cycles to the given
+ * call stack profile, or stop reporting if it is NULL.
+ */
+void Atmega32::setCallStackProfile(CallStackProfile *profile)
+{
+    this->core.call_stack = profile;
+    _updateInstrumented();
+}
+
+/**
+ * Makes the MCU report interrupts to the given statistics, or stop reporting
+ * if it is NULL.
+ */
+void Atmega32::setIsrStats(IsrStats *stats)
+{
+    this->core.isr_stats = stats;
+    _updateInstrumented();
+}
+
+const FirmwareImage& Atmega32::getFirmware(void)
+{
+    return *this->core.firmware;
+}
+
+void Atmega32::resetCoverageTrace(void)
+{
+    this->core.prev_location = 0;
+}
+
+/**
+ * Gets the address just past the last variable in the firmware's static data
+ * (i.e. the lowest address the stack may safely grow down to).
+ */
+int Atmega32::staticDataEnd(void)
+{
+    int end = 0;
+    
+    for (auto& sym : this->core.firmware->ram_syms)
+        end = max(end, sym.address + sym.length);
+    
+    return end;
+}
+
+void Atmega32::_updateInstrumented()
+{
+    this->core.instrumented = this->core.coverage_map || this->core.stack_limit ||
+        this->core.profile_counts || this->core.call_stack || this->core.isr_stats;
+}
+
+/**
+ * Called by the interrupt sources when they raise a flag that was clear.
+ */
+void Atmega32::_noteIrqRaised(uint8_t irq)
+{
+    if (this->core.isr_stats)
+        this->core.isr_stats->onRaise(irq, this->cycle_count);
+}
+
+void Atmega32::_hitBreakpoint()
 {
-    return this->core.prog_mem.flashSymbolAt(2 * pc);
+    this->breakpoint_pc = -1;
+    this->breakpoint_cycle = UINT64_MAX;
+    scheduleCallbackIn(0, move(this->breakpoint_callback));
 }
 
 void Atmega32::_handleIrqs()
@@ -124,11 +350,16 @@ void Atmega32::_handleIrqs()
         return;
     
     if ((irq = this->_handleTimerIrqs())) goto exec;
+    if ((irq = this->_handleUsartIrqs())) goto exec;
     if ((irq = this->_handleAdcIrqs())) goto exec;
     return;
 exec:
     set_flag(&this->core, FLAG_I, false);
     push_word(&this->core, this->core.pc);
+    if (this->core.call_stack)
+        this->core.call_stack->onCall(this->core.pc, _get16BitReg(REG16_SP));
+    if (this->core.isr_stats)
+        this->core.isr_stats->onEnter(irq, _get16BitReg(REG16_SP), this->cycle_count);
     this->core.pc = 2*(irq-1);
 }
 
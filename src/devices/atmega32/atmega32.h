@@ -49,13 +49,40 @@ public:
     Atmega32(Json::Value &json_data, EntityLookup *lookup);
     
     void loadProgramFromElf(const char *filename);
+    void loadProgram(shared_ptr<const FirmwareImage> firmware);
     void setFrequency(uint64_t frequency);
 
     virtual void reset(void);
     virtual void act(int event);
     
+    virtual void saveState(StateWriter& out);
+    virtual void loadState(StateReader& in);
+    virtual void saveCheckpoint(StateWriter& out);
+    virtual void loadCheckpoint(StateReader& in);
+    
     virtual int getPC(void);
-    virtual Symbol* getProgramSymbol(int pc);
+    virtual const Symbol* getProgramSymbol(int pc);
+    virtual int findProgramSymbolPC(const char *name);
+    virtual uint64_t getCycleCount(void);
+    
+    virtual const Symbol* findDataSymbol(const char *name);
+    virtual int dataSize(void);
+    virtual uint8_t peekData(int address);
+    virtual void pokeData(int address, uint8_t value);
+    
+    virtual void setBreakpoint(int pc, SimCallback callback);
+    virtual void setCycleBreakpoint(uint64_t cycle, SimCallback callback);
+    virtual void clearBreakpoint(void);
+    
+    void setCoverageMap(uint8_t *coverage_map);
+    void setStackLimit(int address);
+    void resetCoverageTrace(void);
+    int staticDataEnd(void);
+    
+    void setProfileCounts(uint64_t *counts);
+    void setCallStackProfile(CallStackProfile *profile);
+    void setIsrStats(IsrStats *stats);
+    const FirmwareImage& getFirmware(void);
 protected:
     uint64_t frequency;
     sim_time_t clock_period;
@@ -64,10 +91,17 @@ protected:
 
     Atmega32Core core;
     
+    int breakpoint_pc;
+    uint64_t breakpoint_cycle;
+    SimCallback breakpoint_callback;
+    
     uint8_t *ports; // shortcut
     Atmega32PortMeta port_metas[MEGA32_PORT_COUNT];
 
     void _init();
+    void _hitBreakpoint();
+    void _updateInstrumented();
+    void _noteIrqRaised(uint8_t irq);
 
     void _onPortRead(uint8_t port, int8_t bit, uint8_t &value);
     uint8_t _onPortPreWrite(uint8_t port, int8_t bit, uint8_t &value, uint8_t prev_val);
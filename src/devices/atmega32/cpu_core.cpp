@@ -1,9 +1,12 @@
 #include <inttypes.h>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 
 #include "utils/bit_macros.h"
 #include "utils/fail.h"
+#include "profiling/call_stack_profile.h"
+#include "profiling/isr_stats.h"
 #include "atmega32.h"
 #include "cpu_core.h"
 #include "defs.h"
@@ -11,7 +14,7 @@
 typedef void (*inst_fn_t)(Atmega32Core*, uint16_t);
 
 static inst_fn_t fn_table[65536];
-static bool fn_table_initialized = false;
+static once_flag fn_table_initialized;
 
 static inline bool is_double_width_instruction(uint16_t opcode)
 {
@@ -114,7 +117,7 @@ static uint8_t read_mem(Atmega32Core *core, int addr)
 static void write_mem(Atmega32Core *core, int addr, uint8_t value)
 {
     if (addr >= RAM_SIZE)
-        fail("Read from invalid address (%04x)", addr);
+        fail("Write to invalid address (%04x)", addr);
         
     if (addr < IO_BASE)  {
         write_reg(core, addr, value);
@@ -127,11 +130,11 @@ static void write_mem(Atmega32Core *core, int addr, uint8_t value)
 static uint16_t fetch_next_opcode(Atmega32Core *core)
 {
     if (core->pc >= MEGA32_FLASH_SIZE) {
-        fail("Attempted fetch from invalid address %s%04x (last instr fetched at %04x)",
+        fail("Attempted fetch from invalid address %04x (last instr fetched at %04x)",
             core->pc, core->last_inst_pc);
     }
     
-    uint16_t opcode = core->prog_mem.flash[core->pc++];
+    uint16_t opcode = core->flash[core->pc++];
 
     return opcode;
 }
@@ -186,6 +189,31 @@ static uint16_t pop_word(Atmega32Core *core)
     return (pop(core) << 8) + pop(core);
 }
 
+/**
+ * Reports a call (whose return address was just pushed) to the call stack
+ * profile, if any.
+ */
+static inline void track_call(Atmega32Core *core)
+{
+    if (__builtin_expect(core->instrumented, 0) && core->call_stack)
+        core->call_stack->onCall(core->last_inst_pc, read_16bit_reg(core, REG16_SP));
+}
+
+/**
+ * Reports a return (whose address was just popped) to the call stack profile
+ * and the interrupt statistics, if any. The returning instruction counts as
+ * part of the function it returns from.
+ */
+static inline void track_return(Atmega32Core *core)
+{
+    if (__builtin_expect(core->instrumented, 0)) {
+        if (core->call_stack)
+            core->call_stack->onReturn(read_16bit_reg(core, REG16_SP));
+        if (core->isr_stats)
+            core->isr_stats->onReturn(read_16bit_reg(core, REG16_SP), core->master->getCycleCount() + 1);
+    }
+}
+
 static void do_load_store(Atmega32Core *core, uint8_t addr_reg, uint16_t displ,
     uint8_t dest_reg, uint8_t incrementing, bool store)
 {
@@ -209,7 +237,7 @@ static void load_prog_mem(Atmega32Core *core, uint8_t dest_reg, bool post_increm
     if (extended)
         fail("Extended LPM not supported");
 
-    core->ram[dest_reg] = core->prog_mem.readByte(z);
+    core->ram[dest_reg] = core->firmware->readByte(z);
     
     if (post_increment)
         write_16bit_reg(core, REG16_Z, z+1);
@@ -508,8 +536,10 @@ static void exec_long_jump(Atmega32Core *core, uint16_t opcode)
 
     int addr = fetch_next_opcode(core);
     
-    if (ins->call)
+    if (ins->call) {
         push_word(core, core->pc);
+        track_call(core);
+    }
     
     do_jump(core, addr + (ins->addr_l << 16) + (ins->addr_h << 17));
 }
@@ -589,8 +619,10 @@ static void exec_indirect_jump(Atmega32Core *core, uint16_t opcode)
     if (ins->extended)
         fail("Extended IJMP/ICALL not supported");
     
-    if (ins->call)
+    if (ins->call) {
         push_word(core, core->pc);
+        track_call(core);
+    }
     
     do_jump(core, read_16bit_reg(core, REG16_Z));
 }
@@ -604,6 +636,7 @@ static void exec_return(Atmega32Core *core, uint16_t opcode)
     } *ins = (inst *)&opcode;
     
     uint16_t addr = pop_word(core);
+    track_return(core);
     
     do_jump(core, addr);
     
@@ -730,8 +763,10 @@ static void exec_relative_jump(Atmega32Core *core, uint16_t opcode)
         unsigned : 3;
     } *ins = (inst *)&opcode;
     
-    if (ins->call)
+    if (ins->call) {
         push_word(core, core->pc);
+        track_call(core);
+    }
 
     do_rel_jump(core, (int)ins->displ);
 }
@@ -783,9 +818,6 @@ static void exec_not_implemented(Atmega32Core *core, uint16_t opcode)
 
 static void init_fn_table()
 {
-    if (fn_table_initialized)
-        return;
-    
     for (int op = 0; op < 65536; op++) {
         inst_fn_t fn = exec_not_implemented;
         
@@ -835,21 +867,46 @@ static void init_fn_table()
         
         fn_table[op] = fn;
     }
-    
-    fn_table_initialized = true;
 }
 
 void atmega32_core_init(Atmega32Core *core, Atmega32 *master)
 {
-    init_fn_table();
+    // Several simulations may be set up at once in different threads
+    call_once(fn_table_initialized, init_fn_table);
 
     core->master = master;
 }
 
+/**
+ * Records the edge from the previous instruction to the current one in the
+ * coverage map (AFL-style), counts the cycle against the current PC for the
+ * profiler, and checks the stack pointer against its limit.
+ */
+static void instrument_step(Atmega32Core *core)
+{
+    if (core->profile_counts)
+        core->profile_counts[core->pc]++;
+    if (core->call_stack)
+        core->call_stack->countCycle(core->pc);
+    
+    if (core->coverage_map) {
+        uint16_t location = (core->pc * 0x9e37) ^ (core->pc >> 5);
+        
+        core->coverage_map[location ^ core->prev_location]++;
+        core->prev_location = location >> 1;
+    }
+    
+    if (read_16bit_reg(core, REG16_SP) < core->stack_limit)
+        fail("Stack overflow (SP=%04x) at %04x", read_16bit_reg(core, REG16_SP), core->pc);
+}
+
 void atmega32_core_step(Atmega32Core *core)
 {
     core->last_inst_pc = core->pc;
     
+    if (__builtin_expect(core->instrumented, 0))
+        instrument_step(core);
+    
     uint16_t op = fetch_next_opcode(core);
     
     fn_table[op](core, op);
@@ -2,19 +2,39 @@
 #define _H_ATMEGA32_CORE_H
 
 #include <inttypes.h>
+#include <memory>
 
-#include "devices/mcu/progmem.h"
+#include "devices/mcu/firmware_image.h"
 
 class Atmega32;
+class CallStackProfile;
+class IsrStats;
+
+#define ATMEGA32_COVERAGE_MAP_SIZE  65536
 
 struct Atmega32Core {
     int pc;
     uint8_t ram[0x0860];
     Atmega32 *master;
     int last_inst_pc;
-    ProgMem prog_mem;
-
-    Atmega32Core() : prog_mem(0x4000) {}
+    
+    // Instrumentation for fuzzing and profiling (off unless instrumented
+    // is set)
+    bool instrumented;
+    uint8_t *coverage_map;
+    uint16_t prev_location;
+    int stack_limit;
+    uint64_t *profile_counts;
+    CallStackProfile *call_stack;
+    IsrStats *isr_stats;
+    
+    // Shared with all other MCUs running the same firmware
+    shared_ptr<const FirmwareImage> firmware;
+    const uint16_t *flash; // shortcut
+
+    Atmega32Core() : instrumented(false), coverage_map(NULL), prev_location(0),
+        stack_limit(0), profile_counts(NULL), call_stack(NULL),
+        isr_stats(NULL), firmware(FirmwareImage::blank(0x4000)), flash(firmware->flash) {}
 };
 
 void atmega32_core_init(Atmega32Core *core, Atmega32 *master);
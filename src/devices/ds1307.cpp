@@ -91,11 +91,9 @@ void Ds1307::init(bool init_with_current_time)
     if (loadNVRAM())
         saveNVRAM();
     
-    if (init_with_current_time) {
-        setTime(time(NULL));
-        clear_bit(nvram[REG_SECONDS], B_CH);
-        saveNVRAM();
-    }
+    // The host clock is read once the device is part of a simulation, so
+    // that the reading can be journaled
+    pending_clock_init = init_with_current_time;
     
     reset();
 }
@@ -112,9 +110,37 @@ void Ds1307::reset()
     time_modified = false;
     reg_pointer = 0;
     
+    if (pending_clock_init && simulation) {
+        setTime(simulation->journal.query(this, []() { return time(NULL); }));
+        clear_bit(nvram[REG_SECONDS], B_CH);
+        saveNVRAM();
+        
+        pending_clock_init = false;
+    }
+    
     resetDividerChain();
 }
 
+void Ds1307::saveState(StateWriter& out)
+{
+    out.put(i2c_listening);
+    out.put(receiving_address);
+    out.put(reg_pointer);
+    out.put(time_modified);
+    out.put(nvram);
+    out.put(cached_time);
+}
+
+void Ds1307::loadState(StateReader& in)
+{
+    in.get(i2c_listening);
+    in.get(receiving_address);
+    in.get(reg_pointer);
+    in.get(time_modified);
+    in.get(nvram);
+    in.get(cached_time);
+}
+
 void Ds1307::i2cReceiveStart()
 {
     i2c_listening = false;
@@ -128,7 +154,8 @@ void Ds1307::i2cReceiveStop()
     if (time_modified) {
         time_t time_val = getTimeAndCheck();
         
-        struct tm date = *localtime(&time_val);
+        struct tm date;
+        localtime_r(&time_val, &date);
         
         info("RTC time modified: %04d-%02d-%02d %02d:%02d:%02d",
             1900 + date.tm_year, date.tm_mon + 1, date.tm_mday,
@@ -212,9 +239,9 @@ void Ds1307::setTime(time_t unix_time)
 {
     time_t old_time;
     bool valid = getTime(old_time);
-    struct tm old_cal_time = *localtime(&old_time);
-        
-    struct tm cal_time = *localtime(&unix_time);
+    struct tm old_cal_time, cal_time;
+    localtime_r(&old_time, &old_cal_time);
+    localtime_r(&unix_time, &cal_time);
     
     bcd_write(nvram[REG_SECONDS], 0x7f, cal_time.tm_sec);
     bcd_write(nvram[REG_MINUTES], 0xff, cal_time.tm_min);
@@ -6,12 +6,13 @@
 
 #include "simulation/entity.h"
 #include "simulation/sim_device.h"
+#include "simulation/input_journal.h"
 #include "glue/i2c_device.h"
 #include "devices/device.h"
 
 #define DS1307_NVRAM_SIZE  64
 
-class Ds1307 : public Entity, public I2cDevice, public SimulatedDevice {
+class Ds1307 : public Entity, public I2cDevice, public SimulatedDevice, public JournaledDevice {
 public:
     Ds1307(uint8_t i2c_address);
     Ds1307(uint8_t i2c_address, string backing_file_name);
@@ -21,6 +22,9 @@ public:
     virtual void reset();
     virtual void act(int event);
     
+    virtual void saveState(StateWriter& out);
+    virtual void loadState(StateReader& in);
+    
     virtual void i2cReceiveStart();
     virtual bool i2cReceiveAddress(uint8_t address, bool write);
     virtual bool i2cReceiveData(uint8_t data);
@@ -39,6 +43,7 @@ private:
     uint8_t cached_time[7];
     
     string backing_file_name;
+    bool pending_clock_init;
     
     void init(bool init_with_current_time);
     void tick(void);
@@ -22,8 +22,6 @@ using namespace std;
 #define STATE_RECEIVING_BUFFER_DATA         4
 #define STATE_RESPONDING_WITH_BUFFER_DATA   5
 
-const sim_time_t DEFAULT_RECEIVE_FRAMES_INTERVAL = ms_to_sim_time(100);
-
 #define PADDING_NONE                  0
 #define PADDING_AUTODETECT           -1
 
@@ -65,7 +63,34 @@ void Enc28J60::reset()
     memset(this->eth_buffer, 0, E28J_ETH_BUFFER_SIZE);
     
     unscheduleAll();
-    scheduleEventIn(SIM_EVENT_RECEIVE_FRAMES, DEFAULT_RECEIVE_FRAMES_INTERVAL);
+}
+
+void Enc28J60::saveState(StateWriter& out)
+{
+    out.put(this->regs);
+    out.put(this->phy_regs);
+    out.put(this->eth_buffer);
+    out.put(this->reg_ERXRDPTL_shadow);
+    out.put(this->full_duplex_wired);
+    out.put(this->link_up);
+    out.put(this->state);
+    out.put(this->cmd_byte);
+    out.put(this->response_byte);
+    out.put(this->spi_selected);
+}
+
+void Enc28J60::loadState(StateReader& in)
+{
+    in.get(this->regs);
+    in.get(this->phy_regs);
+    in.get(this->eth_buffer);
+    in.get(this->reg_ERXRDPTL_shadow);
+    in.get(this->full_duplex_wired);
+    in.get(this->link_up);
+    in.get(this->state);
+    in.get(this->cmd_byte);
+    in.get(this->response_byte);
+    in.get(this->spi_selected);
 }
 
 void Enc28J60::setFullDuplexWired(bool wired)
@@ -96,25 +121,9 @@ mac_addr_t Enc28J60::getMacAddress(void) const
     return mac_addr_t(buffer, 6);
 }
 
-void Enc28J60::act(int event)
+void Enc28J60::onReceiveFrame(const EthernetFrame& frame)
 {
-    switch (event) {
-        case SIM_EVENT_RECEIVE_FRAMES:
-            doReceiveFrames();
-            scheduleEventIn(SIM_EVENT_RECEIVE_FRAMES, DEFAULT_RECEIVE_FRAMES_INTERVAL);
-            break;
-    }
-}
-
-void Enc28J60::doReceiveFrames(void)
-{
-    while (true) {
-        EthernetFrame frame = this->getPendingFrame();
-        if (frame.is_null)
-            return;
-        
-        this->doReceiveFrame(frame);
-    }
+    this->doReceiveFrame(frame);
 }
 
 void Enc28J60::doReceiveFrame(const EthernetFrame& frame)
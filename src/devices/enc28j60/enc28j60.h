@@ -27,13 +27,14 @@ public:
     Enc28J60(Json::Value &json_data);
         
     virtual void reset();
-    virtual void act(int event);
+    virtual void saveState(StateWriter& out);
+    virtual void loadState(StateReader& in);
+    
     void setFullDuplexWired(bool wired);
     void setLinkUp(bool link_up);
     
     mac_addr_t getMacAddress(void) const;
     
-    void doReceiveFrames(void);
     bool spiReceiveData(uint8_t &data);
 private:
     uint8_t regs[E28J_REGS_COUNT];
@@ -61,6 +62,7 @@ private:
     void checkFinalTxFrameLength(const EthernetFrame& frame, bool allow_huge,
         uint64_t& tx_status);
 
+    virtual void onReceiveFrame(const EthernetFrame& frame);
     void doReceiveFrame(const EthernetFrame& frame);
     bool receptionEnabled(void) const;
     bool filterFrame(const EthernetFrame& frame) const;
@@ -0,0 +1,227 @@
+#include <inttypes.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <ctype.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "utils/bit_macros.h"
+#include "utils/fail.h"
+#include "utils/hash.h"
+#include "firmware_image.h"
+
+using namespace std;
+
+static mutex image_cache_lock;
+static map<string, weak_ptr<const FirmwareImage>> image_cache;
+
+FirmwareImage::FirmwareImage(unsigned int flash_size) : flash_size(flash_size)
+{
+    this->clear();
+}
+
+void FirmwareImage::clear()
+{
+    memset(this->flash, 0xFF, 2*this->flash_size);
+    this->flash_hash = fnv1a_64(this->flash, 2*this->flash_size);
+    this->flash_syms.clear();
+    this->ram_syms.clear();
+}
+
+/**
+ * Gets the image of a firmware file, loading it only if no other MCU is
+ * using it already. The file's modification time is part of its identity,
+ * so that a rebuilt firmware is picked up.
+ */
+shared_ptr<const FirmwareImage> FirmwareImage::load(const char *filename, unsigned int flash_size)
+{
+    struct stat file_info;
+    char real_path[PATH_MAX];
+    
+    if ((stat(filename, &file_info) < 0) || !realpath(filename, real_path))
+        fail("Cannot open firmware file '%s'", filename);
+    
+    string key = string(real_path) + "@" + to_string(file_info.st_mtime) + "/" +
+        to_string(file_info.st_size) + "/" + to_string(flash_size);
+    
+    lock_guard<mutex> guard(image_cache_lock);
+    
+    shared_ptr<const FirmwareImage> image = image_cache[key].lock();
+    if (!image) {
+        shared_ptr<FirmwareImage> new_image = make_shared<FirmwareImage>(flash_size);
+        new_image->loadElf(filename);
+        
+        image = new_image;
+        image_cache[key] = image;
+    }
+    
+    return image;
+}
+
+/**
+ * Gets an image of erased flash, for MCUs that have no firmware loaded.
+ */
+shared_ptr<const FirmwareImage> FirmwareImage::blank(unsigned int flash_size)
+{
+    string key = "@blank/" + to_string(flash_size);
+    
+    lock_guard<mutex> guard(image_cache_lock);
+    
+    shared_ptr<const FirmwareImage> image = image_cache[key].lock();
+    if (!image) {
+        image = make_shared<FirmwareImage>(flash_size);
+        image_cache[key] = image;
+    }
+    
+    return image;
+}
+
+void FirmwareImage::loadElf(const char *filename)
+{
+    this->clear();
+    
+    ELFIO::elfio elf;
+    
+    if (!elf.load(filename))
+        fail("Cannot open file '%s' as ELF", filename);
+    if (elf.get_class() != ELFCLASS32)
+        fail("Invalid ELF class (expected ELFCLASS32)");
+
+    this->_processElfSections(elf);
+    this->_loadProgramSegments(elf);
+    
+    this->flash_hash = fnv1a_64(this->flash, 2*this->flash_size);
+}
+
+uint8_t FirmwareImage::readByte(unsigned int byte_addr) const
+{
+    if (byte_addr >= 2*this->flash_size)
+        fail("LPM from invalid program memory address (%04x)", byte_addr);
+    
+    return (byte_addr & 1) ?
+        high_byte(this->flash[byte_addr >> 1]) :
+        low_byte(this->flash[byte_addr >> 1]);
+}
+
+const Symbol * FirmwareImage::flashSymbolAt(int flash_byte_addr) const
+{
+    call_once(this->indices_built, &FirmwareImage::_buildIndices, this);
+    
+    return this->flash_index.symbolAt(flash_byte_addr);
+}
+
+const Symbol * FirmwareImage::ramSymbolAt(int ram_vaddr) const
+{
+    call_once(this->indices_built, &FirmwareImage::_buildIndices, this);
+    
+    return this->ram_index.symbolAt(ram_vaddr);
+}
+
+const Symbol * FirmwareImage::flashSymbolByName(const char *name) const
+{
+    call_once(this->indices_built, &FirmwareImage::_buildIndices, this);
+    
+    return this->flash_index.symbolByName(name);
+}
+
+const Symbol * FirmwareImage::ramSymbolByName(const char *name) const
+{
+    call_once(this->indices_built, &FirmwareImage::_buildIndices, this);
+    
+    return this->ram_index.symbolByName(name);
+}
+
+void FirmwareImage::dumpFlashSyms() const
+{
+    for (vector<Symbol>::const_iterator it = this->flash_syms.begin(); it != this->flash_syms.end(); it++) {
+        it->dump();
+    }
+}
+
+void FirmwareImage::dumpRamSyms() const
+{
+    for (vector<Symbol>::const_iterator it = this->ram_syms.begin(); it != this->ram_syms.end(); it++) {
+        it->dump();
+    }
+}
+
+void FirmwareImage::_processElfSections(ELFIO::elfio& elf)
+{
+    for (unsigned int i = 0; i < elf.sections.size(); i++) {
+        if (elf.sections[i]->get_type() == SHT_SYMTAB)
+            this->_processElfSymbolTable(elf, elf.sections[i]);
+    }
+}
+
+void FirmwareImage::_processElfSymbolTable(ELFIO::elfio& elf, ELFIO::section* section)
+{
+    const ELFIO::symbol_section_accessor symbols(elf, section);
+    
+    for (unsigned int i = 0; i < symbols.get_symbols_num(); i++) {
+        std::string name;
+        ELFIO::Elf64_Addr value = 0;
+        ELFIO::Elf_Xword size = 0;
+        unsigned char bind;
+        unsigned char type = 0;
+        ELFIO::Elf_Half section_index;
+        unsigned char other;
+        
+        symbols.get_symbol(i, name, value, size, bind, type, section_index, other);
+        
+        switch (type) {
+            case STT_FUNC:
+                this->flash_syms.push_back(Symbol(name.c_str(), value, size, false));
+                break;
+            case STT_OBJECT:
+                if (value >= 0x100000) {
+                    this->ram_syms.push_back(Symbol(name.c_str(), value & 0xfffff, size, true));
+                } else {
+                    this->flash_syms.push_back(Symbol(name.c_str(), value, size, true));
+                }
+                break;
+        }
+    }
+    
+    sort(this->flash_syms.begin(), this->flash_syms.end());
+    sort(this->ram_syms.begin(), this->ram_syms.end());
+}
+
+void FirmwareImage::_loadProgramSegments(ELFIO::elfio& elf)
+{
+    bool exec_found = false;
+
+    for (unsigned int i = 0; i < elf.segments.size(); i++) {
+        const ELFIO::segment* seg = elf.segments[i];
+        
+        unsigned int ph_addr = seg->get_physical_address();
+        unsigned int seg_size = seg->get_file_size();
+        
+        if (seg->get_type() != PT_LOAD) continue;
+        if (seg_size == 0) continue; // ignore .bss
+        
+        if (ph_addr & 1)
+            fail("ELF segment #%d starts at odd address (%04x)", i, ph_addr);
+        if (ph_addr + seg_size > 2*this->flash_size)
+            fail("ELF segment #%d too long (addr=%04x, length=%d bytes)",
+                i, ph_addr, seg_size);
+        
+        memcpy(this->flash + ph_addr/2, seg->get_data(), seg_size);
+        
+        exec_found |= (seg->get_flags() & PF_X);
+    }
+    
+    if (!exec_found)
+        fail("No executable section found");
+}
+
+void FirmwareImage::_buildIndices() const
+{
+    this->flash_index.build(this->flash_syms);
+    this->ram_index.build(this->ram_syms);
+}
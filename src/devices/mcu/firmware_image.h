@@ -0,0 +1,64 @@
+#ifndef _H_FIRMWARE_IMAGE_H
+#define _H_FIRMWARE_IMAGE_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <inttypes.h>
+
+#include <elfio/elfio.hpp>
+
+#include "symbol.h"
+#include "symbol_index.h"
+
+using namespace std;
+
+#define FIRMWARE_MAX_FLASH_SIZE 65536
+
+/**
+ * The program memory contents and symbols of a firmware, as loaded from an
+ * ELF file.
+ * 
+ * Images are not modified once loaded, so MCUs running the same firmware
+ * share one (see load()). A simulation of many identical boards thus holds
+ * only one copy of the flash and the symbols.
+ * 
+ * The symbol lookup indices are built on first use, since many runs never
+ * look up a symbol.
+ */
+class FirmwareImage {
+public:
+    FirmwareImage(unsigned int flash_size);
+    
+    static shared_ptr<const FirmwareImage> load(const char *filename, unsigned int flash_size);
+    static shared_ptr<const FirmwareImage> blank(unsigned int flash_size);
+    
+    uint8_t readByte(unsigned int byte_addr) const;
+    const Symbol *flashSymbolAt(int flash_byte_addr) const;
+    const Symbol *ramSymbolAt(int ram_vaddr) const;
+    const Symbol *flashSymbolByName(const char *name) const;
+    const Symbol *ramSymbolByName(const char *name) const;
+    void dumpFlashSyms() const;
+    void dumpRamSyms() const;
+
+    uint16_t flash[FIRMWARE_MAX_FLASH_SIZE];
+    const unsigned int flash_size;
+    uint64_t flash_hash;
+
+    vector<Symbol> flash_syms;
+    vector<Symbol> ram_syms;
+private:
+    void clear();
+    void loadElf(const char *filename);
+    
+    void _processElfSections(ELFIO::elfio& elf);
+    void _processElfSymbolTable(ELFIO::elfio& elf, ELFIO::section* section);
+    void _loadProgramSegments(ELFIO::elfio& elf);
+    void _buildIndices() const;
+
+    mutable once_flag indices_built;
+    mutable SymbolIndex flash_index;
+    mutable SymbolIndex ram_index;
+};
+
+#endif
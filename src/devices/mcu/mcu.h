@@ -1,12 +1,35 @@
 #ifndef _H_MCU_H
 #define _H_MCU_H
 
+#include <inttypes.h>
+
 #include "symbol.h"
+#include "simulation/sim_callback.h"
 
 class Mcu {
 public:
     virtual int getPC(void) = 0;
-    virtual Symbol* getProgramSymbol(int pc) = 0;
+    virtual const Symbol* getProgramSymbol(int pc) = 0;
+    virtual int findProgramSymbolPC(const char *name) = 0;
+    virtual uint64_t getCycleCount(void) = 0;
+    
+    /**
+     * Direct access to the data address space (registers, I/O and SRAM),
+     * bypassing any side effects of I/O registers.
+     */
+    virtual const Symbol* findDataSymbol(const char *name) = 0;
+    virtual int dataSize(void) = 0;
+    virtual uint8_t peekData(int address) = 0;
+    virtual void pokeData(int address, uint8_t value) = 0;
+    
+    /**
+     * Arranges for a callback to be scheduled (once) as soon as the MCU is
+     * about to execute the instruction at the given PC. Being a separate
+     * event, it may safely snapshot or checkpoint the simulation.
+     */
+    virtual void setBreakpoint(int pc, SimCallback callback) = 0;
+    virtual void setCycleBreakpoint(uint64_t cycle, SimCallback callback) = 0;
+    virtual void clearBreakpoint(void) = 0;
 };
 
 #endif
@@ -4,7 +4,7 @@
 
 using namespace std;
 
-void Symbol::dump()
+void Symbol::dump() const
 {
     printf("%c %-32s @ %04x : %04x\n", this->is_data ? 'D' : 'C',
         this->name.c_str(), this->address, this->length);
@@ -9,7 +9,7 @@ class Symbol {
 public:
     Symbol(const char *name, int address, int length, bool is_data) :
         name(name), address(address), length(length), is_data(is_data) { }
-    void dump();
+    void dump() const;
     bool operator< (const Symbol &other) const;
 
     string name;
@@ -0,0 +1,86 @@
+#include <cstring>
+#include <algorithm>
+#include <climits>
+#include <map>
+
+#include "symbol_index.h"
+
+using namespace std;
+
+SymbolIndex::SymbolIndex(void) : last_hit(0)
+{
+}
+
+/**
+ * Indexes the given symbols, which must be sorted.
+ */
+void SymbolIndex::build(const vector<Symbol>& symbols)
+{
+    // Paint the symbols over each other in order; each key starts a range
+    // that extends to the next key
+    map<int, const Symbol *> ranges;
+    ranges[INT_MIN] = NULL;
+    
+    for (auto& symbol : symbols) {
+        if (symbol.length <= 0)
+            continue;
+        
+        int start = symbol.address;
+        int end = symbol.address + symbol.length;
+        
+        auto after = ranges.upper_bound(end);
+        const Symbol *resumed = prev(after)->second;
+        
+        ranges.erase(ranges.lower_bound(start), after);
+        ranges[start] = &symbol;
+        ranges[end] = resumed;
+    }
+    
+    range_starts.clear();
+    range_symbols.clear();
+    for (auto& range : ranges) {
+        // Merge ranges covered by the same symbol
+        if (!range_symbols.empty() && (range_symbols.back() == range.second))
+            continue;
+        
+        range_starts.push_back(range.first);
+        range_symbols.push_back(range.second);
+    }
+    
+    by_name.clear();
+    for (auto& symbol : symbols)
+        by_name.push_back(&symbol);
+    
+    // Of several symbols with the same name, the first one by address wins
+    stable_sort(by_name.begin(), by_name.end(), [](const Symbol *a, const Symbol *b) {
+        return a->name < b->name;
+    });
+    
+    last_hit = 0;
+}
+
+const Symbol *SymbolIndex::symbolAt(int address) const
+{
+    size_t index = last_hit.load(memory_order_relaxed);
+    
+    if ((index >= range_starts.size()) || (address < range_starts[index]) ||
+        ((index + 1 < range_starts.size()) && (address >= range_starts[index + 1]))) {
+        if (range_starts.empty())
+            return NULL;
+        
+        index = upper_bound(range_starts.begin(), range_starts.end(), address) -
+            range_starts.begin() - 1;
+        last_hit.store(index, memory_order_relaxed);
+    }
+    
+    return range_symbols[index];
+}
+
+const Symbol *SymbolIndex::symbolByName(const char *name) const
+{
+    auto it = lower_bound(by_name.begin(), by_name.end(), name, [](const Symbol *a, const char *name) {
+        return strcmp(a->name.c_str(), name) < 0;
+    });
+    
+    return ((it != by_name.end()) && ((*it)->name == name)) ? *it : NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef _H_SYMBOL_INDEX_H
+#define _H_SYMBOL_INDEX_H
+
+#include <atomic>
+#include <vector>
+
+#include "symbol.h"
+
+using namespace std;
+
+/**
+ * Finds the symbols of a firmware by address and by name, in O(log n).
+ *
+ * The symbols are flattened into a sorted list of disjoint address ranges,
+ * each covered by (at most) one symbol: where symbols overlap, the one that
+ * comes later in their sort order wins, as nested symbols come after the
+ * ones containing them. Lookups by address first check the range found by
+ * the previous lookup, as they tend to hit the same function repeatedly.
+ *
+ * The symbols must not be moved or changed after build().
+ */
+class SymbolIndex {
+public:
+    SymbolIndex(void);
+
+    void build(const vector<Symbol>& symbols);
+
+    const Symbol *symbolAt(int address) const;
+    const Symbol *symbolByName(const char *name) const;
+private:
+    vector<int> range_starts;
+    vector<const Symbol *> range_symbols;
+    vector<const Symbol *> by_name;
+
+    mutable atomic<size_t> last_hit;
+};
+
+#endif
@@ -3,9 +3,13 @@
 #include <cstring>
 #include <algorithm>
 #include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "utils/bit_macros.h"
 #include "utils/fail.h"
+#include "utils/hash.h"
+#include "profiling/trace_events.h"
 #include "sd_card.h"
 
 using namespace std;
@@ -99,6 +103,25 @@ void SdCard::init(const char *backing_file_name, unsigned capacity)
         fail("SD capacity must be a multiple of 512 bytes");
     this->capacity = capacity;
     
+    openBackingFile(backing_file_name);
+    
+    buffer_writes = false;
+    overlay_len = 0;
+    
+    spi_selected = false;
+    block_op_started_at = SIM_TIME_NEVER;
+    reset();
+}
+
+SdCard::~SdCard()
+{
+    flushWrites();
+    fclose(backing_file);
+}
+
+void SdCard::openBackingFile(const char *backing_file_name)
+{
+    this->backing_file_name = backing_file_name;
     backing_file = fopen(backing_file_name, "rb+");
     if (!backing_file)
         fail("Cannot open SD card backing file '%s'", backing_file_name);
@@ -106,8 +129,31 @@ void SdCard::init(const char *backing_file_name, unsigned capacity)
         fail("Cannot seek in SD card backing file '%s'", backing_file_name);
     backing_file_len = ftell(backing_file);
     
-    spi_selected = false;
-    reset();
+    image_hash_valid = false;
+}
+
+SdImageIdentity SdCard::imageIdentity(void)
+{
+    struct stat st;
+    
+    fflush(backing_file);
+    if (fstat(fileno(backing_file), &st) < 0)
+        fail("Cannot stat SD card backing file '%s'", backing_file_name.c_str());
+    
+    return { (uint64_t)st.st_dev, (uint64_t)st.st_ino, (uint64_t)st.st_size,
+        (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec };
+}
+
+/**
+ * Switches the card to a different backing file, as if it were swapped for
+ * another card. Any writes held in memory are dropped.
+ */
+void SdCard::changeImage(const char *backing_file_name)
+{
+    discardWrites();
+    fclose(backing_file);
+    
+    openBackingFile(backing_file_name);
 }
 
 void SdCard::reset()
@@ -120,6 +166,205 @@ void SdCard::reset()
     block_size = 512;
 }
 
+/**
+ * Saves the state of the card, including its contents as far as they differ
+ * from the backing file.
+ * 
+ * Note that from the first time this is called, writes are no longer
+ * committed to the backing file immediately, but held in memory until
+ * flushWrites() is called (at the latest, when the card is destroyed), so
+ * that the state can be restored to any point since.
+ */
+void SdCard::saveState(StateWriter& out)
+{
+    buffer_writes = true;
+    
+    out.put(in_sd_mode);
+    out.put(idle);
+    out.put(receiving_command);
+    out.put(expecting_acmd);
+    out.put(responding);
+    out.put(responding_with_data);
+    out.put(receiving_write_data);
+    out.put(substate);
+    out.put(flags);
+    out.put(cmd_buffer);
+    out.put(response);
+    out.put(response_length);
+    out.put(read_block_buffer);
+    out.put(read_block_crc);
+    out.put(write_block_addr);
+    out.put(write_block_buffer);
+    out.put(write_block_crc);
+    out.put(crc_enabled);
+    out.put(block_size);
+    out.put(spi_selected);
+    
+    out.put(overlay_len);
+    out.put((uint32_t)write_overlay.size());
+    for (auto& sector : write_overlay) {
+        out.put(sector.first);
+        out.write(sector.second.data(), SDCARD_SECTOR_SIZE);
+    }
+}
+
+void SdCard::loadState(StateReader& in)
+{
+    buffer_writes = true;
+    
+    in.get(in_sd_mode);
+    in.get(idle);
+    in.get(receiving_command);
+    in.get(expecting_acmd);
+    in.get(responding);
+    in.get(responding_with_data);
+    in.get(receiving_write_data);
+    in.get(substate);
+    in.get(flags);
+    in.get(cmd_buffer);
+    in.get(response);
+    in.get(response_length);
+    in.get(read_block_buffer);
+    in.get(read_block_crc);
+    in.get(write_block_addr);
+    in.get(write_block_buffer);
+    in.get(write_block_crc);
+    in.get(crc_enabled);
+    in.get(block_size);
+    in.get(spi_selected);
+    
+    uint32_t sector_count;
+    
+    in.get(overlay_len);
+    in.get(sector_count);
+    
+    write_overlay.clear();
+    for (uint32_t i = 0; i < sector_count; i++) {
+        unsigned sector;
+        in.get(sector);
+        
+        vector<uint8_t>& data = write_overlay[sector];
+        data.resize(SDCARD_SECTOR_SIZE);
+        in.read(data.data(), SDCARD_SECTOR_SIZE);
+    }
+}
+
+/**
+ * Saves the state of the card for a checkpoint.
+ * 
+ * Rather than storing the contents of the card, this commits them to the
+ * backing file and records its identity and hash, so that when the checkpoint
+ * is loaded we can check that the image is still the same.
+ */
+void SdCard::saveCheckpoint(StateWriter& out)
+{
+    flushWrites();
+    
+    uint64_t hash = imageHash();
+    
+    out.put(backing_file_len);
+    out.put(hashed_identity);
+    out.put(hash);
+    
+    saveState(out);
+}
+
+void SdCard::loadCheckpoint(StateReader& in)
+{
+    unsigned saved_len;
+    SdImageIdentity saved_identity;
+    uint64_t saved_hash;
+    
+    in.get(saved_len);
+    in.get(saved_identity);
+    in.get(saved_hash);
+    
+    flushWrites();
+    
+    // An untouched image need not be read again; one that was copied or
+    // rewritten may still have the same contents
+    if ((saved_len == backing_file_len) && (saved_identity == imageIdentity())) {
+        image_hash = saved_hash;
+        hashed_identity = saved_identity;
+        image_hash_valid = true;
+    }
+    
+    if ((saved_len != backing_file_len) || (saved_hash != imageHash()))
+        fail("SD card image '%s' has changed since the checkpoint was made",
+            backing_file_name.c_str());
+    
+    loadState(in);
+}
+
+/**
+ * Computes a hash of the contents of the backing file (not including any
+ * writes held in memory). The file is only read again if it has changed since
+ * the last time.
+ */
+uint64_t SdCard::imageHash(void)
+{
+    SdImageIdentity identity = imageIdentity();
+    if (image_hash_valid && (identity == hashed_identity))
+        return image_hash;
+    
+    uint8_t buf[65536];
+    uint64_t hash = FNV1A_64_INIT;
+    
+    fseek(backing_file, 0, SEEK_SET);
+    
+    size_t count;
+    while ((count = fread(buf, 1, sizeof(buf), backing_file)) > 0)
+        hash = fnv1a_64(buf, count, hash);
+    
+    if (ferror(backing_file))
+        fail("Error reading from SD card backing file");
+    
+    image_hash = hash;
+    hashed_identity = identity;
+    image_hash_valid = true;
+    
+    return hash;
+}
+
+/**
+ * Makes the card keep writes in memory (until flushWrites() is called)
+ * rather than commit them to the backing file immediately.
+ */
+void SdCard::holdWrites(void)
+{
+    buffer_writes = true;
+}
+
+/**
+ * Commits any writes held in memory to the backing file.
+ */
+void SdCard::flushWrites(void)
+{
+    unsigned image_len = max(overlay_len, backing_file_len);
+    
+    for (auto& sector : write_overlay) {
+        unsigned sector_start = sector.first * SDCARD_SECTOR_SIZE;
+        
+        writeBlockToBackingFile(sector.second.data(), sector_start,
+            min((unsigned)SDCARD_SECTOR_SIZE, image_len - sector_start));
+    }
+    
+    write_overlay.clear();
+    overlay_len = 0;
+    
+    fflush(backing_file);
+}
+
+/**
+ * Forgets all writes held in memory, reverting the card to the contents of
+ * its backing file.
+ */
+void SdCard::discardWrites(void)
+{
+    write_overlay.clear();
+    overlay_len = 0;
+}
+
 void SdCard::_onPinChanged(int pin_id, pin_val_t value, pin_val_t old_value)
 {
     switch (pin_id) {
@@ -237,6 +482,9 @@ uint8_t SdCard::handleRespondingWithData(uint8_t data)
         data = low_byte(read_block_crc);
         responding_with_data = false;
         idle = true;
+        
+        if (__builtin_expect(TraceEventWriter::active != NULL, 0))
+            traceBlockOp("read block");
     }
     
     substate++;
@@ -265,11 +513,14 @@ uint8_t SdCard::handleReceivingWriteData(uint8_t data)
         
         bool crc_error = crc_enabled &&
             (write_block_crc != compute_crc16(write_block_buffer, block_size));
-        bool write_error = !writeBlockToBackingFile(
+        bool write_error = !writeBlock(
             write_block_buffer, write_block_addr, block_size);
         
         prepareDataResponse(crc_error, write_error);
         receiving_write_data = false;
+        
+        if (__builtin_expect(TraceEventWriter::active != NULL, 0))
+            traceBlockOp("write block");
     }
     
     return 0xff;
@@ -301,9 +552,10 @@ void SdCard::execCommand(uint8_t command, uint32_t param)
                 fail("SD card read address not aligned (=%08x)", param);
             if (param + block_size >= capacity)
                 fail("Out of range read from SD card (addr=%08x)", param);
-            readBlockFromBackingFile(read_block_buffer, param, block_size);
+            readBlock(read_block_buffer, param, block_size);
             read_block_crc = compute_crc16(read_block_buffer, block_size);
             responding_with_data = true;
+            startTracingBlockOp(param);
             break;
         case CMD_WRITE_SINGLE_BLOCK:
             if (param & 511)
@@ -312,6 +564,7 @@ void SdCard::execCommand(uint8_t command, uint32_t param)
                 fail("Out of range write to SD card (addr=%08x)", param);
             write_block_addr = param;
             receiving_write_data = true;
+            startTracingBlockOp(param);
             break;
         default:
             fail("Unrecognized SD command: %02x %08x\n", command, param);
@@ -358,6 +611,73 @@ void SdCard::prepareDataResponse(bool crc_error, bool write_error)
     responding = true;
 }
 
+void SdCard::startTracingBlockOp(unsigned addr)
+{
+    TraceEventWriter *trace = TraceEventWriter::active;
+    
+    block_op_started_at = trace ? trace->now() : SIM_TIME_NEVER;
+    block_op_addr = addr;
+}
+
+/**
+ * Shows the block operation that has just completed, from its command to
+ * the last byte of its data, as a slice in the active trace.
+ */
+void SdCard::traceBlockOp(const char *name)
+{
+    TraceEventWriter *trace = TraceEventWriter::active;
+    
+    if (block_op_started_at == SIM_TIME_NEVER)
+        return;
+    
+    string track_name = TraceEventWriter::entityName(this) + " blocks";
+    trace->slice(trace->track(track_name), block_op_started_at, name,
+        "block", block_op_addr / SDCARD_SECTOR_SIZE);
+    block_op_started_at = SIM_TIME_NEVER;
+}
+
+void SdCard::readBlock(uint8_t *buffer, unsigned offset, unsigned length)
+{
+    readBlockFromBackingFile(buffer, offset, length);
+    
+    for (auto it = write_overlay.lower_bound(offset / SDCARD_SECTOR_SIZE);
+         (it != write_overlay.end()) && (it->first * SDCARD_SECTOR_SIZE < offset + length);
+         it++) {
+        unsigned sector_start = it->first * SDCARD_SECTOR_SIZE;
+        unsigned from = max(offset, sector_start);
+        unsigned to = min(offset + length, sector_start + SDCARD_SECTOR_SIZE);
+        
+        memcpy(buffer + from - offset, it->second.data() + from - sector_start, to - from);
+    }
+}
+
+bool SdCard::writeBlock(uint8_t *buffer, unsigned offset, unsigned length)
+{
+    if (!buffer_writes)
+        return writeBlockToBackingFile(buffer, offset, length);
+    
+    for (unsigned sector = offset / SDCARD_SECTOR_SIZE;
+         sector * SDCARD_SECTOR_SIZE < offset + length; sector++) {
+        unsigned sector_start = sector * SDCARD_SECTOR_SIZE;
+        
+        auto it = write_overlay.find(sector);
+        if (it == write_overlay.end()) {
+            vector<uint8_t> data(SDCARD_SECTOR_SIZE);
+            readBlockFromBackingFile(data.data(), sector_start, SDCARD_SECTOR_SIZE);
+            it = write_overlay.insert(make_pair(sector, move(data))).first;
+        }
+        
+        unsigned from = max(offset, sector_start);
+        unsigned to = min(offset + length, sector_start + SDCARD_SECTOR_SIZE);
+        
+        memcpy(it->second.data() + from - sector_start, buffer + from - offset, to - from);
+    }
+    
+    overlay_len = max(overlay_len, offset + length);
+    
+    return true;
+}
+
 void SdCard::readBlockFromBackingFile(uint8_t *buffer, unsigned offset, unsigned length)
 {
     memset(buffer, 0xff, length);
@@ -365,8 +685,9 @@ void SdCard::readBlockFromBackingFile(uint8_t *buffer, unsigned offset, unsigned
     if (offset >= backing_file_len)
         return;
     
-    fseek(backing_file, offset, SEEK_SET);
-    int count = fread(buffer, 1, length, backing_file);
+    // pread() leaves the file offset alone, which is shared with any forked
+    // copies of the simulation (see --serve)
+    int count = pread(fileno(backing_file), buffer, min(length, backing_file_len - offset), offset);
     
     if (count < 0)
         fail("Error reading from SD card backing file");
@@ -376,8 +697,11 @@ bool SdCard::writeBlockToBackingFile(uint8_t *buffer, unsigned offset, unsigned
 {
     expandBackingFile(offset + length);
     
+    // The modification time may be too coarse to tell that the file changed
+    image_hash_valid = false;
+    
     fseek(backing_file, offset, SEEK_SET);
-    if (fwrite(buffer, length, 1, backing_file) != 1)
+    if ((fwrite(buffer, length, 1, backing_file) != 1) || fflush(backing_file))
         fail("Error writing to SD card backing file");
     
     return true;
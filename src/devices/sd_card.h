@@ -3,6 +3,9 @@
 
 #include <cstdio>
 #include <inttypes.h>
+#include <string>
+#include <map>
+#include <vector>
 
 #include "glue/spi_device.h"
 #include "glue/pin_device.h"
@@ -14,20 +17,60 @@
 
 #define SDCARD_PIN_SLAVE_SELECT    0
 
+#define SDCARD_SECTOR_SIZE       512
+
+/**
+ * Identifies the contents of an image file cheaply: as long as none of this
+ * changes, neither have the contents.
+ */
+struct SdImageIdentity {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime_ns;
+    
+    inline bool operator==(const SdImageIdentity& other) const
+    {
+        return (device == other.device) && (inode == other.inode) && (size == other.size) &&
+            (mtime_ns == other.mtime_ns);
+    }
+};
 
 class SdCard : public Entity, public SpiDevice, public PinDevice, public SimulatedDevice {
 public:
     SdCard(const char *backing_file_name, unsigned capacity);
     SdCard(Json::Value &json_data);
+    ~SdCard();
     
     virtual void reset();
+    virtual void saveState(StateWriter& out);
+    virtual void loadState(StateReader& in);
+    virtual void saveCheckpoint(StateWriter& out);
+    virtual void loadCheckpoint(StateReader& in);
+    
+    void changeImage(const char *backing_file_name);
+    
+    void holdWrites(void);
+    void flushWrites(void);
+    void discardWrites(void);
+    uint64_t imageHash(void);
     
     bool spiReceiveData(uint8_t &data);
 private:
+    string backing_file_name;
     FILE *backing_file;
     unsigned backing_file_len;
     unsigned capacity;
     
+    // Hash of the backing file, cached while it keeps the same identity
+    bool image_hash_valid;
+    uint64_t image_hash;
+    SdImageIdentity hashed_identity;
+    
+    bool buffer_writes;
+    map<unsigned, vector<uint8_t>> write_overlay;
+    unsigned overlay_len;
+    
     bool in_sd_mode;
     bool idle;
     bool receiving_command;
@@ -49,8 +92,14 @@ private:
     
     bool crc_enabled;
     uint16_t block_size;
+    
+    // For tracing
+    sim_time_t block_op_started_at;
+    unsigned block_op_addr;
 
     void init(const char *backing_file_name, unsigned capacity);
+    void openBackingFile(const char *backing_file_name);
+    SdImageIdentity imageIdentity(void);
     
     virtual void _onPinChanged(int pin_id, pin_val_t value, pin_val_t old_value);
     
@@ -66,9 +115,13 @@ private:
     void execAppCommand(uint8_t command, uint32_t param);
     void prepareR1Response();
     void prepareDataResponse(bool crc_error, bool write_error);
+    void readBlock(uint8_t *buffer, unsigned offset, unsigned length);
+    bool writeBlock(uint8_t *buffer, unsigned offset, unsigned length);
     void readBlockFromBackingFile(uint8_t *buffer, unsigned offset, unsigned length);
     bool writeBlockToBackingFile(uint8_t *buffer, unsigned offset, unsigned length);
     void expandBackingFile(unsigned minimum_size);
+    void startTracingBlockOp(unsigned addr);
+    void traceBlockOp(const char *name);
 };
 
 #endif
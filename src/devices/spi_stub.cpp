@@ -0,0 +1,73 @@
+#include "spi_stub.h"
+
+#include "utils/fail.h"
+
+PinInitData const PIN_INIT_DATA[SPI_STUB_PIN_COUNT] = {
+    { "SS", PIN_MODE_INPUT, PIN_VAL_VCC }  // SLAVE_SELECT
+};
+
+#define DEFAULT_NAME "SPI stub"
+
+SpiStub::SpiStub()
+    : Entity(DEFAULT_NAME), PinDevice(SPI_STUB_PIN_COUNT, PIN_INIT_DATA)
+{
+}
+
+SpiStub::SpiStub(Json::Value &json_data)
+    : Entity(DEFAULT_NAME, json_data), PinDevice(SPI_STUB_PIN_COUNT, PIN_INIT_DATA)
+{
+}
+
+void SpiStub::queueResponse(const uint8_t *data, size_t length)
+{
+    responses.insert(responses.end(), data, data + length);
+}
+
+void SpiStub::clearResponses(void)
+{
+    responses.clear();
+}
+
+void SpiStub::saveState(StateWriter& out)
+{
+    out.put(spi_selected);
+    out.put((uint32_t)responses.size());
+    for (uint8_t byte : responses)
+        out.put(byte);
+}
+
+void SpiStub::loadState(StateReader& in)
+{
+    uint32_t count;
+    
+    in.get(spi_selected);
+    in.get(count);
+    
+    responses.resize(count);
+    for (auto& byte : responses)
+        in.get(byte);
+}
+
+bool SpiStub::spiReceiveData(uint8_t &data)
+{
+    if (!spi_selected)
+        return false;
+    
+    if (responses.empty()) {
+        data = 0xff;
+    } else {
+        data = responses.front();
+        responses.pop_front();
+    }
+    
+    return true;
+}
+
+void SpiStub::_onPinChanged(int pin_id, pin_val_t value, pin_val_t old_value)
+{
+    switch (pin_id) {
+        case SPI_STUB_PIN_SLAVE_SELECT:
+            _spiSlaveSelect(!_pins[pin_id].readDigital());
+            return;
+    }
+}
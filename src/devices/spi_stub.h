@@ -0,0 +1,42 @@
+#ifndef _H_SPI_STUB_H
+#define _H_SPI_STUB_H
+
+#include <inttypes.h>
+#include <deque>
+
+#include <json/json.h>
+
+#include "glue/spi_device.h"
+#include "glue/pin_device.h"
+#include "simulation/entity.h"
+
+using namespace std;
+
+#define SPI_STUB_PIN_COUNT          1
+
+#define SPI_STUB_PIN_SLAVE_SELECT   0
+
+/**
+ * An SPI slave that simply answers with bytes queued by the user (and 0xff
+ * when it runs out). Useful for feeding arbitrary data to firmware that
+ * talks to an SPI peripheral, e.g. when fuzzing.
+ */
+class SpiStub : public Entity, public SpiDevice, public PinDevice {
+public:
+    SpiStub();
+    SpiStub(Json::Value &json_data);
+    
+    void queueResponse(const uint8_t *data, size_t length);
+    void clearResponses(void);
+    
+    virtual void saveState(StateWriter& out);
+    virtual void loadState(StateReader& in);
+    
+    bool spiReceiveData(uint8_t &data);
+private:
+    deque<uint8_t> responses;
+    
+    virtual void _onPinChanged(int pin_id, pin_val_t value, pin_val_t old_value);
+};
+
+#endif
@@ -37,6 +37,16 @@ void VoltageSource::setValue(pin_val_t value)
     _pins[VOLTAGE_SRC_PIN_OUTPUT].write(value);
 }
 
+void VoltageSource::saveState(StateWriter& out)
+{
+    out.put(this->_value);
+}
+
+void VoltageSource::loadState(StateReader& in)
+{
+    in.get(this->_value);
+}
+
 void VoltageSource::_onPinChanged(int pin_id, pin_val_t value, pin_val_t old_value)
 {
 }
@@ -23,6 +23,9 @@ public:
     VoltageSource(Json::Value &json_data);
     
     void setValue(pin_val_t value);
+    
+    virtual void saveState(StateWriter& out);
+    virtual void loadState(StateReader& in);
 protected:
     pin_val_t _value;
     
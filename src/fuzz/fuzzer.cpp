@@ -0,0 +1,560 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "fuzzer.h"
+
+#include "devices/atmega32/cpu_core.h"
+#include "networking/eth_frame.h"
+#include "utils/fail.h"
+#include "utils/hash.h"
+#include "utils/time.h"
+
+#define SYNC_INTERVAL_NS        1000000000LL
+#define STATS_INTERVAL_NS       5000000000LL
+
+#define HAVOC_MAX_STACK_POW2    7
+#define HAVOC_BLOCK_MAX         32
+#define SPLICE_PERCENT          15
+
+static const int8_t INTERESTING_8[] = { -128, -1, 0, 1, 16, 32, 64, 100, 127 };
+static const int16_t INTERESTING_16[] = { -32768, -129, 128, 255, 256, 512, 1000, 1024, 4096, 32767 };
+
+volatile bool Fuzzer::stop_requested = false;
+
+Fuzzer::Fuzzer(Simulation *sim, SystemDescription *sys_desc, Atmega32 *mcu)
+{
+    this->sim = sim;
+    this->sys_desc = sys_desc;
+    this->mcu = mcu;
+    
+    run_time = FUZZER_DEFAULT_RUN_TIME;
+    byte_interval = FUZZER_DEFAULT_BYTE_INTERVAL;
+    idle_pc = -1;
+    watchdog = FUZZER_DEFAULT_WATCHDOG;
+    stack_limit = mcu->staticDataEnd();
+    max_len = FUZZER_DEFAULT_MAX_LEN;
+    crashes_dir = "crashes";
+    seed = 1;
+    iterations = 0;
+    
+    target = FUZZ_TARGET_USART;
+    net_target = NULL;
+    spi_target = NULL;
+    
+    trace_bits = new uint8_t[ATMEGA32_COVERAGE_MAP_SIZE];
+    virgin_bits = new uint8_t[ATMEGA32_COVERAGE_MAP_SIZE];
+}
+
+Fuzzer::~Fuzzer()
+{
+    mcu->setCoverageMap(NULL);
+    mcu->setStackLimit(0);
+    
+    delete[] trace_bits;
+    delete[] virgin_bits;
+}
+
+/**
+ * Selects where inputs are fed to the firmware: "enc28j60:<id>" (or any
+ * other network device), "usart:<mcu id>" or "spi:<SpiStub id>".
+ */
+void Fuzzer::setTarget(const char *spec)
+{
+    const char *colon = strchr(spec, ':');
+    if (!colon)
+        fail("Invalid injection target '%s'", spec);
+    
+    string kind(spec, colon - spec);
+    Entity *entity = sys_desc->lookupEntity(colon + 1);
+    if (!entity)
+        fail("Entity '%s' not found", colon + 1);
+    
+    if (kind == "enc28j60") {
+        net_target = dynamic_cast<NetworkDevice *>(entity);
+        if (!net_target)
+            fail("Entity '%s' is not a network device", colon + 1);
+        target = FUZZ_TARGET_ETHERNET;
+    } else if (kind == "usart") {
+        if (entity != mcu)
+            fail("Entity '%s' is not the fuzzed MCU", colon + 1);
+        target = FUZZ_TARGET_USART;
+    } else if (kind == "spi") {
+        spi_target = dynamic_cast<SpiStub *>(entity);
+        if (!spi_target)
+            fail("Entity '%s' is not an SpiStub", colon + 1);
+        target = FUZZ_TARGET_SPI;
+    } else {
+        fail("Unknown injection target type '%s'", kind.c_str());
+    }
+}
+
+/**
+ * Fuzzes from the current state of the simulation, in the given number of
+ * parallel worker processes, until the iterations are done or a stop is
+ * requested.
+ */
+void Fuzzer::run(int jobs)
+{
+    if (!corpus_dir.empty() && mkdir(corpus_dir.c_str(), 0777) && (errno != EEXIST))
+        fail("Cannot create corpus directory '%s'", corpus_dir.c_str());
+    if (mkdir(crashes_dir.c_str(), 0777) && (errno != EEXIST))
+        fail("Cannot create crashes directory '%s'", crashes_dir.c_str());
+    
+    // Taking a snapshot also makes the SD card hold its writes in memory
+    sim->sync_with_real_time = false;
+    warm_state = sim->snapshot();
+    
+    if (jobs <= 1) {
+        _fuzzLoop(0);
+        return;
+    }
+    
+    fflush(stdout);
+    for (int i = 0; i < jobs; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int status = EXIT_SUCCESS;
+            try {
+                _fuzzLoop(i);
+            } catch (exception &e) {
+                fprintf(stderr, "%s\n", e.what());
+                status = EXIT_FAILURE;
+            }
+            
+            fflush(stdout);
+            _exit(status);
+        }
+        
+        if (pid < 0)
+            fail("Cannot fork worker %d", i);
+    }
+    
+    for (int i = 0; i < jobs; ) {
+        if (wait(NULL) >= 0) {
+            i++;
+        } else if (errno != EINTR) {
+            break;
+        }
+    }
+}
+
+void Fuzzer::_fuzzLoop(int worker)
+{
+    this->worker = worker;
+    rng_state = (seed + worker * 0x9e3779b97f4a7c15ULL) | 1;
+    execs = 0;
+    crashes = 0;
+    edges = 0;
+    memset(virgin_bits, 0xff, ATMEGA32_COVERAGE_MAP_SIZE);
+    
+    mcu->setCoverageMap(trace_bits);
+    mcu->setStackLimit(stack_limit);
+    
+    start_ns = monotonic_time_ns();
+    last_stats_ns = start_ns;
+    
+    _loadCorpus();
+    last_sync_ns = monotonic_time_ns();
+    
+    while (!stop_requested && (!iterations || (execs < iterations))) {
+        const string& parent = queue[_randomBelow(queue.size())];
+        string data = _mutate(parent);
+        string error;
+        
+        if (!_runInput(data, error))
+            _saveCrash(data, error);
+        else if (_hasNewCoverage())
+            _addToCorpus(data, true);
+        
+        int64_t now = monotonic_time_ns();
+        if (now - last_sync_ns >= SYNC_INTERVAL_NS) {
+            _sync();
+            last_sync_ns = now;
+        }
+        if (now - last_stats_ns >= STATS_INTERVAL_NS) {
+            _reportStats(false);
+            last_stats_ns = now;
+        }
+    }
+    
+    _reportStats(true);
+}
+
+/**
+ * Runs the inputs already in the corpus directory, or an empty input if
+ * there are none, to establish the initial coverage.
+ */
+void Fuzzer::_loadCorpus(void)
+{
+    _sync();
+    
+    if (queue.empty()) {
+        string error;
+        if (!_runInput("", error))
+            fail("Fuzzing cannot start: the empty input fails (%s)", error.c_str());
+        
+        _hasNewCoverage();
+        _addToCorpus("", false);
+    }
+}
+
+/**
+ * Picks up inputs added to the corpus directory (e.g. by other workers)
+ * since the last scan.
+ */
+void Fuzzer::_sync(void)
+{
+    if (corpus_dir.empty())
+        return;
+    
+    DIR *dir = opendir(corpus_dir.c_str());
+    if (!dir)
+        return;
+    
+    vector<string> new_files;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.')
+            continue;
+        if (known_files.insert(entry->d_name).second)
+            new_files.push_back(entry->d_name);
+    }
+    closedir(dir);
+    
+    sort(new_files.begin(), new_files.end());
+    for (auto& name : new_files) {
+        string path = corpus_dir + "/" + name;
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f)
+            continue;
+        
+        string data;
+        char buf[4096];
+        size_t count;
+        while ((count = fread(buf, 1, sizeof(buf), f)) > 0)
+            data.append(buf, count);
+        fclose(f);
+        
+        if (data.size() > max_len)
+            data.resize(max_len);
+        
+        string error;
+        if (!_runInput(data, error))
+            _saveCrash(data, error);
+        else if (_hasNewCoverage() || queue.empty())
+            _addToCorpus(data, false);
+    }
+}
+
+void Fuzzer::_reportStats(bool final)
+{
+    double elapsed = (monotonic_time_ns() - start_ns) / 1e9;
+    
+    info("[worker %d]%s %llu execs (%.0f/s), corpus %d, edges %d, crashes %llu", worker,
+        final ? " done:" : "", (unsigned long long)execs, elapsed > 0 ? execs / elapsed : 0.0,
+        (int)queue.size(), edges, (unsigned long long)crashes);
+    fflush(stdout);
+}
+
+/**
+ * Runs the firmware on one input, starting from the warm state.
+ *
+ * @return False if the input made the firmware crash or hang
+ */
+bool Fuzzer::_runInput(const string& data, string &error)
+{
+    sim->restore(warm_state);
+    mcu->clearBreakpoint();
+    mcu->resetCoverageTrace();
+    memset(trace_bits, 0, ATMEGA32_COVERAGE_MAP_SIZE);
+    
+    input = data;
+    execs++;
+    
+    try {
+        _deliverInput();
+        
+        if (idle_pc != -1) {
+            last_idle_time = sim->time;
+            _armIdleBreakpoint();
+            _scheduleWatchdog(sim->time + watchdog);
+        }
+        
+        sim->resume(sim->time + run_time);
+    } catch (exception &e) {
+        error = e.what();
+        return false;
+    }
+    
+    return true;
+}
+
+void Fuzzer::_deliverInput(void)
+{
+    switch (target) {
+        case FUZZ_TARGET_ETHERNET: {
+            // Short inputs are padded to the minimum frame size (sans FCS)
+            string data = input;
+            if (data.size() < 60)
+                data.resize(60, 0);
+            
+            EthernetFrame frame(data, false);
+            frame.addFcs();
+            
+            net_target->receiveFrame(frame);
+            break;
+        }
+        case FUZZ_TARGET_USART:
+            if (!input.empty())
+                _deliverUsartByte(0);
+            break;
+        case FUZZ_TARGET_SPI:
+            spi_target->clearResponses();
+            spi_target->queueResponse((const uint8_t *)input.data(), input.size());
+            break;
+    }
+}
+
+void Fuzzer::_deliverUsartByte(size_t index)
+{
+    static_cast<RS232Device *>(mcu)->onRS232Receive((uint8_t)input[index]);
+    
+    if (index + 1 < input.size())
+        sim->scheduleCallbackIn(NULL, byte_interval, [this, index]() {
+            _deliverUsartByte(index + 1);
+        });
+}
+
+void Fuzzer::_armIdleBreakpoint(void)
+{
+    mcu->setBreakpoint(idle_pc, [this]() {
+        last_idle_time = sim->time;
+        _armIdleBreakpoint();
+    });
+}
+
+void Fuzzer::_scheduleWatchdog(sim_time_t time)
+{
+    sim->scheduleCallback(NULL, time, [this]() {
+        if (sim->time - last_idle_time >= watchdog)
+            fail("Hang: idle function not reached for %.3f ms", watchdog / 1e6);
+        
+        _scheduleWatchdog(last_idle_time + watchdog);
+    });
+}
+
+/**
+ * Classifies the hit counts of the last run into buckets and checks them
+ * against everything seen so far.
+ */
+bool Fuzzer::_hasNewCoverage(void)
+{
+    static uint8_t bucket_of[256];
+    
+    if (!bucket_of[1]) {
+        for (int i = 1; i < 256; i++)
+            bucket_of[i] = (i >= 128) ? 128 : (i >= 32) ? 64 : (i >= 16) ? 32 :
+                (i >= 8) ? 16 : (i >= 4) ? 8 : (i == 3) ? 4 : i;
+    }
+    
+    bool new_coverage = false;
+    
+    for (int i = 0; i < ATMEGA32_COVERAGE_MAP_SIZE; i++) {
+        if (!trace_bits[i])
+            continue;
+        
+        uint8_t bucket = bucket_of[trace_bits[i]];
+        if (bucket & virgin_bits[i]) {
+            if (virgin_bits[i] == 0xff)
+                edges++;
+            
+            virgin_bits[i] &= ~bucket;
+            new_coverage = true;
+        }
+    }
+    
+    return new_coverage;
+}
+
+/**
+ * Adds an input to the queue and, optionally, to the corpus directory. The
+ * file is named by its contents and written under a temporary name first,
+ * so that other workers never see it incomplete.
+ */
+void Fuzzer::_addToCorpus(const string& data, bool save)
+{
+    queue.push_back(data);
+    
+    if (!save || corpus_dir.empty())
+        return;
+    
+    char name[32];
+    sprintf(name, "id-%016llx", (unsigned long long)fnv1a_64(data.data(), data.size()));
+    known_files.insert(name);
+    
+    string path = corpus_dir + "/" + name;
+    string tmp_path = corpus_dir + "/.tmp-" + to_string(getpid());
+    
+    FILE *f = fopen(tmp_path.c_str(), "wb");
+    if (!f) {
+        warn("Cannot write to corpus file '%s'", tmp_path.c_str());
+        return;
+    }
+    
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+    rename(tmp_path.c_str(), path.c_str());
+}
+
+/**
+ * Saves an input that crashed the firmware, unless one with the same error
+ * was already saved (by any worker).
+ */
+void Fuzzer::_saveCrash(const string& data, const string& error)
+{
+    uint64_t signature = fnv1a_64(error.data(), error.size());
+    if (!crash_signatures.insert(signature).second)
+        return;
+    
+    crashes++;
+    
+    char name[32];
+    sprintf(name, "crash-%016llx", (unsigned long long)signature);
+    string path = crashes_dir + "/" + name;
+    
+    if (access(path.c_str(), F_OK) == 0)
+        return;
+    
+    info("[worker %d] Crash: %s (saved as '%s')", worker, error.c_str(), path.c_str());
+    fflush(stdout);
+    
+    string tmp_path = crashes_dir + "/.tmp-" + to_string(getpid());
+    FILE *f = fopen(tmp_path.c_str(), "wb");
+    if (!f) {
+        warn("Cannot write to crash file '%s'", tmp_path.c_str());
+        return;
+    }
+    
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+    rename(tmp_path.c_str(), path.c_str());
+    
+    f = fopen((path + ".txt").c_str(), "w");
+    if (f) {
+        fprintf(f, "%s\n", error.c_str());
+        fclose(f);
+    }
+}
+
+/**
+ * Applies a random stack of AFL-style "havoc" mutations to an input, having
+ * first spliced it with another one from the queue now and then.
+ */
+string Fuzzer::_mutate(const string& parent)
+{
+    string data = parent;
+    
+    if ((queue.size() > 1) && (_randomBelow(100) < SPLICE_PERCENT)) {
+        const string& other = queue[_randomBelow(queue.size())];
+        size_t split = _randomBelow(min(data.size(), other.size()) + 1);
+        data = data.substr(0, split) + other.substr(min(split, other.size()));
+    }
+    
+    int stack = 1 << (1 + _randomBelow(HAVOC_MAX_STACK_POW2));
+    
+    for (int i = 0; i < stack; i++) {
+        switch (_randomBelow(data.empty() ? 1 : 10)) {
+            case 0: {
+                // Insert a block of random or cloned bytes
+                size_t len = 1 + _randomBelow(HAVOC_BLOCK_MAX);
+                size_t pos = _randomBelow(data.size() + 1);
+                string block;
+                
+                if (!data.empty() && _randomBelow(2)) {
+                    size_t from = _randomBelow(data.size());
+                    block = data.substr(from, len);
+                } else {
+                    for (size_t j = 0; j < len; j++)
+                        block += (char)_random();
+                }
+                
+                data.insert(pos, block);
+                break;
+            }
+            case 1:
+                data[_randomBelow(data.size())] ^= (char)(1 << _randomBelow(8));
+                break;
+            case 2:
+                data[_randomBelow(data.size())] = (char)_random();
+                break;
+            case 3:
+                data[_randomBelow(data.size())] =
+                    INTERESTING_8[_randomBelow(sizeof(INTERESTING_8))];
+                break;
+            case 4:
+                if (data.size() >= 2) {
+                    size_t pos = _randomBelow(data.size() - 1);
+                    uint16_t val = INTERESTING_16[_randomBelow(sizeof(INTERESTING_16) / 2)];
+                    if (_randomBelow(2))
+                        val = (val >> 8) | (val << 8);
+                    data[pos] = (char)(val >> 8);
+                    data[pos + 1] = (char)val;
+                }
+                break;
+            case 5:
+                data[_randomBelow(data.size())] += (char)(1 + _randomBelow(35));
+                break;
+            case 6:
+                data[_randomBelow(data.size())] -= (char)(1 + _randomBelow(35));
+                break;
+            case 7: {
+                // Delete a block
+                size_t pos = _randomBelow(data.size());
+                data.erase(pos, 1 + _randomBelow(HAVOC_BLOCK_MAX));
+                break;
+            }
+            case 8: {
+                // Overwrite a block with a copy of another part of the input
+                size_t from = _randomBelow(data.size());
+                size_t to = _randomBelow(data.size());
+                size_t len = 1 + _randomBelow(min((size_t)HAVOC_BLOCK_MAX,
+                    data.size() - max(from, to)));
+                memmove(&data[to], &data[from], len);
+                break;
+            }
+            case 9: {
+                // Overwrite a block with one repeated byte
+                size_t pos = _randomBelow(data.size());
+                size_t len = 1 + _randomBelow(min((size_t)HAVOC_BLOCK_MAX, data.size() - pos));
+                memset(&data[pos], _randomBelow(2) ? (char)_random() : data[pos], len);
+                break;
+            }
+        }
+    }
+    
+    if (data.size() > max_len)
+        data.resize(max_len);
+    
+    return data;
+}
+
+uint64_t Fuzzer::_random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+size_t Fuzzer::_randomBelow(size_t limit)
+{
+    return _random() % limit;
+}
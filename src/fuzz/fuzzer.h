@@ -0,0 +1,115 @@
+#ifndef _H_FUZZER_H
+#define _H_FUZZER_H
+
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "simulation/simulation.h"
+#include "simulation/sys_desc.h"
+#include "devices/atmega32/atmega32.h"
+#include "devices/spi_stub.h"
+#include "networking/net_device.h"
+
+using namespace std;
+
+#define FUZZER_DEFAULT_RUN_TIME         ms_to_sim_time(50)
+#define FUZZER_DEFAULT_BYTE_INTERVAL    us_to_sim_time(100)
+#define FUZZER_DEFAULT_WATCHDOG         ms_to_sim_time(100)
+#define FUZZER_DEFAULT_MAX_LEN          1024
+
+enum FuzzTarget {
+    FUZZ_TARGET_ETHERNET,
+    FUZZ_TARGET_USART,
+    FUZZ_TARGET_SPI
+};
+
+/**
+ * Coverage-guided fuzzer for the firmware, in the style of AFL.
+ *
+ * The simulation is booted once, and each test input is then run from a
+ * snapshot of that warm state: the input is fed to the firmware (as an
+ * Ethernet frame received by a network device, as bytes arriving at the MCU's
+ * USART, or as the responses of an SPI stub), and the MCU records the edges
+ * it executes in a coverage map. Inputs that reach new edges (or new hit
+ * count buckets of known edges) join the corpus and are mutated further.
+ *
+ * An input counts as a crash if the simulation fails (e.g. on an invalid
+ * instruction or memory access), if the stack grows into the static data,
+ * or, when an idle function is given, if the firmware does not come back to
+ * it within the watchdog time (i.e. it hangs).
+ *
+ * Several workers (forked processes) can fuzz in parallel. They share their
+ * findings through the corpus directory, which each of them scans regularly.
+ */
+class Fuzzer {
+public:
+    Fuzzer(Simulation *sim, SystemDescription *sys_desc, Atmega32 *mcu);
+    ~Fuzzer();
+
+    sim_time_t run_time;
+    sim_time_t byte_interval;
+    int idle_pc;
+    sim_time_t watchdog;
+    int stack_limit;
+    size_t max_len;
+    string corpus_dir;
+    string crashes_dir;
+    uint64_t seed;
+    uint64_t iterations;
+
+    void setTarget(const char *spec);
+    void run(int jobs);
+
+    static volatile bool stop_requested;
+private:
+    Simulation *sim;
+    SystemDescription *sys_desc;
+    Atmega32 *mcu;
+
+    FuzzTarget target;
+    NetworkDevice *net_target;
+    SpiStub *spi_target;
+
+    SimulationSnapshot warm_state;
+    uint8_t *trace_bits;
+    uint8_t *virgin_bits;
+
+    vector<string> queue;
+    set<string> known_files;
+    set<uint64_t> crash_signatures;
+
+    int worker;
+    uint64_t rng_state;
+    uint64_t execs;
+    uint64_t crashes;
+    int edges;
+    int64_t last_sync_ns;
+    int64_t last_stats_ns;
+    int64_t start_ns;
+
+    string input;
+    sim_time_t last_idle_time;
+
+    void _fuzzLoop(int worker);
+    void _loadCorpus(void);
+    void _sync(void);
+    void _reportStats(bool final);
+
+    bool _runInput(const string& data, string &error);
+    void _deliverInput(void);
+    void _deliverUsartByte(size_t index);
+    void _armIdleBreakpoint(void);
+    void _scheduleWatchdog(sim_time_t time);
+
+    bool _hasNewCoverage(void);
+    void _addToCorpus(const string& data, bool save);
+    void _saveCrash(const string& data, const string& error);
+
+    string _mutate(const string& data);
+    uint64_t _random(void);
+    size_t _randomBelow(size_t limit);
+};
+
+#endif
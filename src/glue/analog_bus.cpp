@@ -1,19 +1,23 @@
 #include <algorithm>
 
 #include "analog_bus.h"
+#include "profiling/vcd_writer.h"
 #include "utils/fail.h"
 
 using namespace std;
 
 #define DEFAULT_NAME "Analog bus"
 
-AnalogBus::AnalogBus() : Entity(DEFAULT_NAME)
+AnalogBus::AnalogBus() : Entity(DEFAULT_NAME), trace_kind(VCD_UNTRACED), vcd_signal(-1)
 {
 }
 
 AnalogBus::AnalogBus(Json::Value &json_data, EntityLookup *lookup)
-    : Entity(DEFAULT_NAME, json_data)
+    : Entity(DEFAULT_NAME, json_data), trace_kind(VCD_UNTRACED), vcd_signal(-1)
 {
+    if (json_data.isMember("trace"))
+        trace_kind = parse_vcd_kind(json_data["trace"], "trace");
+    
     if (json_data.isMember("pins")) {
         if (!json_data["pins"].isArray()) {
             fail("'pins' should be an array");
@@ -63,6 +67,16 @@ void AnalogBus::removeDevicePin(PinReference &pinref)
     this->removeDevicePin(pinref.device, pinref.pin_id);
 }
 
+void AnalogBus::saveState(StateWriter& out)
+{
+    out.put(this->_value);
+}
+
+void AnalogBus::loadState(StateReader& in)
+{
+    in.get(this->_value);
+}
+
 pin_val_t AnalogBus::query(void)
 {
     return this->_value;
@@ -80,6 +94,9 @@ void AnalogBus::update(void)
     }
     
     this->_value = value;
+    
+    if (__builtin_expect(this->vcd_signal >= 0, 0) && VcdWriter::active)
+        VcdWriter::active->change(this->vcd_signal, value);
         
     for (vector<PinReference>::iterator it = this->_pins.begin(); it != this->_pins.end(); it++)
         it->device->drivePin(it->pin_id, this->_value);
@@ -23,6 +23,12 @@ public:
     void removeDevicePin(PinReference &pinref);
     pin_val_t query(void);
     void update(void);
+    
+    virtual void saveState(StateWriter& out);
+    virtual void loadState(StateReader& in);
+    
+    int trace_kind;     // For VcdWriter
+    int vcd_signal;
 private:
     pin_val_t _value;
     
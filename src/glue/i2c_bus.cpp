@@ -2,18 +2,19 @@
 
 #include "i2c_bus.h"
 #include "i2c_device.h"
+#include "profiling/trace_events.h"
 #include "utils/fail.h"
 
 using namespace std;
 
 #define DEFAULT_NAME "I2C bus"
 
-I2cBus::I2cBus() : Entity(DEFAULT_NAME)
+I2cBus::I2cBus() : Entity(DEFAULT_NAME), transaction_started_at(SIM_TIME_NEVER)
 {
 }
 
 I2cBus::I2cBus(Json::Value &json_data, EntityLookup *lookup)
-    : Entity(DEFAULT_NAME, json_data)
+    : Entity(DEFAULT_NAME, json_data), transaction_started_at(SIM_TIME_NEVER)
 {
     if (json_data.isMember("devices")) {
         if (!json_data["devices"].isArray()) {
@@ -58,6 +59,13 @@ void I2cBus::removeDevice(I2cDevice *device)
 
 void I2cBus::sendStart(I2cDevice *sender)
 {
+    if (__builtin_expect(TraceEventWriter::active != NULL, 0)) {
+        // A repeated start ends the previous transaction
+        _traceTransactionEnd();
+        transaction_started_at = TraceEventWriter::active->now();
+        transaction_address = -1;
+    }
+    
     for (unsigned int i = 0; i < this->devices.size(); i++)
         if (this->devices[i] != sender)
             this->devices[i]->i2cReceiveStart();
@@ -67,6 +75,9 @@ bool I2cBus::sendAddress(I2cDevice *sender, uint8_t address, bool write)
 {
     bool ack = false;
     
+    transaction_address = address;
+    transaction_write = write;
+    
     for (unsigned int i = 0; i < this->devices.size(); i++)
         if (this->devices[i] != sender) {
             bool dev_ack = this->devices[i]->i2cReceiveAddress(address, write);
@@ -131,4 +142,26 @@ void I2cBus::sendStop(I2cDevice *sender)
     for (unsigned int i = 0; i < this->devices.size(); i++)
         if (this->devices[i] != sender)
             this->devices[i]->i2cReceiveStop();
+    
+    if (__builtin_expect(TraceEventWriter::active != NULL, 0))
+        _traceTransactionEnd();
+}
+
+/**
+ * Shows the transaction since the last start condition, if any, as a slice
+ * on the track of the bus.
+ */
+void I2cBus::_traceTransactionEnd(void)
+{
+    TraceEventWriter *trace = TraceEventWriter::active;
+    
+    if (transaction_started_at == SIM_TIME_NEVER)
+        return;
+    
+    const char *name = (transaction_address == -1) ? "I2C transaction" :
+        transaction_write ? "I2C write" : "I2C read";
+    
+    trace->slice(trace->track(TraceEventWriter::entityName(this)), transaction_started_at,
+        name, "address", transaction_address);
+    transaction_started_at = SIM_TIME_NEVER;
 }
@@ -8,6 +8,7 @@
 
 #include "simulation/entity.h"
 #include "simulation/entity_lookup.h"
+#include "simulation/sim_time.h"
 
 using namespace std;
 
@@ -27,6 +28,13 @@ public:
     void sendStop(I2cDevice *sender);
 private:
     vector<I2cDevice *> devices;
+    
+    // For tracing
+    sim_time_t transaction_started_at;
+    int transaction_address;
+    bool transaction_write;
+
+    void _traceTransactionEnd(void);
 };
 
 #endif
@@ -3,6 +3,7 @@
 #include "pin.h"
 #include "pin_device.h"
 #include "analog_bus.h"
+#include "profiling/vcd_writer.h"
 
 using namespace std;
 
@@ -15,6 +16,8 @@ void Pin::initialize(PinDevice *owner, int pin_id, PinInitData const * init_data
     this->drive_value = (init_data->mode == PIN_MODE_OUTPUT) ? init_data->float_value : PIN_VAL_Z;
     this->float_value = init_data->float_value;
     this->last_input = PIN_VAL_Z;
+    this->trace_kind = VCD_UNTRACED;
+    this->vcd_signal = -1;
 }
 
 void Pin::connectToBus(AnalogBus *bus)
@@ -87,6 +90,9 @@ void Pin::write(pin_val_t value)
     
     for (vector<AnalogBus *>::iterator it = this->buses.begin(); it != this->buses.end(); it++)
         (*it)->update();
+    
+    if (__builtin_expect(this->vcd_signal >= 0, 0))
+        this->_traceChange();
 }
 
 /**
@@ -129,6 +135,9 @@ void Pin::drive(pin_val_t value)
     this->last_input = value;
     pin_val_t new_value = this->read();
     
+    if (__builtin_expect(this->vcd_signal >= 0, 0))
+        this->_traceChange();
+    
     if ((this->mode == PIN_MODE_INPUT) && (new_value != prev_value)) {
         this->owner->_onPinChanged(this->pin_id, new_value, prev_value);
     }
@@ -142,6 +151,9 @@ void Pin::setFloatValue(pin_val_t value)
     this->float_value = value;
     pin_val_t new_value = this->read();
     
+    if (__builtin_expect(this->vcd_signal >= 0, 0))
+        this->_traceChange();
+    
     if ((this->mode == PIN_MODE_INPUT) && (new_value != prev_value)) {
         this->owner->_onPinChanged(this->pin_id, new_value, prev_value);
     }
@@ -166,3 +178,23 @@ void Pin::setMode(int mode)
         this->owner->_onPinChanged(this->pin_id, new_value, prev_value);
     }
 }
+
+/**
+ * Gets the value of the line the pin is on: what it drives, if it is an
+ * output driving anything, or else what it reads.
+ *
+ * @return The value of the line, fully resolved
+ */
+pin_val_t Pin::lineValue(void)
+{
+    if ((this->mode == PIN_MODE_OUTPUT) && (this->drive_value != PIN_VAL_Z))
+        return this->query();
+    
+    return this->read();
+}
+
+void Pin::_traceChange(void)
+{
+    if (VcdWriter::active)
+        VcdWriter::active->change(this->vcd_signal, this->lineValue());
+}
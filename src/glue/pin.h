@@ -59,6 +59,8 @@ public:
     pin_val_t drive_value;
     pin_val_t last_input;
     vector<AnalogBus *> buses;
+    int trace_kind;
+    int vcd_signal;
 
     void initialize(PinDevice *owner, int pin_id, PinInitData const * init_data);
     void connectToBus(AnalogBus *bus);
@@ -73,6 +75,9 @@ public:
     void setFloatValue(pin_val_t value);
     void setFloatValueDigital(bool value);
     void setMode(int mode);
+    pin_val_t lineValue(void);
+private:
+    void _traceChange(void);
 };
 
 #endif
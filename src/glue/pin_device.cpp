@@ -37,6 +37,15 @@ int PinDevice::lookupPin(const char *pin_name)
     return -1;
 }
 
+/**
+ * Marks a pin for tracing to a VCD file (see VcdWriter) as a digital or
+ * analog signal, or unmarks it (with VCD_UNTRACED).
+ */
+void PinDevice::setPinTraced(int pin_id, int kind)
+{
+    this->_pins[pin_id].trace_kind = kind;
+}
+
 void PinDevice::drivePin(int pin_id, pin_val_t value)
 {
     this->_pins[pin_id].drive(value);
@@ -46,3 +55,43 @@ pin_val_t PinDevice::queryPin(int pin_id)
 {
     return this->_pins[pin_id].query();
 }
+
+/**
+ * Gets the effective value of a pin as the device itself sees it (i.e.
+ * including what the environment drives it to).
+ */
+pin_val_t PinDevice::readPin(int pin_id)
+{
+    return this->_pins[pin_id].read();
+}
+
+bool PinDevice::readPinDigital(int pin_id)
+{
+    return this->_pins[pin_id].readDigital();
+}
+
+/**
+ * Saves the mode and values of all the pins.
+ * 
+ * Note that restoring them does not trigger any pin change notifications, as
+ * the device and the buses are expected to have their state restored too.
+ */
+void PinDevice::savePinsState(StateWriter& out)
+{
+    for (int i = 0; i < this->_num_pins; i++) {
+        out.put(this->_pins[i].mode);
+        out.put(this->_pins[i].float_value);
+        out.put(this->_pins[i].drive_value);
+        out.put(this->_pins[i].last_input);
+    }
+}
+
+void PinDevice::loadPinsState(StateReader& in)
+{
+    for (int i = 0; i < this->_num_pins; i++) {
+        in.get(this->_pins[i].mode);
+        in.get(this->_pins[i].float_value);
+        in.get(this->_pins[i].drive_value);
+        in.get(this->_pins[i].last_input);
+    }
+}
@@ -4,6 +4,7 @@
 #include "pin.h"
 #include "pin_ref.h"
 #include "simulation/entity_lookup.h"
+#include "simulation/state_stream.h"
 
 using namespace std;
 
@@ -17,13 +18,20 @@ class AnalogBus;
 
 class PinDevice {
     friend class Pin;
+    friend class VcdWriter;
 public:
     PinDevice(int num_pins, PinInitData const * const init_data);
     void connectPinToBus(int pin_id, AnalogBus *bus);
     void disconnectPinFromBus(int pin_id, AnalogBus *bus);
     void drivePin(int pin_id, pin_val_t data);
     pin_val_t queryPin(int pin_id);
+    pin_val_t readPin(int pin_id);
+    bool readPinDigital(int pin_id);
     int lookupPin(const char *pin_name);
+    void setPinTraced(int pin_id, int kind);
+    
+    void savePinsState(StateWriter& out);
+    void loadPinsState(StateReader& in);
 protected:
     Pin *_pins;
     int _num_pins;
@@ -0,0 +1,21 @@
+#ifndef _H_RS232_CAPTURE_H
+#define _H_RS232_CAPTURE_H
+
+#include <string>
+
+#include "rs232_device.h"
+
+using namespace std;
+
+/**
+ * An RS232 peer that just collects everything sent to it, for checking the
+ * console output of a simulation without a dashboard.
+ */
+class RS232Capture : public RS232Device {
+public:
+    string output;
+    
+    void onRS232Receive(uint8_t data) { output += (char)data; }
+};
+
+#endif
@@ -8,12 +8,12 @@ using namespace std;
 
 #define DEFAULT_NAME "SPI bus"
 
-SpiBus::SpiBus() : Entity(DEFAULT_NAME)
+SpiBus::SpiBus() : Entity(DEFAULT_NAME), dispatcher(NULL), dispatcher_context(NULL)
 {
 }
 
 SpiBus::SpiBus(Json::Value &json_data, EntityLookup *lookup)
-    : Entity(DEFAULT_NAME, json_data)
+    : Entity(DEFAULT_NAME, json_data), dispatcher(NULL), dispatcher_context(NULL)
 {
     if (json_data.isMember("devices")) {
         if (!json_data["devices"].isArray()) {
@@ -44,6 +44,7 @@ void SpiBus::addDevice(SpiDevice *device)
         return;
     
     this->devices.push_back(device);
+    this->dispatcher = NULL;
     device->connectToSpiBus(this);
 }
 
@@ -52,12 +53,26 @@ void SpiBus::removeDevice(SpiDevice *device)
     vector<SpiDevice*>::iterator it = find(this->devices.begin(), this->devices.end(), device);
     if (it != this->devices.end()) {
         this->devices.erase(it);
+        this->dispatcher = NULL;
         device->disconnectFromSpiBus();
     }
 }
 
+/**
+ * Sets the function that delivers bytes on the bus from now on. It is reset
+ * to the generic one whenever devices are added or removed.
+ */
+void SpiBus::setDispatcher(SpiBusDispatcher dispatcher, void *context)
+{
+    this->dispatcher = dispatcher;
+    this->dispatcher_context = context;
+}
+
 bool SpiBus::sendData(SpiDevice *sender, uint8_t &data)
 {
+    if (this->dispatcher)
+        return this->dispatcher(this->dispatcher_context, sender, data);
+    
     bool ack = false;
     
     for (unsigned int i = 0; i < this->devices.size(); i++)
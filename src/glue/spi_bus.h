@@ -13,6 +13,12 @@ using namespace std;
 
 class SpiDevice;
 
+/**
+ * Replaces the generic delivery of a byte to all devices on the bus, for
+ * buses whose devices are known at compile time (see codegen/).
+ */
+typedef bool (*SpiBusDispatcher)(void *context, SpiDevice *sender, uint8_t &data);
+
 class SpiBus : public Entity {
 public:
     SpiBus();
@@ -21,8 +27,12 @@ public:
     void addDevice(SpiDevice *device);
     void removeDevice(SpiDevice *device);
     bool sendData(SpiDevice *sender, uint8_t &data);
+    void setDispatcher(SpiBusDispatcher dispatcher, void *context);
 private:
     vector<SpiDevice *> devices;
+    
+    SpiBusDispatcher dispatcher;
+    void *dispatcher_context;
 };
 
 #endif
@@ -2,6 +2,8 @@
 
 #include "spi_bus.h"
 #include "spi_device.h"
+#include "simulation/entity.h"
+#include "profiling/trace_events.h"
 #include "utils/fail.h"
 
 using namespace std;
@@ -10,6 +12,7 @@ SpiDevice::SpiDevice()
 {
     this->spi_bus = NULL;
     this->spi_selected = false;
+    this->spi_selected_at = SIM_TIME_NEVER;
 }
 
 void SpiDevice::connectToSpiBus(SpiBus *bus)
@@ -38,10 +41,33 @@ void SpiDevice::_spiSlaveSelect(bool select)
 {
     if (this->spi_selected != select) {
         this->spi_selected = select;
+        if (__builtin_expect(TraceEventWriter::active != NULL, 0))
+            this->_traceSlaveSelect(select);
         this->_onSpiSlaveSelect(select);
     }
 }
 
+/**
+ * Shows the time from the slave being selected to it being deselected as a
+ * transaction on its own track.
+ */
+void SpiDevice::_traceSlaveSelect(bool select)
+{
+    TraceEventWriter *trace = TraceEventWriter::active;
+    
+    if (select) {
+        this->spi_selected_at = trace->now();
+        return;
+    }
+    
+    if (this->spi_selected_at == SIM_TIME_NEVER)
+        return;
+    
+    string name = TraceEventWriter::entityName(dynamic_cast<Entity *>(this)) + " SPI";
+    trace->slice(trace->track(name), this->spi_selected_at, "SPI transaction");
+    this->spi_selected_at = SIM_TIME_NEVER;
+}
+
 void SpiDevice::_onSpiSlaveSelect(bool select)
 {
     // do nothing
@@ -3,6 +3,8 @@
 
 #include <inttypes.h>
 
+#include "simulation/sim_time.h"
+
 class SpiBus;
 
 class SpiDevice {
@@ -19,6 +21,10 @@ protected:
     void _spiSlaveSelect(bool select);
     virtual void _onSpiSlaveSelect(bool select);
     bool _spiSendData(uint8_t &data);
+private:
+    sim_time_t spi_selected_at;     // For tracing
+
+    void _traceSlaveSelect(bool select);
 };
 
 #endif
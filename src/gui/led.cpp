@@ -22,6 +22,16 @@ Led::Led(const char *default_name, Json::Value &json_data)
     _lit = false;
 }
 
+void Led::saveState(StateWriter& out)
+{
+    out.put(_lit);
+}
+
+void Led::loadState(StateReader& in)
+{
+    in.get(_lit);
+}
+
 void Led::_onPinChanged(int pin_id, pin_val_t value, pin_val_t old_value)
 {
     _lit = value > SIMPLE_LED_LIGHTING_TRESHOLD;
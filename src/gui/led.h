@@ -18,6 +18,9 @@ class Led : public DashboardWidget, public PinDevice
 public:
     Led(const char *default_name, int x, int y);
     Led(const char *default_name, Json::Value &json_data);
+    
+    virtual void saveState(StateWriter& out);
+    virtual void loadState(StateReader& in);
 protected:
     bool _lit;
     
@@ -39,7 +39,7 @@ void PCIndicator::render(Dashboard *dash, SDLColor color, SDLColor bg_color,
     int pc = _mcu->getPC();
     len += sprintf(buf + len, "%04x: ", 2 * pc);
     
-    Symbol *sym = _mcu->getProgramSymbol(pc);
+    const Symbol *sym = _mcu->getProgramSymbol(pc);
     if (!sym)
         len += sprintf(buf + len, "???");
     else
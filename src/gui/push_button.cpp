@@ -43,6 +43,16 @@ PushButton::PushButton(const char *default_name, Json::Value &json_data)
     _setPressed(false);
 }
 
+void PushButton::saveState(StateWriter& out)
+{
+    out.put(_pressed);
+}
+
+void PushButton::loadState(StateReader& in)
+{
+    in.get(_pressed);
+}
+
 void PushButton::_setPressed(bool pressed)
 {
     this->_pressed = pressed;
@@ -26,6 +26,9 @@ public:
     PushButton(const char *default_name, pin_val_t up_value, pin_val_t down_value,
         int x, int y);
     PushButton(const char *default_name, Json::Value &json_data);
+    
+    virtual void saveState(StateWriter& out);
+    virtual void loadState(StateReader& in);
 protected:
     pin_val_t _up_value;
     pin_val_t _down_value;
@@ -3,46 +3,402 @@
 #include <cstdlib>
 #include <cstring>
 #include <stdexcept>
+#include <memory>
+#include <thread>
 #include <time.h>
+#include <signal.h>
 
 #include "utils/fail.h"
 #include "utils/time.h"
+#include "utils/cmd_line.h"
 #include "simulation/sys_desc.h"
 #include "simulation/simulation.h"
+#include "simulation/recorder.h"
+#include "simulation/sim_points.h"
+#include "simulation/benchmark.h"
+#include "server/test_server.h"
+#include "batch/batch_runner.h"
+#include "batch/sweep.h"
+#include "batch/board_farm.h"
+#include "devices/mcu/mcu.h"
+#include "profiling/pc_profiler.h"
+#include "profiling/isr_stats.h"
+#include "profiling/trace_events.h"
+#include "profiling/vcd_writer.h"
 
-#define BENCHMARK_SECONDS           5
+Simulation *running_sim = NULL;
+BoardFarm *running_farm = NULL;
 
 const char *param_sys_desc_file = NULL;
 bool param_do_benchmark = false;
+sim_time_t param_benchmark_time = BENCHMARK_DEFAULT_DURATION;
+sim_time_t param_benchmark_warmup = 0;
+int param_benchmark_trials = 1;
+const char *param_benchmark_json = NULL;
+const char *param_benchmark_baseline = NULL;
+double param_benchmark_tolerance = 10.0;
+bool param_benchmark_perf = false;
+double param_speed = 1.0;
+int64_t param_pace_slice_us = 1000;
+int64_t param_pace_spin_us = 0;
+const char *param_checkpoint_at = NULL;
+const char *param_checkpoint_out = NULL;
+const char *param_resume_file = NULL;
+bool param_record = false;
+sim_time_t param_record_interval = RECORDER_DEFAULT_INTERVAL;
+double param_record_budget_mb = RECORDER_DEFAULT_BUDGET / 1048576.0;
+uint64_t param_rewind_cycles = 16;
+const char *param_record_inputs_file = NULL;
+const char *param_replay_inputs_file = NULL;
+const char *param_serve_socket = NULL;
+const char *param_serve_from = NULL;
+const char *param_batch_manifest = NULL;
+const char *param_sweep_spec = NULL;
+int param_farm_boards = 0;
+sim_time_t param_farm_quantum = FARM_DEFAULT_QUANTUM;
+sim_time_t param_farm_time = SIM_TIME_NEVER;
+int param_jobs = 0;
+const char *param_profile_file = NULL;
+bool param_isr_stats = false;
+bool param_host_costs = false;
+const char *param_trace_events_file = NULL;
+const char *param_vcd_file = NULL;
 
-void run_benchmark(Simulation &sim)
+bool run_benchmark(Simulation &sim, Mcu *mcu)
 {
-    struct timespec t0, t1;
+    SimulationBenchmark benchmark(&sim, mcu);
+    
+    benchmark.duration = param_benchmark_time;
+    benchmark.warmup = param_benchmark_warmup;
+    benchmark.trials = param_benchmark_trials;
+    
+    HostPerfCounters perf_counters;
+    if (param_benchmark_perf) {
+        string problem;
+        if (!perf_counters.open(problem))
+            warn("Some host performance counters are unavailable: %s", problem.c_str());
+        benchmark.perf_counters = &perf_counters;
+    }
+    
+    benchmark.run();
+    benchmark.writeReport(stdout);
+    
+    if (param_benchmark_json)
+        benchmark.writeJson(param_benchmark_json);
+    
+    if (param_benchmark_baseline)
+        return benchmark.compareWithBaseline(param_benchmark_baseline,
+            param_benchmark_tolerance / 100.0, stdout);
+    
+    return true;
+}
+
+void take_checkpoint(Simulation *sim)
+{
+    // Callbacks cannot be saved, so wait until any pending ones have run
+    if (sim->hasPendingCallbacks()) {
+        sim->scheduleCallbackIn(NULL, us_to_sim_time(1), [sim]() {
+            take_checkpoint(sim);
+        });
+        return;
+    }
+    
+    sim->saveCheckpoint(param_checkpoint_out);
+    info("Checkpoint saved to '%s' at %.6f s", param_checkpoint_out,
+        sim_time_to_ns(sim->time) / 1e9);
+    
+    sim->end();
+}
+
+void setup_checkpoint(Simulation &sim, SystemDescription &sys_desc)
+{
+    schedule_at_point(sim, sys_desc, param_checkpoint_at, [&sim]() {
+        take_checkpoint(&sim);
+    });
+}
+
+void run_server(Simulation &sim, SystemDescription &sys_desc)
+{
+    if (param_serve_from) {
+        schedule_at_point(sim, sys_desc, param_serve_from, [&sim]() {
+            sim.end();
+        });
+        
+        sim.sync_with_real_time = false;
+        sim.resume();
+    }
+    
+    TestServer server(&sim, &sys_desc, find_mcu(sys_desc));
+    server.serve(param_serve_socket);
+}
+
+int default_jobs(void)
+{
+    return param_jobs ? param_jobs : max(1, (int)thread::hardware_concurrency());
+}
 
-    sim.sync_with_real_time = false;
-    clock_gettime(CLOCK_MONOTONIC, &t0);
-    sim.runToTime(sec_to_sim_time(BENCHMARK_SECONDS));
-    clock_gettime(CLOCK_MONOTONIC, &t1);
+int run_batch(void)
+{
+    BatchRunner runner(param_batch_manifest);
+    Json::Value summary = runner.run(default_jobs());
     
-    int64_t sim_elapsed = BENCHMARK_SECONDS * 1000000000LL;
-    int64_t real_elapsed = timespec_delta_ns(&t1, &t0);
+    cout << Json::StyledWriter().write(summary);
+    
+    return summary["failed"].asInt() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
-    printf("Unsynced speed: %d%%\n", (int)(100LL*sim_elapsed/real_elapsed));
+void print_trace_line(Mcu *mcu)
+{
+    int pc = mcu->getPC();
+    const Symbol *symbol = mcu->getProgramSymbol(pc);
+    
+    printf("  cycle %llu: pc=%04x", (unsigned long long)mcu->getCycleCount(), pc);
+    if (symbol)
+        printf(" <%s+0x%x>", symbol->name.c_str(), 2 * pc - symbol->address);
+    printf("\n");
+}
+
+/**
+ * Rewinds a simulation that has just failed and traces the last few
+ * instructions the MCU executed before the failure.
+ */
+void post_mortem(ExecutionRecorder &recorder, Mcu *mcu)
+{
+    uint64_t fail_cycle = mcu->getCycleCount();
+    uint64_t cycle = (fail_cycle > param_rewind_cycles) ? fail_cycle - param_rewind_cycles : 0;
+    
+    info("Rewinding to cycle %llu; trace up to the failure follows",
+        (unsigned long long)cycle);
+    
+    recorder.seekToCycle(cycle);
+    while (true) {
+        print_trace_line(mcu);
+        if (mcu->getCycleCount() >= fail_cycle)
+            break;
+        
+        recorder.runToCycle(mcu->getCycleCount() + 1);
+    }
+}
+
+void write_profile(PCProfiler &profiler)
+{
+    string callgrind_file = string(param_profile_file) + ".callgrind";
+    string folded_file = string(param_profile_file) + ".folded";
+    
+    profiler.writeReport(param_profile_file);
+    profiler.writeCallgrind(callgrind_file.c_str());
+    profiler.writeFoldedStacks(folded_file.c_str());
+    
+    info("Profile of %llu cycles written to %s, %s and %s", (unsigned long long)profiler.totalCycles(),
+        param_profile_file, callgrind_file.c_str(), folded_file.c_str());
+}
+
+void handle_stop_signal(int signum)
+{
+    if (running_sim)
+        running_sim->requestStop();
+    if (running_farm)
+        running_farm->requestStop();
+}
+
+void run_farm(void)
+{
+    BoardFarm farm(param_sys_desc_file, param_farm_boards, param_farm_quantum);
+    
+    running_farm = &farm;
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+    
+    string error;
+    try {
+        farm.run(param_farm_time, default_jobs());
+    } catch (exception& e) {
+        error = e.what();
+    }
+    
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    running_farm = NULL;
+    
+    farm.reportStats();
+    
+    if (!error.empty())
+        fail("%s", error.c_str());
 }
 
 void show_help()
 {
-    printf("Invocation: megas2 [--benchmark] <system.msd>\n");
+    printf("Invocation: megas2 [options] <system.msd>\n");
+    printf("            megas2 --batch=MANIFEST [-j N]\n");
+    printf("            megas2 --sweep=SPEC [-j N] <system.msd>\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  --benchmark          Run unsynced for a few seconds and report speed\n");
+    printf("  --benchmark-time=T   Simulated time per benchmark trial (default: 5s)\n");
+    printf("  --benchmark-warmup=T Simulated time to run before measuring (default: 0)\n");
+    printf("  --benchmark-trials=N Number of benchmark trials (default: 1)\n");
+    printf("  --benchmark-json=F   Also write the benchmark results as JSON to F\n");
+    printf("  --benchmark-baseline=F  Compare the speed with the results in F (from\n");
+    printf("                       --benchmark-json), and fail if it is lower by more\n");
+    printf("                       than the tolerance and than the noise of the trials\n");
+    printf("  --benchmark-tolerance=PCT  Allowed slowdown, in percent (default: 10)\n");
+    printf("  --benchmark-perf     Also count host cycles, instructions, branch, cache and\n");
+    printf("                       TLB misses (with perf_event_open, where permitted)\n");
+    printf("                       (all --benchmark-* options imply --benchmark)\n");
+    printf("  --speed=N            Run at N times real time (default: 1)\n");
+    printf("  --pace-slice=USEC    Simulated time between real-time syncs (default: 1000)\n");
+    printf("  --pace-spin=USEC     Busy-wait the last USEC of each sync (default: 0)\n");
+    printf("  --checkpoint-at=T    Save a checkpoint at time T (e.g. 20s, 1500ms) or when\n");
+    printf("                       the MCU first reaches the function named T\n");
+    printf("  --checkpoint-out=F   File to save the checkpoint to (the run then ends)\n");
+    printf("  --resume=F           Continue from the checkpoint in file F. The system and\n");
+    printf("                       its firmware and SD image must be unchanged.\n");
+    printf("  --record-inputs=F    Log all external input (network, host clock) to file F\n");
+    printf("  --replay-inputs=F    Replay the external input logged in file F instead of\n");
+    printf("                       using the network and host clock\n");
+    printf("  --serve=SOCKET       Run tests requested on Unix socket SOCKET, each in a\n");
+    printf("                       forked copy of the booted system\n");
+    printf("  --serve-from=T       Boot up to time T or function T before serving\n");
+    printf("  --batch=MANIFEST     Run the simulations listed in MANIFEST (JSON) in a\n");
+    printf("                       thread pool, and print their results as JSON\n");
+    printf("  --sweep=SPEC         Run the system once for every combination of the\n");
+    printf("                       parameter values in SPEC (JSON), and print the\n");
+    printf("                       metrics of each run as CSV\n");
+    printf("  --farm=N             Run N copies of the system in lockstep, with their\n");
+    printf("                       network devices connected to a common switch\n");
+    printf("  --farm-quantum=T     Simulated time between switch updates, which is also\n");
+    printf("                       the switch latency (default: 100us)\n");
+    printf("  --farm-time=T        Simulated time to run the farm for (default: until\n");
+    printf("                       interrupted)\n");
+    printf("  -j N                 Number of threads for --batch and --farm, or processes\n");
+    printf("                       for --sweep (default: one per CPU)\n");
+    printf("  --record             Record the execution so that it can be rewound\n");
+    printf("  --record-interval=T  Simulated time between recorded snapshots (default: 10ms)\n");
+    printf("  --record-budget=MB   Memory available for snapshots (default: 256)\n");
+    printf("  --profile=F          Count the MCU cycles spent at each firmware address and\n");
+    printf("                       write a profile by function and address to F, one for\n");
+    printf("                       callgrind tools to F.callgrind, and the cycles by call\n");
+    printf("                       stack to F.folded (for flamegraph.pl or speedscope)\n");
+    printf("  --isr-stats          Time the interrupt handlers of the MCU, and print their\n");
+    printf("                       counts, durations and latencies on exit\n");
+    printf("  --host-costs         Measure the host time spent on each device and event,\n");
+    printf("                       and print a breakdown on exit\n");
+    printf("  --trace-events=F     Write a trace of the device events, SPI and I2C\n");
+    printf("                       transactions, interrupt handlers, Ethernet frames and SD\n");
+    printf("                       card block operations to F, in simulated time (JSON, for\n");
+    printf("                       chrome://tracing or ui.perfetto.dev)\n");
+    printf("  --vcd=F              Write the waveforms of the pins and analog buses marked\n");
+    printf("                       with 'trace_pins' or 'trace' in the system description\n");
+    printf("                       to F, in VCD format (e.g. for GTKWave)\n");
+    printf("  --rewind-on-fail=N   On failure, trace the last N MCU cycles (default: 16;\n");
+    printf("                       implies --record)\n");
     
     exit(EXIT_SUCCESS);
 }
 
 void process_args(int argc, char **argv)
 {
+    const char *value;
+    
     for (int i=1; i < argc; i++) {
         if (argv[i][0] == '-') {
             if (!strcmp(argv[i], "--benchmark")) {
                 param_do_benchmark = true;
+            } else if (!strcmp(argv[i], "--benchmark-perf")) {
+                param_benchmark_perf = true;
+                param_do_benchmark = true;
+            } else if ((value = flag_value(argc, argv, i, "--benchmark-time"))) {
+                if (!parse_sim_time(value, param_benchmark_time) || !param_benchmark_time)
+                    fail("Invalid value '%s' for --benchmark-time", value);
+                param_do_benchmark = true;
+            } else if ((value = flag_value(argc, argv, i, "--benchmark-warmup"))) {
+                if (!parse_sim_time(value, param_benchmark_warmup))
+                    fail("Invalid value '%s' for --benchmark-warmup", value);
+                param_do_benchmark = true;
+            } else if ((value = flag_value(argc, argv, i, "--benchmark-trials"))) {
+                param_benchmark_trials = (int)parse_double_flag(value, "--benchmark-trials");
+                if (param_benchmark_trials < 1)
+                    fail("--benchmark-trials must be at least 1");
+                param_do_benchmark = true;
+            } else if ((value = flag_value(argc, argv, i, "--benchmark-json"))) {
+                param_benchmark_json = value;
+                param_do_benchmark = true;
+            } else if ((value = flag_value(argc, argv, i, "--benchmark-baseline"))) {
+                param_benchmark_baseline = value;
+                param_do_benchmark = true;
+            } else if ((value = flag_value(argc, argv, i, "--benchmark-tolerance"))) {
+                param_benchmark_tolerance = parse_double_flag(value, "--benchmark-tolerance");
+                if (param_benchmark_tolerance < 0.0)
+                    fail("--benchmark-tolerance must not be negative");
+                param_do_benchmark = true;
+            } else if ((value = flag_value(argc, argv, i, "--speed"))) {
+                param_speed = parse_double_flag(value, "--speed");
+                if (param_speed <= 0.0)
+                    fail("--speed must be positive");
+            } else if ((value = flag_value(argc, argv, i, "--pace-slice"))) {
+                param_pace_slice_us = (int64_t)parse_double_flag(value, "--pace-slice");
+                if (param_pace_slice_us <= 0)
+                    fail("--pace-slice must be positive");
+            } else if ((value = flag_value(argc, argv, i, "--pace-spin"))) {
+                param_pace_spin_us = (int64_t)parse_double_flag(value, "--pace-spin");
+                if (param_pace_spin_us < 0)
+                    fail("--pace-spin must not be negative");
+            } else if ((value = flag_value(argc, argv, i, "--checkpoint-at"))) {
+                param_checkpoint_at = value;
+            } else if ((value = flag_value(argc, argv, i, "--checkpoint-out"))) {
+                param_checkpoint_out = value;
+            } else if ((value = flag_value(argc, argv, i, "--resume"))) {
+                param_resume_file = value;
+            } else if ((value = flag_value(argc, argv, i, "--record-inputs"))) {
+                param_record_inputs_file = value;
+            } else if ((value = flag_value(argc, argv, i, "--replay-inputs"))) {
+                param_replay_inputs_file = value;
+            } else if ((value = flag_value(argc, argv, i, "--serve"))) {
+                param_serve_socket = value;
+            } else if ((value = flag_value(argc, argv, i, "--serve-from"))) {
+                param_serve_from = value;
+            } else if ((value = flag_value(argc, argv, i, "--batch"))) {
+                param_batch_manifest = value;
+            } else if ((value = flag_value(argc, argv, i, "--sweep"))) {
+                param_sweep_spec = value;
+            } else if ((value = flag_value(argc, argv, i, "--farm"))) {
+                param_farm_boards = (int)parse_double_flag(value, "--farm");
+                if (param_farm_boards < 1)
+                    fail("--farm must be at least 1");
+            } else if ((value = flag_value(argc, argv, i, "--farm-quantum"))) {
+                if (!parse_sim_time(value, param_farm_quantum) || !param_farm_quantum)
+                    fail("Invalid value '%s' for --farm-quantum", value);
+            } else if ((value = flag_value(argc, argv, i, "--farm-time"))) {
+                if (!parse_sim_time(value, param_farm_time))
+                    fail("Invalid value '%s' for --farm-time", value);
+            } else if ((value = flag_value(argc, argv, i, "-j"))) {
+                param_jobs = (int)parse_double_flag(value, "-j");
+                if (param_jobs < 1)
+                    fail("-j must be at least 1");
+            } else if (!strcmp(argv[i], "--record")) {
+                param_record = true;
+            } else if ((value = flag_value(argc, argv, i, "--record-interval"))) {
+                if (!parse_sim_time(value, param_record_interval) || !param_record_interval)
+                    fail("Invalid value '%s' for --record-interval", value);
+                param_record = true;
+            } else if ((value = flag_value(argc, argv, i, "--record-budget"))) {
+                param_record_budget_mb = parse_double_flag(value, "--record-budget");
+                if (param_record_budget_mb <= 0.0)
+                    fail("--record-budget must be positive");
+                param_record = true;
+            } else if ((value = flag_value(argc, argv, i, "--profile"))) {
+                param_profile_file = value;
+            } else if (!strcmp(argv[i], "--isr-stats")) {
+                param_isr_stats = true;
+            } else if (!strcmp(argv[i], "--host-costs")) {
+                param_host_costs = true;
+            } else if ((value = flag_value(argc, argv, i, "--trace-events"))) {
+                param_trace_events_file = value;
+            } else if ((value = flag_value(argc, argv, i, "--vcd"))) {
+                param_vcd_file = value;
+            } else if ((value = flag_value(argc, argv, i, "--rewind-on-fail"))) {
+                param_rewind_cycles = (uint64_t)parse_double_flag(value, "--rewind-on-fail");
+                param_record = true;
             } else {
                 fail("Unknown flag '%s'", argv[i]);
             }
@@ -55,24 +411,188 @@ void process_args(int argc, char **argv)
         }
     }
     
+    if (param_batch_manifest) {
+        if (param_sys_desc_file)
+            fail("--batch does not take a system description");
+        if (param_sweep_spec || param_farm_boards)
+            fail("--batch cannot be used with --sweep or --farm");
+        if (param_profile_file || param_isr_stats || param_host_costs || param_trace_events_file ||
+            param_vcd_file)
+            fail("--profile, --isr-stats, --host-costs, --trace-events and --vcd cannot be used with "
+                "--batch");
+        return;
+    }
+    
     if (param_sys_desc_file == NULL) {
         show_help();
     }
+    
+    if ((param_checkpoint_at == NULL) != (param_checkpoint_out == NULL))
+        fail("--checkpoint-at and --checkpoint-out must be used together");
+    if (param_farm_boards && param_sweep_spec)
+        fail("--farm and --sweep cannot be used together");
+    if ((param_profile_file || param_isr_stats || param_host_costs || param_trace_events_file ||
+         param_vcd_file) && (param_farm_boards || param_sweep_spec))
+        fail("--profile, --isr-stats, --host-costs, --trace-events and --vcd cannot be used with "
+            "--farm or --sweep");
+    if ((param_profile_file || param_isr_stats || param_host_costs || param_trace_events_file ||
+         param_vcd_file) && param_serve_socket)
+        fail("--profile, --isr-stats, --host-costs, --trace-events and --vcd cannot be used with "
+            "--serve");
+    if (param_record_inputs_file && param_replay_inputs_file)
+        fail("--record-inputs and --replay-inputs cannot be used together");
 }
 
 int main(int argc, char **argv)
 {
     try {
         process_args(argc, argv);
-
+        
+        if (param_batch_manifest)
+            return run_batch();
+        
+        if (param_farm_boards) {
+            run_farm();
+            return EXIT_SUCCESS;
+        }
+        
         SystemDescription sys_desc(param_sys_desc_file);
         Simulation sim(sys_desc);
         
-        if (param_do_benchmark) {
-            run_benchmark(sim);
+        if (param_sweep_spec) {
+            ParameterSweep sweep(&sim, &sys_desc, param_sweep_spec);
+            sweep.run(default_jobs());
+            return EXIT_SUCCESS;
+        }
+        
+        sim.pacer.speed = param_speed;
+        sim.pacer.slice = us_to_sim_time(param_pace_slice_us);
+        sim.pacer.spin_ns = 1000LL * param_pace_spin_us;
+        
+        if (param_record_inputs_file)
+            sim.journal.recordTo(param_record_inputs_file);
+        if (param_replay_inputs_file)
+            sim.journal.replayFrom(param_replay_inputs_file, &sys_desc);
+        
+        if (param_resume_file)
+            sim.loadCheckpoint(param_resume_file);
+        else
+            sim.reset();
+        
+        if (param_checkpoint_at)
+            setup_checkpoint(sim, sys_desc);
+        
+        Mcu *mcu = find_mcu(sys_desc);
+        unique_ptr<ExecutionRecorder> recorder;
+        
+        if (param_record) {
+            if (!mcu)
+                fail("Recording needs a system with an MCU");
+            
+            recorder.reset(new ExecutionRecorder(&sim, mcu));
+            recorder->interval = param_record_interval;
+            recorder->budget = (size_t)(param_record_budget_mb * 1048576.0);
+            recorder->start();
+        }
+        
+        unique_ptr<PCProfiler> profiler;
+        if (param_profile_file) {
+            auto as_atmega = dynamic_cast<Atmega32 *>(mcu);
+            if (!as_atmega)
+                fail("Profiling needs a system with an Atmega32");
+            
+            profiler.reset(new PCProfiler(as_atmega));
+        }
+        
+        unique_ptr<TraceEventWriter> trace;
+        if (param_trace_events_file)
+            trace.reset(new TraceEventWriter(param_trace_events_file, &sim.time));
+        
+        unique_ptr<VcdWriter> vcd;
+        if (param_vcd_file) {
+            vcd.reset(new VcdWriter(param_vcd_file, &sim.time));
+            vcd->addTracedSignals(sys_desc.entities);
+            if (!vcd->signalCount())
+                warn("No pins or buses are marked for tracing in the system description");
+            vcd->start();
+        }
+        
+        // Interrupt handlers are traced through the statistics
+        unique_ptr<IsrStats> isr_stats;
+        auto as_atmega = dynamic_cast<Atmega32 *>(mcu);
+        if (param_isr_stats && !as_atmega)
+            fail("--isr-stats needs a system with an Atmega32");
+        if (as_atmega && (param_isr_stats || trace)) {
+            isr_stats.reset(new IsrStats());
+            if (trace)
+                isr_stats->trace_name = TraceEventWriter::entityName(as_atmega) + " interrupts";
+            as_atmega->setIsrStats(isr_stats.get());
+        }
+        
+        HostCostProfile host_costs;
+        if (param_host_costs)
+            sim.host_costs = &host_costs;
+        
+        bool failed = false;
+        bool rewind = false;
+        
+        if (param_serve_socket) {
+            run_server(sim, sys_desc);
+        } else if (param_do_benchmark) {
+            failed = !run_benchmark(sim, mcu);
         } else {
-            sim.run();
+            running_sim = &sim;
+            signal(SIGINT, handle_stop_signal);
+            signal(SIGTERM, handle_stop_signal);
+            
+            try {
+                sim.resume();
+            } catch (exception &e) {
+                if (!recorder)
+                    throw;
+                
+                cerr << e.what() << endl;
+                failed = true;
+                rewind = true;
+            }
+            
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            running_sim = NULL;
+            
+            if (!failed)
+                sim.pacer.reportStats();
+        }
+        
+        // Reports and traces are written, and the tools detached, before any
+        // rewind, so that the replayed cycles are not counted twice
+        if (profiler) {
+            write_profile(*profiler);
+            profiler.reset();
         }
+        if (isr_stats) {
+            if (param_isr_stats)
+                isr_stats->writeReport(stdout);
+            as_atmega->setIsrStats(NULL);
+        }
+        if (param_host_costs) {
+            host_costs.writeReport(stdout);
+            sim.host_costs = NULL;
+        }
+        if (trace) {
+            trace->close();
+            info("Trace written to '%s'", param_trace_events_file);
+        }
+        if (vcd) {
+            vcd->close();
+            info("Waveforms of %d signals written to '%s'", vcd->signalCount(), param_vcd_file);
+        }
+        
+        if (rewind)
+            post_mortem(*recorder, mcu);
+        
+        if (failed)
+            return EXIT_FAILURE;
     } catch (exception &e) {
         cerr << e.what() << endl;
         return EXIT_FAILURE;
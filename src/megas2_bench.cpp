@@ -0,0 +1,94 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "utils/fail.h"
+#include "utils/cmd_line.h"
+#include "microbench/microbench.h"
+#include "microbench/component_benches.h"
+
+const char *param_filter = NULL;
+const char *param_json = NULL;
+bool param_list = false;
+double param_min_time = MICROBENCH_DEFAULT_MIN_TIME;
+int param_repetitions = MICROBENCH_DEFAULT_REPETITIONS;
+
+void show_help()
+{
+    printf("Invocation: megas2-bench [options] [FILTER]\n");
+    printf("\n");
+    printf("Times single operations of the simulator's components, in ns per\n");
+    printf("operation. Only the benchmarks whose names contain FILTER are run.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  --list               List the benchmarks and exit\n");
+    printf("  --min-time=S         Minimum time per repetition, in seconds (default: 0.2)\n");
+    printf("  --repetitions=N      Repetitions per benchmark (default: 5)\n");
+    printf("  --json=F             Also write the results as JSON to F\n");
+    printf("  --help               Show this help\n");
+    
+    exit(EXIT_SUCCESS);
+}
+
+void process_args(int argc, char **argv)
+{
+    const char *value;
+    
+    for (int i=1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (!strcmp(argv[i], "--help")) {
+                show_help();
+            } else if (!strcmp(argv[i], "--list")) {
+                param_list = true;
+            } else if ((value = flag_value(argc, argv, i, "--min-time"))) {
+                param_min_time = parse_double_flag(value, "--min-time");
+                if (param_min_time <= 0.0)
+                    fail("--min-time must be positive");
+            } else if ((value = flag_value(argc, argv, i, "--repetitions"))) {
+                param_repetitions = (int)parse_double_flag(value, "--repetitions");
+                if (param_repetitions < 1)
+                    fail("--repetitions must be at least 1");
+            } else if ((value = flag_value(argc, argv, i, "--json"))) {
+                param_json = value;
+            } else {
+                fail("Unknown flag '%s'", argv[i]);
+            }
+        } else {
+            if (param_filter == NULL) {
+                param_filter = argv[i];
+            } else {
+                fail("Too many command-line arguments");
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    try {
+        process_args(argc, argv);
+        
+        MicrobenchSuite suite;
+        suite.min_time = param_min_time;
+        suite.repetitions = param_repetitions;
+        add_component_benchmarks(suite);
+        
+        if (param_list) {
+            for (auto& name : suite.names())
+                printf("%s\n", name.c_str());
+            return EXIT_SUCCESS;
+        }
+        
+        suite.run(param_filter, stdout);
+        
+        if (param_json)
+            suite.writeJson(param_json);
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
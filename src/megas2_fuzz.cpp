@@ -0,0 +1,187 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <signal.h>
+
+#include "utils/fail.h"
+#include "utils/cmd_line.h"
+#include "simulation/sys_desc.h"
+#include "simulation/simulation.h"
+#include "simulation/sim_points.h"
+#include "devices/atmega32/atmega32.h"
+#include "fuzz/fuzzer.h"
+
+const char *param_sys_desc_file = NULL;
+const char *param_inject = NULL;
+const char *param_boot_to = NULL;
+sim_time_t param_run_time = FUZZER_DEFAULT_RUN_TIME;
+sim_time_t param_byte_interval = FUZZER_DEFAULT_BYTE_INTERVAL;
+const char *param_idle = NULL;
+sim_time_t param_watchdog = FUZZER_DEFAULT_WATCHDOG;
+const char *param_stack_limit = NULL;
+const char *param_corpus_dir = NULL;
+const char *param_crashes_dir = NULL;
+int param_jobs = 1;
+uint64_t param_seed = 1;
+uint64_t param_iterations = 0;
+size_t param_max_len = FUZZER_DEFAULT_MAX_LEN;
+
+void handle_stop_signal(int signum)
+{
+    Fuzzer::stop_requested = true;
+}
+
+void show_help()
+{
+    printf("Invocation: megas2-fuzz [options] --inject=TARGET <system.msd>\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  --inject=TARGET      Where to feed inputs: enc28j60:ID (as an Ethernet frame\n");
+    printf("                       received by device ID), usart:MCU (as bytes received\n");
+    printf("                       by the MCU) or spi:ID (as the responses of SpiStub ID)\n");
+    printf("  --boot-to=T          Boot up to time T or function T before fuzzing\n");
+    printf("  --run=T              Simulated time to run each input for (default: 50ms)\n");
+    printf("  --byte-interval=T    Time between USART bytes (default: 100us)\n");
+    printf("  --idle=FUNC          Function the firmware returns to when idle; not\n");
+    printf("                       reaching it for the watchdog time counts as a hang\n");
+    printf("  --watchdog=T         Watchdog time for --idle (default: 100ms)\n");
+    printf("  --stack-limit=ADDR   Lowest valid stack address, or 0 for none (default:\n");
+    printf("                       the end of the firmware's static data)\n");
+    printf("  --corpus=DIR         Directory of inputs to start from and to save inputs\n");
+    printf("                       with new coverage to (shared between workers)\n");
+    printf("  --crashes=DIR        Directory to save crashing inputs to (default: crashes)\n");
+    printf("  -j N                 Run N workers in parallel (default: 1)\n");
+    printf("  --seed=N             Random seed (default: 1)\n");
+    printf("  --iterations=N       Stop each worker after N executions (default: never)\n");
+    printf("  --max-len=N          Maximum input length (default: 1024)\n");
+    
+    exit(EXIT_SUCCESS);
+}
+
+sim_time_t parse_time_flag(const char *value, const char *flag)
+{
+    sim_time_t time;
+    
+    if (!parse_sim_time(value, time) || !time)
+        fail("Invalid value '%s' for %s", value, flag);
+    
+    return time;
+}
+
+void process_args(int argc, char **argv)
+{
+    const char *value;
+    
+    for (int i=1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if ((value = flag_value(argc, argv, i, "--inject"))) {
+                param_inject = value;
+            } else if ((value = flag_value(argc, argv, i, "--boot-to"))) {
+                param_boot_to = value;
+            } else if ((value = flag_value(argc, argv, i, "--run"))) {
+                param_run_time = parse_time_flag(value, "--run");
+            } else if ((value = flag_value(argc, argv, i, "--byte-interval"))) {
+                param_byte_interval = parse_time_flag(value, "--byte-interval");
+            } else if ((value = flag_value(argc, argv, i, "--idle"))) {
+                param_idle = value;
+            } else if ((value = flag_value(argc, argv, i, "--watchdog"))) {
+                param_watchdog = parse_time_flag(value, "--watchdog");
+            } else if ((value = flag_value(argc, argv, i, "--stack-limit"))) {
+                param_stack_limit = value;
+            } else if ((value = flag_value(argc, argv, i, "--corpus"))) {
+                param_corpus_dir = value;
+            } else if ((value = flag_value(argc, argv, i, "--crashes"))) {
+                param_crashes_dir = value;
+            } else if ((value = flag_value(argc, argv, i, "-j"))) {
+                param_jobs = (int)parse_double_flag(value, "-j");
+                if (param_jobs < 1)
+                    fail("-j must be at least 1");
+            } else if ((value = flag_value(argc, argv, i, "--seed"))) {
+                param_seed = (uint64_t)parse_double_flag(value, "--seed");
+            } else if ((value = flag_value(argc, argv, i, "--iterations"))) {
+                param_iterations = (uint64_t)parse_double_flag(value, "--iterations");
+            } else if ((value = flag_value(argc, argv, i, "--max-len"))) {
+                param_max_len = (size_t)parse_double_flag(value, "--max-len");
+                if (!param_max_len)
+                    fail("--max-len must be positive");
+            } else {
+                fail("Unknown flag '%s'", argv[i]);
+            }
+        } else {
+            if (param_sys_desc_file == NULL) {
+                param_sys_desc_file = argv[i];
+            } else {
+                fail("Too many command-line arguments");
+            }
+        }
+    }
+    
+    if (param_sys_desc_file == NULL) {
+        show_help();
+    }
+    
+    if (param_inject == NULL)
+        fail("An injection target must be given with --inject");
+}
+
+int main(int argc, char **argv)
+{
+    try {
+        process_args(argc, argv);
+        
+        SystemDescription sys_desc(param_sys_desc_file);
+        Simulation sim(sys_desc);
+        
+        auto mcu = dynamic_cast<Atmega32 *>(find_mcu(sys_desc));
+        if (!mcu)
+            fail("Fuzzing needs a system with an ATmega32");
+        
+        sim.sync_with_real_time = false;
+        sim.reset();
+        
+        if (param_boot_to) {
+            schedule_at_point(sim, sys_desc, param_boot_to, [&sim]() {
+                sim.end();
+            });
+            sim.resume();
+        }
+        
+        Fuzzer fuzzer(&sim, &sys_desc, mcu);
+        fuzzer.setTarget(param_inject);
+        fuzzer.run_time = param_run_time;
+        fuzzer.byte_interval = param_byte_interval;
+        fuzzer.watchdog = param_watchdog;
+        fuzzer.max_len = param_max_len;
+        fuzzer.seed = param_seed;
+        fuzzer.iterations = param_iterations;
+        
+        if (param_idle) {
+            fuzzer.idle_pc = mcu->findProgramSymbolPC(param_idle);
+            if (fuzzer.idle_pc == -1)
+                fail("Symbol '%s' not found in the firmware", param_idle);
+        }
+        if (param_stack_limit)
+            fuzzer.stack_limit = (int)strtol(param_stack_limit, NULL, 0);
+        if (param_corpus_dir)
+            fuzzer.corpus_dir = param_corpus_dir;
+        if (param_crashes_dir)
+            fuzzer.crashes_dir = param_crashes_dir;
+        
+        // Firmware under fuzzing tends to make devices complain a lot
+        mute_warnings(true);
+        
+        signal(SIGINT, handle_stop_signal);
+        signal(SIGTERM, handle_stop_signal);
+        
+        info("Fuzzing from %.6f s, stack limit %04x", sim_time_to_ns(sim.time) / 1e9,
+            fuzzer.stack_limit);
+        fuzzer.run(param_jobs);
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "utils/fail.h"
+#include "utils/cmd_line.h"
+#include "codegen/board_gen.h"
+
+const char *param_sys_desc_file = NULL;
+const char *param_output_file = NULL;
+
+void show_help()
+{
+    printf("Invocation: megas2-gen [options] <system.msd>\n");
+    printf("\n");
+    printf("Generates the C++ source of a simulator for just the given system, with its\n");
+    printf("devices wired up statically. Build it with \"make board MSD=<system.msd>\".\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -o FILE              File to write the source to (default: standard output)\n");
+    
+    exit(EXIT_SUCCESS);
+}
+
+void process_args(int argc, char **argv)
+{
+    const char *value;
+    
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            show_help();
+        } else if ((value = flag_value(argc, argv, i, "-o"))) {
+            param_output_file = value;
+        } else if (argv[i][0] == '-') {
+            fail("Unknown flag '%s'", argv[i]);
+        } else if (param_sys_desc_file == NULL) {
+            param_sys_desc_file = argv[i];
+        } else {
+            fail("Too many command-line arguments");
+        }
+    }
+    
+    if (param_sys_desc_file == NULL)
+        show_help();
+}
+
+int main(int argc, char **argv)
+{
+    try {
+        process_args(argc, argv);
+        
+        BoardGenerator generator(param_sys_desc_file);
+        
+        if (param_output_file) {
+            ofstream out(param_output_file);
+            if (!out.is_open())
+                fail("Cannot create file '%s'", param_output_file);
+            
+            generator.generate(out);
+            
+            if (!out.good())
+                fail("Error writing to '%s'", param_output_file);
+        } else {
+            generator.generate(cout);
+        }
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    
+    return EXIT_SUCCESS;
+}
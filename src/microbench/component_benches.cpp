@@ -0,0 +1,476 @@
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "component_benches.h"
+
+#include "simulation/simulation.h"
+#include "simulation/sim_device.h"
+#include "glue/spi_bus.h"
+#include "glue/spi_device.h"
+#include "glue/analog_bus.h"
+#include "glue/pin_device.h"
+#include "devices/spi_stub.h"
+#include "devices/voltage_src.h"
+#include "devices/sd_card.h"
+#include "devices/enc28j60/enc28j60.h"
+#include "devices/enc28j60/defs.h"
+#include "networking/eth_frame.h"
+#include "utils/bit_macros.h"
+#include "utils/fail.h"
+
+using namespace std;
+
+#define ETHERTYPE_TEST  0x88b5
+
+#define SD_IMAGE_SIZE   (1 << 20)
+
+// Where the ENC28J60 benchmarks keep the frame to transmit (after the
+// receive buffer)
+#define ENC_RX_END      0x19ff
+#define ENC_TX_START    0x1a00
+
+// Results of computations that must not be optimized away
+static volatile uint32_t sink;
+
+/**
+ * A device that does nothing but reschedule itself, if given a period.
+ */
+class BenchDevice : public SimulatedDevice {
+public:
+    BenchDevice(sim_time_t period = 0) : period(period) {}
+    
+    virtual void reset(void) {}
+    
+    virtual void act(int event)
+    {
+        if (period)
+            scheduleEventIn(0, period);
+    }
+private:
+    sim_time_t period;
+};
+
+/**
+ * Stands in for the MCU on an SPI bus.
+ */
+class BenchSpiMaster : public SpiDevice {
+public:
+    uint8_t transfer(uint8_t data)
+    {
+        _spiSendData(data);
+        return data;
+    }
+    
+    virtual bool spiReceiveData(uint8_t &data) { return false; }
+};
+
+static PinInitData const BENCH_PIN_INIT_DATA[1] = {
+    { "IN", PIN_MODE_INPUT, PIN_VAL_0 }
+};
+
+/**
+ * A device with a single input pin that ignores its changes, so that only
+ * the bus is measured.
+ */
+class BenchPinDevice : public PinDevice {
+public:
+    BenchPinDevice(void) : PinDevice(1, BENCH_PIN_INIT_DATA) {}
+protected:
+    virtual void _onPinChanged(int pin_id, pin_val_t value, pin_val_t old_value) {}
+};
+
+static EthernetFrame make_test_frame(int size)
+{
+    static const uint8_t SOURCE_MAC[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    static const uint8_t BROADCAST_MAC[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    
+    EthernetFrame frame;
+    
+    frame.is_null = false;
+    frame.is_malformed = false;
+    frame.has_fcs = false;
+    frame.dest_mac = mac_addr_t(BROADCAST_MAC, 6);
+    frame.src_mac = mac_addr_t(SOURCE_MAC, 6);
+    frame.ethertype = ETHERTYPE_TEST;
+    frame.padTo(size);
+    frame.addFcs();
+    
+    return frame;
+}
+
+// Scheduler
+
+enum QueueShape { QUEUE_FRONT, QUEUE_BACK, QUEUE_MIDDLE };
+
+static const char *QUEUE_SHAPE_NAMES[] = { "front", "back", "middle" };
+
+/**
+ * Schedules an event into a queue holding others (of another device), where
+ * the shape says whether it lands before, after or among them, then removes
+ * it again with unscheduleAll().
+ */
+static MicrobenchSetup schedule_bench(int queue_length, QueueShape shape)
+{
+    return [=]() -> MicrobenchBody {
+        struct State {
+            Simulation sim;
+            BenchDevice background;
+            BenchDevice probe;
+            uint32_t random;
+        };
+        auto state = make_shared<State>();
+        
+        state->sim.addDevice(&state->background);
+        state->sim.addDevice(&state->probe);
+        state->random = 1;
+        
+        for (int i = 1; i <= queue_length; i++)
+            state->sim.scheduleEvent(&state->background, 0, i * 1000);
+        
+        return [=](uint64_t ops) {
+            Simulation& sim = state->sim;
+            
+            for (uint64_t i = 0; i < ops; i++) {
+                sim_time_t time;
+                
+                switch (shape) {
+                    case QUEUE_FRONT:
+                        time = 0;
+                        break;
+                    case QUEUE_BACK:
+                        time = (queue_length + 1) * 1000;
+                        break;
+                    default:
+                        state->random = state->random * 1103515245 + 12345;
+                        time = 500 + (state->random >> 8) % (queue_length * 1000);
+                        break;
+                }
+                
+                sim.scheduleEvent(&state->probe, 0, time);
+                sim.unscheduleAll(&state->probe);
+            }
+        };
+    };
+}
+
+/**
+ * Runs the main loop on a device that reschedules itself every nanosecond,
+ * with other events pending further on.
+ */
+static MicrobenchSetup dispatch_bench(int queue_length)
+{
+    return [=]() -> MicrobenchBody {
+        struct State {
+            Simulation sim;
+            BenchDevice background;
+            BenchDevice ticker;
+            
+            State(void) : ticker(1) {}
+        };
+        auto state = make_shared<State>();
+        
+        state->sim.sync_with_real_time = false;
+        state->sim.addDevice(&state->background);
+        state->sim.addDevice(&state->ticker);
+        
+        state->sim.time = 0;
+        state->sim.scheduleEvent(&state->ticker, 0, 1);
+        for (int i = 1; i <= queue_length; i++)
+            state->sim.scheduleEvent(&state->background, 0, SIM_TIME_NEVER - i);
+        
+        return [=](uint64_t ops) {
+            state->sim.resume(state->sim.time + ops);
+        };
+    };
+}
+
+// Buses
+
+/**
+ * Sends a byte over an SPI bus with the given number of slaves (besides
+ * the master), of which one is selected.
+ */
+static MicrobenchSetup spi_bench(int slave_count)
+{
+    return [=]() -> MicrobenchBody {
+        struct State {
+            SpiBus bus;
+            BenchSpiMaster master;
+            vector<unique_ptr<SpiStub>> slaves;
+        };
+        auto state = make_shared<State>();
+        
+        state->bus.addDevice(&state->master);
+        for (int i = 0; i < slave_count; i++) {
+            state->slaves.emplace_back(new SpiStub());
+            state->bus.addDevice(state->slaves.back().get());
+        }
+        state->slaves[0]->drivePin(SPI_STUB_PIN_SLAVE_SELECT, PIN_VAL_0);
+        
+        return [=](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++) {
+                uint8_t data = (uint8_t)i;
+                state->bus.sendData(&state->master, data);
+            }
+        };
+    };
+}
+
+/**
+ * Toggles a voltage source on an analog bus that has the given number of
+ * pins in all (the others being inputs).
+ */
+static MicrobenchSetup analog_bus_bench(int pin_count)
+{
+    return [=]() -> MicrobenchBody {
+        struct State {
+            AnalogBus bus;
+            VoltageSource source;
+            vector<unique_ptr<BenchPinDevice>> inputs;
+        };
+        auto state = make_shared<State>();
+        
+        state->bus.addDevicePin(&state->source, VOLTAGE_SRC_PIN_OUTPUT);
+        for (int i = 1; i < pin_count; i++) {
+            state->inputs.emplace_back(new BenchPinDevice());
+            state->bus.addDevicePin(state->inputs.back().get(), 0);
+        }
+        
+        return [=](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++)
+                state->source.setValue((i & 1) ? DEFAULT_VCC : PIN_VAL_0);
+        };
+    };
+}
+
+// ENC28J60
+
+/**
+ * An ENC28J60 on an SPI bus, set up (over SPI, as firmware would) to
+ * receive broadcast frames and to transmit with automatic padding and CRC.
+ */
+class EncRig {
+public:
+    SpiBus bus;
+    BenchSpiMaster master;
+    Enc28J60 enc;
+    
+    EncRig(void)
+    {
+        bus.addDevice(&master);
+        bus.addDevice(&enc);
+        
+        select(true);
+        
+        writeReg(REG_ERXSTL, 0x00);
+        writeReg(REG_ERXSTH, 0x00);
+        writeReg(REG_ERXNDL, ENC_RX_END & 0xff);
+        writeReg(REG_ERXNDH, ENC_RX_END >> 8);
+        writeReg(REG_ERXRDPTL, 0x00);
+        writeReg(REG_ERXRDPTH, 0x00);
+        
+        writeReg(REG_MACON1, _BV(B_MARXEN));
+        writeReg(REG_MACON2, 0x00);
+        writeReg(REG_MACON3, 0x30); // Pad to 60 bytes and add CRC
+        
+        command(OPCODE_BIT_FIELD_SET, REG_ECON1, _BV(B_RXEN));
+    }
+    
+    void select(bool selected)
+    {
+        enc.drivePin(E28J_PIN_SLAVE_SELECT, selected ? PIN_VAL_0 : DEFAULT_VCC);
+    }
+    
+    void command(uint8_t opcode, uint8_t reg, uint8_t arg)
+    {
+        master.transfer((opcode << 5) | (reg & 0x1f));
+        master.transfer(arg);
+    }
+    
+    void writeReg(uint8_t reg, uint8_t value)
+    {
+        uint8_t bank = (reg >> 5) & 0x03;
+        
+        command(OPCODE_BIT_FIELD_CLEAR, REG_ECON1, _BV(B_BSEL1) | _BV(B_BSEL0));
+        if (bank)
+            command(OPCODE_BIT_FIELD_SET, REG_ECON1, bank);
+        command(OPCODE_WRITE_CONTROL_REG, reg, value);
+    }
+    
+    /**
+     * Puts a frame (without its FCS) in the buffer for transmission.
+     */
+    void loadTxFrame(const EthernetFrame& frame)
+    {
+        uint8_t data[2048];
+        int length = frame.toBuffer(data) - 4;
+        
+        writeReg(REG_EWRPTL, ENC_TX_START & 0xff);
+        writeReg(REG_EWRPTH, ENC_TX_START >> 8);
+        writeReg(REG_ETXSTL, ENC_TX_START & 0xff);
+        writeReg(REG_ETXSTH, ENC_TX_START >> 8);
+        writeReg(REG_ETXNDL, (ENC_TX_START + length) & 0xff);
+        writeReg(REG_ETXNDH, (ENC_TX_START + length) >> 8);
+        command(OPCODE_BIT_FIELD_CLEAR, REG_ECON1, _BV(B_BSEL1) | _BV(B_BSEL0));
+        
+        master.transfer((OPCODE_WRITE_BUFFER_MEMORY << 5) | 0x1a);
+        master.transfer(0x00); // Per-packet control byte
+        for (int i = 0; i < length; i++)
+            master.transfer(data[i]);
+        
+        select(false);
+        select(true);
+    }
+};
+
+/**
+ * Receives a frame from the network, and has the ENC28J60 drop it again
+ * (decrementing the packet count, as firmware would).
+ */
+static MicrobenchSetup enc_receive_bench(int frame_size)
+{
+    return [=]() -> MicrobenchBody {
+        auto rig = make_shared<EncRig>();
+        auto frame = make_shared<EthernetFrame>(make_test_frame(frame_size));
+        
+        return [=](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++) {
+                rig->enc.receiveFrame(*frame);
+                rig->command(OPCODE_BIT_FIELD_SET, REG_ECON2, _BV(B_PKTDEC));
+            }
+        };
+    };
+}
+
+/**
+ * Transmits a frame already in the ENC28J60 buffer (to no network).
+ */
+static MicrobenchSetup enc_transmit_bench(int frame_size)
+{
+    return [=]() -> MicrobenchBody {
+        auto rig = make_shared<EncRig>();
+        
+        rig->loadTxFrame(make_test_frame(frame_size));
+        
+        return [=](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++)
+                rig->command(OPCODE_BIT_FIELD_SET, REG_ECON1, _BV(B_TXRTS));
+        };
+    };
+}
+
+static MicrobenchSetup fcs_bench(int frame_size)
+{
+    return [=]() -> MicrobenchBody {
+        auto frame = make_shared<EthernetFrame>(make_test_frame(frame_size));
+        
+        return [=](uint64_t ops) {
+            uint32_t fcs = 0;
+            
+            for (uint64_t i = 0; i < ops; i++) {
+                frame->payload[0] = (char)i;
+                fcs ^= frame->computeFcs();
+            }
+            
+            sink = fcs;
+        };
+    };
+}
+
+// SD card
+
+/**
+ * Reads 512-byte blocks over SPI, one per operation, cycling through an
+ * image of SD_IMAGE_SIZE bytes (held in a temporary file).
+ */
+static MicrobenchSetup sd_read_bench(void)
+{
+    return [=]() -> MicrobenchBody {
+        struct State {
+            SpiBus bus;
+            BenchSpiMaster master;
+            unique_ptr<SdCard> card;
+            unsigned block;
+        };
+        auto state = make_shared<State>();
+        
+        char image_name[] = "/tmp/megas2-bench-sd-XXXXXX";
+        int fd = mkstemp(image_name);
+        if (fd < 0)
+            fail("Cannot create temporary SD card image");
+        if (ftruncate(fd, SD_IMAGE_SIZE) < 0)
+            fail("Cannot size temporary SD card image");
+        close(fd);
+        
+        // The card keeps the file open, so it can go from the directory
+        state->card.reset(new SdCard(image_name, SD_IMAGE_SIZE));
+        unlink(image_name);
+        
+        state->bus.addDevice(&state->master);
+        state->bus.addDevice(state->card.get());
+        state->card->drivePin(SDCARD_PIN_SLAVE_SELECT, PIN_VAL_0);
+        state->block = 0;
+        
+        static const uint8_t GO_IDLE_STATE[6] = { 0x40, 0x00, 0x00, 0x00, 0x00, 0x95 };
+        for (int i = 0; i < 6; i++)
+            state->master.transfer(GO_IDLE_STATE[i]);
+        state->master.transfer(0xff);
+        
+        return [=](uint64_t ops) {
+            BenchSpiMaster& master = state->master;
+            uint32_t checksum = 0;
+            
+            for (uint64_t i = 0; i < ops; i++) {
+                uint32_t address = state->block * SDCARD_SECTOR_SIZE;
+                state->block = (state->block + 1) % (SD_IMAGE_SIZE / SDCARD_SECTOR_SIZE - 1);
+                
+                master.transfer(0x51); // READ_SINGLE_BLOCK
+                master.transfer(address >> 24);
+                master.transfer(address >> 16);
+                master.transfer(address >> 8);
+                master.transfer(address);
+                master.transfer(0x01);
+                
+                master.transfer(0xff); // R1
+                for (int j = 0; j < 1 + SDCARD_SECTOR_SIZE + 2; j++)
+                    checksum += master.transfer(0xff);
+            }
+            
+            sink = checksum;
+        };
+    };
+}
+
+void add_component_benchmarks(MicrobenchSuite& suite)
+{
+    static const int QUEUE_LENGTHS[] = { 0, 16, 256, 4096 };
+    
+    for (QueueShape shape : { QUEUE_FRONT, QUEUE_BACK, QUEUE_MIDDLE })
+        for (int length : QUEUE_LENGTHS) {
+            if (!length && (shape != QUEUE_FRONT))
+                continue;
+            
+            suite.add(string("scheduler/schedule+unschedule_all/") + QUEUE_SHAPE_NAMES[shape] +
+                "/queue=" + to_string(length), schedule_bench(length, shape));
+        }
+    for (int length : QUEUE_LENGTHS)
+        suite.add("scheduler/dispatch/queue=" + to_string(length), dispatch_bench(length));
+    
+    for (int slaves : { 1, 2, 4, 8 })
+        suite.add("spi_bus/send_data/slaves=" + to_string(slaves), spi_bench(slaves));
+    for (int pins : { 2, 4, 8, 32 })
+        suite.add("analog_bus/update/pins=" + to_string(pins), analog_bus_bench(pins));
+    
+    for (int size : { 64, 1518 }) {
+        suite.add("enc28j60/receive/" + to_string(size) + "B", enc_receive_bench(size));
+        suite.add("enc28j60/transmit/" + to_string(size) + "B", enc_transmit_bench(size));
+        suite.add("eth_frame/compute_fcs/" + to_string(size) + "B", fcs_bench(size));
+    }
+    
+    suite.add("sd_card/read_block", sd_read_bench());
+    
+    add_cpu_benchmarks(suite);
+}
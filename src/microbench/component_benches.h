@@ -0,0 +1,19 @@
+#ifndef _H_COMPONENT_BENCHES_H
+#define _H_COMPONENT_BENCHES_H
+
+#include "microbench.h"
+
+/**
+ * Adds the microbenchmarks of the simulator's components: the scheduler,
+ * the SPI and analog buses, the ENC28J60 and SD card models, Ethernet FCS
+ * computation and the dispatch of each class of AVR instruction.
+ */
+void add_component_benchmarks(MicrobenchSuite& suite);
+
+/**
+ * Adds just the instruction dispatch benchmarks (cpu_benches.cpp, apart as
+ * the ATmega32 and ENC28J60 definitions clash).
+ */
+void add_cpu_benchmarks(MicrobenchSuite& suite);
+
+#endif
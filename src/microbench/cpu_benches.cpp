@@ -0,0 +1,83 @@
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "component_benches.h"
+
+#include "devices/atmega32/atmega32.h"
+#include "devices/atmega32/defs.h"
+
+using namespace std;
+
+struct OpcodeClass {
+    const char *name;
+    vector<uint16_t> unit;      // Code repeated throughout the program
+};
+
+static const OpcodeClass OPCODE_CLASSES[] = {
+    { "nop", { 0x0000 } },
+    { "alu_reg", { 0x0c12 } },                          // ADD r1, r2
+    { "alu_imm", { 0x5001 } },                          // SUBI r16, 1
+    { "movw", { 0x01cd } },                             // MOVW r24, r26
+    { "mul", { 0x9c23 } },                              // MUL r2, r3
+    { "ld_st", { 0x900c, 0x920c } },                    // LD r0, X / ST X, r0
+    { "lds_sts", { 0x9000, 0x0100, 0x9200, 0x0100 } },  // LDS/STS r0, 0x0100
+    { "push_pop", { 0x920f, 0x900f } },                 // PUSH r0 / POP r0
+    { "lpm", { 0x95c8 } },                              // LPM
+    { "in_out", { 0xb389, 0xbb8b } },                   // IN r24, PINA / OUT PORTA, r24
+    { "sbi_cbi", { 0x9ad8, 0x98d8 } },                  // SBI/CBI PORTA, 0
+    { "cp_branch", { 0x1412, 0xf401 } },                // CP r1, r2 / BRNE .+0
+    { "skip", { 0x1011, 0x0000 } },                     // CPSE r1, r1 (over a NOP)
+    { "rjmp", { 0xc000 } },                             // RJMP .+0
+    { "call_ret", { 0xd001, 0xc001, 0x9508 } },         // RCALL / RET / RJMP over it
+};
+
+// Sets up the SP (to the top of RAM), X (to 0x0100) and Z (to 0)
+static const uint16_t DISPATCH_PROLOGUE[] = {
+    0xe50f, 0xbf0d, 0xe008, 0xbf0e, 0xe0a0, 0xe0b1, 0xe0e0, 0xe0f0
+};
+
+#define DISPATCH_LOOP_WORDS  1024
+
+/**
+ * Runs a program made of one class of instructions, over and over, on an
+ * ATmega32. Operations are instructions, each dispatched as a cycle of the
+ * MCU would be (but without the scheduler).
+ */
+static MicrobenchSetup dispatch_bench(const OpcodeClass& opcode_class)
+{
+    return [=]() -> MicrobenchBody {
+        auto image = make_shared<FirmwareImage>(MEGA32_FLASH_SIZE);
+        int loop_start = sizeof(DISPATCH_PROLOGUE) / sizeof(DISPATCH_PROLOGUE[0]);
+        
+        memcpy(image->flash, DISPATCH_PROLOGUE, sizeof(DISPATCH_PROLOGUE));
+        
+        int pc = loop_start;
+        int unit_size = (int)opcode_class.unit.size();
+        while (pc + unit_size <= loop_start + DISPATCH_LOOP_WORDS)
+            for (uint16_t word : opcode_class.unit)
+                image->flash[pc++] = word;
+        image->flash[pc++] = 0x940c; // JMP loop_start
+        image->flash[pc++] = loop_start;
+        
+        auto mcu = make_shared<Atmega32>();
+        mcu->loadProgram(image);
+        mcu->reset();
+        
+        // Leave the prologue behind
+        for (int i = 0; i < loop_start; i++)
+            mcu->act(SIM_EVENT_TICK);
+        
+        return [=](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i++)
+                mcu->act(SIM_EVENT_TICK);
+        };
+    };
+}
+
+void add_cpu_benchmarks(MicrobenchSuite& suite)
+{
+    for (auto& opcode_class : OPCODE_CLASSES)
+        suite.add(string("cpu/") + opcode_class.name, dispatch_bench(opcode_class));
+}
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <fstream>
+
+#include "microbench.h"
+
+#include "utils/fail.h"
+#include "utils/time.h"
+
+using namespace std;
+
+// Calibration stops growing the number of operations at this many
+#define MAX_OPS  (1ULL << 40)
+
+MicrobenchSuite::MicrobenchSuite(void)
+    : min_time(MICROBENCH_DEFAULT_MIN_TIME), repetitions(MICROBENCH_DEFAULT_REPETITIONS)
+{
+}
+
+void MicrobenchSuite::add(const string& name, MicrobenchSetup setup)
+{
+    benchmarks.push_back({ name, setup });
+}
+
+vector<string> MicrobenchSuite::names(void)
+{
+    vector<string> names;
+    
+    for (auto& benchmark : benchmarks)
+        names.push_back(benchmark.name);
+    
+    return names;
+}
+
+static int64_t time_body(MicrobenchBody& body, uint64_t ops)
+{
+    int64_t start_ns = monotonic_raw_time_ns();
+    body(ops);
+    
+    return max(monotonic_raw_time_ns() - start_ns, (int64_t)1);
+}
+
+MicrobenchResult MicrobenchSuite::_measure(const Benchmark& benchmark)
+{
+    MicrobenchBody body = benchmark.setup();
+    int64_t min_ns = (int64_t)(min_time * 1e9);
+    
+    // Grow the count tenfold at most per round, until a run takes a tenth
+    // of the minimum time, then scale it up to the full time
+    uint64_t ops = 1;
+    int64_t elapsed_ns;
+    while (((elapsed_ns = time_body(body, ops)) < min_ns / 10) && (ops < MAX_OPS))
+        ops *= min((uint64_t)10, max((uint64_t)2, (uint64_t)(min_ns / 10 / elapsed_ns)));
+    
+    ops = max(ops, (uint64_t)(ops * ((double)min_ns / elapsed_ns)));
+    
+    vector<double> samples;
+    for (int i = 0; i < repetitions; i++)
+        samples.push_back((double)time_body(body, ops) / ops);
+    
+    sort(samples.begin(), samples.end());
+    
+    MicrobenchResult result;
+    result.name = benchmark.name;
+    result.ops = ops;
+    result.ns_per_op = samples[samples.size() / 2];
+    result.min_ns_per_op = samples[0];
+    
+    return result;
+}
+
+/**
+ * Runs the benchmarks whose names contain the filter (or all of them),
+ * reporting each as it finishes.
+ */
+void MicrobenchSuite::run(const char *filter, FILE *f)
+{
+    if (repetitions < 1)
+        fail("Microbenchmarks need at least one repetition");
+    
+    results.clear();
+    
+    fprintf(f, "%-52s %12s %12s %14s\n", "benchmark", "ns/op", "best ns/op", "ops/repetition");
+    
+    for (auto& benchmark : benchmarks) {
+        if (filter && (benchmark.name.find(filter) == string::npos))
+            continue;
+        
+        MicrobenchResult result = _measure(benchmark);
+        results.push_back(result);
+        
+        fprintf(f, "%-52s %12.2f %12.2f %14llu\n", result.name.c_str(), result.ns_per_op,
+            result.min_ns_per_op, (unsigned long long)result.ops);
+        fflush(f);
+    }
+}
+
+Json::Value MicrobenchSuite::toJson(void)
+{
+    Json::Value json;
+    
+    json["min_time_s"] = min_time;
+    json["repetitions"] = repetitions;
+    
+    json["benchmarks"] = Json::Value(Json::arrayValue);
+    for (auto& result : results) {
+        Json::Value item;
+        item["name"] = result.name;
+        item["ops"] = (Json::UInt64)result.ops;
+        item["ns_per_op"] = result.ns_per_op;
+        item["min_ns_per_op"] = result.min_ns_per_op;
+        json["benchmarks"].append(item);
+    }
+    
+    return json;
+}
+
+void MicrobenchSuite::writeJson(const char *filename)
+{
+    ofstream file(filename);
+    if (file.fail())
+        fail("Cannot create benchmark results file '%s'", filename);
+    
+    file << Json::StyledWriter().write(toJson());
+}
@@ -0,0 +1,69 @@
+#ifndef _H_MICROBENCH_H
+#define _H_MICROBENCH_H
+
+#include <inttypes.h>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+using namespace std;
+
+#define MICROBENCH_DEFAULT_MIN_TIME     0.2
+#define MICROBENCH_DEFAULT_REPETITIONS  5
+
+/**
+ * Performs the operation being measured the given number of times.
+ */
+typedef function<void(uint64_t ops)> MicrobenchBody;
+
+/**
+ * Sets up whatever a benchmark needs (outside of the measurement) and
+ * returns its body, which holds on to it.
+ */
+typedef function<MicrobenchBody(void)> MicrobenchSetup;
+
+struct MicrobenchResult {
+    string name;
+    uint64_t ops;               // Per repetition
+    double ns_per_op;           // Median over the repetitions
+    double min_ns_per_op;
+};
+
+/**
+ * A set of microbenchmarks, each timing a single operation of some part of
+ * the simulator in isolation.
+ *
+ * For each benchmark, the number of operations is first calibrated so that
+ * a repetition takes at least the minimum time; the body is then run that
+ * many times per repetition, and the median and the best time per
+ * operation are reported.
+ */
+class MicrobenchSuite {
+public:
+    MicrobenchSuite(void);
+
+    double min_time;            // In seconds, per repetition
+    int repetitions;
+
+    void add(const string& name, MicrobenchSetup setup);
+    vector<string> names(void);
+
+    void run(const char *filter, FILE *f);
+    Json::Value toJson(void);
+    void writeJson(const char *filename);
+private:
+    struct Benchmark {
+        string name;
+        MicrobenchSetup setup;
+    };
+
+    vector<Benchmark> benchmarks;
+    vector<MicrobenchResult> results;
+
+    MicrobenchResult _measure(const Benchmark& benchmark);
+};
+
+#endif
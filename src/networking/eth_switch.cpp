@@ -0,0 +1,107 @@
+#include <cstring>
+#include <algorithm>
+
+#include "eth_switch.h"
+
+#define DEFAULT_PORT_NAME "Switch port"
+
+static uint64_t mac_key(const mac_addr_t& addr)
+{
+    uint64_t key = 0;
+    memcpy(&key, addr.octets, sizeof(addr.octets));
+    
+    return key;
+}
+
+static bool is_group_address(const mac_addr_t& addr)
+{
+    return addr.isMulticast() || addr.isBroadcast();
+}
+
+SwitchPort::SwitchPort(int index)
+    : VirtualNetwork()
+{
+    this->id = DEFAULT_PORT_NAME " " + to_string(index);
+    this->index = index;
+}
+
+void SwitchPort::sendFrame(const EthernetFrame& frame)
+{
+    outbox.push_back(make_pair(simulation->time, frame));
+}
+
+void SwitchPort::reset(void)
+{
+    unscheduleAll();
+    outbox.clear();
+}
+
+void SwitchPort::loadCheckpoint(StateReader& in)
+{
+}
+
+void SwitchPort::receiveSwitchedFrame(shared_ptr<EthernetFrame> frame, sim_time_t time)
+{
+    // Never deliver into the board's past, even if the owner lets it run
+    // beyond the forwarding point
+    scheduleCallback(max(time, simulation->time), [this, frame]() {
+        deliverFrame(*frame);
+    });
+}
+
+EthernetSwitch::EthernetSwitch(sim_time_t latency)
+{
+    this->latency = latency;
+    
+    frames_forwarded = 0;
+    frames_flooded = 0;
+}
+
+/**
+ * Adds a port to the switch for a board with the given simulation. The port
+ * is owned by the switch; connect the board's network devices to it.
+ */
+SwitchPort *EthernetSwitch::addPort(Simulation *sim)
+{
+    ports.push_back(unique_ptr<SwitchPort>(new SwitchPort((int)ports.size())));
+    sim->addDevice(ports.back().get());
+    
+    return ports.back().get();
+}
+
+/**
+ * Delivers the frames sent since the last call. None of the simulations
+ * connected to the switch may be running meanwhile.
+ */
+void EthernetSwitch::forwardFrames(void)
+{
+    for (auto& port : ports) {
+        for (auto& entry : port->outbox) {
+            auto frame = make_shared<EthernetFrame>(entry.second);
+            if (!frame->has_fcs) {
+                frame->padTo(60);
+                frame->addFcs();
+            }
+            
+            sim_time_t arrival = entry.first + latency;
+            
+            if (!is_group_address(frame->src_mac))
+                mac_table[mac_key(frame->src_mac)] = port->index;
+            
+            auto dest = mac_table.find(mac_key(frame->dest_mac));
+            if (!is_group_address(frame->dest_mac) && (dest != mac_table.end())) {
+                if (dest->second != port->index)
+                    ports[dest->second]->receiveSwitchedFrame(frame, arrival);
+                frames_forwarded++;
+                continue;
+            }
+            
+            for (auto& other : ports)
+                if (other != port)
+                    other->receiveSwitchedFrame(frame, arrival);
+            frames_flooded++;
+        }
+        
+        port->outbox.clear();
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef _H_ETH_SWITCH_H
+#define _H_ETH_SWITCH_H
+
+#include <inttypes.h>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "simulation/simulation.h"
+#include "networking/virtual_net.h"
+
+#include "eth_frame.h"
+
+using namespace std;
+
+
+class EthernetSwitch;
+
+/**
+ * The network that the network devices of one board see when the board is
+ * connected to an EthernetSwitch (instead of the host, through a TAP
+ * interface). It is added to the board's simulation as a device.
+ */
+class SwitchPort : public VirtualNetwork
+{
+    friend class EthernetSwitch;
+public:
+    SwitchPort(int index);
+
+    virtual void sendFrame(const EthernetFrame& frame);
+
+    virtual void reset();
+    virtual void loadCheckpoint(StateReader& in);
+protected:
+    int index;
+
+    vector<pair<sim_time_t, EthernetFrame>> outbox;
+
+    void receiveSwitchedFrame(shared_ptr<EthernetFrame> frame, sim_time_t time);
+};
+
+/**
+ * An Ethernet switch connecting boards that are each simulated separately,
+ * possibly in different threads (see BoardFarm).
+ *
+ * Frames sent through a port are only queued there. The owner of the
+ * simulations runs them all up to a common point in time, then calls
+ * forwardFrames() while none of them is running. Each frame is delivered at
+ * the time it was sent plus the switch latency, which must be no less than
+ * the interval between calls to forwardFrames(), so that no frame arrives in
+ * the past of its destination. Since frames are forwarded in port order,
+ * the result does not depend on how the simulations were scheduled.
+ *
+ * Like a real switch, it learns the port behind each source MAC address and
+ * floods frames to unknown, broadcast and multicast addresses.
+ */
+class EthernetSwitch
+{
+public:
+    EthernetSwitch(sim_time_t latency);
+
+    SwitchPort *addPort(Simulation *sim);
+
+    void forwardFrames(void);
+
+    sim_time_t latency;
+
+    uint64_t frames_forwarded;
+    uint64_t frames_flooded;
+protected:
+    vector<unique_ptr<SwitchPort>> ports;
+    map<uint64_t, int> mac_table;
+};
+
+#endif
@@ -2,6 +2,8 @@
 
 #include "virtual_net.h"
 
+#include "profiling/trace_events.h"
+
 NetworkDevice::NetworkDevice()
 {
     this->network = NULL;
@@ -35,28 +37,21 @@ void NetworkDevice::disconnectFromNetwork(void)
     }
 }
 
-EthernetFrame NetworkDevice::getPendingFrame(void)
-{
-    lock_guard<mutex> guard(this->receive_lock);
-    
-    if (this->receive_buffer.size()) {
-        EthernetFrame frame = this->receive_buffer.front();
-        this->receive_buffer.pop_front();
-        
-        return frame;
-    } else
-        return EthernetFrame();
-}
-
 void NetworkDevice::sendFrame(const EthernetFrame& frame)
 {
-    if (this->network)
-        this->network->sendFrame(frame);
+    if (!this->network)
+        return;
+    
+    if (__builtin_expect(TraceEventWriter::active != NULL, 0))
+        this->network->traceFrame("sent frame", frame);
+    
+    this->network->sendFrame(frame);
 }
 
-void NetworkDevice::onReceiveFrame(const EthernetFrame& frame)
+/**
+ * Hands a frame directly to the device, as if it came from the network.
+ */
+void NetworkDevice::receiveFrame(const EthernetFrame& frame)
 {
-    lock_guard<mutex> guard(this->receive_lock);
-    
-    this->receive_buffer.push_back(frame);
+    onReceiveFrame(frame);
 }
@@ -1,8 +1,6 @@
 #ifndef _H_NET_DEVICE_H
 #define _H_NET_DEVICE_H
 
-#include <mutex>
-#include <deque>
 #include <string>
 
 #include "eth_frame.h"
@@ -22,16 +20,14 @@ public:
     
     void connectToNetwork(VirtualNetwork *network);
     void disconnectFromNetwork(void);
+    
+    void receiveFrame(const EthernetFrame& frame);
 protected:
     VirtualNetwork *network;
     
-    mutex receive_lock;
-    deque<EthernetFrame> receive_buffer;
-    
-    EthernetFrame getPendingFrame(void);
     void sendFrame(const EthernetFrame& frame);
     
-    virtual void onReceiveFrame(const EthernetFrame& frame);
+    virtual void onReceiveFrame(const EthernetFrame& frame) = 0;
 };
 
 #endif
@@ -0,0 +1,86 @@
+#include "traffic_source.h"
+
+#include "simulation/sim_points.h"
+#include "utils/fail.h"
+
+#define DEFAULT_INTERVAL    ms_to_sim_time(1)
+#define DEFAULT_FRAME_SIZE  64
+#define MAX_FRAME_SIZE      1518
+
+#define ETHERTYPE_TEST      0x88b5 // For local experiments
+
+#define SIM_EVENT_SEND_FRAME 0
+
+static const uint8_t SOURCE_MAC[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t BROADCAST_MAC[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+TrafficSource::TrafficSource(Json::Value &json_data, EntityLookup *lookup)
+    : VirtualNetwork(json_data, lookup)
+{
+    interval = json_data.isMember("interval") ?
+        parse_json_time(json_data["interval"], "interval") : DEFAULT_INTERVAL;
+    if (!interval)
+        fail("Traffic source interval must be positive");
+    
+    frame_size = DEFAULT_FRAME_SIZE;
+    parseOptionalJsonParam(frame_size, json_data, "frame_size");
+    if ((frame_size < 64) || (frame_size > MAX_FRAME_SIZE))
+        fail("Traffic source frame size must be between 64 and %d", MAX_FRAME_SIZE);
+    
+    frames_sent = 0;
+    frames_received = 0;
+}
+
+void TrafficSource::act(int event)
+{
+    EthernetFrame frame;
+    
+    frame.is_null = false;
+    frame.is_malformed = false;
+    frame.has_fcs = false;
+    frame.dest_mac = mac_addr_t(BROADCAST_MAC, 6);
+    frame.src_mac = mac_addr_t(SOURCE_MAC, 6);
+    frame.ethertype = ETHERTYPE_TEST;
+    
+    uint32_t sequence = (uint32_t)frames_sent;
+    frame.payload.assign((const char *)&sequence, sizeof(sequence));
+    frame.padTo(frame_size);
+    frame.addFcs();
+    
+    frames_sent++;
+    deliverFrame(frame);
+    
+    scheduleEventIn(SIM_EVENT_SEND_FRAME, interval);
+}
+
+void TrafficSource::sendFrame(const EthernetFrame& frame)
+{
+    frames_received++;
+}
+
+void TrafficSource::reset(void)
+{
+    unscheduleAll();
+    
+    frames_sent = 0;
+    frames_received = 0;
+    
+    scheduleEventIn(SIM_EVENT_SEND_FRAME, interval);
+}
+
+void TrafficSource::saveState(StateWriter& out)
+{
+    out.put(frames_sent);
+    out.put(frames_received);
+}
+
+void TrafficSource::loadState(StateReader& in)
+{
+    in.get(frames_sent);
+    in.get(frames_received);
+}
+
+void TrafficSource::loadCheckpoint(StateReader& in)
+{
+    loadState(in);
+}
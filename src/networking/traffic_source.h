@@ -0,0 +1,44 @@
+#ifndef _H_TRAFFIC_SOURCE_H
+#define _H_TRAFFIC_SOURCE_H
+
+#include <inttypes.h>
+
+#include <json/json.h>
+
+#include "simulation/entity_lookup.h"
+#include "simulation/sim_time.h"
+
+#include "virtual_net.h"
+
+using namespace std;
+
+/**
+ * A network that, instead of connecting its devices to the host, sends them
+ * a broadcast frame of a fixed size at fixed intervals, and counts the
+ * frames they send back. Each frame carries its sequence number in the
+ * first four bytes of the payload. Being entirely simulated, it makes for
+ * reproducible network workloads, e.g.:
+ *
+ *   { "type": "TrafficSource", "devices": ["enc28j60"], "interval": "1ms", "frame_size": 64 }
+ */
+class TrafficSource : public VirtualNetwork
+{
+public:
+    TrafficSource(Json::Value &json_data, EntityLookup *lookup);
+
+    virtual void act(int event);
+    virtual void sendFrame(const EthernetFrame& frame);
+
+    virtual void reset();
+    virtual void saveState(StateWriter& out);
+    virtual void loadState(StateReader& in);
+    virtual void loadCheckpoint(StateReader& in);
+
+    uint64_t frames_sent;
+    uint64_t frames_received;
+protected:
+    sim_time_t interval;
+    int frame_size;
+};
+
+#endif
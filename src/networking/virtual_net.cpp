@@ -10,18 +10,15 @@
 #include <resolv.h>
 
 #include <chrono>
+#include <memory>
 
 #include "virtual_net.h"
 
+#include "profiling/trace_events.h"
 #include "utils/cpp_macros.h"
 #include "utils/fail.h"
 
 
-#define SIM_EVENT_CHECK_FRAMES         1
-
-const sim_time_t DEFAULT_CHECK_FRAMES_INTERVAL = ms_to_sim_time(10);
-
-
 #define DEFAULT_NAME "Virtual network"
 
 VirtualNetwork::VirtualNetwork(void)
@@ -83,6 +80,9 @@ VirtualNetwork::VirtualNetwork(Json::Value &json_data, EntityLookup *lookup)
 
 VirtualNetwork::~VirtualNetwork()
 {
+    if (!receive_frames_thread.joinable())
+        return;
+    
     close(shutdown_fds[1]);
     
     receive_frames_thread.join();
@@ -107,6 +107,20 @@ void VirtualNetwork::removeDevice(NetworkDevice *device)
 
 void VirtualNetwork::init(void)
 {
+    interface_fd = -1;
+}
+
+/**
+ * Creates the TAP interface and starts receiving frames from it. This is
+ * deferred until the simulation starts, and skipped entirely when the
+ * network input is replayed from a journal, so that such runs need neither
+ * root rights nor a network.
+ */
+void VirtualNetwork::openInterface(void)
+{
+    if ((interface_fd != -1) || !simulation || simulation->journal.isReplaying())
+        return;
+    
     if (pipe(shutdown_fds) < 0)
         fail("Failed to create shutdown pipe!");
     
@@ -160,47 +174,71 @@ void VirtualNetwork::receiveFramesThreadCode(void)
         if (count <= 0)
             break;
     
-        EthernetFrame frame = EthernetFrame(buffer, count, false);
-        frame.padTo(64);
-        frame.addFcs();
-    
-        lock.lock();
-        pending_frames.push_back(frame);
-        lock.unlock();
+        auto data = make_shared<string>((char *)buffer, count);
+        
+        postCallback([this, data]() {
+            receiveLiveFrame(*data);
+        });
     }
 }
 
 void VirtualNetwork::reset(void)
 {
     unscheduleAll();
-    scheduleEventIn(SIM_EVENT_CHECK_FRAMES, DEFAULT_CHECK_FRAMES_INTERVAL);
+    openInterface();
 }
 
-void VirtualNetwork::act(int event)
+void VirtualNetwork::loadCheckpoint(StateReader& in)
 {
-    EthernetFrame frame;
+    openInterface();
+}
+
+void VirtualNetwork::receiveLiveFrame(const string& data)
+{
+    // After a rewind, the frames received the first time around are replayed
+    // from the journal instead
+    if (simulation->journal.isReplaying())
+        return;
     
-    if (event == SIM_EVENT_CHECK_FRAMES) {
-        while (true) {
-            lock.lock();
-            if (pending_frames.empty()) {
-                lock.unlock();
-                break;
-            }
-            frame = pending_frames.front();
-            pending_frames.pop_front();
-            lock.unlock();
-        
-            for (auto& device : devices)
-                device->onReceiveFrame(frame);
-        }
-        
-        scheduleEventIn(SIM_EVENT_CHECK_FRAMES, DEFAULT_CHECK_FRAMES_INTERVAL);
-    }
+    simulation->journal.record(this, data);
+    replayInput(data);
+}
+
+void VirtualNetwork::replayInput(const string& data)
+{
+    EthernetFrame frame(data, false);
+    frame.padTo(64);
+    frame.addFcs();
+    
+    deliverFrame(frame);
+}
+
+void VirtualNetwork::deliverFrame(const EthernetFrame& frame)
+{
+    if (__builtin_expect(TraceEventWriter::active != NULL, 0))
+        traceFrame("delivered frame", frame);
+    
+    for (auto& device : devices)
+        device->onReceiveFrame(frame);
+}
+
+/**
+ * Shows a frame passing through the network in the active trace, on the
+ * track of the network.
+ */
+void VirtualNetwork::traceFrame(const char *what, const EthernetFrame& frame)
+{
+    TraceEventWriter *trace = TraceEventWriter::active;
+    
+    trace->instant(trace->track(TraceEventWriter::entityName(this)), what,
+        "length", frame.totalLength(), "ethertype", frame.ethertype);
 }
 
 void VirtualNetwork::sendFrame(const EthernetFrame& frame)
 {
+    if (interface_fd == -1)
+        return;
+    
     char data[65536];
     unsigned int data_len = frame.toBuffer(data);
     
@@ -3,15 +3,14 @@
 
 #include <string>
 #include <thread>
-#include <mutex>
 #include <vector>
-#include <deque>
 
 #include <json/json.h>
 
 #include "simulation/entity.h"
 #include "simulation/entity_lookup.h"
 #include "simulation/sim_device.h"
+#include "simulation/input_journal.h"
 #include "networking/net_device.h"
 
 #include "eth_frame.h"
@@ -23,7 +22,7 @@ using namespace std;
 const string DEFAULT_VNET_NAME = "megasnet0";
 
 
-class VirtualNetwork : public Entity, public SimulatedDevice
+class VirtualNetwork : public Entity, public SimulatedDevice, public JournaledDevice
 {
 public:
     VirtualNetwork(void);
@@ -36,10 +35,13 @@ public:
     void addDevice(NetworkDevice *device);
     void removeDevice(NetworkDevice *device);
     
-    void sendFrame(const EthernetFrame& frame);
+    virtual void sendFrame(const EthernetFrame& frame);
+    void traceFrame(const char *what, const EthernetFrame& frame);
     
-    void reset();
-    void act(int event);
+    virtual void reset();
+    
+    virtual void loadCheckpoint(StateReader& in);
+    virtual void replayInput(const string& data);
 protected:
     string interface_name;
     int interface_fd;
@@ -47,15 +49,16 @@ protected:
     
     thread receive_frames_thread;
     int shutdown_fds[2];
-    recursive_mutex lock;
     
     vector<NetworkDevice *> devices;
-    deque<EthernetFrame> pending_frames;
 
     void init(void);
+    void openInterface(void);
     void setInterfaceIpv4(ipv4_addr_t address);
     void ifupdown(bool bring_up);
     void receiveFramesThreadCode(void);
+    void receiveLiveFrame(const string& data);
+    void deliverFrame(const EthernetFrame& frame);
 };
 
 #endif
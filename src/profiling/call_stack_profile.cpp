@@ -0,0 +1,121 @@
+#include <cstdio>
+
+#include "call_stack_profile.h"
+
+#include "utils/fail.h"
+
+using namespace std;
+
+#define ROOT_NODE 0
+
+#define UNKNOWN_FUNCTION "??"
+
+CallStackProfile::CallStackProfile(const FirmwareImage *firmware) : firmware(firmware)
+{
+    nodes.push_back({ -1, NULL, map<const Symbol *, int>() });
+    
+    reset();
+}
+
+/**
+ * Forgets the stack (e.g. when the MCU is reset), but not the counts.
+ */
+void CallStackProfile::reset(void)
+{
+    frames.clear();
+    
+    cached_node = -1;
+    cached_symbol = NULL;
+    cached_counter = NULL;
+}
+
+void CallStackProfile::onCall(int caller_pc, int sp)
+{
+    _popFramesBelow(sp + 1);
+    
+    const Symbol *caller = firmware->flashSymbolAt(2 * caller_pc);
+    int parent = _currentNode();
+    
+    auto it = nodes[parent].children.find(caller);
+    int node;
+    
+    if (it != nodes[parent].children.end()) {
+        node = it->second;
+    } else {
+        node = (int)nodes.size();
+        nodes[parent].children[caller] = node;
+        nodes.push_back({ parent, caller, map<const Symbol *, int>() });
+    }
+    
+    frames.push_back({ node, sp });
+}
+
+void CallStackProfile::onReturn(int sp)
+{
+    _popFramesBelow(sp);
+}
+
+void CallStackProfile::countCycle(int pc)
+{
+    int node = _currentNode();
+    int byte_addr = 2 * pc;
+    
+    if ((node != cached_node) || !cached_symbol || (byte_addr < cached_symbol->address) ||
+        (byte_addr >= cached_symbol->address + cached_symbol->length)) {
+        cached_node = node;
+        cached_symbol = firmware->flashSymbolAt(byte_addr);
+        cached_counter = &counts[make_pair(node, cached_symbol)];
+    }
+    
+    (*cached_counter)++;
+}
+
+/**
+ * Gets the cycles spent in each stack, as "outer;...;inner" function names.
+ */
+map<string, uint64_t> CallStackProfile::foldedStacks(void)
+{
+    map<string, uint64_t> stacks;
+    
+    for (auto& item : counts) {
+        string stack = item.first.second ? item.first.second->name : UNKNOWN_FUNCTION;
+        
+        for (int node = item.first.first; node != ROOT_NODE; node = nodes[node].parent)
+            stack = (nodes[node].caller ? nodes[node].caller->name : UNKNOWN_FUNCTION) + ";" + stack;
+        
+        stacks[stack] += item.second;
+    }
+    
+    return stacks;
+}
+
+/**
+ * Writes the stacks in the "folded" format of flamegraph.pl, which
+ * speedscope also reads.
+ */
+void CallStackProfile::writeFolded(const char *filename)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        fail("Cannot create profile file '%s'", filename);
+    
+    for (auto& stack : foldedStacks())
+        fprintf(f, "%s %llu\n", stack.first.c_str(), (unsigned long long)stack.second);
+    
+    fclose(f);
+}
+
+int CallStackProfile::_currentNode(void)
+{
+    return frames.empty() ? ROOT_NODE : frames.back().node;
+}
+
+/**
+ * Drops the frames whose return address lies below the given SP, i.e. is no
+ * longer on the stack.
+ */
+void CallStackProfile::_popFramesBelow(int sp)
+{
+    while (!frames.empty() && (frames.back().sp < sp))
+        frames.pop_back();
+}
@@ -0,0 +1,70 @@
+#ifndef _H_CALL_STACK_PROFILE_H
+#define _H_CALL_STACK_PROFILE_H
+
+#include <inttypes.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "devices/mcu/firmware_image.h"
+
+using namespace std;
+
+/**
+ * Shadow call stack of an MCU, counting the cycles spent in each distinct
+ * stack of functions.
+ *
+ * The MCU reports calls (including interrupt entries) with the PC of the
+ * calling instruction and the SP just after the return address was pushed,
+ * and returns with the SP just after it was popped. Frames are matched by
+ * SP rather than by pairing calls and returns, so that the stack stays
+ * right when the firmware pops return addresses itself, returns through a
+ * pushed address, or resets the SP (as with longjmp): a return drops all
+ * frames whose return address is now above the stack, and a call first
+ * drops those whose return address it overwrites.
+ *
+ * Each cycle is counted against the current stack of callers plus the
+ * function the PC is in, so code reached by jumps rather than calls (as
+ * interrupt handlers are, from the vector table) shows up by its own name.
+ */
+class CallStackProfile {
+public:
+    CallStackProfile(const FirmwareImage *firmware);
+
+    void reset(void);
+    void onCall(int caller_pc, int sp);
+    void onReturn(int sp);
+    void countCycle(int pc);
+
+    map<string, uint64_t> foldedStacks(void);
+    void writeFolded(const char *filename);
+private:
+    struct Node {
+        int parent;
+        const Symbol *caller;
+        map<const Symbol *, int> children;
+    };
+
+    struct Frame {
+        int node;
+        int sp;
+    };
+
+    const FirmwareImage *firmware;
+
+    vector<Node> nodes;
+    vector<Frame> frames;
+    map<pair<int, const Symbol *>, uint64_t> counts;
+
+    // Counter for the last cycle, reused while the node and function stay
+    // the same
+    int cached_node;
+    const Symbol *cached_symbol;
+    uint64_t *cached_counter;
+
+    int _currentNode(void);
+    void _popFramesBelow(int sp);
+};
+
+#endif
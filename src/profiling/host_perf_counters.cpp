@@ -0,0 +1,152 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "host_perf_counters.h"
+
+using namespace std;
+
+#define PARANOID_FILE  "/proc/sys/kernel/perf_event_paranoid"
+
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+struct CounterDef {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+static const CounterDef COUNTER_DEFS[HOST_PERF_COUNTER_COUNT] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "L1d-misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { "LLC-misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { "dTLB-misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+};
+
+HostPerfCounters::HostPerfCounters(void)
+{
+    for (int i = 0; i < HOST_PERF_COUNTER_COUNT; i++)
+        fds[i] = -1;
+}
+
+HostPerfCounters::~HostPerfCounters()
+{
+    for (int i = 0; i < HOST_PERF_COUNTER_COUNT; i++)
+        if (fds[i] != -1)
+            close(fds[i]);
+}
+
+static string describe_open_error(int error)
+{
+    if ((error == EACCES) || (error == EPERM)) {
+        int paranoid = -1;
+        
+        FILE *f = fopen(PARANOID_FILE, "r");
+        if (f) {
+            if (fscanf(f, "%d", &paranoid) != 1)
+                paranoid = -1;
+            fclose(f);
+        }
+        
+        if (paranoid > 2)
+            return "not permitted (" PARANOID_FILE " is " + to_string(paranoid) +
+                "; it must be 2 or less)";
+        
+        return "not permitted (perf events may be blocked, e.g. in a container)";
+    }
+    
+    if ((error == ENOENT) || (error == EOPNOTSUPP) || (error == ENODEV))
+        return "not supported by this CPU (or VM)";
+    if (error == ENOSYS)
+        return "not supported by the kernel";
+    
+    return strerror(error);
+}
+
+/**
+ * Opens all the counters that the host allows, disabled. Returns false if
+ * some could not be opened, with the reason in problem.
+ */
+bool HostPerfCounters::open(string &problem)
+{
+    bool all_open = true;
+    
+    for (int i = 0; i < HOST_PERF_COUNTER_COUNT; i++) {
+        if (fds[i] != -1)
+            continue;
+        
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = COUNTER_DEFS[i].type;
+        attr.config = COUNTER_DEFS[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        
+        fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[i] == -1) {
+            if (all_open)
+                problem = describe_open_error(errno);
+            all_open = false;
+        }
+    }
+    
+    return all_open;
+}
+
+void HostPerfCounters::enable(void)
+{
+    for (int i = 0; i < HOST_PERF_COUNTER_COUNT; i++)
+        if (fds[i] != -1)
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+void HostPerfCounters::disable(void)
+{
+    for (int i = 0; i < HOST_PERF_COUNTER_COUNT; i++)
+        if (fds[i] != -1)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+}
+
+bool HostPerfCounters::isOpen(int counter)
+{
+    return fds[counter] != -1;
+}
+
+/**
+ * Gets the count so far, scaled up if the counter was not counting all the
+ * time it was enabled (in which case scaled is set). Returns false if the
+ * counter is not open, or never got to count.
+ */
+bool HostPerfCounters::read(int counter, double &value, bool &scaled)
+{
+    if (fds[counter] == -1)
+        return false;
+    
+    uint64_t data[3]; // value, time enabled, time running
+    if (::read(fds[counter], data, sizeof(data)) != sizeof(data))
+        return false;
+    if (!data[2])
+        return false;
+    
+    value = (double)data[0];
+    scaled = (data[2] < data[1]);
+    if (scaled)
+        value *= (double)data[1] / data[2];
+    
+    return true;
+}
+
+const char *HostPerfCounters::counterName(int counter)
+{
+    return COUNTER_DEFS[counter].name;
+}
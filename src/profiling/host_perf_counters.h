@@ -0,0 +1,45 @@
+#ifndef _H_HOST_PERF_COUNTERS_H
+#define _H_HOST_PERF_COUNTERS_H
+
+#include <inttypes.h>
+#include <string>
+
+using namespace std;
+
+#define HOST_PERF_CYCLES            0
+#define HOST_PERF_INSTRUCTIONS      1
+#define HOST_PERF_BRANCH_MISSES     2
+#define HOST_PERF_L1D_MISSES        3
+#define HOST_PERF_LLC_MISSES        4
+#define HOST_PERF_DTLB_MISSES       5
+
+#define HOST_PERF_COUNTER_COUNT     6
+
+/**
+ * Hardware performance counters of the host CPU (through Linux's
+ * perf_event_open), counting the user-space work of the calling thread
+ * while enabled.
+ *
+ * Counters that cannot be opened (for lack of permission, as set by
+ * /proc/sys/kernel/perf_event_paranoid, or of support by the CPU or a VM)
+ * are left out, and open() explains why. When the CPU has fewer counters
+ * than were opened, the kernel takes turns among them, and the values are
+ * scaled up from the time each was actually counting.
+ */
+class HostPerfCounters {
+public:
+    HostPerfCounters(void);
+    ~HostPerfCounters();
+
+    bool open(string &problem);
+    void enable(void);
+    void disable(void);
+
+    bool isOpen(int counter);
+    bool read(int counter, double &value, bool &scaled);
+    static const char *counterName(int counter);
+private:
+    int fds[HOST_PERF_COUNTER_COUNT];
+};
+
+#endif
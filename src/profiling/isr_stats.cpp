@@ -0,0 +1,174 @@
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "isr_stats.h"
+#include "trace_events.h"
+
+using namespace std;
+
+// As in the ATmega32 datasheet
+static const char *VECTOR_NAMES[ISR_STATS_VECTOR_COUNT + 1] = {
+    NULL, "RESET", "INT0", "INT1", "INT2", "TIMER2_COMP", "TIMER2_OVF", "TIMER1_CAPT",
+    "TIMER1_COMPA", "TIMER1_COMPB", "TIMER1_OVF", "TIMER0_COMP", "TIMER0_OVF", "SPI_STC",
+    "USART_RXC", "USART_UDRE", "USART_TXC", "ADC", "EE_RDY", "ANA_COMP", "TWI", "SPM_RDY"
+};
+
+IsrStats::IsrStats(void)
+{
+    clear();
+}
+
+/**
+ * Clears all statistics, and forgets any interrupts in progress.
+ */
+void IsrStats::clear(void)
+{
+    memset(vectors, 0, sizeof(vectors));
+    reset();
+}
+
+/**
+ * Forgets any interrupts in progress (e.g. when the MCU is reset), but not
+ * the statistics.
+ */
+void IsrStats::reset(void)
+{
+    memset(raised, 0, sizeof(raised));
+    active.clear();
+}
+
+/**
+ * Notes that the flag of an interrupt was raised, having been clear. (Flags
+ * raised again while still set do not count, as the first raise is what the
+ * handler is late for.)
+ */
+void IsrStats::onRaise(int vector, uint64_t cycle)
+{
+    raised[vector] = true;
+    raised_at[vector] = cycle;
+}
+
+void IsrStats::onEnter(int vector, int sp, uint64_t cycle)
+{
+    IsrVectorStats& stats = vectors[vector];
+    
+    // Handlers whose return address this overwrites are over
+    onReturn(sp + 1, cycle);
+    
+    stats.count++;
+    
+    if (raised[vector]) {
+        uint64_t latency = cycle - raised_at[vector];
+        
+        stats.latency_samples++;
+        stats.latency_cycles += latency;
+        stats.worst_latency = max(stats.worst_latency, latency);
+        
+        raised[vector] = false;
+    }
+    
+    TraceEventWriter *trace = TraceEventWriter::active;
+    active.push_back({ vector, sp, cycle, 0, (trace && !trace_name.empty()) ? trace->now() : SIM_TIME_NEVER });
+}
+
+void IsrStats::onReturn(int sp, uint64_t cycle)
+{
+    while (!active.empty() && (active.back().sp < sp)) {
+        ActiveIsr isr = active.back();
+        active.pop_back();
+        
+        IsrVectorStats& stats = vectors[isr.vector];
+        uint64_t duration = cycle - isr.entry_cycle;
+        
+        stats.inclusive_cycles += duration;
+        stats.exclusive_cycles += duration - isr.nested_cycles;
+        stats.worst_cycles = max(stats.worst_cycles, duration);
+        
+        if (!active.empty())
+            active.back().nested_cycles += duration;
+        
+        TraceEventWriter *trace = TraceEventWriter::active;
+        if (trace && (isr.entry_time != SIM_TIME_NEVER))
+            trace->slice(trace->track(trace_name), isr.entry_time, vectorName(isr.vector));
+    }
+}
+
+const char *IsrStats::vectorName(int vector)
+{
+    return ((vector > 0) && (vector <= ISR_STATS_VECTOR_COUNT)) ? VECTOR_NAMES[vector] : "?";
+}
+
+/**
+ * Finds a vector by name (e.g. "TIMER1_COMPA") or number. Returns -1 if
+ * there is no such vector.
+ */
+int IsrStats::lookupVector(const char *name)
+{
+    for (int vector = 1; vector <= ISR_STATS_VECTOR_COUNT; vector++)
+        if (!strcmp(name, VECTOR_NAMES[vector]))
+            return vector;
+    
+    char *end;
+    long vector = strtol(name, &end, 10);
+    if (*name && !*end && (vector > 0) && (vector <= ISR_STATS_VECTOR_COUNT))
+        return (int)vector;
+    
+    return -1;
+}
+
+/**
+ * Gets one of the statistics of a vector: "count", "cycles" (inclusive),
+ * "exclusive_cycles", "worst_cycles", "mean_latency" or "worst_latency".
+ */
+bool IsrStats::lookupStat(int vector, const char *stat, double &value)
+{
+    IsrVectorStats& stats = vectors[vector];
+    
+    if (!strcmp(stat, "count"))
+        value = stats.count;
+    else if (!strcmp(stat, "cycles"))
+        value = stats.inclusive_cycles;
+    else if (!strcmp(stat, "exclusive_cycles"))
+        value = stats.exclusive_cycles;
+    else if (!strcmp(stat, "worst_cycles"))
+        value = stats.worst_cycles;
+    else if (!strcmp(stat, "mean_latency"))
+        value = stats.latency_samples ? (double)stats.latency_cycles / stats.latency_samples : 0.0;
+    else if (!strcmp(stat, "worst_latency"))
+        value = stats.worst_latency;
+    else
+        return false;
+    
+    return true;
+}
+
+void IsrStats::writeReport(FILE *f)
+{
+    fprintf(f, "Interrupts (times in cycles):\n");
+    fprintf(f, "  %-13s %10s %14s %14s %10s %10s %10s\n", "vector", "count", "inclusive", "exclusive",
+        "worst", "latency", "worst lat.");
+    
+    bool any = false;
+    for (int vector = 1; vector <= ISR_STATS_VECTOR_COUNT; vector++) {
+        IsrVectorStats& stats = vectors[vector];
+        if (!stats.count)
+            continue;
+        
+        char latency[32] = "-";
+        char worst_latency[32] = "-";
+        if (stats.latency_samples) {
+            snprintf(latency, sizeof(latency), "%.1f", (double)stats.latency_cycles / stats.latency_samples);
+            snprintf(worst_latency, sizeof(worst_latency), "%llu", (unsigned long long)stats.worst_latency);
+        }
+        
+        fprintf(f, "  %-13s %10llu %14llu %14llu %10llu %10s %10s\n", VECTOR_NAMES[vector],
+            (unsigned long long)stats.count, (unsigned long long)stats.inclusive_cycles,
+            (unsigned long long)stats.exclusive_cycles, (unsigned long long)stats.worst_cycles,
+            latency, worst_latency);
+        any = true;
+    }
+    
+    if (!any)
+        fprintf(f, "  (none)\n");
+}
@@ -0,0 +1,73 @@
+#ifndef _H_ISR_STATS_H
+#define _H_ISR_STATS_H
+
+#include <inttypes.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "simulation/sim_time.h"
+
+using namespace std;
+
+#define ISR_STATS_VECTOR_COUNT  21
+
+struct IsrVectorStats {
+    uint64_t count;
+    uint64_t inclusive_cycles;      // Including nested interrupts
+    uint64_t exclusive_cycles;
+    uint64_t worst_cycles;          // Inclusive, for a single invocation
+
+    uint64_t latency_samples;
+    uint64_t latency_cycles;
+    uint64_t worst_latency;
+};
+
+/**
+ * Timing statistics for the interrupt handlers of an MCU, by vector (1 being
+ * RESET, as in the datasheet).
+ *
+ * The MCU reports when an interrupt flag is raised, when a handler is
+ * entered (with the SP after the return address was pushed), and every
+ * return (with the SP after the address was popped). A handler ends at the
+ * first return that takes its return address off the stack, which is
+ * normally its RETI. The latency of an invocation is the time from its flag
+ * being raised to the handler being entered, for the sources that report
+ * raising their flags (timers, USART receive and ADC).
+ *
+ * If trace_name is set, each invocation also shows as a slice on the track
+ * of that name in the active trace (see TraceEventWriter), if any.
+ */
+class IsrStats {
+public:
+    IsrStats(void);
+
+    IsrVectorStats vectors[ISR_STATS_VECTOR_COUNT + 1];
+    string trace_name;
+
+    void clear(void);
+    void reset(void);
+    void onRaise(int vector, uint64_t cycle);
+    void onEnter(int vector, int sp, uint64_t cycle);
+    void onReturn(int sp, uint64_t cycle);
+
+    static const char *vectorName(int vector);
+    static int lookupVector(const char *name);
+    bool lookupStat(int vector, const char *stat, double &value);
+
+    void writeReport(FILE *f);
+private:
+    struct ActiveIsr {
+        int vector;
+        int sp;
+        uint64_t entry_cycle;
+        uint64_t nested_cycles;
+        sim_time_t entry_time;
+    };
+
+    vector<ActiveIsr> active;
+    uint64_t raised_at[ISR_STATS_VECTOR_COUNT + 1];
+    bool raised[ISR_STATS_VECTOR_COUNT + 1];
+};
+
+#endif
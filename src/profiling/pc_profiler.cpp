@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <map>
+
+#include "pc_profiler.h"
+
+#include "devices/atmega32/defs.h"
+#include "utils/fail.h"
+
+using namespace std;
+
+#define UNKNOWN_FUNCTION "??"
+
+struct FunctionCycles {
+    const Symbol *symbol;
+    uint64_t cycles;
+};
+
+PCProfiler::PCProfiler(Atmega32 *mcu)
+    : mcu(mcu), counts(MEGA32_FLASH_SIZE, 0), call_stack(&mcu->getFirmware())
+{
+    mcu->setProfileCounts(counts.data());
+    mcu->setCallStackProfile(&call_stack);
+}
+
+PCProfiler::~PCProfiler()
+{
+    mcu->setProfileCounts(NULL);
+    mcu->setCallStackProfile(NULL);
+}
+
+uint64_t PCProfiler::totalCycles(void)
+{
+    uint64_t total = 0;
+    
+    for (auto count : counts)
+        total += count;
+    
+    return total;
+}
+
+static double percent(uint64_t part, uint64_t total)
+{
+    return total ? 100.0 * part / total : 0.0;
+}
+
+static const char *function_name(const Symbol *symbol)
+{
+    return symbol ? symbol->name.c_str() : UNKNOWN_FUNCTION;
+}
+
+void PCProfiler::writeReport(const char *filename)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        fail("Cannot create profile file '%s'", filename);
+    
+    const FirmwareImage& firmware = mcu->getFirmware();
+    uint64_t total = totalCycles();
+    
+    map<const Symbol *, uint64_t> by_function;
+    for (int pc = 0; pc < (int)counts.size(); pc++)
+        if (counts[pc])
+            by_function[firmware.flashSymbolAt(2 * pc)] += counts[pc];
+    
+    vector<FunctionCycles> functions;
+    for (auto& item : by_function)
+        functions.push_back({ item.first, item.second });
+    
+    sort(functions.begin(), functions.end(), [](const FunctionCycles& a, const FunctionCycles& b) {
+        return (a.cycles != b.cycles) ? (a.cycles > b.cycles) :
+            (strcmp(function_name(a.symbol), function_name(b.symbol)) < 0);
+    });
+    
+    fprintf(f, "Flat profile of '%s' (%llu cycles)\n\n", mcu->id.c_str(), (unsigned long long)total);
+    fprintf(f, "   %%time   cumul%%         cycles  function\n");
+    
+    uint64_t cumulative = 0;
+    for (auto& function : functions) {
+        cumulative += function.cycles;
+        fprintf(f, "  %6.2f  %6.2f  %13llu  %s\n", percent(function.cycles, total),
+            percent(cumulative, total), (unsigned long long)function.cycles,
+            function_name(function.symbol));
+    }
+    
+    fprintf(f, "\nPer-address profile\n\n");
+    fprintf(f, "  address         cycles   %%time  opcode\n");
+    
+    const Symbol *current = NULL;
+    bool first = true;
+    for (int pc = 0; pc < (int)counts.size(); pc++) {
+        if (!counts[pc])
+            continue;
+        
+        const Symbol *symbol = firmware.flashSymbolAt(2 * pc);
+        if (first || (symbol != current)) {
+            fprintf(f, "\n%s:\n", function_name(symbol));
+            current = symbol;
+            first = false;
+        }
+        
+        fprintf(f, "  %06x  %13llu  %6.2f  %04x", 2 * pc, (unsigned long long)counts[pc],
+            percent(counts[pc], total), firmware.flash[pc]);
+        if (symbol)
+            fprintf(f, "    <%s+0x%x>", symbol->name.c_str(), 2 * pc - symbol->address);
+        fprintf(f, "\n");
+    }
+    
+    fclose(f);
+}
+
+/**
+ * Writes the counts in the callgrind format, with one cost line per
+ * executed address under the function containing it.
+ */
+void PCProfiler::writeCallgrind(const char *filename)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f)
+        fail("Cannot create profile file '%s'", filename);
+    
+    const FirmwareImage& firmware = mcu->getFirmware();
+    
+    fprintf(f, "# callgrind format\n");
+    fprintf(f, "version: 1\n");
+    fprintf(f, "creator: megas2\n");
+    fprintf(f, "positions: instr\n");
+    fprintf(f, "events: Cycles\n");
+    fprintf(f, "summary: %llu\n", (unsigned long long)totalCycles());
+    fprintf(f, "\nob=%s\n", mcu->id.c_str());
+    
+    const Symbol *current = NULL;
+    bool first = true;
+    for (int pc = 0; pc < (int)counts.size(); pc++) {
+        if (!counts[pc])
+            continue;
+        
+        const Symbol *symbol = firmware.flashSymbolAt(2 * pc);
+        if (first || (symbol != current)) {
+            fprintf(f, "\nfn=%s\n", function_name(symbol));
+            current = symbol;
+            first = false;
+        }
+        
+        fprintf(f, "0x%x %llu\n", 2 * pc, (unsigned long long)counts[pc]);
+    }
+    
+    fclose(f);
+}
+
+void PCProfiler::writeFoldedStacks(const char *filename)
+{
+    call_stack.writeFolded(filename);
+}
@@ -0,0 +1,37 @@
+#ifndef _H_PC_PROFILER_H
+#define _H_PC_PROFILER_H
+
+#include <inttypes.h>
+#include <vector>
+
+#include "call_stack_profile.h"
+#include "devices/atmega32/atmega32.h"
+
+using namespace std;
+
+/**
+ * Counts the cycles the MCU spends at each address of the firmware, and in
+ * each call stack, for as long as the profiler exists.
+ *
+ * The counts can be written out as a text report (a flat profile by
+ * function, followed by a listing of every address that was executed), in
+ * the format of callgrind, for tools such as KCachegrind, and as folded
+ * stacks, for flame graphs. Addresses are byte addresses, as in the ELF file
+ * and in objdump listings.
+ */
+class PCProfiler {
+public:
+    PCProfiler(Atmega32 *mcu);
+    ~PCProfiler();
+
+    uint64_t totalCycles(void);
+    void writeReport(const char *filename);
+    void writeCallgrind(const char *filename);
+    void writeFoldedStacks(const char *filename);
+private:
+    Atmega32 *mcu;
+    vector<uint64_t> counts;
+    CallStackProfile call_stack;
+};
+
+#endif
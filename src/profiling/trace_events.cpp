@@ -0,0 +1,186 @@
+#include <climits>
+
+#include <json/json.h>
+
+#include "trace_events.h"
+
+#include "simulation/entity.h"
+#include "simulation/sim_device.h"
+#include "simulation/simulation.h"
+#include "utils/fail.h"
+
+using namespace std;
+
+// Matches no event, so the first one a device handles starts a slice
+#define NO_EVENT  INT_MIN
+
+#define FILE_BUFFER_SIZE  (1 << 20)
+
+TraceEventWriter *TraceEventWriter::active = NULL;
+
+TraceEventWriter::TraceEventWriter(const char *filename, const sim_time_t *clock)
+    : filename(filename), clock(clock), first_event(true), cached_device(NULL), cached_act(NULL),
+      queue(TRACE_BATCH_EVENTS, [this](const vector<TraceEvent>& events) {
+          for (auto& event : events)
+              _writeEvent(event);
+      })
+{
+    file = fopen(filename, "w");
+    if (!file)
+        fail("Cannot create trace file '%s'", filename);
+    
+    setvbuf(file, NULL, _IOFBF, FILE_BUFFER_SIZE);
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    
+    active = this;
+}
+
+TraceEventWriter::~TraceEventWriter()
+{
+    close();
+}
+
+/**
+ * Gets the track with the given name, creating it if need be.
+ */
+int TraceEventWriter::track(const string& name)
+{
+    auto it = tracks.find(name);
+    if (it != tracks.end())
+        return it->second;
+    
+    int track = (int)track_names.size() + 1;
+    tracks[name] = track;
+    track_names.push_back(name);
+    
+    return track;
+}
+
+string TraceEventWriter::entityName(Entity *entity)
+{
+    if (!entity)
+        return "?";
+    
+    return entity->id.empty() ? entity->name : entity->id;
+}
+
+/**
+ * Records a slice from the given time until now.
+ */
+void TraceEventWriter::slice(int track, sim_time_t start, const char *name,
+    const char *arg_name, int64_t arg_value)
+{
+    queue.push({ start, now() - start, name, { arg_name, NULL }, { arg_value, 0 }, track, 'X' });
+}
+
+void TraceEventWriter::instant(int track, const char *name, const char *arg_name, int64_t arg_value,
+    const char *arg2_name, int64_t arg2_value)
+{
+    queue.push({ now(), 0, name, { arg_name, arg2_name }, { arg_value, arg2_value }, track, 'i' });
+}
+
+/**
+ * Writes out everything recorded and finishes the file.
+ */
+void TraceEventWriter::close(void)
+{
+    if (!file)
+        return;
+    
+    if (active == this)
+        active = NULL;
+    
+    for (auto& item : acts)
+        _closeAct(item.second);
+    
+    queue.finish();
+    
+    _writeTrackNames();
+    fprintf(file, "\n]}\n");
+    
+    if (ferror(file) | fclose(file))
+        warn("Error writing trace file '%s'", filename.c_str());
+    file = NULL;
+}
+
+TraceEventWriter::OpenAct *TraceEventWriter::_findAct(SimulatedDevice *device)
+{
+    auto it = acts.find(device);
+    if (it == acts.end()) {
+        string name = device ? entityName(dynamic_cast<Entity *>(device)) : "(simulation)";
+        it = acts.insert({ device, { track(name), NO_EVENT, 0, 0, 0 } }).first;
+    }
+    
+    cached_device = device;
+    cached_act = &it->second;
+    
+    return cached_act;
+}
+
+void TraceEventWriter::_restartAct(OpenAct& act, int event_id, sim_time_t time)
+{
+    _closeAct(act);
+    
+    act.event_id = event_id;
+    act.start = time;
+    act.end = time;
+    act.count = 1;
+}
+
+void TraceEventWriter::_closeAct(OpenAct& act)
+{
+    if (!act.count)
+        return;
+    
+    const char *name = (act.event_id == SIM_EVENT_CALLBACK) ? "callback" :
+        (act.event_id == SIM_EVENT_REPLAY) ? "replay" :
+        (act.event_id == SIM_EVENT_RECORDER) ? "recorder" : "act";
+    
+    queue.push({ act.start, act.end - act.start, name, { "event", "count" },
+        { act.event_id, (int64_t)act.count }, act.track, 'X' });
+    
+    act.count = 0;
+}
+
+static void write_timestamp(FILE *f, const char *key, sim_time_t time)
+{
+    // In microseconds, as the format wants, but exactly
+    int64_t ns = sim_time_to_ns(time);
+    fprintf(f, ",\"%s\":%lld.%03d", key, (long long)(ns / 1000), (int)(ns % 1000));
+}
+
+void TraceEventWriter::_writeEvent(const TraceEvent& event)
+{
+    fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\"", first_event ? "" : ",\n", event.name, event.phase);
+    first_event = false;
+    
+    write_timestamp(file, "ts", event.time);
+    if (event.phase == 'X')
+        write_timestamp(file, "dur", event.duration);
+    else
+        fprintf(file, ",\"s\":\"t\"");
+    
+    fprintf(file, ",\"pid\":1,\"tid\":%d", event.track);
+    
+    if (event.arg_names[0]) {
+        fprintf(file, ",\"args\":{\"%s\":%lld", event.arg_names[0], (long long)event.arg_values[0]);
+        if (event.arg_names[1])
+            fprintf(file, ",\"%s\":%lld", event.arg_names[1], (long long)event.arg_values[1]);
+        fprintf(file, "}");
+    }
+    
+    fprintf(file, "}");
+}
+
+void TraceEventWriter::_writeTrackNames(void)
+{
+    fprintf(file, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"megas2\"}}",
+        first_event ? "" : ",\n");
+    
+    for (unsigned int i = 0; i < track_names.size(); i++) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":%s}}",
+            i + 1, Json::valueToQuotedString(track_names[i].c_str()).c_str());
+        fprintf(file, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+            i + 1, i + 1);
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef _H_TRACE_EVENTS_H
+#define _H_TRACE_EVENTS_H
+
+#include <inttypes.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+#include "simulation/sim_time.h"
+#include "utils/batch_queue.h"
+
+using namespace std;
+
+class SimulatedDevice;
+class Entity;
+
+// Events of a device that follow each other this closely share a slice
+#define TRACE_ACT_MERGE_GAP     us_to_sim_time(1)
+
+// Events are handed to the background thread in batches of this many
+#define TRACE_BATCH_EVENTS      65536
+
+struct TraceEvent {
+    sim_time_t time;
+    sim_time_t duration;
+    const char *name;
+    const char *arg_names[2];
+    int64_t arg_values[2];
+    int track;
+    char phase;
+};
+
+/**
+ * Writes a trace of a simulation, in the Chrome trace-event JSON format
+ * (for chrome://tracing or ui.perfetto.dev), with simulated time as the
+ * timeline.
+ *
+ * Each entity gets tracks (threads, in the format's terms) on which its
+ * activity shows as slices: the events it handles (with runs of the same
+ * event closer than TRACE_ACT_MERGE_GAP merged into one slice, so that
+ * e.g. the clock ticks of an MCU show as a single slice while it runs), SPI
+ * transactions, interrupt handlers and the like, or as instant events for
+ * e.g. Ethernet frames. Event names are not copied, and must be static.
+ *
+ * Events are collected in memory and handed over in batches to a
+ * background thread, which formats and writes them, so that the simulation
+ * only waits for the file if the thread falls a full batch behind.
+ *
+ * While a writer is open, it is available to the devices as active.
+ */
+class TraceEventWriter {
+public:
+    TraceEventWriter(const char *filename, const sim_time_t *clock);
+    ~TraceEventWriter();
+
+    static TraceEventWriter *active;
+
+    inline sim_time_t now(void)
+    {
+        return *clock;
+    }
+
+    int track(const string& name);
+    static string entityName(Entity *entity);
+
+    void slice(int track, sim_time_t start, const char *name,
+        const char *arg_name = NULL, int64_t arg_value = 0);
+    void instant(int track, const char *name, const char *arg_name = NULL, int64_t arg_value = 0,
+        const char *arg2_name = NULL, int64_t arg2_value = 0);
+
+    inline void onAct(SimulatedDevice *device, int event_id, sim_time_t time)
+    {
+        OpenAct *act = (device == cached_device) ? cached_act : _findAct(device);
+
+        if ((act->event_id == event_id) && (time - act->end <= TRACE_ACT_MERGE_GAP)) {
+            act->end = time;
+            act->count++;
+        } else {
+            _restartAct(*act, event_id, time);
+        }
+    }
+
+    void close(void);
+private:
+    struct OpenAct {
+        int track;
+        int event_id;
+        sim_time_t start;
+        sim_time_t end;
+        uint64_t count;
+    };
+
+    string filename;
+    FILE *file;
+    const sim_time_t *clock;
+    bool first_event;
+
+    map<string, int> tracks;
+    vector<string> track_names;
+
+    unordered_map<SimulatedDevice *, OpenAct> acts;
+    SimulatedDevice *cached_device;
+    OpenAct *cached_act;
+
+    BatchQueue<TraceEvent> queue;
+
+    OpenAct *_findAct(SimulatedDevice *device);
+    void _restartAct(OpenAct& act, int event_id, sim_time_t time);
+    void _closeAct(OpenAct& act);
+
+    void _writeEvent(const TraceEvent& event);
+    void _writeTrackNames(void);
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include <cctype>
+#include <ctime>
+#include <map>
+
+#include "vcd_writer.h"
+
+#include "glue/analog_bus.h"
+#include "glue/pin_device.h"
+#include "utils/fail.h"
+
+using namespace std;
+
+#define FILE_BUFFER_SIZE  (1 << 20)
+
+#define TOP_SCOPE  "system"
+
+VcdWriter *VcdWriter::active = NULL;
+
+/**
+ * Parses the value of a "trace" member: true or "digital" for a digital
+ * signal, "analog" for an analog one, or false.
+ */
+int parse_vcd_kind(const Json::Value& value, const char *what)
+{
+    if (value.isBool())
+        return value.asBool() ? VCD_DIGITAL : VCD_UNTRACED;
+    if (value.isString() && (value.asString() == "digital"))
+        return VCD_DIGITAL;
+    if (value.isString() && (value.asString() == "analog"))
+        return VCD_ANALOG;
+    
+    fail("'%s' should be true, false, \"digital\" or \"analog\"", what);
+    return VCD_UNTRACED;
+}
+
+static string entity_name(Entity *entity)
+{
+    return entity->id.empty() ? entity->name : entity->id;
+}
+
+// VCD identifiers and names cannot contain whitespace
+static string vcd_name(const string& name)
+{
+    string result = name;
+    
+    for (auto& c : result)
+        if (isspace((unsigned char)c))
+            c = '_';
+    
+    return result;
+}
+
+static string vcd_code(int index)
+{
+    string code;
+    
+    do {
+        code += (char)('!' + index % 94);
+        index /= 94;
+    } while (index);
+    
+    return code;
+}
+
+VcdWriter::VcdWriter(const char *filename, const sim_time_t *clock)
+    : filename(filename), clock(clock), last_time(-1),
+      queue(VCD_BATCH_CHANGES, [this](const vector<VcdChange>& changes) {
+          _writeChanges(changes);
+      })
+{
+    file = fopen(filename, "w");
+    if (!file)
+        fail("Cannot create VCD file '%s'", filename);
+    
+    setvbuf(file, NULL, _IOFBF, FILE_BUFFER_SIZE);
+}
+
+VcdWriter::~VcdWriter()
+{
+    close();
+}
+
+/**
+ * Adds the pins and buses marked for tracing in the given entities.
+ */
+void VcdWriter::addTracedSignals(const vector<Entity *>& entities)
+{
+    for (auto entity : entities) {
+        if (auto bus = dynamic_cast<AnalogBus *>(entity)) {
+            if (bus->trace_kind != VCD_UNTRACED)
+                bus->vcd_signal = addSignal("", entity_name(bus), bus->trace_kind,
+                    DEFAULT_LOGIC_THRESHOLD, bus->query());
+        }
+        
+        if (auto device = dynamic_cast<PinDevice *>(entity)) {
+            for (int i = 0; i < device->_num_pins; i++) {
+                Pin& pin = device->_pins[i];
+                if (pin.trace_kind != VCD_UNTRACED)
+                    pin.vcd_signal = addSignal(entity_name(entity), pin.pin_name, pin.trace_kind,
+                        device->_logic_threshold, pin.lineValue());
+            }
+        }
+    }
+}
+
+/**
+ * Adds a signal, with its current value, in the scope of the given name
+ * (under the top one, if empty). All signals must be added before start().
+ */
+int VcdWriter::addSignal(const string& scope, const string& name, int kind, pin_val_t threshold,
+    pin_val_t value)
+{
+    if (active == this)
+        fail("Signals must be added to a VCD file before it is started");
+    
+    Signal sig;
+    sig.scope = vcd_name(scope);
+    sig.name = vcd_name(name);
+    sig.code = vcd_code((int)signals.size());
+    sig.kind = kind;
+    sig.threshold = threshold;
+    
+    VcdChange initial = { 0, 0.0, 0, 0 };
+    _resolve(sig, value, initial);
+    sig.state = initial.state;
+    sig.volts = initial.volts;
+    
+    signals.push_back(sig);
+    
+    return (int)signals.size() - 1;
+}
+
+int VcdWriter::signalCount(void)
+{
+    return (int)signals.size();
+}
+
+/**
+ * Writes the definitions and initial values of the signals, and starts
+ * recording their changes.
+ */
+void VcdWriter::start(void)
+{
+    _writeHeader();
+    
+    active = this;
+}
+
+/**
+ * Writes out all changes recorded and closes the file.
+ */
+void VcdWriter::close(void)
+{
+    if (!file)
+        return;
+    
+    if (active == this)
+        active = NULL;
+    
+    queue.finish();
+    
+    if (ferror(file) | fclose(file))
+        warn("Error writing VCD file '%s'", filename.c_str());
+    file = NULL;
+}
+
+void VcdWriter::_writeHeader(void)
+{
+    time_t now = time(NULL);
+    char date[64];
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    
+    fprintf(file, "$date %s $end\n", date);
+    fprintf(file, "$version megas2 $end\n");
+    fprintf(file, "$timescale 1ns $end\n");
+    fprintf(file, "$scope module %s $end\n", TOP_SCOPE);
+    
+    // Group the signals by scope, in the order the scopes first appear
+    vector<string> scopes;
+    map<string, vector<const Signal *>> by_scope;
+    for (auto& sig : signals) {
+        if (!by_scope.count(sig.scope))
+            scopes.push_back(sig.scope);
+        by_scope[sig.scope].push_back(&sig);
+    }
+    
+    for (auto& scope : scopes) {
+        if (!scope.empty())
+            fprintf(file, "$scope module %s $end\n", scope.c_str());
+        
+        for (auto sig : by_scope[scope])
+            fprintf(file, "$var %s %s %s %s $end\n", (sig->kind == VCD_ANALOG) ? "real" : "wire",
+                (sig->kind == VCD_ANALOG) ? "64" : "1", sig->code.c_str(), sig->name.c_str());
+        
+        if (!scope.empty())
+            fprintf(file, "$upscope $end\n");
+    }
+    
+    fprintf(file, "$upscope $end\n");
+    fprintf(file, "$enddefinitions $end\n");
+    
+    last_time = *clock;
+    fprintf(file, "#%lld\n$dumpvars\n", (long long)sim_time_to_ns(last_time));
+    for (auto& sig : signals)
+        _writeValue(sig, sig.state, sig.volts);
+    fprintf(file, "$end\n");
+}
+
+void VcdWriter::_writeValue(const Signal& sig, char state, double volts)
+{
+    if (sig.kind == VCD_ANALOG)
+        fprintf(file, "r%.6g %s\n", volts, sig.code.c_str());
+    else
+        fprintf(file, "%c%s\n", state, sig.code.c_str());
+}
+
+void VcdWriter::_writeChanges(const vector<VcdChange>& changes)
+{
+    for (auto& change : changes) {
+        if (change.time != last_time) {
+            last_time = change.time;
+            fprintf(file, "#%lld\n", (long long)sim_time_to_ns(last_time));
+        }
+        
+        _writeValue(signals[change.signal], change.state, change.volts);
+    }
+}
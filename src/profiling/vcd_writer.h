@@ -0,0 +1,114 @@
+#ifndef _H_VCD_WRITER_H
+#define _H_VCD_WRITER_H
+
+#include <inttypes.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include "glue/pin_val.h"
+#include "simulation/entity.h"
+#include "simulation/sim_time.h"
+#include "utils/batch_queue.h"
+
+using namespace std;
+
+#define VCD_UNTRACED    0
+#define VCD_DIGITAL     1       // Written as a wire: 0, 1 or z
+#define VCD_ANALOG      2       // Written as a real, in volts
+
+// Changes are handed to the background thread in batches of this many
+#define VCD_BATCH_CHANGES   65536
+
+int parse_vcd_kind(const Json::Value& value, const char *what);
+
+struct VcdChange {
+    sim_time_t time;
+    double volts;
+    int signal;
+    char state;
+};
+
+/**
+ * Writes the waveforms of traced pins and analog buses to a VCD file (e.g.
+ * for GTKWave), in simulated time.
+ *
+ * The signals to trace are marked in the system description, with a
+ * "trace" member in an AnalogBus ("digital" or true, or "analog"), and a
+ * "trace_pins" member in a pin device (an array of pin names, traced as
+ * digital, or an object mapping pin names to "digital" or "analog").
+ * Digital signals change when their value crosses the logic threshold (of
+ * the pin's device, or the default one for buses), or becomes Z. Analog
+ * signals change with any change of the voltage, an undriven net being
+ * written as 0 V.
+ *
+ * Only actual changes are recorded. They are collected in memory and
+ * written out in batches by a background thread.
+ *
+ * While the writer is started, it is available to the pins and buses as
+ * active.
+ */
+class VcdWriter {
+public:
+    VcdWriter(const char *filename, const sim_time_t *clock);
+    ~VcdWriter();
+
+    static VcdWriter *active;
+
+    void addTracedSignals(const vector<Entity *>& entities);
+    int addSignal(const string& scope, const string& name, int kind, pin_val_t threshold,
+        pin_val_t value);
+    int signalCount(void);
+
+    void start(void);
+    void close(void);
+
+    inline void change(int signal, pin_val_t value)
+    {
+        Signal& sig = signals[signal];
+
+        VcdChange change = { *clock, 0.0, signal, 0 };
+        _resolve(sig, value, change);
+
+        if ((change.state != sig.state) || (change.volts != sig.volts)) {
+            sig.state = change.state;
+            sig.volts = change.volts;
+            queue.push(change);
+        }
+    }
+private:
+    struct Signal {
+        string scope;
+        string name;
+        string code;
+        int kind;
+        pin_val_t threshold;
+        char state;
+        double volts;
+    };
+
+    string filename;
+    FILE *file;
+    const sim_time_t *clock;
+    sim_time_t last_time;
+
+    vector<Signal> signals;
+
+    BatchQueue<VcdChange> queue;
+
+    inline void _resolve(const Signal& sig, pin_val_t value, VcdChange& change)
+    {
+        if (sig.kind == VCD_ANALOG)
+            change.volts = (value == PIN_VAL_Z) ? 0.0 : value / pin_val_t(1.0);
+        else
+            change.state = (value == PIN_VAL_Z) ? 'z' : (value > sig.threshold) ? '1' : '0';
+    }
+
+    void _writeHeader(void);
+    void _writeValue(const Signal& sig, char state, double volts);
+    void _writeChanges(const vector<VcdChange>& changes);
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "test_server.h"
+
+#include "devices/sd_card.h"
+#include "glue/pin_device.h"
+#include "glue/pin_ref.h"
+#include "simulation/sim_points.h"
+#include "utils/fail.h"
+
+#define MAX_REQUEST_SIZE    (1 << 20)
+
+TestServer::TestServer(Simulation *sim, SystemDescription *sys_desc, Mcu *mcu)
+{
+    this->sim = sim;
+    this->sys_desc = sys_desc;
+    this->mcu = mcu;
+}
+
+/**
+ * Accepts and runs tests forever, from the current state of the simulation.
+ */
+void TestServer::serve(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        fail("Socket path '%s' is too long", socket_path);
+    strcpy(addr.sun_path, socket_path);
+    
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+        fail("Cannot create socket");
+    
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        fail("Cannot bind socket to '%s'", socket_path);
+    if (listen(listen_fd, SOMAXCONN) < 0)
+        fail("Cannot listen on '%s'", socket_path);
+    
+    // Tests never write to the SD card images
+    for (auto ent : sys_desc->entities) {
+        auto as_card = dynamic_cast<SdCard *>(ent);
+        if (as_card)
+            as_card->holdWrites();
+    }
+    
+    sim->sync_with_real_time = false;
+    
+    // Finished tests are reaped automatically
+    signal(SIGCHLD, SIG_IGN);
+    
+    info("Serving tests on '%s' from %.6f s", socket_path, sim_time_to_ns(sim->time) / 1e9);
+    
+    while (true) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            fail("accept() failed");
+        }
+        
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listen_fd);
+            _handleConnection(fd);
+            
+            // Skip all destructors, which would e.g. flush the SD card
+            fflush(stdout);
+            _exit(EXIT_SUCCESS);
+        }
+        
+        if (pid < 0)
+            warn("Cannot fork test process");
+        
+        close(fd);
+    }
+}
+
+void TestServer::_handleConnection(int fd)
+{
+    string request_text;
+    char buffer[4096];
+    ssize_t count;
+    
+    while ((request_text.find('\n') == string::npos) && (request_text.size() < MAX_REQUEST_SIZE) &&
+           ((count = read(fd, buffer, sizeof(buffer))) > 0))
+        request_text.append(buffer, count);
+    
+    Json::Value request, response;
+    Json::Reader reader;
+    
+    if (!reader.parse(request_text, request) || !request.isObject()) {
+        response["ok"] = false;
+        response["error"] = "Malformed request";
+    } else {
+        response = _runTest(request);
+    }
+    
+    string response_text = Json::FastWriter().write(response);
+    
+    for (size_t ptr = 0; ptr < response_text.size(); ptr += count) {
+        count = write(fd, response_text.data() + ptr, response_text.size() - ptr);
+        if (count <= 0)
+            break;
+    }
+    
+    close(fd);
+}
+
+Json::Value TestServer::_runTest(Json::Value &request)
+{
+    Json::Value response;
+    
+    try {
+        if (!request.isMember("run"))
+            fail("Member 'run' required in test request");
+        
+        sim_time_t run_time = parse_json_time(request["run"], "run");
+        
+        for (auto& stimulus : request["stimulus"])
+            _scheduleStimulus(stimulus);
+        
+        sim->resume(sim->time + run_time);
+        
+        response = _report(request["report"]);
+        response["ok"] = true;
+    } catch (exception& e) {
+        response["ok"] = false;
+        response["error"] = e.what();
+    }
+    
+    response["time"] = (Json::Int64)sim_time_to_ns(sim->time);
+    if (mcu) {
+        response["cycles"] = (Json::UInt64)mcu->getCycleCount();
+        response["pc"] = mcu->getPC();
+    }
+    
+    return response;
+}
+
+void TestServer::_scheduleStimulus(Json::Value &stimulus)
+{
+    if (!stimulus.isObject() || !stimulus.isMember("at") || !stimulus.isMember("value"))
+        fail("Stimulus must be an object with 'at' and 'value' members");
+    
+    sim_time_t at = sim->time + parse_json_time(stimulus["at"], "at");
+    Json::Value &value = stimulus["value"];
+    
+    if (stimulus.isMember("poke")) {
+        int length;
+        int address = resolve_data_ref(mcu, stimulus["poke"], length);
+        
+        auto bytes = make_shared<vector<uint8_t>>();
+        if (value.isArray()) {
+            for (auto& byte : value)
+                bytes->push_back(byte.asUInt());
+        } else {
+            bytes->push_back(value.asUInt());
+        }
+        
+        if ((int)bytes->size() > length)
+            fail("Too many bytes to poke at %d", address);
+        
+        Mcu *mcu = this->mcu;
+        sim->scheduleCallback(NULL, at, [mcu, address, bytes]() {
+            for (size_t i = 0; i < bytes->size(); i++)
+                mcu->pokeData(address + i, (*bytes)[i]);
+        });
+    } else if (stimulus.isMember("drive")) {
+        PinReference pin(stimulus["drive"], sys_desc);
+        
+        pin_val_t pin_value;
+        if (value.isNumeric())
+            pin_value = pin_val_t(value.asDouble());
+        else if (value.asString() == "Z")
+            pin_value = PIN_VAL_Z;
+        else if (value.asString() == "VCC")
+            pin_value = PIN_VAL_VCC;
+        else
+            fail("Invalid pin value '%s'", value.asString().c_str());
+        
+        sim->scheduleCallback(NULL, at, [pin, pin_value]() {
+            pin.device->drivePin(pin.pin_id, pin_value);
+        });
+    } else {
+        fail("Stimulus must have a 'poke' or 'drive' member");
+    }
+}
+
+Json::Value TestServer::_report(Json::Value &report)
+{
+    Json::Value result;
+    
+    for (auto& ref : report["ram"]) {
+        int length;
+        int address = resolve_data_ref(mcu, ref, length);
+        
+        Json::Value bytes(Json::arrayValue);
+        for (int i = 0; i < length; i++)
+            bytes.append(mcu->peekData(address + i));
+        
+        result["ram"][ref.isString() ? ref.asString() : to_string(address)] = bytes;
+    }
+    
+    for (auto& ref : report["pins"]) {
+        PinReference pin(ref, sys_desc);
+        
+        // The value on the wire (as batch expectations see it), not the one
+        // the device drives
+        ostringstream value;
+        value << pin.device->readPin(pin.pin_id);
+        
+        result["pins"][ref["device"].asString() + "." + ref["pin"].asString()] = value.str();
+    }
+    
+    return result;
+}
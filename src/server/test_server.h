@@ -0,0 +1,56 @@
+#ifndef _H_TEST_SERVER_H
+#define _H_TEST_SERVER_H
+
+#include <string>
+
+#include <json/json.h>
+
+#include "simulation/simulation.h"
+#include "simulation/sys_desc.h"
+#include "devices/mcu/mcu.h"
+
+using namespace std;
+
+/**
+ * Serves test requests on a Unix socket. The simulation is booted once, and
+ * each test then runs in a forked (copy-on-write) copy of it, so that tests
+ * start from the same warm state and do not affect each other.
+ * 
+ * The client sends a JSON request (ended by a newline, or by shutting down
+ * its side of the connection) and receives a JSON response, after which the
+ * connection is closed. A request looks like:
+ * 
+ *   {
+ *     "run": "100ms",
+ *     "stimulus": [
+ *       { "at": "10ms", "poke": "counter", "value": [1, 0] },
+ *       { "at": "20ms", "drive": { "device": "button", "pin": "OUT" }, "value": "VCC" }
+ *     ],
+ *     "report": {
+ *       "ram": ["counter"],
+ *       "pins": [{ "device": "mcu", "pin": "B0" }]
+ *     }
+ *   }
+ * 
+ * Times are relative to the warm state. RAM is poked and reported as byte
+ * arrays (or a single byte). Pin values are numbers (volts), "Z" or "VCC".
+ * The response holds "ok", the final "time" (in ns), "cycles" and "pc", and
+ * the reported "ram" and "pins" values, or "error" if the test failed.
+ */
+class TestServer {
+public:
+    TestServer(Simulation *sim, SystemDescription *sys_desc, Mcu *mcu);
+    
+    void serve(const char *socket_path);
+private:
+    Simulation *sim;
+    SystemDescription *sys_desc;
+    Mcu *mcu;
+    
+    void _handleConnection(int fd);
+    Json::Value _runTest(Json::Value &request);
+    void _scheduleStimulus(Json::Value &stimulus);
+    Json::Value _report(Json::Value &report);
+};
+
+#endif
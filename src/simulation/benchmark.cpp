@@ -0,0 +1,303 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <sys/resource.h>
+
+#include "benchmark.h"
+#include "sim_device.h"
+#include "entity.h"
+
+#include "utils/fail.h"
+#include "utils/time.h"
+
+using namespace std;
+
+SimulationBenchmark::SimulationBenchmark(Simulation *sim, Mcu *mcu)
+    : duration(BENCHMARK_DEFAULT_DURATION), warmup(0), trials(1), perf_counters(NULL), sim(sim),
+      mcu(mcu), peak_rss_kb(0)
+{
+    memset(perf_results, 0, sizeof(perf_results));
+}
+
+static string device_name(SimulatedDevice *device)
+{
+    auto as_entity = dynamic_cast<Entity *>(device);
+    if (!as_entity)
+        return "?";
+    
+    return as_entity->id.empty() ? as_entity->name : as_entity->id;
+}
+
+void SimulationBenchmark::run(void)
+{
+    sim->sync_with_real_time = false;
+    
+    if (warmup)
+        sim->resume(sim->time + warmup);
+    
+    map<SimulatedDevice *, uint64_t> events_before;
+    for (auto device : sim->getDevices())
+        events_before[device] = device->event_count;
+    
+    results.clear();
+    for (int trial = 0; trial < trials; trial++) {
+        uint64_t cycles_before = mcu ? mcu->getCycleCount() : 0;
+        uint64_t sim_events_before = sim->event_count;
+        
+        if (perf_counters)
+            perf_counters->enable();
+        
+        int64_t start_ns = monotonic_time_ns();
+        sim->resume(sim->time + duration);
+        int64_t real_ns = monotonic_time_ns() - start_ns;
+        
+        if (perf_counters)
+            perf_counters->disable();
+        
+        BenchmarkTrial result;
+        result.real_seconds = real_ns / 1e9;
+        result.speed = (double)sim_time_to_ns(duration) / real_ns;
+        result.mips = mcu ? (mcu->getCycleCount() - cycles_before) / (real_ns / 1e3) : 0.0;
+        result.instructions = mcu ? mcu->getCycleCount() - cycles_before : 0;
+        result.events = sim->event_count - sim_events_before;
+        result.events_per_second = result.events / result.real_seconds;
+        results.push_back(result);
+    }
+    
+    if (perf_counters)
+        for (int i = 0; i < HOST_PERF_COUNTER_COUNT; i++) {
+            HostPerfResult& perf = perf_results[i];
+            perf.valid = perf_counters->read(i, perf.total, perf.scaled);
+        }
+    
+    device_events.clear();
+    for (auto device : sim->getDevices())
+        device_events[device_name(device)] += device->event_count - events_before[device];
+    
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    peak_rss_kb = usage.ru_maxrss;
+}
+
+BenchmarkSummary SimulationBenchmark::summarize(double BenchmarkTrial::*metric)
+{
+    vector<double> values;
+    for (auto& result : results)
+        values.push_back(result.*metric);
+    
+    if (values.empty())
+        return { 0.0, 0.0 };
+    
+    sort(values.begin(), values.end());
+    
+    size_t n = values.size();
+    double median = (n % 2) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    
+    double mean = 0.0;
+    for (auto value : values)
+        mean += value / n;
+    
+    double variance = 0.0;
+    for (auto value : values)
+        variance += (value - mean) * (value - mean);
+    
+    return { median, (n > 1) ? sqrt(variance / (n - 1)) : 0.0 };
+}
+
+void SimulationBenchmark::writeReport(FILE *f)
+{
+    BenchmarkSummary speed = summarize(&BenchmarkTrial::speed);
+    BenchmarkSummary mips = summarize(&BenchmarkTrial::mips);
+    BenchmarkSummary events = summarize(&BenchmarkTrial::events_per_second);
+    
+    if (results.size() > 1) {
+        for (size_t i = 0; i < results.size(); i++)
+            fprintf(f, "Trial %d: speed %d%%, %.2f MIPS, %.2fM events/s\n", (int)i + 1,
+                (int)(100 * results[i].speed), results[i].mips, results[i].events_per_second / 1e6);
+        
+        fprintf(f, "Unsynced speed: %d%% (median of %d trials, stddev %.1f%%)\n", (int)(100 * speed.median),
+            (int)results.size(), 100 * speed.stddev);
+    } else {
+        fprintf(f, "Unsynced speed: %d%%\n", (int)(100 * speed.median));
+    }
+    
+    if (mcu)
+        fprintf(f, "Emulated MIPS: %.2f (stddev %.2f)\n", mips.median, mips.stddev);
+    fprintf(f, "Scheduler events: %.2fM/s (stddev %.2fM)\n", events.median / 1e6, events.stddev / 1e6);
+    fprintf(f, "Peak RSS: %.1f MB\n", peak_rss_kb / 1024.0);
+    
+    fprintf(f, "Events by device:");
+    for (auto& item : device_events)
+        fprintf(f, " %s %llu", item.first.c_str(), (unsigned long long)item.second);
+    fprintf(f, "\n");
+    
+    if (perf_counters)
+        _writePerfReport(f);
+}
+
+void SimulationBenchmark::_sumTrials(uint64_t &instructions, uint64_t &events)
+{
+    instructions = 0;
+    events = 0;
+    
+    for (auto& result : results) {
+        instructions += result.instructions;
+        events += result.events;
+    }
+}
+
+void SimulationBenchmark::_writePerfReport(FILE *f)
+{
+    uint64_t instructions, events;
+    _sumTrials(instructions, events);
+    
+    bool any_valid = false;
+    for (int i = 0; i < HOST_PERF_COUNTER_COUNT; i++)
+        any_valid |= perf_results[i].valid;
+    
+    if (!any_valid) {
+        fprintf(f, "Host counters: none available\n");
+        return;
+    }
+    
+    fprintf(f, "Host counters:  %16s %12s %12s\n", "total", "per instr.", "per event");
+    
+    bool any_scaled = false;
+    for (int i = 0; i < HOST_PERF_COUNTER_COUNT; i++) {
+        HostPerfResult& perf = perf_results[i];
+        
+        if (!perf.valid) {
+            fprintf(f, "  %-14s %16s\n", HostPerfCounters::counterName(i), "n/a");
+            continue;
+        }
+        
+        char per_instruction[32] = "-";
+        char per_event[32] = "-";
+        if (instructions)
+            snprintf(per_instruction, sizeof(per_instruction), "%.3f", perf.total / instructions);
+        if (events)
+            snprintf(per_event, sizeof(per_event), "%.3f", perf.total / events);
+        
+        fprintf(f, "  %-14s %15.0f%s %12s %12s\n", HostPerfCounters::counterName(i), perf.total,
+            perf.scaled ? "*" : " ", per_instruction, per_event);
+        any_scaled |= perf.scaled;
+    }
+    
+    HostPerfResult& cycles = perf_results[HOST_PERF_CYCLES];
+    HostPerfResult& host_instructions = perf_results[HOST_PERF_INSTRUCTIONS];
+    if (cycles.valid && host_instructions.valid && (cycles.total > 0))
+        fprintf(f, "Host IPC: %.2f\n", host_instructions.total / cycles.total);
+    if (any_scaled)
+        fprintf(f, "(* estimated: the CPU counted these only part of the time)\n");
+}
+
+static Json::Value summary_json(const BenchmarkSummary& summary)
+{
+    Json::Value json;
+    
+    json["median"] = summary.median;
+    json["stddev"] = summary.stddev;
+    
+    return json;
+}
+
+Json::Value SimulationBenchmark::toJson(void)
+{
+    Json::Value json;
+    
+    json["duration_s"] = sim_time_to_ns(duration) / 1e9;
+    json["warmup_s"] = sim_time_to_ns(warmup) / 1e9;
+    
+    json["trials"] = Json::Value(Json::arrayValue);
+    for (auto& result : results) {
+        Json::Value trial;
+        trial["real_s"] = result.real_seconds;
+        trial["speed"] = result.speed;
+        if (mcu)
+            trial["mips"] = result.mips;
+        trial["events_per_s"] = result.events_per_second;
+        json["trials"].append(trial);
+    }
+    
+    json["speed"] = summary_json(summarize(&BenchmarkTrial::speed));
+    if (mcu)
+        json["mips"] = summary_json(summarize(&BenchmarkTrial::mips));
+    json["events_per_s"] = summary_json(summarize(&BenchmarkTrial::events_per_second));
+    json["peak_rss_kb"] = (Json::Int64)peak_rss_kb;
+    
+    if (perf_counters) {
+        uint64_t instructions, events;
+        _sumTrials(instructions, events);
+        
+        json["host_counters"] = Json::Value(Json::objectValue);
+        for (int i = 0; i < HOST_PERF_COUNTER_COUNT; i++) {
+            HostPerfResult& perf = perf_results[i];
+            if (!perf.valid)
+                continue;
+            
+            Json::Value counter;
+            counter["total"] = perf.total;
+            if (instructions)
+                counter["per_instruction"] = perf.total / instructions;
+            if (events)
+                counter["per_event"] = perf.total / events;
+            counter["scaled"] = perf.scaled;
+            json["host_counters"][HostPerfCounters::counterName(i)] = counter;
+        }
+    }
+    
+    json["device_events"] = Json::Value(Json::objectValue);
+    for (auto& item : device_events)
+        json["device_events"][item.first] = (Json::UInt64)item.second;
+    
+    return json;
+}
+
+void SimulationBenchmark::writeJson(const char *filename)
+{
+    ofstream file(filename);
+    if (file.fail())
+        fail("Cannot create benchmark results file '%s'", filename);
+    
+    file << Json::StyledWriter().write(toJson());
+}
+
+/**
+ * Compares the median speed with that of an earlier run, as written by
+ * writeJson(). Returns false if it is lower by more than the tolerance (a
+ * fraction of the baseline speed), and by more than the trials can be told
+ * apart from noise (see BENCHMARK_NOISE_SIGMAS).
+ */
+bool SimulationBenchmark::compareWithBaseline(const char *filename, double tolerance, FILE *f)
+{
+    ifstream file(filename);
+    if (file.fail())
+        fail("Cannot open benchmark baseline '%s'", filename);
+    
+    Json::Value baseline;
+    Json::Reader reader;
+    if (!reader.parse(file, baseline) || !baseline["speed"].isObject())
+        fail("Invalid benchmark baseline '%s'", filename);
+    
+    double before = baseline["speed"]["median"].asDouble();
+    double before_stddev = baseline["speed"].get("stddev", 0.0).asDouble();
+    BenchmarkSummary speed = summarize(&BenchmarkTrial::speed);
+    double change = (before > 0.0) ? speed.median / before - 1.0 : 0.0;
+    double noise = BENCHMARK_NOISE_SIGMAS *
+        sqrt(before_stddev * before_stddev + speed.stddev * speed.stddev);
+    
+    fprintf(f, "Baseline speed: %d%% (change: %+.1f%%)\n", (int)(100 * before), 100 * change);
+    if (change >= -tolerance)
+        return true;
+    if (before - speed.median <= noise) {
+        fprintf(f, "Slower than the baseline by more than %.1f%%, but within the noise of the trials\n",
+            100 * tolerance);
+        return true;
+    }
+    
+    fprintf(f, "Slower than the baseline by more than %.1f%% (and %.0f stddevs)\n", 100 * tolerance,
+        BENCHMARK_NOISE_SIGMAS);
+    
+    return false;
+}
@@ -0,0 +1,87 @@
+#ifndef _H_BENCHMARK_H
+#define _H_BENCHMARK_H
+
+#include <inttypes.h>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include "simulation.h"
+#include "devices/mcu/mcu.h"
+#include "profiling/host_perf_counters.h"
+
+using namespace std;
+
+#define BENCHMARK_DEFAULT_DURATION  sec_to_sim_time(5)
+
+// A slowdown only counts if it is also this many times the spread of the
+// trials (of the baseline and the run combined)
+#define BENCHMARK_NOISE_SIGMAS      3.0
+
+struct BenchmarkTrial {
+    double real_seconds;
+    double speed;               // Simulated time over real time
+    double mips;                // MCU instructions (cycles) per real second
+    double events_per_second;
+    uint64_t instructions;
+    uint64_t events;
+};
+
+struct HostPerfResult {
+    bool valid;
+    bool scaled;                // Estimated from part of the time
+    double total;
+};
+
+struct BenchmarkSummary {
+    double median;
+    double stddev;
+};
+
+/**
+ * Measures how fast a simulation runs unsynced.
+ *
+ * The simulation is first run for the warm-up time, unmeasured, then for
+ * the given duration once per trial, each trial continuing where the last
+ * one left off. Every trial yields the speed (as a fraction of real time),
+ * the emulated MIPS of the MCU (if any) and the scheduler events handled per
+ * second; the results give the median and the standard deviation of each,
+ * along with the peak RSS of the process and the events handled by each
+ * device over all trials.
+ *
+ * If given host performance counters, they count over all trials, and are
+ * reported per emulated instruction and per scheduler event.
+ */
+class SimulationBenchmark {
+public:
+    SimulationBenchmark(Simulation *sim, Mcu *mcu);
+
+    sim_time_t duration;
+    sim_time_t warmup;
+    int trials;
+    HostPerfCounters *perf_counters;
+
+    void run(void);
+
+    BenchmarkSummary summarize(double BenchmarkTrial::*metric);
+    void writeReport(FILE *f);
+    Json::Value toJson(void);
+    void writeJson(const char *filename);
+    bool compareWithBaseline(const char *filename, double tolerance, FILE *f);
+private:
+    Simulation *sim;
+    Mcu *mcu;
+
+    vector<BenchmarkTrial> results;
+    map<string, uint64_t> device_events;
+    long peak_rss_kb;
+    HostPerfResult perf_results[HOST_PERF_COUNTER_COUNT];
+
+    void _sumTrials(uint64_t &instructions, uint64_t &events);
+    void _writePerfReport(FILE *f);
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "simulation.h"
+#include "sim_device.h"
+#include "state_stream.h"
+
+#include "utils/cpp_macros.h"
+#include "utils/fail.h"
+
+using namespace std;
+
+// Checkpoint file layout (all values in host byte order):
+//
+// - magic, version, byte order mark
+// - simulation time
+// - event queue: count, then (timestamp, device index, event id) for each
+// - entities: count, then for each, its type name and a section with its
+//   checkpoint state
+
+#define CHECKPOINT_MAGIC         "MEGAS2CK"
+#define CHECKPOINT_VERSION       3
+#define CHECKPOINT_BYTE_ORDER    0x01020304
+
+/**
+ * Saves the complete state of the simulation to a file.
+ * 
+ * Unlike with snapshot(), pending callbacks cannot be saved, so this fails if
+ * there are any (see hasPendingCallbacks()). Like snapshot(), it should be
+ * called between events.
+ */
+void Simulation::saveCheckpoint(const char *filename)
+{
+    if (hasPendingCallbacks())
+        fail("Cannot checkpoint the simulation while callbacks are pending");
+    
+    vector<uint8_t> buffer;
+    StateWriter out(buffer);
+    
+    out.write(CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC));
+    out.put((uint32_t)CHECKPOINT_VERSION);
+    out.put((uint32_t)CHECKPOINT_BYTE_ORDER);
+    
+    out.put(time);
+    
+    // Replayed input is rescheduled from the journal on loading, and the
+    // recorder starts anew
+    uint32_t event_count = 0;
+    for (auto& evt : event_queue)
+        event_count += (evt.event_id != SIM_EVENT_REPLAY) && (evt.event_id != SIM_EVENT_RECORDER);
+    
+    out.put(event_count);
+    for (auto& evt : event_queue) {
+        if ((evt.event_id == SIM_EVENT_REPLAY) || (evt.event_id == SIM_EVENT_RECORDER))
+            continue;
+        
+        int32_t device_index = -1;
+        if (evt.device) {
+            auto it = FIND(devices, evt.device);
+            if (it == devices.end())
+                fail("Event scheduled for a device outside the simulation");
+            device_index = it - devices.begin();
+        }
+        
+        out.put(evt.timestamp);
+        out.put(device_index);
+        out.put((int32_t)evt.event_id);
+    }
+    
+    out.put((uint32_t)entities.size());
+    for (auto ent : entities)
+        out.putString(ent->type_name);
+    _saveEntities(out, true);
+    
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+        fail("Cannot create checkpoint file '%s'", filename);
+    
+    bool ok = (fwrite(buffer.data(), buffer.size(), 1, file) == 1);
+    ok &= (fclose(file) == 0);
+    if (!ok)
+        fail("Error writing checkpoint file '%s'", filename);
+}
+
+/**
+ * Loads the state of the simulation from a checkpoint file.
+ * 
+ * The simulation must have been set up from the same system description as
+ * the one the checkpoint was made from. It can then be continued using
+ * resume().
+ */
+void Simulation::loadCheckpoint(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        fail("Cannot open checkpoint file '%s'", filename);
+    
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        fail("Cannot stat checkpoint file '%s'", filename);
+    }
+    if (st.st_size < (off_t)strlen(CHECKPOINT_MAGIC)) {
+        close(fd);
+        fail("'%s' is not a checkpoint file", filename);
+    }
+    
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        fail("Cannot map checkpoint file '%s'", filename);
+    
+    try {
+        StateReader in((const uint8_t *)data, st.st_size);
+        
+        char magic[sizeof(CHECKPOINT_MAGIC) - 1];
+        uint32_t version, byte_order;
+        
+        in.read(magic, sizeof(magic));
+        if (memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)))
+            fail("'%s' is not a checkpoint file", filename);
+        
+        in.get(version);
+        in.get(byte_order);
+        if ((version != CHECKPOINT_VERSION) || (byte_order != CHECKPOINT_BYTE_ORDER))
+            fail("Checkpoint file '%s' has an unsupported version or byte order", filename);
+        
+        sim_time_t saved_time;
+        in.get(saved_time);
+        
+        uint32_t event_count;
+        in.get(event_count);
+        
+        deque<SimulationEventEntry> saved_events;
+        for (uint32_t i = 0; i < event_count; i++) {
+            sim_time_t timestamp;
+            int32_t device_index, event_id;
+            
+            in.get(timestamp);
+            in.get(device_index);
+            in.get(event_id);
+            
+            if ((device_index < -1) || (device_index >= (int32_t)devices.size()) ||
+                (event_id >= SIM_EVENT_RECORDER))
+                fail("Checkpoint file '%s' is corrupt", filename);
+            
+            saved_events.push_back(SimulationEventEntry(timestamp,
+                (device_index == -1) ? NULL : devices[device_index], event_id));
+        }
+        
+        uint32_t entity_count;
+        in.get(entity_count);
+        if (entity_count != entities.size())
+            fail("Checkpoint file '%s' was made for a different system", filename);
+        
+        for (auto ent : entities) {
+            string type_name;
+            in.getString(type_name);
+            
+            if (type_name != ent->type_name)
+                fail("Checkpoint file '%s' was made for a different system", filename);
+        }
+        
+        _loadEntities(in, true);
+        if (!in.atEnd())
+            fail("Checkpoint file '%s' is corrupt", filename);
+        
+        time = saved_time;
+        event_queue = move(saved_events);
+        journal.rewind(time);
+    } catch (exception& e) {
+        munmap(data, st.st_size);
+        throw;
+    }
+    
+    munmap(data, st.st_size);
+    
+    _onTimeWarp();
+}
@@ -7,6 +7,7 @@
 #include <json/json.h>
 
 #include "utils/parse_json_param.h"
+#include "state_stream.h"
 
 using namespace std;
 
@@ -20,6 +21,25 @@ public:
     string name;
     string type_name;
     
+    /**
+     * Saves/restores the runtime state of the entity, i.e. everything that,
+     * together with its configuration, determines its future behavior.
+     * 
+     * Entities without runtime state of their own need not override these.
+     * The state of the pins of PinDevice entities is handled separately.
+     */
+    virtual void saveState(StateWriter& out) { }
+    virtual void loadState(StateReader& in) { }
+    
+    /**
+     * Like saveState()/loadState(), but for checkpoints that are stored on
+     * disk and outlive the process. Entities whose state includes external
+     * resources (e.g. files) should also record enough to check that these
+     * are unchanged when the checkpoint is loaded.
+     */
+    virtual void saveCheckpoint(StateWriter& out) { saveState(out); }
+    virtual void loadCheckpoint(StateReader& in) { loadState(in); }
+    
     template<typename T>
     void parseJsonParam(T& value, Json::Value &json_data, const char *param_name)
     {
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "host_costs.h"
+#include "simulation.h"
+#include "sim_device.h"
+#include "entity.h"
+
+using namespace std;
+
+struct CostRow {
+    string device;
+    string event;
+    HostCost cost;
+};
+
+HostCostProfile::HostCostProfile(void)
+    : insertion({ 0, 0 }), pacing({ 0, 0 }), cached_device(NULL), cached_event_id(0),
+      cached_cost(NULL), total_ticks(0), total_ns(0), started_ticks(0), started_ns(0)
+{
+}
+
+/**
+ * Marks the start of a stretch of time spent in the simulation loop.
+ */
+void HostCostProfile::start(void)
+{
+    started_ns = monotonic_raw_time_ns();
+    started_ticks = host_ticks();
+}
+
+void HostCostProfile::stop(void)
+{
+    total_ticks += host_ticks() - started_ticks;
+    total_ns += monotonic_raw_time_ns() - started_ns;
+}
+
+static string device_name(SimulatedDevice *device)
+{
+    if (!device)
+        return "(system)";
+    
+    auto as_entity = dynamic_cast<Entity *>(device);
+    if (!as_entity)
+        return "?";
+    
+    return as_entity->id.empty() ? as_entity->name : as_entity->id;
+}
+
+static string event_name(int event_id)
+{
+    if (event_id == SIM_EVENT_CALLBACK)
+        return "callback";
+    if (event_id == SIM_EVENT_REPLAY)
+        return "replay";
+    if (event_id == SIM_EVENT_RECORDER)
+        return "recorder";
+    
+    return to_string(event_id);
+}
+
+void HostCostProfile::writeReport(FILE *f)
+{
+    // Ticks are converted using the rate measured over the whole profile
+    double ns_per_tick = total_ticks ? (double)total_ns / total_ticks : 0.0;
+    
+    vector<CostRow> rows;
+    uint64_t accounted = 0;
+    
+    for (auto& item : costs) {
+        rows.push_back({ device_name(item.first.first), event_name(item.first.second), item.second });
+        accounted += item.second.ticks;
+    }
+    
+    sort(rows.begin(), rows.end(), [](const CostRow& a, const CostRow& b) {
+        return a.cost.ticks > b.cost.ticks;
+    });
+    
+    rows.push_back({ "(queue insertion)", "", insertion });
+    rows.push_back({ "(real-time pacing)", "", pacing });
+    accounted += insertion.ticks + pacing.ticks;
+    
+    HostCost other = { 0, (total_ticks > accounted) ? total_ticks - accounted : 0 };
+    rows.push_back({ "(loop overhead)", "", other });
+    
+    int width = 6;
+    for (auto& row : rows)
+        width = max(width, (int)row.device.size());
+    
+    fprintf(f, "Host time by device and event (%.1f ms in total):\n", total_ns / 1e6);
+    fprintf(f, "  %-*s %-9s %12s %12s %7s %10s\n", width, "device", "event", "count", "time (ms)",
+        "share", "ns/event");
+    
+    for (auto& row : rows) {
+        double ns = row.cost.ticks * ns_per_tick;
+        char per_event[32] = "-";
+        
+        if (row.cost.count)
+            snprintf(per_event, sizeof(per_event), "%.1f", ns / row.cost.count);
+        
+        fprintf(f, "  %-*s %-9s %12llu %12.1f %6.1f%% %10s\n", width, row.device.c_str(), row.event.c_str(),
+            (unsigned long long)row.cost.count, ns / 1e6,
+            total_ticks ? 100.0 * row.cost.ticks / total_ticks : 0.0, per_event);
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef _H_HOST_COSTS_H
+#define _H_HOST_COSTS_H
+
+#include <inttypes.h>
+#include <cstdio>
+#include <map>
+#include <utility>
+
+#include "utils/time.h"
+
+using namespace std;
+
+class SimulatedDevice;
+
+struct HostCost {
+    uint64_t count;
+    uint64_t ticks;
+};
+
+/**
+ * Host time spent by a simulation, by device and event.
+ *
+ * While attached to a Simulation, every event dispatched by resume() is
+ * timed (with host_ticks()) and counted against its device and event id.
+ * Insertions into the event queue are timed separately, and not counted
+ * against the events that made them, and so is the time the simulation
+ * spends waiting for real time. Whatever is left of the time inside resume()
+ * is the overhead of the loop itself (which includes that of the
+ * measurements, so the profile slows down small events considerably).
+ */
+class HostCostProfile {
+public:
+    HostCostProfile(void);
+
+    HostCost insertion;
+    HostCost pacing;
+
+    void start(void);
+    void stop(void);
+
+    inline HostCost *costFor(SimulatedDevice *device, int event_id)
+    {
+        if ((device != cached_device) || (event_id != cached_event_id) || !cached_cost) {
+            cached_device = device;
+            cached_event_id = event_id;
+            cached_cost = &costs[make_pair(device, event_id)];
+        }
+
+        return cached_cost;
+    }
+
+    void writeReport(FILE *f);
+private:
+    map<pair<SimulatedDevice *, int>, HostCost> costs;
+
+    SimulatedDevice *cached_device;
+    int cached_event_id;
+    HostCost *cached_cost;
+
+    uint64_t total_ticks;
+    int64_t total_ns;
+    uint64_t started_ticks;
+    int64_t started_ns;
+};
+
+/**
+ * Accounts the lifetime of a scope as time spent in the simulation loop, if
+ * there is a profile.
+ */
+class HostCostWindow {
+public:
+    HostCostWindow(HostCostProfile *profile) : profile(profile)
+    {
+        if (profile)
+            profile->start();
+    }
+
+    ~HostCostWindow()
+    {
+        if (profile)
+            profile->stop();
+    }
+private:
+    HostCostProfile *profile;
+};
+
+#endif
@@ -0,0 +1,231 @@
+#include <algorithm>
+
+#include "input_journal.h"
+#include "simulation.h"
+#include "state_stream.h"
+
+#include "utils/cpp_macros.h"
+
+// Journal file layout (all values in host byte order):
+//
+// - magic, version, byte order mark
+// - records, each starting with its type:
+//   - device: index, entity ID (precedes the first entry for the device)
+//   - input/query: simulation time, device index, data
+
+#define JOURNAL_MAGIC           "MEGAS2IJ"
+#define JOURNAL_VERSION         1
+#define JOURNAL_BYTE_ORDER      0x01020304
+
+#define JOURNAL_RECORD_DEVICE   0
+#define JOURNAL_RECORD_INPUT    1
+#define JOURNAL_RECORD_QUERY    2
+
+InputJournal::InputJournal(Simulation *sim)
+{
+    this->sim = sim;
+    this->recording = false;
+    this->horizon = 0;
+    this->query_cursor = 0;
+    this->replay_cursor = 0;
+    this->log_file = NULL;
+}
+
+InputJournal::~InputJournal()
+{
+    if (log_file)
+        fclose(log_file);
+}
+
+/**
+ * Starts logging all inputs recorded from now on to a file, for replaying
+ * in a later run.
+ */
+void InputJournal::recordTo(const char *filename)
+{
+    log_file = fopen(filename, "wb");
+    if (!log_file)
+        fail("Cannot create input journal file '%s'", filename);
+    
+    vector<uint8_t> buffer;
+    StateWriter out(buffer);
+    
+    out.write(JOURNAL_MAGIC, strlen(JOURNAL_MAGIC));
+    out.put((uint32_t)JOURNAL_VERSION);
+    out.put((uint32_t)JOURNAL_BYTE_ORDER);
+    
+    fwrite(buffer.data(), buffer.size(), 1, log_file);
+}
+
+/**
+ * Loads the inputs recorded in a journal file. From now on, all live input is
+ * ignored, and the recorded input is replayed instead, starting with the next
+ * reset (or checkpoint load) of the simulation.
+ */
+void InputJournal::replayFrom(const char *filename, EntityLookup *lookup)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+        fail("Cannot open input journal file '%s'", filename);
+    
+    vector<uint8_t> buffer;
+    uint8_t chunk[65536];
+    size_t count;
+    
+    while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        buffer.insert(buffer.end(), chunk, chunk + count);
+    fclose(file);
+    
+    StateReader in(buffer);
+    
+    char magic[sizeof(JOURNAL_MAGIC) - 1];
+    uint32_t version, byte_order;
+    
+    if (buffer.size() < sizeof(magic))
+        fail("'%s' is not an input journal file", filename);
+    
+    in.read(magic, sizeof(magic));
+    if (memcmp(magic, JOURNAL_MAGIC, sizeof(magic)))
+        fail("'%s' is not an input journal file", filename);
+    
+    in.get(version);
+    in.get(byte_order);
+    if ((version != JOURNAL_VERSION) || (byte_order != JOURNAL_BYTE_ORDER))
+        fail("Input journal file '%s' has an unsupported version or byte order", filename);
+    
+    vector<JournaledDevice *> devices;
+    
+    entries.clear();
+    while (!in.atEnd()) {
+        uint8_t type;
+        uint16_t device_index;
+        
+        in.get(type);
+        in.get(device_index);
+        
+        if (type == JOURNAL_RECORD_DEVICE) {
+            string id;
+            in.getString(id);
+            
+            auto device = dynamic_cast<JournaledDevice *>(lookup->lookupEntity(id.c_str()));
+            if (!device)
+                fail("Input journal file '%s' refers to unknown device '%s'", filename, id.c_str());
+            
+            devices.resize(max(devices.size(), (size_t)device_index + 1));
+            devices[device_index] = device;
+        } else if ((type == JOURNAL_RECORD_INPUT) || (type == JOURNAL_RECORD_QUERY)) {
+            JournalEntry entry;
+            
+            in.get(entry.time);
+            in.getString(entry.data);
+            entry.is_query = (type == JOURNAL_RECORD_QUERY);
+            
+            if ((device_index >= devices.size()) || !devices[device_index])
+                fail("Input journal file '%s' is corrupt", filename);
+            entry.device = devices[device_index];
+            
+            entries.push_back(move(entry));
+        } else {
+            fail("Input journal file '%s' is corrupt", filename);
+        }
+    }
+    
+    horizon = SIM_TIME_NEVER;
+    query_cursor = 0;
+}
+
+bool InputJournal::isReplaying(void)
+{
+    return sim->time < horizon;
+}
+
+void InputJournal::record(JournaledDevice *device, const string& data)
+{
+    _recordEntry(device, false, data);
+}
+
+void InputJournal::_recordEntry(JournaledDevice *device, bool is_query, const string& data)
+{
+    JournalEntry entry = { sim->time, device, is_query, data };
+    
+    if (log_file)
+        _logEntry(entry);
+    if (recording)
+        entries.push_back(move(entry));
+}
+
+void InputJournal::_logEntry(const JournalEntry& entry)
+{
+    vector<uint8_t> buffer;
+    StateWriter out(buffer);
+    
+    auto it = FIND(log_devices, entry.device);
+    uint16_t device_index = it - log_devices.begin();
+    
+    if (it == log_devices.end()) {
+        log_devices.push_back(entry.device);
+        
+        out.put((uint8_t)JOURNAL_RECORD_DEVICE);
+        out.put(device_index);
+        out.putString(dynamic_cast<Entity *>(entry.device)->id);
+    }
+    
+    out.put((uint8_t)(entry.is_query ? JOURNAL_RECORD_QUERY : JOURNAL_RECORD_INPUT));
+    out.put(device_index);
+    out.put(entry.time);
+    out.putString(entry.data);
+    
+    // Flushed right away, so that the journal survives a crash
+    if ((fwrite(buffer.data(), buffer.size(), 1, log_file) != 1) || fflush(log_file))
+        fail("Error writing input journal");
+}
+
+const string& InputJournal::_nextQueryResult(JournaledDevice *device)
+{
+    while ((query_cursor < entries.size()) && !entries[query_cursor].is_query)
+        query_cursor++;
+    
+    if ((query_cursor == entries.size()) || (entries[query_cursor].device != device))
+        fail("Input journal does not match the simulation");
+    
+    return entries[query_cursor++].data;
+}
+
+void InputJournal::extendHorizon(sim_time_t time)
+{
+    horizon = max(horizon, time);
+}
+
+/**
+ * Schedules all recorded input received at or after the given time to be
+ * delivered again, at the same simulation time as it was originally.
+ */
+void InputJournal::rewind(sim_time_t time)
+{
+    auto it = lower_bound(entries.begin(), entries.end(), time,
+        [](const JournalEntry& entry, sim_time_t time) { return entry.time < time; });
+    
+    query_cursor = it - entries.begin();
+    replay_cursor = query_cursor;
+    
+    _scheduleNextReplay();
+}
+
+// Only the next input is scheduled at any time, so that a long journal does
+// not crowd the event queue
+void InputJournal::_scheduleNextReplay(void)
+{
+    while ((replay_cursor < entries.size()) && entries[replay_cursor].is_query)
+        replay_cursor++;
+    
+    if (replay_cursor < entries.size())
+        sim->scheduleReplayCallback(entries[replay_cursor].time, [this]() { _replayNext(); });
+}
+
+void InputJournal::_replayNext(void)
+{
+    size_t index = replay_cursor++;
+    
+    _scheduleNextReplay();
+    entries[index].device->replayInput(entries[index].data);
+}
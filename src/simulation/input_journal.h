@@ -0,0 +1,104 @@
+#ifndef _H_INPUT_JOURNAL_H
+#define _H_INPUT_JOURNAL_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+#include "sim_time.h"
+#include "entity_lookup.h"
+
+#include "utils/fail.h"
+
+using namespace std;
+
+class Simulation;
+
+/**
+ * Implemented by devices that take input from the outside world (i.e.
+ * nondeterministic input), either as it arrives (replayInput() is then
+ * called to deliver it again), or by querying the host (see
+ * InputJournal::query()).
+ */
+class JournaledDevice {
+public:
+    virtual void replayInput(const string& data) { }
+};
+
+/**
+ * Records the external inputs received during a simulation, so that they can
+ * be replayed deterministically, either after the simulation has been
+ * rewound (see ExecutionRecorder), or in a later run (from a journal file).
+ * 
+ * Up to the horizon (the furthest point in time the simulation has reached
+ * before being rewound, or forever when replaying a file), the devices must
+ * ignore live input and let the journal replay the recorded input instead.
+ * The Simulation calls rewind() whenever it is reset or moved in time.
+ */
+class InputJournal {
+public:
+    InputJournal(Simulation *sim);
+    ~InputJournal();
+    
+    bool recording;
+    
+    void recordTo(const char *filename);
+    void replayFrom(const char *filename, EntityLookup *lookup);
+    
+    bool isReplaying(void);
+    void record(JournaledDevice *device, const string& data);
+    void extendHorizon(sim_time_t time);
+    void rewind(sim_time_t time);
+    
+    /**
+     * Reads a value from the host (e.g. the wall clock time) through the
+     * journal. When replaying, the recorded value is returned instead, and
+     * the host is not queried at all.
+     */
+    template<typename F>
+    auto query(JournaledDevice *device, F read_live) -> decltype(read_live())
+    {
+        typedef decltype(read_live()) T;
+        static_assert(is_trivially_copyable<T>::value, "Queried value must be trivially copyable");
+        
+        T value;
+        
+        if (isReplaying()) {
+            const string& data = _nextQueryResult(device);
+            if (data.size() != sizeof(T))
+                fail("Input journal does not match the simulation");
+            memcpy(&value, data.data(), sizeof(T));
+        } else {
+            value = read_live();
+            _recordEntry(device, true, string((const char *)&value, sizeof(T)));
+        }
+        
+        return value;
+    }
+private:
+    struct JournalEntry {
+        sim_time_t time;
+        JournaledDevice *device;
+        bool is_query;
+        string data;
+    };
+    
+    Simulation *sim;
+    vector<JournalEntry> entries;
+    sim_time_t horizon;
+    size_t query_cursor;
+    size_t replay_cursor;
+    
+    FILE *log_file;
+    vector<JournaledDevice *> log_devices;
+    
+    void _recordEntry(JournaledDevice *device, bool is_query, const string& data);
+    void _logEntry(const JournalEntry& entry);
+    const string& _nextQueryResult(JournaledDevice *device);
+    void _scheduleNextReplay(void);
+    void _replayNext(void);
+};
+
+#endif
@@ -0,0 +1,221 @@
+#include <cstdio>
+#include <cerrno>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "pacer.h"
+
+#include "utils/fail.h"
+#include "utils/time.h"
+
+using namespace std;
+
+const sim_time_t DEFAULT_PACING_SLICE = ms_to_sim_time(1);
+const int64_t DEFAULT_MAX_LAG_NS = 100000000LL;
+
+RealTimePacer::RealTimePacer(void)
+{
+    speed = 1.0;
+    slice = DEFAULT_PACING_SLICE;
+    spin_ns = 0;
+    max_lag_ns = DEFAULT_MAX_LAG_NS;
+    
+    real_anchor = 0;
+    sim_anchor = 0;
+    
+    resetStats();
+    
+    woken = false;
+    
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((epoll_fd == -1) || (timer_fd == -1) || (wake_fd == -1))
+        fail("Could not create real-time pacer wait set");
+    
+    struct epoll_event ev;
+    
+    ev.events = EPOLLIN;
+    ev.data.fd = timer_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) == -1)
+        fail("Could not add timer to real-time pacer wait set");
+    
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == -1)
+        fail("Could not add eventfd to real-time pacer wait set");
+}
+
+RealTimePacer::~RealTimePacer()
+{
+    close(epoll_fd);
+    close(timer_fd);
+    close(wake_fd);
+}
+
+void RealTimePacer::resetStats(void)
+{
+    slices = 0;
+    late_slices = 0;
+    resyncs = 0;
+    total_lag_ns = 0;
+    worst_lag_ns = 0;
+}
+
+void RealTimePacer::start(sim_time_t sim_time)
+{
+    if (speed <= 0.0)
+        fail("Real-time pacing speed factor must be positive");
+    if (slice <= 0)
+        fail("Real-time pacing slice must be positive");
+    
+    resync(sim_time);
+    resetStats();
+}
+
+/**
+ * Makes the given simulation time correspond to the present moment.
+ */
+void RealTimePacer::resync(sim_time_t sim_time)
+{
+    real_anchor = monotonic_time_ns();
+    sim_anchor = sim_time;
+}
+
+/**
+ * Waits until the real time at which the given simulation time is due.
+ * 
+ * Returns true if the deadline was reached, or false if the wait was cut
+ * short by wake(). In the latter case, simTimeNow() tells how far the
+ * simulation may advance in the meantime.
+ */
+bool RealTimePacer::pace(sim_time_t sim_time)
+{
+    if (woken.load(memory_order_relaxed) && _consumeWake())
+        return false;
+    
+    int64_t deadline = _deadlineFor(sim_time);
+    int64_t now = monotonic_time_ns();
+    
+    if (now < deadline) {
+        if (!_waitUntil(deadline))
+            return false;
+        
+        slices++;
+        return true;
+    }
+    
+    slices++;
+    
+    int64_t lag = now - deadline;
+    
+    late_slices++;
+    total_lag_ns += lag;
+    if (lag > worst_lag_ns)
+        worst_lag_ns = lag;
+    
+    if (lag > max_lag_ns) {
+        // Catching up would mean running in a burst for too long; start
+        // afresh from here instead
+        if (!resyncs)
+            warn("Host cannot keep up with real time at speed %gx", speed);
+        
+        real_anchor = now;
+        sim_anchor = sim_time;
+        resyncs++;
+    }
+    
+    return true;
+}
+
+/**
+ * Interrupts a wait in progress (or the next one, if there is none).
+ * 
+ * May be called from any thread, and also from a signal handler.
+ */
+void RealTimePacer::wake(void)
+{
+    if (woken.exchange(true))
+        return;
+    
+    uint64_t one = 1;
+    ssize_t rc = write(wake_fd, &one, sizeof(one));
+    (void)rc;
+}
+
+sim_time_t RealTimePacer::simTimeNow(void)
+{
+    return sim_anchor + ns_to_sim_time((int64_t)((monotonic_time_ns() - real_anchor) * speed));
+}
+
+void RealTimePacer::reportStats(void)
+{
+    if (!late_slices)
+        return;
+    
+    info("Real-time pacing: host fell behind in %llu of %llu slices (%.1f%%), "
+        "average lag %.3f ms, worst %.3f ms, %llu resyncs",
+        (unsigned long long)late_slices, (unsigned long long)slices,
+        100.0 * late_slices / slices, total_lag_ns / 1e6 / late_slices,
+        worst_lag_ns / 1e6, (unsigned long long)resyncs);
+}
+
+int64_t RealTimePacer::_deadlineFor(sim_time_t sim_time)
+{
+    return real_anchor + (int64_t)(sim_time_to_ns(sim_time - sim_anchor) / speed);
+}
+
+bool RealTimePacer::_waitUntil(int64_t deadline)
+{
+    int64_t sleep_until = deadline - spin_ns;
+    
+    if (sleep_until > monotonic_time_ns()) {
+        struct itimerspec its;
+        
+        its.it_interval.tv_sec = 0;
+        its.it_interval.tv_nsec = 0;
+        its.it_value = ns_to_timespec(sleep_until);
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+        
+        bool expired = false;
+        while (!expired) {
+            struct epoll_event events[2];
+            
+            int count = epoll_wait(epoll_fd, events, 2, -1);
+            if (count == -1) {
+                if (errno == EINTR)
+                    continue;
+                fail("Real-time pacer wait failed");
+            }
+            
+            for (int i = 0; i < count; i++) {
+                if (events[i].data.fd == wake_fd) {
+                    _consumeWake();
+                    return false;
+                }
+                
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) > 0)
+                    expired = true;
+            }
+        }
+    }
+    
+    while (monotonic_time_ns() < deadline)
+        if (woken.load(memory_order_relaxed) && _consumeWake())
+            return false;
+    
+    return true;
+}
+
+bool RealTimePacer::_consumeWake(void)
+{
+    uint64_t count;
+    ssize_t rc = read(wake_fd, &count, sizeof(count));
+    (void)rc;
+    
+    return woken.exchange(false);
+}
@@ -0,0 +1,67 @@
+#ifndef _H_PACER_H
+#define _H_PACER_H
+
+#include <inttypes.h>
+#include <atomic>
+
+#include "sim_time.h"
+
+using namespace std;
+
+/**
+ * Keeps the simulation in step with real (wall clock) time.
+ *
+ * The simulation is divided into slices of simulated time. At the start of
+ * each slice, the pacer computes the absolute real-time deadline at which
+ * that point in simulated time is due (taking the speed factor into account)
+ * and sleeps until then using clock_nanosleep(TIMER_ABSTIME), so that timing
+ * errors do not accumulate. Optionally, the last part of the wait is spent
+ * spinning on the clock instead, for sub-millisecond precision.
+ *
+ * If the host cannot keep up, the simulation runs unthrottled to catch up,
+ * and the lag is recorded. If the lag exceeds max_lag, the pacer gives up on
+ * catching up and re-anchors the schedule to the current time instead.
+ *
+ * The wait is done with epoll on a timerfd armed for the deadline together
+ * with an eventfd, so that wake() (e.g. on input arriving from the outside
+ * world) interrupts it immediately.
+ */
+class RealTimePacer {
+public:
+    RealTimePacer(void);
+    ~RealTimePacer();
+
+    double speed;
+    sim_time_t slice;
+    int64_t spin_ns;
+    int64_t max_lag_ns;
+
+    void start(sim_time_t sim_time);
+    void resync(sim_time_t sim_time);
+    bool pace(sim_time_t sim_time);
+    void wake(void);
+    sim_time_t simTimeNow(void);
+
+    uint64_t slices;
+    uint64_t late_slices;
+    uint64_t resyncs;
+    int64_t total_lag_ns;
+    int64_t worst_lag_ns;
+
+    void resetStats(void);
+    void reportStats(void);
+private:
+    int64_t real_anchor;
+    sim_time_t sim_anchor;
+
+    int epoll_fd;
+    int timer_fd;
+    int wake_fd;
+    atomic<bool> woken;
+
+    int64_t _deadlineFor(sim_time_t sim_time);
+    bool _waitUntil(int64_t deadline);
+    bool _consumeWake(void);
+};
+
+#endif
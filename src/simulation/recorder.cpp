@@ -0,0 +1,203 @@
+#include <cstring>
+#include <algorithm>
+
+#include "recorder.h"
+
+#include "utils/fail.h"
+
+ExecutionRecorder::ExecutionRecorder(Simulation *sim, Mcu *mcu)
+{
+    this->sim = sim;
+    this->mcu = mcu;
+    
+    this->interval = RECORDER_DEFAULT_INTERVAL;
+    this->budget = RECORDER_DEFAULT_BUDGET;
+}
+
+/**
+ * Starts recording from the current point in the simulation. Should be called
+ * after the simulation has been reset (or loaded from a checkpoint).
+ */
+void ExecutionRecorder::start(void)
+{
+    sim->journal.recording = true;
+    
+    _record();
+    _scheduleNext();
+}
+
+void ExecutionRecorder::_scheduleNext(void)
+{
+    sim->scheduleRecorderCallbackIn(interval, [this]() { _onTick(); });
+}
+
+void ExecutionRecorder::_onTick(void)
+{
+    // When running forward after a rewind, the earlier points are already
+    // recorded
+    if (sim->time > points.back().time)
+        _record();
+    
+    _scheduleNext();
+}
+
+void ExecutionRecorder::_record(void)
+{
+    SimulationSnapshot snapshot = sim->snapshot();
+    const vector<uint8_t>& state = snapshot.entity_state;
+    
+    RecordedPoint point;
+    point.time = snapshot.time;
+    point.cycle = mcu->getCycleCount();
+    point.event_queue = move(snapshot.event_queue);
+    
+    if (current_base && (current_base->size() == state.size())) {
+        const vector<uint8_t>& base = *current_base;
+        
+        for (size_t offset = 0; offset < state.size(); offset += RECORDER_CHUNK_SIZE) {
+            size_t len = min((size_t)RECORDER_CHUNK_SIZE, state.size() - offset);
+            
+            if (memcmp(&state[offset], &base[offset], len)) {
+                point.chunk_offsets.push_back(offset);
+                point.chunk_data.insert(point.chunk_data.end(),
+                    state.begin() + offset, state.begin() + offset + len);
+            }
+        }
+        
+        // Start a new series once the deltas get too large
+        if (point.chunk_data.size() > base.size() / 2)
+            current_base.reset();
+    } else {
+        current_base.reset();
+    }
+    
+    if (!current_base) {
+        point.chunk_offsets.clear();
+        point.chunk_data.clear();
+        
+        current_base = make_shared<const vector<uint8_t>>(move(snapshot.entity_state));
+    }
+    
+    point.base = current_base;
+    points.push_back(move(point));
+    
+    sim->journal.extendHorizon(sim->time);
+    
+    while ((memoryUsage() > budget) && (points.size() > 2))
+        _thin();
+}
+
+void ExecutionRecorder::_thin(void)
+{
+    vector<RecordedPoint> kept;
+    
+    for (size_t i = 0; i < points.size(); i++)
+        if (!(i & 1) || (i == points.size() - 1))
+            kept.push_back(move(points[i]));
+    
+    points = move(kept);
+    interval *= 2;
+}
+
+SimulationSnapshot ExecutionRecorder::_rebuild(const RecordedPoint& point)
+{
+    SimulationSnapshot snapshot;
+    
+    snapshot.time = point.time;
+    snapshot.event_queue = point.event_queue;
+    snapshot.entity_state = *point.base;
+    
+    const uint8_t *data = point.chunk_data.data();
+    
+    for (uint32_t offset : point.chunk_offsets) {
+        size_t len = min((size_t)RECORDER_CHUNK_SIZE, snapshot.entity_state.size() - offset);
+        
+        memcpy(&snapshot.entity_state[offset], data, len);
+        data += len;
+    }
+    
+    return snapshot;
+}
+
+/**
+ * Takes the simulation back (or forward) to the point where the MCU has
+ * executed the given number of cycles. Must not be called while the
+ * simulation is running.
+ */
+void ExecutionRecorder::seekToCycle(uint64_t cycle)
+{
+    if (points.empty())
+        fail("Nothing has been recorded yet");
+    
+    auto it = upper_bound(points.begin(), points.end(), cycle,
+        [](uint64_t cycle, const RecordedPoint& point) { return cycle < point.cycle; });
+    if (it == points.begin())
+        fail("Cycle %llu precedes the start of the recording", (unsigned long long)cycle);
+    
+    const RecordedPoint& point = *(it - 1);
+    
+    sim->journal.extendHorizon(sim->time);
+    
+    sim->restore(_rebuild(point));
+    _scheduleNext();
+    
+    runToCycle(cycle);
+}
+
+/**
+ * Runs the simulation forward (as fast as possible) until the MCU has
+ * executed the given number of cycles.
+ */
+void ExecutionRecorder::runToCycle(uint64_t cycle)
+{
+    if (mcu->getCycleCount() >= cycle)
+        return;
+    
+    bool sync_with_real_time = sim->sync_with_real_time;
+    sim->sync_with_real_time = false;
+    
+    mcu->setCycleBreakpoint(cycle, [this]() { sim->end(); });
+    
+    try {
+        sim->resume();
+    } catch (...) {
+        mcu->clearBreakpoint();
+        sim->sync_with_real_time = sync_with_real_time;
+        throw;
+    }
+    
+    sim->sync_with_real_time = sync_with_real_time;
+}
+
+void ExecutionRecorder::reverseStep(uint64_t cycles)
+{
+    uint64_t cycle = mcu->getCycleCount();
+    
+    seekToCycle(cycle > cycles ? cycle - cycles : 0);
+}
+
+size_t ExecutionRecorder::snapshotCount(void)
+{
+    return points.size();
+}
+
+size_t ExecutionRecorder::memoryUsage(void)
+{
+    size_t total = 0;
+    const vector<uint8_t> *last_base = NULL;
+    
+    for (auto& point : points) {
+        total += sizeof(RecordedPoint) +
+            point.event_queue.size() * sizeof(SimulationEventEntry) +
+            point.chunk_offsets.size() * sizeof(uint32_t) +
+            point.chunk_data.size();
+        
+        // Points sharing a base are always adjacent
+        if (point.base.get() != last_base) {
+            total += point.base->size();
+            last_base = point.base.get();
+        }
+    }
+    
+    return total;
+}
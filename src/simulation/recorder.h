@@ -0,0 +1,72 @@
+#ifndef _H_RECORDER_H
+#define _H_RECORDER_H
+
+#include <inttypes.h>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "simulation.h"
+#include "devices/mcu/mcu.h"
+
+using namespace std;
+
+#define RECORDER_CHUNK_SIZE           64
+#define RECORDER_DEFAULT_INTERVAL     ms_to_sim_time(10)
+#define RECORDER_DEFAULT_BUDGET       (256 << 20)
+
+/**
+ * Makes it possible to travel back in the execution of a simulation.
+ * 
+ * While the simulation runs, the recorder takes a snapshot every so often
+ * (every 'interval' of simulated time). Only the first snapshot in a series
+ * is stored in full; the following ones only store the chunks of state that
+ * differ from it. External input is recorded in the simulation's journal.
+ * 
+ * To go to an earlier point in the execution, the recorder restores the
+ * nearest snapshot before it and runs the simulation forward from there,
+ * replaying the journal.
+ * 
+ * If the recorded snapshots exceed the memory budget, every other one is
+ * dropped and the interval is doubled, so the recording always covers the
+ * whole execution, at a coarser granularity.
+ */
+class ExecutionRecorder {
+public:
+    ExecutionRecorder(Simulation *sim, Mcu *mcu);
+    
+    sim_time_t interval;
+    size_t budget;
+    
+    void start(void);
+    
+    void seekToCycle(uint64_t cycle);
+    void runToCycle(uint64_t cycle);
+    void reverseStep(uint64_t cycles = 1);
+    
+    size_t snapshotCount(void);
+    size_t memoryUsage(void);
+private:
+    struct RecordedPoint {
+        sim_time_t time;
+        uint64_t cycle;
+        deque<SimulationEventEntry> event_queue;
+        shared_ptr<const vector<uint8_t>> base;
+        vector<uint32_t> chunk_offsets;
+        vector<uint8_t> chunk_data;
+    };
+    
+    Simulation *sim;
+    Mcu *mcu;
+    
+    vector<RecordedPoint> points;
+    shared_ptr<const vector<uint8_t>> current_base;
+    
+    void _scheduleNext(void);
+    void _onTick(void);
+    void _record(void);
+    void _thin(void);
+    SimulationSnapshot _rebuild(const RecordedPoint& point);
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef _H_SIM_CALLBACK_H
+#define _H_SIM_CALLBACK_H
+
+#include <cstring>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+using namespace std;
+
+#define SIM_CALLBACK_INLINE_SIZE   48
+#define SIM_CALLBACK_INLINE_ALIGN   8
+
+/**
+ * A closure that can be scheduled in the simulation event queue.
+ *
+ * The callable (i.e. the lambda together with everything it captures) is
+ * stored in a fixed-size buffer inside the object itself, so creating,
+ * copying and scheduling a callback never touches the heap. Callables larger
+ * than SIM_CALLBACK_INLINE_SIZE bytes are rejected at compile time; to carry
+ * a bigger payload, capture a (smart) pointer to it instead.
+ *
+ * Trivially copyable callables (the common case of a lambda capturing a few
+ * pointers and integers) are copied with a plain memcpy and need no cleanup.
+ */
+class SimCallback {
+public:
+    SimCallback(void) : invoker(NULL), manager(NULL) { }
+
+    template<typename F, typename = typename enable_if<
+        !is_same<typename decay<F>::type, SimCallback>::value>::type>
+    SimCallback(F&& fn)
+    {
+        typedef typename decay<F>::type Fn;
+
+        static_assert(sizeof(Fn) <= SIM_CALLBACK_INLINE_SIZE,
+            "Closure too large for SimCallback inline storage");
+        static_assert(alignof(Fn) <= SIM_CALLBACK_INLINE_ALIGN,
+            "Closure alignment too strict for SimCallback inline storage");
+
+        new (storage) Fn(forward<F>(fn));
+        invoker = &SimCallback::_invoke<Fn>;
+        manager = is_trivially_copyable<Fn>::value ? NULL : &SimCallback::_manage<Fn>;
+    }
+
+    SimCallback(const SimCallback& other)
+        : invoker(other.invoker), manager(other.manager)
+    {
+        _copyFrom(other);
+    }
+
+    SimCallback(SimCallback&& other)
+        : invoker(other.invoker), manager(other.manager)
+    {
+        _moveFrom(other);
+    }
+
+    ~SimCallback()
+    {
+        _destroy();
+    }
+
+    SimCallback& operator= (const SimCallback& other)
+    {
+        if (this != &other) {
+            _destroy();
+            invoker = other.invoker;
+            manager = other.manager;
+            _copyFrom(other);
+        }
+
+        return *this;
+    }
+
+    SimCallback& operator= (SimCallback&& other)
+    {
+        if (this != &other) {
+            _destroy();
+            invoker = other.invoker;
+            manager = other.manager;
+            _moveFrom(other);
+        }
+
+        return *this;
+    }
+
+    explicit operator bool() const
+    {
+        return invoker != NULL;
+    }
+
+    void operator() (void)
+    {
+        invoker(storage);
+    }
+private:
+    enum ManagerOp { OP_COPY, OP_MOVE, OP_DESTROY };
+
+    typedef void (*invoker_t)(void *);
+    typedef void (*manager_t)(ManagerOp, void *, void *);
+
+    alignas(SIM_CALLBACK_INLINE_ALIGN) unsigned char storage[SIM_CALLBACK_INLINE_SIZE];
+    invoker_t invoker;
+    manager_t manager;
+
+    template<typename Fn>
+    static void _invoke(void *fn)
+    {
+        (*static_cast<Fn *>(fn))();
+    }
+
+    template<typename Fn>
+    static void _manage(ManagerOp op, void *dest, void *src)
+    {
+        switch (op) {
+            case OP_COPY:
+                new (dest) Fn(*static_cast<const Fn *>(src));
+                break;
+            case OP_MOVE:
+                new (dest) Fn(move(*static_cast<Fn *>(src)));
+                break;
+            case OP_DESTROY:
+                static_cast<Fn *>(dest)->~Fn();
+                break;
+        }
+    }
+
+    void _copyFrom(const SimCallback& other)
+    {
+        if (manager)
+            manager(OP_COPY, storage, (void *)other.storage);
+        else if (invoker)
+            memcpy(storage, other.storage, SIM_CALLBACK_INLINE_SIZE);
+    }
+
+    void _moveFrom(SimCallback& other)
+    {
+        if (manager)
+            manager(OP_MOVE, storage, other.storage);
+        else if (invoker)
+            memcpy(storage, other.storage, SIM_CALLBACK_INLINE_SIZE);
+    }
+
+    void _destroy(void)
+    {
+        if (manager)
+            manager(OP_DESTROY, storage, NULL);
+
+        invoker = NULL;
+        manager = NULL;
+    }
+};
+
+#endif
@@ -7,6 +7,7 @@ using namespace std;
 SimulatedDevice::SimulatedDevice(void)
 {
     this->simulation = NULL;
+    this->event_count = 0;
 }
 
 void SimulatedDevice::setSimulation(Simulation *simulation)
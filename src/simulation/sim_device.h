@@ -10,6 +10,9 @@ public:
 
     virtual void act(int event);
     void setSimulation(Simulation *simulation);
+    
+    // Events (and callbacks) dispatched to the device so far
+    uint64_t event_count;
 protected:
     Simulation *simulation;
     
@@ -18,6 +21,27 @@ protected:
     void scheduleEvent(int event, sim_time_t time);
     void scheduleEventIn(int event, sim_time_t time);
     void unscheduleAll(void);
+    
+    template<typename F>
+    void scheduleCallback(sim_time_t time, F&& fn)
+    {
+        if (simulation)
+            simulation->scheduleCallback(this, time, forward<F>(fn));
+    }
+    
+    template<typename F>
+    void scheduleCallbackIn(sim_time_t time, F&& fn)
+    {
+        if (simulation)
+            simulation->scheduleCallbackIn(this, time, forward<F>(fn));
+    }
+    
+    template<typename F>
+    void postCallback(F&& fn)
+    {
+        if (simulation)
+            simulation->postCallback(this, forward<F>(fn));
+    }
 };
 
 #endif
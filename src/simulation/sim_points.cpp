@@ -0,0 +1,86 @@
+#include "sim_points.h"
+
+#include "utils/fail.h"
+
+Mcu *find_mcu(SystemDescription &sys_desc)
+{
+    for (auto ent : sys_desc.entities) {
+        auto as_mcu = dynamic_cast<Mcu *>(ent);
+        if (as_mcu)
+            return as_mcu;
+    }
+    
+    return NULL;
+}
+
+/**
+ * Arranges for a callback to run at a point in the simulation, given either
+ * as a time or as the name of a function the MCU will reach.
+ */
+void schedule_at_point(Simulation &sim, SystemDescription &sys_desc, const char *point,
+                       SimCallback callback)
+{
+    sim_time_t time;
+    
+    if (parse_sim_time(point, time)) {
+        sim.scheduleCallback(NULL, time, move(callback));
+        return;
+    }
+    
+    Mcu *mcu = find_mcu(sys_desc);
+    if (!mcu)
+        fail("No MCU to look up symbol '%s' in", point);
+    
+    int pc = mcu->findProgramSymbolPC(point);
+    if (pc == -1)
+        fail("Symbol '%s' not found in the firmware", point);
+    
+    mcu->setBreakpoint(pc, move(callback));
+}
+
+/**
+ * Parses a time given in JSON either as a number of seconds or as a string
+ * like "150ms".
+ */
+sim_time_t parse_json_time(Json::Value &value, const char *what)
+{
+    sim_time_t time;
+    
+    if (value.isNumeric() && (value.asDouble() >= 0.0))
+        return (sim_time_t)(value.asDouble() * sec_to_sim_time(1));
+    if (value.isString() && parse_sim_time(value.asCString(), time))
+        return time;
+    
+    fail("Invalid time for '%s'", what);
+    return 0;
+}
+
+/**
+ * Resolves a RAM reference, i.e. a data symbol name or an address.
+ */
+int resolve_data_ref(Mcu *mcu, Json::Value &ref, int &length)
+{
+    if (!mcu)
+        fail("The system has no MCU");
+    
+    if (ref.isIntegral()) {
+        int address = ref.asInt();
+        if ((address < 0) || (address >= mcu->dataSize()))
+            fail("Address %d out of range", address);
+        
+        length = 1;
+        return address;
+    }
+    
+    if (!ref.isString())
+        fail("RAM must be referred to by symbol name or address");
+    
+    const Symbol *symbol = mcu->findDataSymbol(ref.asCString());
+    if (!symbol)
+        fail("Symbol '%s' not found in the firmware", ref.asCString());
+    if (symbol->address + symbol->length > mcu->dataSize())
+        fail("Symbol '%s' is outside the data memory", ref.asCString());
+    
+    length = symbol->length;
+    return symbol->address;
+}
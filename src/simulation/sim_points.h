@@ -0,0 +1,17 @@
+#ifndef _H_SIM_POINTS_H
+#define _H_SIM_POINTS_H
+
+#include <json/json.h>
+
+#include "simulation.h"
+#include "sys_desc.h"
+#include "devices/mcu/mcu.h"
+
+Mcu *find_mcu(SystemDescription &sys_desc);
+void schedule_at_point(Simulation &sim, SystemDescription &sys_desc, const char *point,
+                       SimCallback callback);
+
+sim_time_t parse_json_time(Json::Value &value, const char *what);
+int resolve_data_ref(Mcu *mcu, Json::Value &ref, int &length);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _H_SIM_TIME_H
+#define _H_SIM_TIME_H
+
+#include <inttypes.h>
+#include <cstdlib>
+#include <cstring>
+
+#define SIM_TIME_NEVER 0x0fffffffffffffffLL
+
+typedef int64_t sim_time_t;
+
+#define ns_to_sim_time(x) (x)
+#define us_to_sim_time(x) (1000LL*(x))
+#define ms_to_sim_time(x) (1000000LL*(x))
+#define sec_to_sim_time(x) (1000000000LL*(x))
+
+#define sim_time_to_ns(x) (x)
+
+/**
+ * Parses a time given in seconds, or with a unit (e.g. "20s", "1500ms",
+ * "10us", "500ns").
+ */
+static inline bool parse_sim_time(const char *text, sim_time_t &time)
+{
+    char *end;
+    double value = strtod(text, &end);
+    
+    if ((end == text) || (value < 0.0))
+        return false;
+    
+    if (!*end || !strcmp(end, "s"))
+        time = (sim_time_t)(value * sec_to_sim_time(1));
+    else if (!strcmp(end, "ms"))
+        time = (sim_time_t)(value * ms_to_sim_time(1));
+    else if (!strcmp(end, "us"))
+        time = (sim_time_t)(value * us_to_sim_time(1));
+    else if (!strcmp(end, "ns"))
+        time = (sim_time_t)(value * ns_to_sim_time(1));
+    else
+        return false;
+    
+    return true;
+}
+
+#endif
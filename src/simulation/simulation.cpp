@@ -1,18 +1,19 @@
 #include <cstdio>
 #include <cstdlib>
 #include <algorithm>
-#include <unistd.h>
 
 #include "simulation.h"
 #include "sim_device.h"
+#include "state_stream.h"
+#include "glue/pin_device.h"
+#include "profiling/trace_events.h"
 
 #include "utils/cpp_macros.h"
 #include "utils/fail.h"
-#include "utils/time.h"
 
 using namespace std;
 
-bool SimulationEventEntry::before(SimulationEventEntry &other)
+bool SimulationEventEntry::before(const SimulationEventEntry &other) const
 {
     if (timestamp != other.timestamp)
         return timestamp < other.timestamp;
@@ -23,19 +24,25 @@ bool SimulationEventEntry::before(SimulationEventEntry &other)
 }
 
 Simulation::Simulation()
+    : event_count(0), journal(this), host_costs(NULL), inbox_pending(false), stop_requested(false)
 {
     sync_with_real_time = true;
+    next_real_sync_time = SIM_TIME_NEVER;
 }
 
 Simulation::Simulation(SystemDescription &sys_desc)
+    : event_count(0), journal(this), host_costs(NULL), inbox_pending(false), stop_requested(false)
 {
     for (auto& ent : sys_desc.entities) {
+        entities.push_back(ent);
+        
         auto as_sim_dev = dynamic_cast<SimulatedDevice *>(ent);
         if (as_sim_dev != NULL)
             addDevice(as_sim_dev);
     }
     
     sync_with_real_time = true;
+    next_real_sync_time = SIM_TIME_NEVER;
 }
 
 void Simulation::addDevice(SimulatedDevice *device)
@@ -44,6 +51,11 @@ void Simulation::addDevice(SimulatedDevice *device)
         return;
         
     devices.push_back(device);
+    
+    auto as_entity = dynamic_cast<Entity *>(device);
+    if (as_entity && !CONTAINS(entities, as_entity))
+        entities.push_back(as_entity);
+    
     device->setSimulation(this);
 }
 
@@ -59,28 +71,67 @@ void Simulation::removeDevice(SimulatedDevice *device)
 
 void Simulation::scheduleEvent(SimulatedDevice *device, int event, sim_time_t time)
 {
-    SimulationEventEntry new_evt(time, device, event);
+    _insertEvent(SimulationEventEntry(time, device, event));
+}
+
+void Simulation::_insertEvent(SimulationEventEntry&& new_evt)
+{
+    if (__builtin_expect(host_costs != NULL, 0)) {
+        uint64_t started = host_ticks();
+        
+        _queueEvent(move(new_evt));
+        
+        host_costs->insertion.count++;
+        host_costs->insertion.ticks += host_ticks() - started;
+    } else {
+        _queueEvent(move(new_evt));
+    }
+}
+
+void Simulation::_queueEvent(SimulationEventEntry&& new_evt)
+{
+    // Note: an event is always placed after any equivalent ones already in
+    // the queue, so that a device's callbacks for the same instant run in
+    // FIFO order
 
     // fast path: insert in front
     if (event_queue.empty() || new_evt.before(event_queue.front())) {
-        event_queue.push_front(new_evt);
+        event_queue.push_front(move(new_evt));
         return;
     }
 
     // fast path: insert in back
-    if (event_queue.back().before(new_evt)) {
-        event_queue.push_back(new_evt);
+    if (!new_evt.before(event_queue.back())) {
+        event_queue.push_back(move(new_evt));
         return;
     }
 
     for (auto it = event_queue.begin(); it != event_queue.end(); it++) {
-        if (!it->before(new_evt)) {
-            event_queue.insert(it, new_evt);
+        if (new_evt.before(*it)) {
+            event_queue.insert(it, move(new_evt));
             break;
         }
     }
 }
 
+void Simulation::_drainInbox(void)
+{
+    vector<SimulationEventEntry> posted;
+    
+    inbox_lock.lock();
+    posted.swap(inbox);
+    inbox_pending.store(false, memory_order_relaxed);
+    inbox_lock.unlock();
+    
+    for (auto& evt : posted) {
+        evt.timestamp = time;
+        _insertEvent(move(evt));
+    }
+    
+    if (stop_requested.exchange(false))
+        end();
+}
+
 void Simulation::scheduleEventIn(SimulatedDevice *device, int event, sim_time_t time)
 {
     scheduleEvent(device, event, this->time + time);
@@ -102,50 +153,210 @@ void Simulation::run()
 
 void Simulation::runToTime(sim_time_t to_time)
 {
-    vector<SimulatedDevice*>::iterator it;
-    
+    reset();
+    resume(to_time);
+}
+
+void Simulation::reset()
+{
     if (devices.empty())
         fail("Can't run simulation with no devices present");
     
-    struct timespec t0;
-    clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
-    
     time = 0;
-    sim_time_t next_real_sync_time = time + ms_to_sim_time(1);
 
     event_queue.clear();
+    journal.rewind(time);
+    
     for (auto dev : devices)
         dev->reset();
+}
+
+/**
+ * Runs the simulation from its current state (i.e. as left by reset(),
+ * restore(), or a previous run), until the given time or until it is ended.
+ */
+void Simulation::resume(sim_time_t to_time)
+{
+    HostCostWindow cost_window(host_costs);
+    
+    next_real_sync_time = SIM_TIME_NEVER;
+    if (sync_with_real_time) {
+        pacer.start(time);
+        next_real_sync_time = time;
+    }
     
     while (time < to_time) {
+        if (inbox_pending.load(memory_order_acquire))
+            _drainInbox();
+        
         if (event_queue.empty())
             fail("Deadlock - all devices quiescent");
+        
+        sim_time_t due = event_queue.front().timestamp;
+        if (due >= next_real_sync_time) {
+            if (!_pace(due)) {
+                // Woken up by external input; let it in at the simulation
+                // time matching the present moment
+                time = max(time, min(pacer.simTimeNow(), due));
+                continue;
+            }
+            
+            next_real_sync_time = due + pacer.slice;
+        }
 
-        SimulationEventEntry evt = event_queue.front();
+        SimulationEventEntry evt(move(event_queue.front()));
         event_queue.pop_front();
 
         time = evt.timestamp;
+        event_count++;
         
-        if (sync_with_real_time && (time >= next_real_sync_time)) {
-            struct timespec t1;
-            clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
-            
-            int64_t real_elapsed = timespec_delta_ns(&t1, &t0);
-            int64_t delta = sim_time_to_ns(time) - real_elapsed;
-            
-            if (delta > 10000000) {
-                usleep(delta/1000);
-            }
-            
-            next_real_sync_time = time + ms_to_sim_time(1);
+        HostCost *cost = NULL;
+        uint64_t started = 0, insertion_before = 0;
+        if (__builtin_expect(host_costs != NULL, 0)) {
+            cost = host_costs->costFor(evt.device, evt.event_id);
+            insertion_before = host_costs->insertion.ticks;
+            started = host_ticks();
         }
         
-        if (evt.device) {
+        if (__builtin_expect(TraceEventWriter::active != NULL, 0))
+            TraceEventWriter::active->onAct(evt.device, evt.event_id, time);
+        
+        if (evt.event_id >= SIM_EVENT_RECORDER) {
+            if (evt.device)
+                evt.device->event_count++;
+            evt.callback();
+        } else if (evt.device) {
+            evt.device->event_count++;
             evt.device->act(evt.event_id);
         } else { // System event
             if (evt.event_id == SIM_EVENT_END)
                 break;
         }
+        
+        if (cost) {
+            // Insertions made by the event are accounted separately
+            cost->count++;
+            cost->ticks += host_ticks() - started - (host_costs->insertion.ticks - insertion_before);
+        }
+    }
+    
+    next_real_sync_time = SIM_TIME_NEVER;
+}
+
+bool Simulation::_pace(sim_time_t due)
+{
+    if (__builtin_expect(host_costs == NULL, 1))
+        return pacer.pace(due);
+    
+    uint64_t started = host_ticks();
+    bool result = pacer.pace(due);
+    
+    host_costs->pacing.count++;
+    host_costs->pacing.ticks += host_ticks() - started;
+    
+    return result;
+}
+
+/**
+ * Captures the complete state of the simulation.
+ * 
+ * This should be called between events, i.e. before or after running the
+ * simulation, or from within a callback.
+ */
+SimulationSnapshot Simulation::snapshot(void)
+{
+    SimulationSnapshot snapshot;
+    
+    snapshot.time = time;
+    for (auto& evt : event_queue)
+        if ((evt.event_id != SIM_EVENT_REPLAY) && (evt.event_id != SIM_EVENT_RECORDER))
+            snapshot.event_queue.push_back(evt);
+    
+    StateWriter out(snapshot.entity_state);
+    _saveEntities(out, false);
+    
+    return snapshot;
+}
+
+/**
+ * Returns the simulation to the state captured in a snapshot.
+ * 
+ * Like snapshot(), this should be called between events. It is cheap
+ * enough that a simulation can be branched many times from the same point.
+ */
+void Simulation::restore(const SimulationSnapshot& snapshot)
+{
+    StateReader in(snapshot.entity_state);
+    _loadEntities(in, false);
+    if (!in.atEnd())
+        fail("Snapshot does not match the simulated system");
+    
+    time = snapshot.time;
+    event_queue = snapshot.event_queue;
+    journal.rewind(time);
+    
+    _onTimeWarp();
+}
+
+bool Simulation::hasPendingCallbacks(void)
+{
+    if (inbox_pending.load(memory_order_acquire))
+        return true;
+    
+    for (auto& evt : event_queue)
+        if (evt.event_id == SIM_EVENT_CALLBACK)
+            return true;
+    
+    return false;
+}
+
+const vector<SimulatedDevice *>& Simulation::getDevices(void)
+{
+    return devices;
+}
+
+void Simulation::_saveEntities(StateWriter& out, bool for_checkpoint)
+{
+    for (auto ent : entities) {
+        size_t section = out.beginSection();
+        
+        auto as_pin_dev = dynamic_cast<PinDevice *>(ent);
+        if (as_pin_dev)
+            as_pin_dev->savePinsState(out);
+        
+        if (for_checkpoint)
+            ent->saveCheckpoint(out);
+        else
+            ent->saveState(out);
+        
+        out.endSection(section);
+    }
+}
+
+void Simulation::_loadEntities(StateReader& in, bool for_checkpoint)
+{
+    for (auto ent : entities) {
+        size_t section_end = in.beginSection();
+        
+        auto as_pin_dev = dynamic_cast<PinDevice *>(ent);
+        if (as_pin_dev)
+            as_pin_dev->loadPinsState(in);
+        
+        if (for_checkpoint)
+            ent->loadCheckpoint(in);
+        else
+            ent->loadState(in);
+        
+        if (!in.endSection(section_end))
+            fail("Saved state does not match '%s'", ent->id.c_str());
+    }
+}
+
+void Simulation::_onTimeWarp(void)
+{
+    if (next_real_sync_time != SIM_TIME_NEVER) {
+        pacer.resync(time);
+        next_real_sync_time = time;
     }
 }
 
@@ -153,3 +364,17 @@ void Simulation::end()
 {
     scheduleEventIn(NULL, SIM_EVENT_END, 0);
 }
+
+/**
+ * Asks the simulation to end at the earliest opportunity.
+ * 
+ * Unlike end(), this may be called from any thread, and also from a signal
+ * handler.
+ */
+void Simulation::requestStop()
+{
+    stop_requested.store(true);
+    inbox_pending.store(true, memory_order_release);
+    
+    pacer.wake();
+}
@@ -2,23 +2,25 @@
 #define _H_SIMULATION_H
 
 #include "sys_desc.h"
+#include "sim_time.h"
+#include "sim_callback.h"
+#include "pacer.h"
+#include "input_journal.h"
+#include "state_stream.h"
+#include "host_costs.h"
 
 #include <inttypes.h>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
 
 using namespace std;
 
-#define SIM_TIME_NEVER 0x0fffffffffffffffLL
-
-#define SIM_EVENT_END  -1
-
-typedef int64_t sim_time_t;
-
-#define ns_to_sim_time(x) (x)
-#define ms_to_sim_time(x) (1000000LL*(x))
-#define sec_to_sim_time(x) (1000000000LL*(x))
-
-#define sim_time_to_ns(x) (x)
+#define SIM_EVENT_END       -1
+#define SIM_EVENT_RECORDER  0x7ffffffd
+#define SIM_EVENT_REPLAY    0x7ffffffe
+#define SIM_EVENT_CALLBACK  0x7fffffff
 
 class SimulatedDevice;
 
@@ -27,10 +29,28 @@ public:
     sim_time_t timestamp;
     SimulatedDevice *device;
     int event_id;
+    SimCallback callback;
 
     SimulationEventEntry(sim_time_t timestamp_, SimulatedDevice* device_, int event_id_)
         : timestamp(timestamp_), device(device_), event_id(event_id_) {}
-    bool before(SimulationEventEntry &other);
+    SimulationEventEntry(sim_time_t timestamp_, SimulatedDevice* device_, SimCallback&& callback_,
+                         int event_id_ = SIM_EVENT_CALLBACK)
+        : timestamp(timestamp_), device(device_), event_id(event_id_),
+          callback(move(callback_)) {}
+    bool before(const SimulationEventEntry &other) const;
+};
+
+/**
+ * A copy of the complete state of a simulation at some point in time.
+ * 
+ * Snapshots are tied to the Simulation (and the devices) they were taken
+ * from, and can only be restored there.
+ */
+class SimulationSnapshot {
+public:
+    sim_time_t time;
+    deque<SimulationEventEntry> event_queue;
+    vector<uint8_t> entity_state;
 };
 
 class Simulation {
@@ -44,18 +64,122 @@ public:
     void run();
     void runToTime(sim_time_t to_time);
     
+    void reset();
+    void resume(sim_time_t to_time = SIM_TIME_NEVER);
+    
+    SimulationSnapshot snapshot(void);
+    void restore(const SimulationSnapshot& snapshot);
+    
+    void saveCheckpoint(const char *filename);
+    void loadCheckpoint(const char *filename);
+    
+    bool hasPendingCallbacks(void);
+    const vector<SimulatedDevice *>& getDevices(void);
+    
     void end();
+    void requestStop();
 
     void scheduleEvent(SimulatedDevice *device, int event, sim_time_t time);
     void scheduleEventIn(SimulatedDevice *device, int event, sim_time_t time);
     void unscheduleAll(SimulatedDevice *device);
 
+    /**
+     * Schedules a closure to be run at the given time, on behalf of a device.
+     * 
+     * The closure is stored inline in the event queue entry (see SimCallback)
+     * and may carry its own payload. Callbacks of the same device scheduled
+     * for the same time run in the order they were scheduled (the order
+     * across devices is unspecified). They are removed along with any other
+     * events of the owning device by unscheduleAll().
+     */
+    template<typename F>
+    void scheduleCallback(SimulatedDevice *device, sim_time_t time, F&& fn)
+    {
+        _insertEvent(SimulationEventEntry(time, device, SimCallback(forward<F>(fn))));
+    }
+
+    template<typename F>
+    void scheduleCallbackIn(SimulatedDevice *device, sim_time_t time, F&& fn)
+    {
+        scheduleCallback(device, this->time + time, forward<F>(fn));
+    }
+
+    /**
+     * Schedules a callback that replays recorded external input (see
+     * InputJournal). These are not captured in snapshots or checkpoints;
+     * instead, the journal schedules them anew whenever the simulation is
+     * reset or moved to another point in time.
+     */
+    template<typename F>
+    void scheduleReplayCallback(sim_time_t time, F&& fn)
+    {
+        _insertEvent(SimulationEventEntry(time, NULL, SimCallback(forward<F>(fn)), SIM_EVENT_REPLAY));
+    }
+
+    /**
+     * Schedules a callback of the execution recorder (see ExecutionRecorder).
+     * Like replay callbacks, these are not captured in snapshots or
+     * checkpoints, and do not count as pending callbacks; the recorder
+     * schedules its next one anew whenever it moves the simulation.
+     */
+    template<typename F>
+    void scheduleRecorderCallbackIn(sim_time_t time, F&& fn)
+    {
+        _insertEvent(SimulationEventEntry(this->time + time, NULL, SimCallback(forward<F>(fn)),
+                                          SIM_EVENT_RECORDER));
+    }
+
+    /**
+     * Like scheduleCallback(), but may be called from any thread. The
+     * callback will run in the simulation thread at the earliest opportunity,
+     * as of the simulation time at which it is picked up.
+     * 
+     * If the simulation is idling while synchronized with real time, it is
+     * woken up immediately and the callback runs at the simulation time that
+     * corresponds to the present moment.
+     */
+    template<typename F>
+    void postCallback(SimulatedDevice *device, F&& fn)
+    {
+        {
+            lock_guard<mutex> guard(inbox_lock);
+
+            inbox.push_back(SimulationEventEntry(0, device, SimCallback(forward<F>(fn))));
+            inbox_pending.store(true, memory_order_release);
+        }
+        
+        pacer.wake();
+    }
+
     sim_time_t time;
+    uint64_t event_count;
     
     bool sync_with_real_time;
+    RealTimePacer pacer;
+    InputJournal journal;
+    
+    // If set, host time is accounted here (see HostCostProfile)
+    HostCostProfile *host_costs;
 private:
+    vector<Entity *> entities;
     vector<SimulatedDevice *> devices;
     deque<SimulationEventEntry> event_queue;
+    
+    sim_time_t next_real_sync_time;
+    
+    mutex inbox_lock;
+    vector<SimulationEventEntry> inbox;
+    atomic<bool> inbox_pending;
+    atomic<bool> stop_requested;
+
+    void _insertEvent(SimulationEventEntry&& new_evt);
+    void _queueEvent(SimulationEventEntry&& new_evt);
+    bool _pace(sim_time_t due);
+    void _drainInbox(void);
+    
+    void _saveEntities(StateWriter& out, bool for_checkpoint);
+    void _loadEntities(StateReader& in, bool for_checkpoint);
+    void _onTimeWarp(void);
 };
 
 #endif
@@ -0,0 +1,135 @@
+#include <cstring>
+
+#include "state_stream.h"
+
+#include "utils/fail.h"
+
+using namespace std;
+
+StateWriter::StateWriter(vector<uint8_t>& buffer) : buffer(buffer)
+{
+}
+
+void StateWriter::write(const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+void StateWriter::putBools(const vector<bool>& values)
+{
+    put((uint32_t)values.size());
+    for (bool value : values)
+        put((uint8_t)value);
+}
+
+void StateWriter::putString(const string& value)
+{
+    put((uint32_t)value.size());
+    write(value.data(), value.size());
+}
+
+/**
+ * Starts a length-prefixed section, so that a reader can check that it
+ * consumed exactly what was written.
+ * 
+ * @return A token to be passed to endSection()
+ */
+size_t StateWriter::beginSection(void)
+{
+    size_t section = buffer.size();
+    put((uint32_t)0);
+    
+    return section;
+}
+
+void StateWriter::endSection(size_t section)
+{
+    uint32_t length = buffer.size() - section - sizeof(uint32_t);
+    
+    memcpy(&buffer[section], &length, sizeof(uint32_t));
+}
+
+size_t StateWriter::size(void) const
+{
+    return buffer.size();
+}
+
+StateReader::StateReader(const uint8_t *data, size_t size)
+    : data(data), size(size), position(0)
+{
+}
+
+StateReader::StateReader(const vector<uint8_t>& buffer)
+    : StateReader(buffer.data(), buffer.size())
+{
+}
+
+void StateReader::read(void *data, size_t size)
+{
+    if (size > this->size - position)
+        fail("Saved state is truncated");
+    
+    memcpy(data, this->data + position, size);
+    position += size;
+}
+
+void StateReader::getBools(vector<bool>& values)
+{
+    uint32_t count;
+    get(count);
+    
+    values.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t value;
+        get(value);
+        values[i] = value;
+    }
+}
+
+void StateReader::getString(string& value)
+{
+    uint32_t length;
+    get(length);
+    
+    if (length > size - position)
+        fail("Saved state is truncated");
+    
+    value.assign((const char *)data + position, length);
+    position += length;
+}
+
+/**
+ * Reads the header of a section written by StateWriter::beginSection().
+ * 
+ * @return The position at which the section should end
+ */
+size_t StateReader::beginSection(void)
+{
+    uint32_t length;
+    get(length);
+    
+    if (length > size - position)
+        fail("Saved state is truncated");
+    
+    return position + length;
+}
+
+/**
+ * Checks that a section was consumed exactly, and skips to its end.
+ * 
+ * @return False if the reader did not end up exactly at the section end
+ */
+bool StateReader::endSection(size_t section_end)
+{
+    bool exact = (position == section_end);
+    position = section_end;
+    
+    return exact;
+}
+
+bool StateReader::atEnd(void) const
+{
+    return position == size;
+}
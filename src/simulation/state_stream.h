@@ -0,0 +1,74 @@
+#ifndef _H_STATE_STREAM_H
+#define _H_STATE_STREAM_H
+
+#include <inttypes.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+using namespace std;
+
+/**
+ * Serializes the runtime state of entities into a flat byte buffer.
+ * 
+ * The format is raw host-endian memory images of the saved values, with no
+ * tagging. Thus the state must be read back, with a StateReader, in exactly
+ * the same order and by the same build of the program.
+ */
+class StateWriter {
+public:
+    StateWriter(vector<uint8_t>& buffer);
+    
+    void write(const void *data, size_t size);
+    
+    template<typename T>
+    void put(const T& value)
+    {
+        static_assert(is_trivially_copyable<T>::value,
+            "Only trivially copyable values can be saved directly");
+        
+        write(&value, sizeof(T));
+    }
+    
+    void putBools(const vector<bool>& values);
+    void putString(const string& value);
+    
+    size_t beginSection(void);
+    void endSection(size_t section);
+    
+    size_t size(void) const;
+private:
+    vector<uint8_t>& buffer;
+};
+
+class StateReader {
+public:
+    StateReader(const uint8_t *data, size_t size);
+    StateReader(const vector<uint8_t>& buffer);
+    
+    void read(void *data, size_t size);
+    
+    template<typename T>
+    void get(T& value)
+    {
+        static_assert(is_trivially_copyable<T>::value,
+            "Only trivially copyable values can be loaded directly");
+        
+        read(&value, sizeof(T));
+    }
+    
+    void getBools(vector<bool>& values);
+    void getString(string& value);
+    
+    size_t beginSection(void);
+    bool endSection(size_t section_end);
+    
+    bool atEnd(void) const;
+private:
+    const uint8_t *data;
+    size_t size;
+    size_t position;
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include "devices/enc28j60/enc28j60.h"
 #include "devices/ds1307.h"
 #include "devices/sd_card.h"
+#include "devices/spi_stub.h"
 #include "devices/voltage_src.h"
 
 #include "glue/i2c_bus.h"
@@ -21,22 +22,25 @@
 #include "gui/rs232_console.h"
 
 #include "networking/virtual_net.h"
+#include "networking/traffic_source.h"
+
+#include "profiling/vcd_writer.h"
 
 #include "sys_desc.h"
 #include "utils/fail.h"
 
 using namespace std;
 
-SystemDescription::SystemDescription()
+SystemDescription::SystemDescription() : owns_entities(true)
 {
 }
 
-SystemDescription::SystemDescription(Json::Value &json_data)
+SystemDescription::SystemDescription(Json::Value &json_data) : owns_entities(true)
 {
     initFromJson(json_data);
 }
 
-SystemDescription::SystemDescription(const char *filename)
+SystemDescription::SystemDescription(const char *filename) : owns_entities(true)
 {
     Json::Value json_data;
 
@@ -51,7 +55,7 @@ SystemDescription::SystemDescription(const char *filename)
 
 SystemDescription::~SystemDescription()
 {
-    while (!entities.empty()) {
+    while (owns_entities && !entities.empty()) {
         delete entities.back();
         entities.pop_back();
     }
@@ -83,6 +87,7 @@ void SystemDescription::initEntitiesFromJson(Json::Value &json_data)
         Entity *ent = parseEntity(json_val);
         entities.push_back(ent);
         parseEntityConnections(ent, json_val);
+        parseEntityTracing(ent, json_val);
     }
 }
 
@@ -110,8 +115,12 @@ Entity * SystemDescription::parseEntity(Json::Value &json_data)
         return new AnalogBus(json_data, this);
     } else if (type == "VoltageSource") {
         return new VoltageSource(json_data);
+    } else if (type == "SpiStub") {
+        return new SpiStub(json_data);
     } else if (type == "VirtualNetwork") {
         return new VirtualNetwork(json_data, this);
+    } else if (type == "TrafficSource") {
+        return new TrafficSource(json_data, this);
     } else if (type == "SimpleLed") {
         return new SimpleLed(json_data);
     } else if (type == "SimplePushButton") {
@@ -129,6 +138,37 @@ Entity * SystemDescription::parseEntity(Json::Value &json_data)
     return NULL;
 }
 
+/**
+ * Marks the pins listed in 'trace_pins' for tracing to a VCD file, either as
+ * an array of names (traced as digital), or as an object mapping names to
+ * "digital" or "analog".
+ */
+void SystemDescription::parseEntityTracing(Entity *entity, Json::Value &json_data)
+{
+    if (!json_data.isMember("trace_pins"))
+        return;
+    
+    PinDevice *pin_device = dynamic_cast<PinDevice *>(entity);
+    if (!pin_device) {
+        fail("Device '%s' is not a pin device", entity->id.c_str());
+    }
+    
+    Json::Value pins = json_data["trace_pins"];
+    if (!pins.isArray() && !pins.isObject())
+        fail("'trace_pins' should be an array or an object");
+    
+    for (Json::ValueIterator it = pins.begin(); it != pins.end(); it++) {
+        string pin_name = pins.isArray() ? (*it).asString() : it.key().asString();
+        int kind = pins.isArray() ? VCD_DIGITAL : parse_vcd_kind(*it, "trace_pins");
+        
+        int pin_id = pin_device->lookupPin(pin_name.c_str());
+        if (pin_id < 0)
+            fail("Pin '%s' not found in device '%s'", pin_name.c_str(), entity->id.c_str());
+        
+        pin_device->setPinTraced(pin_id, kind);
+    }
+}
+
 void SystemDescription::parseEntityConnections(Entity *entity, Json::Value &json_data)
 {
     if (!json_data.isMember("connect"))
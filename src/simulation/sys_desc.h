@@ -21,11 +21,15 @@ public:
     virtual Entity * lookupEntity(const char *id);
 
     vector<Entity *> entities;
+protected:
+    // False for boards whose entities are members rather than heap objects
+    bool owns_entities;
 private:
     void initFromJson(Json::Value &json_data);
     void initEntitiesFromJson(Json::Value &json_data);
     Entity * parseEntity(Json::Value &json_data);
     void parseEntityConnections(Entity *entity, Json::Value &json_data);
+    void parseEntityTracing(Entity *entity, Json::Value &json_data);
 };
 
 #endif
@@ -0,0 +1,109 @@
+#ifndef _H_BATCH_QUEUE_H
+#define _H_BATCH_QUEUE_H
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+/**
+ * Collects items in memory and hands them over in batches to a background
+ * thread, which passes each batch to a consumer (e.g. to write them to a
+ * file). Pushing only waits if the thread is still busy with the previous
+ * batch when the next one is full.
+ *
+ * Items must be pushed from a single thread. The consumer runs on the
+ * background thread, and nothing is handed over any more after finish().
+ */
+template<typename T>
+class BatchQueue {
+public:
+    BatchQueue(size_t batch_size, function<void(const vector<T>&)> consume)
+        : batch_size(batch_size), consume(consume), batch_pending(false), closing(false)
+    {
+        filling.reserve(batch_size);
+        consuming.reserve(batch_size);
+
+        consumer_thread = thread(&BatchQueue::_consumerThreadCode, this);
+    }
+
+    ~BatchQueue()
+    {
+        finish();
+    }
+
+    inline void push(const T& item)
+    {
+        filling.push_back(item);
+        if (filling.size() >= batch_size)
+            _handOff();
+    }
+
+    /**
+     * Hands over what is left, and waits for the thread to consume it all.
+     */
+    void finish(void)
+    {
+        if (!consumer_thread.joinable())
+            return;
+
+        if (!filling.empty())
+            _handOff();
+
+        {
+            lock_guard<mutex> guard(lock);
+            closing = true;
+        }
+        cond.notify_all();
+        consumer_thread.join();
+    }
+private:
+    size_t batch_size;
+    function<void(const vector<T>&)> consume;
+
+    vector<T> filling;
+    vector<T> consuming;
+    mutex lock;
+    condition_variable cond;
+    bool batch_pending;
+    bool closing;
+    thread consumer_thread;
+
+    void _handOff(void)
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            cond.wait(guard, [this]() { return !batch_pending; });
+
+            consuming.swap(filling);
+            batch_pending = true;
+        }
+        cond.notify_all();
+
+        filling.clear();
+    }
+
+    void _consumerThreadCode(void)
+    {
+        unique_lock<mutex> guard(lock);
+
+        while (true) {
+            cond.wait(guard, [this]() { return batch_pending || closing; });
+            if (!batch_pending)
+                break;
+
+            guard.unlock();
+            consume(consuming);
+            guard.lock();
+
+            consuming.clear();
+            batch_pending = false;
+            cond.notify_all();
+        }
+    }
+};
+
+#endif
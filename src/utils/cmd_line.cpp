@@ -0,0 +1,42 @@
+#include <cstring>
+#include <cstdlib>
+
+#include "cmd_line.h"
+#include "fail.h"
+
+/**
+ * Gets the value of a flag given either as --flag=value or as --flag value.
+ * 
+ * @return The value, or NULL if the argument at index i is not this flag
+ */
+const char *flag_value(int argc, char **argv, int &i, const char *flag)
+{
+    const char *arg = argv[i];
+    size_t len = strlen(flag);
+    
+    if (strncmp(arg, flag, len))
+        return NULL;
+    
+    if (arg[len] == '=')
+        return arg + len + 1;
+    
+    if (arg[len] == 0) {
+        if (i + 1 >= argc)
+            fail("Missing value for %s", flag);
+        
+        return argv[++i];
+    }
+    
+    return NULL;
+}
+
+double parse_double_flag(const char *value, const char *flag)
+{
+    char *end;
+    double result = strtod(value, &end);
+    
+    if (!*value || *end)
+        fail("Invalid value '%s' for %s", value, flag);
+    
+    return result;
+}
@@ -0,0 +1,7 @@
+#ifndef _H_CMD_LINE_H
+#define _H_CMD_LINE_H
+
+const char *flag_value(int argc, char **argv, int &i, const char *flag);
+double parse_double_flag(const char *value, const char *flag);
+
+#endif
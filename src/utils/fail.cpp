@@ -6,13 +6,18 @@
 
 using namespace std;
 
+// Muting is per thread, so that simulations running in the background (e.g.
+// batch jobs) can be kept quiet without affecting the rest of the program
+static thread_local bool warnings_muted = false;
+static thread_local bool info_muted = false;
+
 void fail(const char *format, ...)
 {
     char buf[16384];
     va_list args;
 
     va_start(args, format);
-    vsprintf(buf, format, args);
+    vsnprintf(buf, sizeof(buf), format, args);
     va_end(args);
 
     throw runtime_error(buf);
@@ -23,21 +28,37 @@ void warn(const char *format, ...)
     char buf[16384];
     va_list args;
 
+    if (warnings_muted)
+        return;
+
     va_start(args, format);
-    vsprintf(buf, format, args);
+    vsnprintf(buf, sizeof(buf), format, args);
     va_end(args);
 
     printf("%s\n", buf);
 }
 
+void mute_warnings(bool mute)
+{
+    warnings_muted = mute;
+}
+
 void info(const char *format, ...)
 {
     char buf[16384];
     va_list args;
 
+    if (info_muted)
+        return;
+
     va_start(args, format);
-    vsprintf(buf, format, args);
+    vsnprintf(buf, sizeof(buf), format, args);
     va_end(args);
 
     printf("%s\n", buf);
 }
+
+void mute_info(bool mute)
+{
+    info_muted = mute;
+}
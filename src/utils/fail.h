@@ -5,4 +5,7 @@ void info(const char *format, ...);
 void warn(const char *format, ...);
 void fail(const char *format, ...);
 
+void mute_warnings(bool mute);
+void mute_info(bool mute);
+
 #endif
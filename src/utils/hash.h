@@ -0,0 +1,21 @@
+#ifndef _H_UTILS_HASH_H
+#define _H_UTILS_HASH_H
+
+#include <inttypes.h>
+#include <cstddef>
+
+#define FNV1A_64_INIT 0xcbf29ce484222325ULL
+
+static inline uint64_t fnv1a_64(const void *data, size_t size, uint64_t hash = FNV1A_64_INIT)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    
+    return hash;
+}
+
+#endif
@@ -4,9 +4,58 @@
 #include <inttypes.h>
 #include <time.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 static inline int64_t timespec_delta_ns(struct timespec *later, struct timespec *earlier)
 {
     return (later->tv_sec - earlier->tv_sec)*1000000000LL + later->tv_nsec - earlier->tv_nsec;
 }
 
+static inline int64_t timespec_to_ns(const struct timespec *ts)
+{
+    return ts->tv_sec*1000000000LL + ts->tv_nsec;
+}
+
+static inline struct timespec ns_to_timespec(int64_t ns)
+{
+    struct timespec ts;
+    
+    ts.tv_sec = ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+    
+    return ts;
+}
+
+static inline int64_t monotonic_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return timespec_to_ns(&ts);
+}
+
+static inline int64_t monotonic_raw_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    
+    return timespec_to_ns(&ts);
+}
+
+/**
+ * Reads a cheap, steadily increasing host clock in unspecified units (the
+ * TSC where there is one), for measuring short stretches of code. The units
+ * must be calibrated against monotonic_raw_time_ns().
+ */
+static inline uint64_t host_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)monotonic_raw_time_ns();
+#endif
+}
+
 #endif
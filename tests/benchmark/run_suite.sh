@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# Runs each workload of the benchmark suite (suite/*.msd) and compares its
+# median speed with the baseline recorded on this machine
+# (suite/baseline/<name>.json, which is not committed, as speeds only compare
+# on the same host).
+#
+#   run_suite.sh [--update-baseline] path/to/megas2
+#
+# Fails if any workload is slower than its baseline by more than the
+# tolerance, and by more than the noise of the trials (see
+# --benchmark-baseline). Workloads without a baseline are run, but not
+# checked. The
+# benchmark options can be overridden with BENCH_FLAGS, and the results of
+# the last run are kept in obj/bench.
+
+set -e
+
+UPDATE=0
+if [ "$1" = "--update-baseline" ]; then
+    UPDATE=1
+    shift
+fi
+
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 [--update-baseline] path/to/megas2" >&2
+    exit 2
+fi
+
+MEGAS2="$(cd "$(dirname "$1")" && pwd)/$(basename "$1")"
+BENCH_DIR="$(cd "$(dirname "$0")" && pwd)"
+SUITE_DIR="$BENCH_DIR/suite"
+WORK_DIR="${BENCH_WORK_DIR:-obj/bench}"
+BENCH_FLAGS="${BENCH_FLAGS:---benchmark-time=1s --benchmark-warmup=100ms --benchmark-trials=5 --benchmark-tolerance=10}"
+
+# The firmware is committed, and only built (which needs an AVR toolchain)
+# when missing
+for msd in "$SUITE_DIR"/*.msd; do
+    if [ ! -f "${msd%.msd}.elf" ]; then
+        make -C "$SUITE_DIR"
+        break
+    fi
+done
+
+mkdir -p "$WORK_DIR" "$SUITE_DIR/baseline"
+cp "$SUITE_DIR"/*.msd "$SUITE_DIR"/*.elf "$WORK_DIR"
+
+FAILED=""
+for msd in "$SUITE_DIR"/*.msd; do
+    name="$(basename "$msd" .msd)"
+    baseline="$SUITE_DIR/baseline/$name.json"
+    
+    # Workloads may write to the card image, so each gets a fresh copy
+    cp "$BENCH_DIR/fsimage.bin" "$WORK_DIR/fsimage.bin"
+    
+    echo "== $name"
+    if [ $UPDATE -eq 1 ]; then
+        (cd "$WORK_DIR" && "$MEGAS2" $BENCH_FLAGS --benchmark-json="$baseline" "$name.msd")
+    elif [ -f "$baseline" ]; then
+        (cd "$WORK_DIR" && "$MEGAS2" $BENCH_FLAGS --benchmark-json="$name.json" \
+            --benchmark-baseline="$baseline" "$name.msd") || FAILED="$FAILED $name"
+    else
+        (cd "$WORK_DIR" && "$MEGAS2" $BENCH_FLAGS --benchmark-json="$name.json" "$name.msd")
+        echo "(no baseline; run 'make bench-baseline' to record one)"
+    fi
+    echo
+done
+
+if [ -n "$FAILED" ]; then
+    echo "Slower than the baseline (or failed):$FAILED"
+    exit 1
+fi
@@ -0,0 +1,142 @@
+; Pure ALU and branch workload: a linear congruential generator (32-bit
+; multiplications) feeding data-dependent branches, with no I/O at all.
+;
+; x is kept in r25:r22 and the accumulator in r13:r10.
+
+    .include "bench.inc"
+
+bench_var result, 4
+
+function reset
+    bench_start
+
+    ldi r22, 1                  ; x = 1
+    clr r23
+    clr r24
+    clr r25
+    clr r10                     ; acc = 0
+    clr r11
+    clr r12
+    clr r13
+
+main_loop:
+    ldi r28, lo8(1000)
+    ldi r29, hi8(1000)
+
+lcg_loop:
+    ; x = x * 1103515245 + 12345
+    ldi r18, 0x6d
+    ldi r19, 0x4e
+    ldi r20, 0xc6
+    ldi r21, 0x41
+    rcall mul32
+    subi r22, 0xc7              ; i.e. add 0x00003039
+    sbci r23, 0xcf
+    sbci r24, 0xff
+    sbci r25, 0xff
+
+    sbrs r25, 7
+    rjmp 1f
+
+    ; acc += x >> 7
+    mov r18, r22
+    mov r19, r23
+    mov r20, r24
+    mov r21, r25
+    clr r17
+    lsl r18
+    rol r19
+    rol r20
+    rol r21
+    rol r17
+    add r10, r19
+    adc r11, r20
+    adc r12, r21
+    adc r13, r17
+    rjmp 3f
+
+1:
+    sbrs r24, 0
+    rjmp 2f
+
+    ; acc ^= x << 3
+    mov r18, r22
+    mov r19, r23
+    mov r20, r24
+    mov r21, r25
+    ldi r17, 3
+4:
+    lsl r18
+    rol r19
+    rol r20
+    rol r21
+    dec r17
+    brne 4b
+    eor r10, r18
+    eor r11, r19
+    eor r12, r20
+    eor r13, r21
+    rjmp 3f
+
+2:
+    ; acc -= (uint8_t)x
+    sub r10, r22
+    sbc r11, r1
+    sbc r12, r1
+    sbc r13, r1
+
+3:
+    sbiw r28, 1
+    brne lcg_loop
+
+    sts result, r10
+    sts result + 1, r11
+    sts result + 2, r12
+    sts result + 3, r13
+    bench_count
+    rjmp main_loop
+endfunction reset
+
+; r25:r22 = low 32 bits of r25:r22 * r21:r18 (clobbers r0, r17, r26, r27,
+; r30, r31)
+function mul32
+    clr r17
+
+    mul r22, r18                ; a0 * b0
+    movw r26, r0
+    clr r30
+    clr r31
+
+    mul r22, r19                ; a0 * b1
+    add r27, r0
+    adc r30, r1
+    adc r31, r17
+    mul r23, r18                ; a1 * b0
+    add r27, r0
+    adc r30, r1
+    adc r31, r17
+
+    mul r22, r20                ; a0 * b2
+    add r30, r0
+    adc r31, r1
+    mul r23, r19                ; a1 * b1
+    add r30, r0
+    adc r31, r1
+    mul r24, r18                ; a2 * b0
+    add r30, r0
+    adc r31, r1
+
+    mul r22, r21                ; a0 * b3
+    add r31, r0
+    mul r23, r20                ; a1 * b2
+    add r31, r0
+    mul r24, r19                ; a2 * b1
+    add r31, r0
+    mul r25, r18                ; a3 * b0
+    add r31, r0
+
+    movw r22, r26
+    movw r24, r30
+    clr r1
+    ret
+endfunction mul32
@@ -0,0 +1,375 @@
+; Network workload: echoes every frame the ENC28J60 receives back to its
+; sender, through a minimal polling driver (SS on PB4, RESET on PB3). The
+; system description drives it with a TrafficSource.
+;
+; Register numbers are passed in r22 and data in r20 (r21:r20 for 16-bit
+; values); enc_* functions keep r22.
+
+    .include "bench.inc"
+
+.equ ENC_SS,            PB4
+.equ ENC_RESET,         PB3
+
+.equ OP_RCR,            0x00
+.equ OP_RBM,            0x3a
+.equ OP_WCR,            0x40
+.equ OP_WBM,            0x7a
+.equ OP_BFS,            0x80
+.equ OP_BFC,            0xa0
+
+; Registers are given as bank * 0x20 + address; 0x1b-0x1f are in all banks
+.equ ERDPTL,            0x00
+.equ EWRPTL,            0x02
+.equ ETXSTL,            0x04
+.equ ETXNDL,            0x06
+.equ ERXSTL,            0x08
+.equ ERXNDL,            0x0a
+.equ ERXRDPTL,          0x0c
+.equ ECON2,             0x1e
+.equ ECON1,             0x1f
+.equ EPKTCNT,           0x39
+.equ MACON1,            0x40
+.equ MACON2,            0x41
+.equ MACON3,            0x42
+.equ MABBIPG,           0x44
+.equ MAIPGL,            0x46
+.equ MAIPGH,            0x47
+.equ MAMXFLL,           0x4a
+.equ MAADR1,            0x60
+.equ MAADR0,            0x61
+.equ MAADR3,            0x62
+.equ MAADR2,            0x63
+.equ MAADR5,            0x64
+.equ MAADR4,            0x65
+
+.equ ECON1_TXRTS,       0x08
+.equ ECON1_RXEN,        0x04
+.equ ECON1_BSEL,        0x03
+.equ ECON2_PKTDEC,      0x40
+
+.equ RX_START,          0x0000
+.equ RX_END,            0x0bff
+.equ TX_START,          0x0c00
+
+.equ MAX_FRAME,         128
+.equ HEADER_SIZE,       6
+
+bench_var frames_dropped, 2
+bench_var next_packet, 2
+bench_var header, HEADER_SIZE
+bench_var tx_control, 1
+bench_var frame, MAX_FRAME
+
+.macro enc_set reg, value
+    ldi r22, \reg
+    ldi r20, \value
+    rcall enc_write
+.endm
+
+.macro enc_set16 reg, value
+    ldi r22, \reg
+    ldi r20, lo8(\value)
+    ldi r21, hi8(\value)
+    rcall enc_write16
+.endm
+
+function reset
+    bench_start
+
+    rcall spi_init
+    rcall enc_init
+
+main_loop:
+    ldi r22, EPKTCNT
+    rcall enc_read
+    tst r24
+    breq main_loop
+
+    rcall echo_next_frame
+    bench_count
+    rjmp main_loop
+endfunction reset
+
+; Runs opcode r24 on register r22 with data r20
+function enc_op
+    cbi PORTB, ENC_SS
+    mov r25, r22
+    andi r25, 0x1f
+    or r24, r25
+    rcall spi_transfer
+    mov r24, r20
+    rcall spi_transfer
+    sbi PORTB, ENC_SS
+    ret
+endfunction enc_op
+
+; Selects the bank of register r22
+function enc_bank
+    mov r25, r22
+    andi r25, 0x1f
+    cpi r25, 0x1b
+    brsh 1f
+
+    push r22
+    ldi r24, OP_BFC
+    ldi r22, ECON1
+    ldi r20, ECON1_BSEL
+    rcall enc_op
+    pop r22
+
+    mov r20, r22
+    swap r20
+    lsr r20
+    andi r20, 0x07
+    push r22
+    ldi r24, OP_BFS
+    ldi r22, ECON1
+    rcall enc_op
+    pop r22
+1:
+    ret
+endfunction enc_bank
+
+function enc_write
+    push r20
+    rcall enc_bank
+    pop r20
+    ldi r24, OP_WCR
+    rjmp enc_op
+endfunction enc_write
+
+function enc_write16
+    push r21
+    rcall enc_write
+    pop r20
+    inc r22
+    rcall enc_write
+    dec r22
+    ret
+endfunction enc_write16
+
+; Returns register r22 in r24. For ETH registers only; MAC and MII registers
+; send a dummy byte first.
+function enc_read
+    rcall enc_bank
+    cbi PORTB, ENC_SS
+    mov r24, r22
+    andi r24, 0x1f
+    ori r24, OP_RCR
+    rcall spi_transfer
+    ldi r24, 0xff
+    rcall spi_transfer
+    sbi PORTB, ENC_SS
+    ret
+endfunction enc_read
+
+; Reads r29:r28 bytes from the buffer memory to X
+function enc_read_buffer
+    cbi PORTB, ENC_SS
+    ldi r24, OP_RBM
+    rcall spi_transfer
+    rjmp 2f
+1:
+    ldi r24, 0xff
+    rcall spi_transfer
+    st X+, r24
+    sbiw r28, 1
+2:
+    cp r28, r1
+    cpc r29, r1
+    brne 1b
+    sbi PORTB, ENC_SS
+    ret
+endfunction enc_read_buffer
+
+; Writes r29:r28 bytes from X to the buffer memory
+function enc_write_buffer
+    cbi PORTB, ENC_SS
+    ldi r24, OP_WBM
+    rcall spi_transfer
+    rjmp 2f
+1:
+    ld r24, X+
+    rcall spi_transfer
+    sbiw r28, 1
+2:
+    cp r28, r1
+    cpc r29, r1
+    brne 1b
+    sbi PORTB, ENC_SS
+    ret
+endfunction enc_write_buffer
+
+function enc_init
+    in r24, DDRB
+    ori r24, (1 << ENC_SS) | (1 << ENC_RESET)
+    out DDRB, r24
+    sbi PORTB, ENC_SS
+
+    cbi PORTB, ENC_RESET
+    ldi r24, 100
+1:
+    dec r24
+    brne 1b
+    sbi PORTB, ENC_RESET
+
+    enc_set16 ERXSTL, RX_START
+    enc_set16 ERXNDL, RX_END
+    enc_set16 ERXRDPTL, RX_END
+    enc_set16 ETXSTL, TX_START
+
+    enc_set MACON1, 0x0d        ; MARXEN, TXPAUS, RXPAUS
+    enc_set MACON2, 0x00        ; Out of reset
+    enc_set MACON3, 0x30        ; Pad to 60 bytes, add CRC
+    enc_set16 MAMXFLL, 1518
+    enc_set MABBIPG, 0x12
+    enc_set MAIPGL, 0x12
+    enc_set MAIPGH, 0x0c
+
+    ldi r30, lo8(mac)
+    ldi r31, hi8(mac)
+    ldi r22, MAADR5
+    lpm r20, Z+
+    rcall enc_write
+    ldi r22, MAADR4
+    lpm r20, Z+
+    rcall enc_write
+    ldi r22, MAADR3
+    lpm r20, Z+
+    rcall enc_write
+    ldi r22, MAADR2
+    lpm r20, Z+
+    rcall enc_write
+    ldi r22, MAADR1
+    lpm r20, Z+
+    rcall enc_write
+    ldi r22, MAADR0
+    lpm r20, Z+
+    rcall enc_write
+
+    ldi r24, OP_BFS
+    ldi r22, ECON1
+    ldi r20, ECON1_RXEN
+    rjmp enc_op
+endfunction enc_init
+
+; Keeps the start of the following frame in r17:r16 and the length of this
+; one in r15:r14
+function echo_next_frame
+    lds r20, next_packet
+    lds r21, next_packet + 1
+    ldi r22, ERDPTL
+    rcall enc_write16
+
+    ldi r26, lo8(header)
+    ldi r27, hi8(header)
+    ldi r28, HEADER_SIZE
+    clr r29
+    rcall enc_read_buffer
+
+    lds r16, header
+    lds r17, header + 1
+
+    ; The length (without the CRC) follows from where the next frame starts
+    lds r18, next_packet
+    lds r19, next_packet + 1
+    movw r30, r16
+    sub r30, r18
+    sbc r31, r19
+    cp r18, r16
+    cpc r19, r17
+    brlo 1f
+    ldi r24, hi8(RX_END + 1 - RX_START)
+    add r31, r24
+1:
+    sbiw r30, HEADER_SIZE + 4
+    movw r14, r30
+
+    cpi r30, lo8(MAX_FRAME + 1)
+    ldi r24, hi8(MAX_FRAME + 1)
+    cpc r31, r24
+    brsh 4f
+
+    ldi r26, lo8(frame)
+    ldi r27, hi8(frame)
+    movw r28, r14
+    rcall enc_read_buffer
+
+    ; Send it back: the source address becomes the destination
+    ldi r28, lo8(frame)
+    ldi r29, hi8(frame)
+    ldi r30, lo8(mac)
+    ldi r31, hi8(mac)
+    ldi r25, 6
+2:
+    ldd r24, Y + 6
+    st Y, r24
+    lpm r24, Z+
+    std Y + 6, r24
+    adiw r28, 1
+    dec r25
+    brne 2b
+
+    enc_set16 EWRPTL, TX_START
+    ldi r26, lo8(tx_control)
+    ldi r27, hi8(tx_control)
+    ldi r28, 1
+    clr r29
+    rcall enc_write_buffer
+    ldi r26, lo8(frame)
+    ldi r27, hi8(frame)
+    movw r28, r14
+    rcall enc_write_buffer
+
+    movw r20, r14
+    ldi r24, hi8(TX_START)
+    add r21, r24
+    ldi r22, ETXNDL
+    rcall enc_write16
+
+    ldi r24, OP_BFS
+    ldi r22, ECON1
+    ldi r20, ECON1_TXRTS
+    rcall enc_op
+3:
+    ldi r22, ECON1
+    rcall enc_read
+    sbrc r24, 3                 ; ECON1_TXRTS
+    rjmp 3b
+    rjmp 5f
+
+4:
+    lds r24, frames_dropped
+    lds r25, frames_dropped + 1
+    adiw r24, 1
+    sts frames_dropped, r24
+    sts frames_dropped + 1, r25
+
+5:
+    sts next_packet, r16
+    sts next_packet + 1, r17
+
+    movw r20, r16
+    subi r20, 1
+    sbci r21, 0
+    cp r16, r1
+    cpc r17, r1
+    brne 6f
+    ldi r20, lo8(RX_END)
+    ldi r21, hi8(RX_END)
+6:
+    ldi r22, ERXRDPTL
+    rcall enc_write16
+
+    ldi r24, OP_BFS
+    ldi r22, ECON2
+    ldi r20, ECON2_PKTDEC
+    rjmp enc_op
+endfunction echo_next_frame
+
+spi_functions
+
+    .type mac, @object
+    .size mac, 6
+mac:
+    .byte 0x02, 0x00, 0x00, 0x00, 0x00, 0x02
@@ -0,0 +1,37 @@
+; GPIO workload: toggles all of port A as fast as possible, with PA0 wired
+; to PC0 in the system description, and reads the level back through PINC.
+
+    .include "bench.inc"
+
+bench_var mismatches, 1
+
+function reset
+    bench_start
+
+    ldi r24, 0xff
+    out DDRA, r24
+    out DDRC, r1
+
+main_loop:
+    ldi r17, 100
+1:
+    in r24, PORTA
+    com r24
+    out PORTA, r24
+
+    in r25, PINC
+    in r24, PORTA
+    eor r25, r24
+    sbrs r25, 0
+    rjmp 2f
+
+    lds r24, mismatches
+    inc r24
+    sts mismatches, r24
+2:
+    dec r17
+    brne 1b
+
+    bench_count
+    rjmp main_loop
+endfunction reset
@@ -0,0 +1,85 @@
+; Memory workload: copies blocks back and forth in SRAM, and from a table in
+; flash (LPM), which exercises the load/store and pointer instructions.
+
+    .include "bench.inc"
+
+.equ BLOCK_SIZE, 768
+.equ TABLE_SIZE, 256
+
+bench_var sink, 1
+bench_var block_a, BLOCK_SIZE
+bench_var block_b, BLOCK_SIZE
+
+function reset
+    bench_start
+
+main_loop:
+    ; block_a[0..255] = table
+    ldi r26, lo8(block_a)
+    ldi r27, hi8(block_a)
+    ldi r30, lo8(table)
+    ldi r31, hi8(table)
+    ldi r24, lo8(TABLE_SIZE)
+    ldi r25, hi8(TABLE_SIZE)
+1:
+    lpm r0, Z+
+    st X+, r0
+    sbiw r24, 1
+    brne 1b
+
+    ; block_b = block_a
+    ldi r26, lo8(block_b)
+    ldi r27, hi8(block_b)
+    ldi r30, lo8(block_a)
+    ldi r31, hi8(block_a)
+    rcall copy_block
+
+    ; block_a[1..] = block_a[..BLOCK_SIZE - 1], from the end as they overlap
+    ldi r26, lo8(block_a + BLOCK_SIZE)
+    ldi r27, hi8(block_a + BLOCK_SIZE)
+    ldi r30, lo8(block_a + BLOCK_SIZE - 1)
+    ldi r31, hi8(block_a + BLOCK_SIZE - 1)
+    ldi r24, lo8(BLOCK_SIZE - 1)
+    ldi r25, hi8(BLOCK_SIZE - 1)
+2:
+    ld r0, -Z
+    st -X, r0
+    sbiw r24, 1
+    brne 2b
+
+    ; block_a = block_b
+    ldi r26, lo8(block_a)
+    ldi r27, hi8(block_a)
+    ldi r30, lo8(block_b)
+    ldi r31, hi8(block_b)
+    rcall copy_block
+
+    lds r24, block_a + 17
+    lds r25, block_b + BLOCK_SIZE - 1
+    eor r24, r25
+    sts sink, r24
+
+    bench_count
+    rjmp main_loop
+endfunction reset
+
+; Copies BLOCK_SIZE bytes from Z to X
+function copy_block
+    ldi r24, lo8(BLOCK_SIZE)
+    ldi r25, hi8(BLOCK_SIZE)
+1:
+    ld r0, Z+
+    st X+, r0
+    sbiw r24, 1
+    brne 1b
+    ret
+endfunction copy_block
+
+    .type table, @object
+    .size table, TABLE_SIZE
+table:
+    .set value, 0
+    .rept TABLE_SIZE
+    .byte value
+    .set value, value + 1
+    .endr
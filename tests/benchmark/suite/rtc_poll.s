@@ -0,0 +1,140 @@
+; I2C workload: polls the time registers of a DS1307 over TWI at 100 kHz.
+
+    .include "bench.inc"
+
+.equ DS1307_ADDRESS, 0x68
+
+; TWI status codes (TWSR & 0xf8)
+.equ TW_START,          0x08
+.equ TW_REP_START,      0x10
+.equ TW_MT_SLA_ACK,     0x18
+.equ TW_MT_DATA_ACK,    0x28
+.equ TW_MR_SLA_ACK,     0x40
+
+bench_var twi_error, 1
+bench_var seconds, 1
+bench_var rtc_time, 7
+
+function reset
+    bench_start
+
+    out TWSR, r1
+    ldi r24, (F_CPU / 100000 - 16) / 2
+    out TWBR, r24
+
+main_loop:
+    rcall read_time
+    lds r24, rtc_time
+    sts seconds, r24
+
+    bench_count
+    rjmp main_loop
+endfunction reset
+
+; Reads the 7 time registers into rtc_time
+function read_time
+    ldi r24, DS1307_ADDRESS << 1
+    rcall twi_start
+    tst r24
+    breq 2f
+    ldi r24, 0
+    rcall twi_write
+    tst r24
+    breq 2f
+    ldi r24, (DS1307_ADDRESS << 1) | 1
+    rcall twi_start
+    tst r24
+    breq 2f
+
+    ldi r28, lo8(rtc_time)
+    ldi r29, hi8(rtc_time)
+    clr r17
+1:
+    ldi r24, 1                  ; ACK all but the last byte
+    cpi r17, 6
+    brlo 3f
+    ldi r24, 0
+3:
+    rcall twi_read
+    st Y+, r24
+    inc r17
+    cpi r17, 7
+    brne 1b
+    rjmp twi_stop
+
+2:
+    ldi r24, 1
+    sts twi_error, r24
+    rjmp twi_stop
+endfunction read_time
+
+; Waits for the current operation, and returns the status in r24
+function twi_wait
+    in r24, TWCR
+    sbrs r24, TWINT
+    rjmp twi_wait
+    in r24, TWSR
+    andi r24, 0xf8
+    ret
+endfunction twi_wait
+
+; Sends a (repeated) start and the address in r24; returns 1 in r24 if the
+; slave acknowledged
+function twi_start
+    mov r25, r24
+    ldi r24, (1 << TWINT) | (1 << TWSTA) | (1 << TWEN)
+    out TWCR, r24
+    rcall twi_wait
+    cpi r24, TW_START
+    breq 1f
+    cpi r24, TW_REP_START
+    brne 2f
+1:
+    out TWDR, r25
+    ldi r24, (1 << TWINT) | (1 << TWEN)
+    out TWCR, r24
+    rcall twi_wait
+    cpi r24, TW_MT_SLA_ACK
+    breq 3f
+    cpi r24, TW_MR_SLA_ACK
+    breq 3f
+2:
+    ldi r24, 0
+    ret
+3:
+    ldi r24, 1
+    ret
+endfunction twi_start
+
+function twi_stop
+    ldi r24, (1 << TWINT) | (1 << TWSTO) | (1 << TWEN)
+    out TWCR, r24
+    ret
+endfunction twi_stop
+
+; Sends r24; returns 1 in r24 if the slave acknowledged
+function twi_write
+    out TWDR, r24
+    ldi r24, (1 << TWINT) | (1 << TWEN)
+    out TWCR, r24
+    rcall twi_wait
+    cpi r24, TW_MT_DATA_ACK
+    ldi r24, 0
+    brne 1f
+    ldi r24, 1
+1:
+    ret
+endfunction twi_write
+
+; Receives a byte into r24, acknowledging it if r24 is not 0
+function twi_read
+    ldi r25, (1 << TWINT) | (1 << TWEN)
+    tst r24
+    breq 1f
+    ori r25, (1 << TWEA)
+1:
+    out TWCR, r25
+    rcall twi_wait
+    in r24, TWDR
+    ret
+endfunction twi_read
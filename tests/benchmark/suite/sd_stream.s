@@ -0,0 +1,227 @@
+; SD card streaming: reads a run of blocks and writes another run back, over
+; and over, through a minimal SPI-mode driver (the card's SS is on PB1).
+
+    .include "bench.inc"
+
+.equ SD_SS,             PB1
+
+.equ CMD_GO_IDLE,       0
+.equ CMD_SET_BLOCKLEN,  16
+.equ CMD_READ_BLOCK,    17
+.equ CMD_WRITE_BLOCK,   24
+.equ CMD_APP_CMD,       55
+.equ ACMD_SEND_OP,      41
+
+.equ READ_FIRST,        0
+.equ WRITE_FIRST,       64
+.equ RUN_LENGTH,        64
+
+bench_var sd_error, 1
+bench_var block, 512
+
+function reset
+    bench_start
+
+    rcall spi_init
+    rcall sd_init
+
+main_loop:
+    clr r14
+1:
+    ldi r22, READ_FIRST
+    add r22, r14
+    rcall sd_read_block
+
+    lds r24, block
+    lds r25, bench_iterations
+    eor r24, r25
+    sts block, r24
+
+    ldi r22, WRITE_FIRST
+    add r22, r14
+    rcall sd_write_block
+
+    inc r14
+    ldi r24, RUN_LENGTH
+    cp r14, r24
+    brne 1b
+
+    bench_count
+    rjmp main_loop
+endfunction reset
+
+function sd_select
+    cbi PORTB, SD_SS
+    ret
+endfunction sd_select
+
+function sd_deselect
+    sbi PORTB, SD_SS
+    ldi r24, 0xff
+    rjmp spi_transfer
+endfunction sd_deselect
+
+; Sends command r16 with the argument in r21:r18, and returns the R1
+; response in r24 (clobbers r17)
+function sd_command
+    mov r24, r16
+    ori r24, 0x40
+    rcall spi_transfer
+    mov r24, r21
+    rcall spi_transfer
+    mov r24, r20
+    rcall spi_transfer
+    mov r24, r19
+    rcall spi_transfer
+    mov r24, r18
+    rcall spi_transfer
+    ldi r24, 0x95               ; Only GO_IDLE needs a valid CRC
+    tst r16
+    breq 1f
+    ldi r24, 0x01
+1:
+    rcall spi_transfer
+
+    ldi r17, 8
+2:
+    ldi r24, 0xff
+    rcall spi_transfer
+    cpi r24, 0xff
+    brne 3f
+    dec r17
+    brne 2b
+3:
+    ret
+endfunction sd_command
+
+function sd_init
+    sbi DDRB, SD_SS
+    rcall sd_deselect
+
+    ldi r17, 10
+1:
+    ldi r24, 0xff
+    rcall spi_transfer
+    dec r17
+    brne 1b
+
+    clr r18
+    clr r19
+    clr r20
+    clr r21
+
+    rcall sd_select
+    ldi r16, CMD_GO_IDLE
+    rcall sd_command
+    rcall sd_deselect
+
+2:
+    rcall sd_select
+    ldi r16, CMD_APP_CMD
+    rcall sd_command
+    rcall sd_deselect
+
+    rcall sd_select
+    ldi r16, ACMD_SEND_OP
+    rcall sd_command
+    mov r15, r24
+    rcall sd_deselect
+    sbrc r15, 0
+    rjmp 2b
+
+    rcall sd_select
+    ldi r16, CMD_SET_BLOCKLEN
+    ldi r19, hi8(512)
+    rcall sd_command
+    rjmp sd_deselect
+endfunction sd_init
+
+; Sets r21:r18 to the address of block r22
+function block_address
+    clr r18
+    mov r19, r22
+    clr r20
+    lsl r19
+    rol r20
+    clr r21
+    ret
+endfunction block_address
+
+; Reads block r22 into block
+function sd_read_block
+    rcall sd_select
+    rcall block_address
+    ldi r16, CMD_READ_BLOCK
+    rcall sd_command
+    tst r24
+    breq 1f
+
+    ldi r24, 1
+    sts sd_error, r24
+    rjmp sd_deselect
+
+1:
+    ldi r24, 0xff
+    rcall spi_transfer
+    cpi r24, 0xfe
+    brne 1b
+
+    ldi r26, lo8(block)
+    ldi r27, hi8(block)
+    ldi r30, lo8(512)
+    ldi r31, hi8(512)
+2:
+    ldi r24, 0xff
+    rcall spi_transfer
+    st X+, r24
+    sbiw r30, 1
+    brne 2b
+
+    ldi r24, 0xff               ; CRC
+    rcall spi_transfer
+    ldi r24, 0xff
+    rcall spi_transfer
+    rjmp sd_deselect
+endfunction sd_read_block
+
+; Writes block to block r22
+function sd_write_block
+    rcall sd_select
+    rcall block_address
+    ldi r16, CMD_WRITE_BLOCK
+    rcall sd_command
+    tst r24
+    brne 3f
+
+    ldi r24, 0xfe
+    rcall spi_transfer
+
+    ldi r26, lo8(block)
+    ldi r27, hi8(block)
+    ldi r30, lo8(512)
+    ldi r31, hi8(512)
+1:
+    ld r24, X+
+    rcall spi_transfer
+    sbiw r30, 1
+    brne 1b
+
+    ldi r24, 0xff               ; CRC
+    rcall spi_transfer
+    ldi r24, 0xff
+    rcall spi_transfer
+
+    ldi r24, 0xff
+    rcall spi_transfer
+    andi r24, 0x1f
+    cpi r24, 0x05
+    breq 2f
+
+3:
+    ldi r24, 1
+    sts sd_error, r24
+2:
+    rjmp sd_deselect
+endfunction sd_write_block
+
+spi_functions
@@ -0,0 +1,105 @@
+; Interrupt storm: timer 1 in CTC mode interrupts every 200 cycles, and the
+; ADC is kept converting with its interrupt enabled, while the main loop
+; does trivial work. (Timers 0 and 2 are not simulated.)
+
+    .include "bench.inc"
+
+.equ TIMER_PERIOD, 200
+
+bench_var timer_ticks, 2
+bench_var adc_value, 2
+
+; Vectors are 4 bytes apart; TIMER1_COMPA is #7 and ADC #16
+vectors:
+    jmp reset
+    .rept 6
+    jmp unexpected_irq
+    .endr
+    jmp timer1_compa_isr
+    .rept 8
+    jmp unexpected_irq
+    .endr
+    jmp adc_isr
+    .rept 4
+    jmp unexpected_irq
+    .endr
+
+function reset
+    bench_start
+
+    ldi r24, hi8(TIMER_PERIOD - 1)
+    out OCR1AH, r24
+    ldi r24, lo8(TIMER_PERIOD - 1)
+    out OCR1AL, r24
+    ldi r24, (1 << WGM12) | (1 << CS10)
+    out TCCR1B, r24
+    ldi r24, (1 << OCIE1A)
+    out TIMSK, r24
+
+    ldi r24, (1 << REFS0)
+    out ADMUX, r24
+    ldi r24, (1 << ADEN) | (1 << ADIE) | (1 << ADPS1)
+    out ADCSRA, r24
+    sbi ADCSRA, ADSC
+
+    sei
+
+main_loop:
+    cli
+    lds r24, timer_ticks
+    lds r25, timer_ticks + 1
+    sei
+
+    cpi r24, lo8(1000)
+    ldi r18, hi8(1000)
+    cpc r25, r18
+    brlo main_loop
+
+    cli
+    sts timer_ticks, r1
+    sts timer_ticks + 1, r1
+    sei
+
+    bench_count
+    rjmp main_loop
+endfunction reset
+
+function timer1_compa_isr
+    push r24
+    in r24, 0x3f
+    push r24
+    push r25
+
+    lds r24, timer_ticks
+    lds r25, timer_ticks + 1
+    adiw r24, 1
+    sts timer_ticks, r24
+    sts timer_ticks + 1, r25
+
+    pop r25
+    pop r24
+    out 0x3f, r24
+    pop r24
+    reti
+endfunction timer1_compa_isr
+
+function adc_isr
+    push r24
+    in r24, 0x3f
+    push r24
+
+    in r24, ADCL
+    sts adc_value, r24
+    in r24, ADCH
+    sts adc_value + 1, r24
+    sbi ADCSRA, ADSC
+
+    pop r24
+    out 0x3f, r24
+    pop r24
+    reti
+endfunction adc_isr
+
+function unexpected_irq
+    rjmp reset
+endfunction unexpected_irq